@@ -0,0 +1,34 @@
+# fizzy_add_native_module(<target> <wasm_file> [NAME <name>])
+#
+# Compiles the functions of the wasm module to C++ with fizzy-aot and builds them as the static
+# library <target>. The library provides the header <name>.hpp declaring
+# `extern const fizzy::NativeModule <name>;`, to be set as the native_module of the instances
+# of the module (see ExecutionEngine::Native). The name must be a C++ identifier, it defaults
+# to the wasm file name without the extension followed by _module.
+function(fizzy_add_native_module TARGET WASM_FILE)
+    cmake_parse_arguments(arg "" "NAME" "" ${ARGN})
+    if(NOT arg_NAME)
+        get_filename_component(arg_NAME ${WASM_FILE} NAME_WE)
+        set(arg_NAME ${arg_NAME}_module)
+    endif()
+    get_filename_component(wasm_file ${WASM_FILE} ABSOLUTE)
+
+    set(output_dir ${CMAKE_CURRENT_BINARY_DIR}/${TARGET})
+    set(outputs ${output_dir}/${arg_NAME}.cpp ${output_dir}/${arg_NAME}.hpp)
+    add_custom_command(
+        OUTPUT ${outputs}
+        COMMAND ${CMAKE_COMMAND} -E make_directory ${output_dir}
+        COMMAND fizzy-aot ${wasm_file} ${arg_NAME} ${output_dir}
+        DEPENDS fizzy-aot ${wasm_file}
+        COMMENT "Compiling ${WASM_FILE} with fizzy-aot"
+    )
+
+    add_library(${TARGET} STATIC ${outputs})
+    target_compile_features(${TARGET} PUBLIC cxx_std_17)
+    # The generated code mirrors the wasm code, which may recurse infinitely (trapping
+    # at the call depth limit).
+    target_compile_options(
+        ${TARGET} PRIVATE $<$<CXX_COMPILER_ID:GNU,Clang,AppleClang>:-Wno-infinite-recursion>)
+    target_include_directories(${TARGET} PUBLIC ${output_dir} ${PROJECT_SOURCE_DIR}/lib/fizzy)
+    target_link_libraries(${TARGET} PUBLIC fizzy::fizzy)
+endfunction()
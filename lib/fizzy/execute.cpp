@@ -1,23 +1,66 @@
 #include "execute.hpp"
+#include "jit.hpp"
 #include "limits.hpp"
+#include "native.hpp"
+#include "parser.hpp"
+#include "register_code.hpp"
 #include "stack.hpp"
+#include "threaded_code.hpp"
 #include "types.hpp"
 #include <algorithm>
 #include <cassert>
 #include <cstring>
+#include <exception>
+#include <limits>
+#include <new>
+#include <utility>
+
+#if FIZZY_GUARD_PAGES
+#include <setjmp.h>
+#endif
+#if defined(__linux__)
+#include <pthread.h>
+#endif
+
+// Use direct threaded dispatch in the interpreter loop if the compiler supports the "labels as
+// values" extension. The function bodies are translated to the addresses of the instruction
+// handlers on their first execution and every handler jumps to the next one through this
+// translation, what gives each handler its own (better predicted) indirect branch and skips
+// decoding the opcode and the bounds check of the switch jump table. Otherwise fall back
+// to the plain switch.
+// The choice can be overridden by defining FIZZY_COMPUTED_GOTO to 0 or 1.
+#ifndef FIZZY_COMPUTED_GOTO
+#if defined(__GNUC__)
+#define FIZZY_COMPUTED_GOTO 1
+#else
+#define FIZZY_COMPUTED_GOTO 0
+#endif
+#endif
+
+#if FIZZY_COMPUTED_GOTO
+#define TARGET(name)  \
+    case Instr::name: \
+    target_##name
+#define TARGET_INVALID \
+    default:           \
+    target_invalid
+#define DISPATCH() goto* handlers[pc++ - instructions_begin]
+#define REGISTER_TARGET(name) \
+    case RegisterOp::name:    \
+    register_target_##name
+#define REGISTER_DISPATCH() goto* register_dispatch_table[*pc]
+#else
+#define TARGET(name) case Instr::name
+#define TARGET_INVALID default
+#define DISPATCH() break
+#define REGISTER_TARGET(name) case RegisterOp::name
+#define REGISTER_DISPATCH() break
+#endif
 
 namespace fizzy
 {
 namespace
 {
-struct LabelContext
-{
-    const Instr* pc = nullptr;           ///< The jump target instruction.
-    const uint8_t* immediate = nullptr;  ///< The jump target immediate pointer.
-    size_t arity = 0;                    ///< The type arity of the label instruction.
-    size_t stack_height = 0;             ///< The stack height at the label instruction.
-};
-
 inline bool operator==(const FuncType& lhs, const FuncType& rhs)
 {
     return lhs.inputs == rhs.inputs && lhs.outputs == rhs.outputs;
@@ -211,11 +254,11 @@ table_ptr allocate_table(
         return {nullptr, null_delete};
 }
 
-std::tuple<bytes_ptr, size_t> allocate_memory(const std::vector<Memory>& module_memories,
-    const std::vector<ExternalMemory>& imported_memories)
+std::tuple<memory_ptr, size_t> allocate_memory(const std::vector<Memory>& module_memories,
+    const std::vector<ExternalMemory>& imported_memories, const MemoryImage* memory_image)
 {
-    static const auto bytes_delete = [](bytes* b) noexcept { delete b; };
-    static const auto null_delete = [](bytes*) noexcept {};
+    static const auto memory_delete = [](LinearMemory* m) noexcept { delete m; };
+    static const auto null_delete = [](LinearMemory*) noexcept {};
 
     if (module_memories.size() + imported_memories.size() > 1)
     {
@@ -236,8 +279,17 @@ std::tuple<bytes_ptr, size_t> allocate_memory(const std::vector<Memory>& module_
                                     std::to_string(MemoryPagesLimit * PageSize) + " bytes.");
         }
 
+        if (memory_image != nullptr)
+        {
+            assert(memory_image->size() == memory_min * PageSize);
+            memory_ptr memory{
+                new LinearMemory(*memory_image, memory_max * PageSize), memory_delete};
+            return {std::move(memory), memory_max};
+        }
+
         // NOTE: fill it with zeroes
-        bytes_ptr memory{new bytes(memory_min * PageSize, 0), bytes_delete};
+        memory_ptr memory{
+            new LinearMemory(memory_min * PageSize, memory_max * PageSize), memory_delete};
         return {std::move(memory), memory_max};
     }
     else if (imported_memories.size() == 1)
@@ -254,16 +306,61 @@ std::tuple<bytes_ptr, size_t> allocate_memory(const std::vector<Memory>& module_
                                     std::to_string(MemoryPagesLimit * PageSize) + " bytes.");
         }
 
-        bytes_ptr memory{imported_memories[0].data, null_delete};
+        memory_ptr memory{imported_memories[0].data, null_delete};
         return {std::move(memory), memory_max};
     }
     else
     {
-        bytes_ptr memory{nullptr, null_delete};
+        memory_ptr memory{nullptr, null_delete};
         return {std::move(memory), MemoryPagesLimit};
     }
 }
 
+/// Builds the image of the module's memory with the data segments applied.
+/// Returns nullptr if the memory content depends on the instantiation (the memory is imported
+/// or a data segment offset is a global) or there is nothing to gain from the image.
+std::unique_ptr<MemoryImage> build_memory_image(const Module& module)
+{
+    if (module.memorysec.size() != 1 || module.datasec.empty())
+        return nullptr;
+
+    const size_t memory_min = module.memorysec[0].limits.min;
+    if (memory_min == 0 || memory_min > MemoryPagesLimit)
+        return nullptr;
+    const auto size = memory_min * PageSize;
+
+    for (const auto& data : module.datasec)
+    {
+        if (data.offset.kind != ConstantExpression::Kind::Constant ||
+            data.offset.value.constant + data.payload().size() > size)
+            return nullptr;
+    }
+
+    auto image = MemoryImage::create(size);
+    if (image == nullptr)
+        return nullptr;
+
+    for (const auto& data : module.datasec)
+    {
+        // NOTE: these writes can overlap
+        if (!image->write(data.offset.value.constant, data.payload()))
+            return nullptr;
+    }
+    return image;
+}
+
+/// Returns the memory image of the module, building it on the first use.
+/// Returns nullptr if the module memory cannot be initialized from an image.
+const MemoryImage* get_memory_image(const Module& module)
+{
+    if (module.memory_image_cache == nullptr)
+        return nullptr;
+
+    auto& cache = *module.memory_image_cache;
+    std::call_once(cache.built, [&] { cache.image = build_memory_image(module); });
+    return cache.image.get();
+}
+
 uint64_t eval_constant_expression(ConstantExpression expr,
     const std::vector<ExternalGlobal>& imported_globals, const std::vector<Global>& global_types,
     const std::vector<uint64_t>& globals)
@@ -286,62 +383,160 @@ uint64_t eval_constant_expression(ConstantExpression expr,
         return globals[global_idx - imported_globals.size()];
 }
 
-void branch(uint32_t label_idx, Stack<LabelContext>& labels, Stack<uint64_t>& stack,
-    const Instr*& pc, const uint8_t*& immediates) noexcept
+const FuncType& function_type(const Instance& instance, FuncIdx idx)
 {
-    assert(labels.size() > label_idx);
-    labels.drop(label_idx);  // Drop skipped labels (does nothing for labelidx == 0).
-    const auto label = labels.pop();
+    assert(idx < instance.imported_functions.size() + instance.module->funcsec.size());
+
+    if (idx < instance.imported_functions.size())
+        return instance.imported_functions[idx].type;
 
-    pc = label.pc;
-    immediates = label.immediate;
+    const auto type_idx = instance.module->funcsec[idx - instance.imported_functions.size()];
+    assert(type_idx < instance.module->typesec.size());
 
-    // When branch is taken, additional stack items must be dropped.
-    assert(stack.size() >= label.stack_height + label.arity);
-    if (label.arity != 0)
+    return instance.module->typesec[type_idx];
+}
+
+/// The call frame: the state of the calling function saved when another wasm function is called.
+struct Frame
+{
+    const Code* code = nullptr;
+    const Instr* pc = nullptr;
+    const uint8_t* immediates = nullptr;
+    uint64_t* locals = nullptr;
+    uint64_t* stack_bottom = nullptr;
+    size_t func_arity = 0;
+#if FIZZY_COMPUTED_GOTO
+    const void* const* handlers = nullptr;
+#endif
+};
+static_assert(sizeof(Frame) % sizeof(uint64_t) == 0);
+static_assert(alignof(Frame) <= alignof(uint64_t));
+
+/// The number of the execution stack values a Frame occupies.
+constexpr size_t FrameSize = sizeof(Frame) / sizeof(uint64_t);
+
+/// Returns the execution stack of the instance, allocating its memory on the first use
+/// and reallocating it if the instance's execution_stack_limit has changed. The stack in use
+/// by the outer execution of a nested one is not reallocated.
+ExecutionStack& get_execution_stack(Instance& instance)
+{
+    auto& execution_stack = instance.execution_stack;
+    const auto size = instance.execution_stack_limit / sizeof(uint64_t);
+    if (execution_stack.memory != nullptr && execution_stack.size == size)
+        return execution_stack;
+
+    if (execution_stack.num_executions == 0)
     {
-        assert(label.arity == 1);
-        const auto result = stack.peek();
-        stack.resize(label.stack_height);
-        stack.push(result);
+        // NOTE: the memory is intentionally left uninitialized.
+        execution_stack.memory.reset(new uint64_t[size]);
+        execution_stack.size = size;
+        execution_stack.values_end = execution_stack.memory.get();
+        execution_stack.frames_begin = execution_stack.memory.get() + size;
     }
-    else
-        stack.resize(label.stack_height);
+    return execution_stack;
 }
 
-const FuncType& function_type(const Instance& instance, FuncIdx idx)
+/// Checks if the execution stack has space for a function's frame: the locals, the operand stack
+/// of the function's max height (computed by the parser) and the call frame record.
+///
+/// This is the only stack bounds check, the operand stack operations are unchecked.
+inline bool have_frame_space(
+    const uint64_t* locals, size_t num_locals, const Code& code, const uint64_t* frames_begin)
 {
-    assert(idx < instance.imported_functions.size() + instance.module.funcsec.size());
+    assert(code.max_stack_height >= 0);
+    const auto available = frames_begin - locals;
+    const auto required = num_locals + static_cast<size_t>(code.max_stack_height) + FrameSize;
+    return available >= 0 && static_cast<size_t>(available) >= required;
+}
 
-    if (idx < instance.imported_functions.size())
-        return instance.imported_functions[idx].type;
+#if FIZZY_GUARD_PAGES
+/// The wasm execution in progress on the current thread, for which the memory faults
+/// are turned into traps.
+struct MemoryTrapContext
+{
+    /// The point where the execution is abandoned in case of a fault,
+    /// nullptr if no wasm code is being executed.
+    sigjmp_buf* recovery_point = nullptr;
 
-    const auto type_idx = instance.module.funcsec[idx - instance.imported_functions.size()];
-    assert(type_idx < instance.module.typesec.size());
+    /// The address range reserved for the memory being accessed by the execution.
+    const uint8_t* reservation_begin = nullptr;
+    const uint8_t* reservation_end = nullptr;
+};
 
-    return instance.module.typesec[type_idx];
-}
+thread_local MemoryTrapContext memory_trap_context;
 
-bool invoke_function(const FuncType& func_type, uint32_t func_idx, Instance& instance,
-    Stack<uint64_t>& stack, int depth)
+/// Abandons the execution of the current thread if the fault is its access to the memory.
+void handle_memory_trap(const void* fault_address)
 {
-    if (depth == CallStackLimit)
-        return false;
+    const auto& context = memory_trap_context;
+    const auto* const address = static_cast<const uint8_t*>(fault_address);
+    if (context.recovery_point != nullptr && address >= context.reservation_begin &&
+        address < context.reservation_end)
+        siglongjmp(*context.recovery_point, 1);
+}
+#endif
 
-    const auto num_args = func_type.inputs.size();
+bool invoke_imported_function(
+    Instance& instance, FuncIdx func_idx, OperandStack& stack, uint64_t* frames_begin)
+{
+    const auto& func = instance.imported_functions[func_idx];
+    const auto num_args = func.type.inputs.size();
+    const auto num_outputs = func.type.outputs.size();
+    // NOTE: we can assume this from validation
+    assert(num_outputs <= 1);
     assert(stack.size() >= num_args);
-    std::vector<uint64_t> call_args(stack.end() - static_cast<ptrdiff_t>(num_args), stack.end());
-    stack.resize(stack.size() - num_args);
 
-    const auto ret = execute(instance, func_idx, std::move(call_args), depth + 1);
+    if (func.host_function != nullptr)
+    {
+        // The arguments stay in place on the operand stack, so the execution stack usage
+        // published for the imported function includes them.
+        const uint64_t* const args = stack.end() - num_args;
+        instance.execution_stack.values_end = stack.end();
+        instance.execution_stack.frames_begin = frames_begin;
+
+        uint64_t result = 0;
+#if FIZZY_GUARD_PAGES
+        // The faults inside the imported function are not traps of this execution.
+        const auto trap_context = std::exchange(memory_trap_context, {});
+        const auto ok = func.host_function(
+            func.host_context.get(), instance, {args, num_args}, {&result, num_outputs});
+        memory_trap_context = trap_context;
+#else
+        const auto ok = func.host_function(
+            func.host_context.get(), instance, {args, num_args}, {&result, num_outputs});
+#endif
+        if (!ok)
+            return false;
+
+        stack.drop(num_args);
+        if (num_outputs != 0)
+            stack.push(result);
+        return true;
+    }
+
+    std::vector<uint64_t> call_args(stack.end() - num_args, stack.end());
+    stack.drop(num_args);
+
+    // Publish the execution stack usage, so the imported function can execute wasm functions
+    // on the same instance.
+    instance.execution_stack.values_end = stack.end();
+    instance.execution_stack.frames_begin = frames_begin;
+
+#if FIZZY_GUARD_PAGES
+    // The faults inside the imported function are not traps of this execution.
+    const auto trap_context = std::exchange(memory_trap_context, {});
+    const auto ret = func.function(instance, std::move(call_args));
+    memory_trap_context = trap_context;
+#else
+    const auto ret = func.function(instance, std::move(call_args));
+#endif
+
     // Bubble up traps
     if (ret.trapped)
         return false;
 
-    const auto num_outputs = func_type.outputs.size();
-    // NOTE: we can assume these two from validation
+    // NOTE: we can assume this from validation
     assert(ret.stack.size() == num_outputs);
-    assert(num_outputs <= 1);
     // Push back the result
     if (num_outputs != 0)
         stack.push(ret.stack[0]);
@@ -350,16 +545,16 @@ bool invoke_function(const FuncType& func_type, uint32_t func_idx, Instance& ins
 }
 
 template <typename T>
-inline void store(bytes& input, size_t offset, T value) noexcept
+inline void store(LinearMemory& memory, uint64_t offset, T value) noexcept
 {
-    __builtin_memcpy(input.data() + offset, &value, sizeof(value));
+    __builtin_memcpy(memory.data() + offset, &value, sizeof(value));
 }
 
 template <typename T>
-inline T load(bytes_view input, size_t offset) noexcept
+inline T load(const LinearMemory& memory, uint64_t offset) noexcept
 {
     T ret;
-    __builtin_memcpy(&ret, input.data() + offset, sizeof(ret));
+    __builtin_memcpy(&ret, memory.data() + offset, sizeof(ret));
     return ret;
 }
 
@@ -372,6 +567,44 @@ inline T read(const uint8_t*& input) noexcept
     return ret;
 }
 
+/// Checks if the execution of the instance is requested to be interrupted, what is done
+/// on the loop back-edges and the function calls.
+inline bool interrupt_requested(const Instance& instance) noexcept
+{
+    return instance.interrupt_requested.load(std::memory_order_relaxed);
+}
+
+/// Takes the branch with the target resolved by the parser (see BranchImmediateSize).
+/// Returns false if the branch goes back to a loop and the execution is to be interrupted.
+[[nodiscard]] inline bool branch(const Instance& instance, const Code& code, OperandStack& stack,
+    const Instr*& pc, const uint8_t*& immediates) noexcept
+{
+    const auto target_pc = read<uint32_t>(immediates);
+    const auto target_imm = read<uint32_t>(immediates);
+    const auto stack_height = read<uint32_t>(immediates);
+    const auto arity = read<uint32_t>(immediates);
+
+    const auto* const target = code.instructions.data() + target_pc;
+    if (target < pc && interrupt_requested(instance))
+        return false;
+
+    pc = target;
+    immediates = code.immediates.data() + target_imm;
+
+    // When branch is taken, additional stack items must be dropped.
+    assert(stack.size() >= stack_height + arity);
+    if (arity != 0)
+    {
+        assert(arity == 1);
+        const auto result = stack.peek();
+        stack.resize(stack_height);
+        stack.push(result);
+    }
+    else
+        stack.resize(stack_height);
+    return true;
+}
+
 template <typename DstT, typename SrcT>
 inline DstT extend(SrcT in) noexcept
 {
@@ -385,37 +618,44 @@ inline DstT extend(SrcT in) noexcept
 }
 
 template <typename DstT, typename SrcT = DstT>
-inline bool load_from_memory(bytes_view memory, Stack<uint64_t>& stack, const uint8_t*& immediates)
+inline bool load_from_memory(
+    const LinearMemory& memory, OperandStack& stack, const uint8_t*& immediates)
 {
     const auto address = static_cast<uint32_t>(stack.pop());
     // NOTE: alignment is dropped by the parser
     const auto offset = read<uint32_t>(immediates);
     // Addressing is 32-bit, but we keep the value as 64-bit to detect overflows.
-    if ((uint64_t{address} + offset + sizeof(SrcT)) > memory.size())
+    const auto effective_address = uint64_t{address} + offset;
+#if !FIZZY_GUARD_PAGES
+    if ((effective_address + sizeof(SrcT)) > memory.size())
         return false;
+#endif
 
-    const auto ret = load<SrcT>(memory, address + offset);
+    const auto ret = load<SrcT>(memory, effective_address);
     stack.push(extend<DstT>(ret));
     return true;
 }
 
 template <typename DstT>
-inline bool store_into_memory(bytes& memory, Stack<uint64_t>& stack, const uint8_t*& immediates)
+inline bool store_into_memory(LinearMemory& memory, OperandStack& stack, const uint8_t*& immediates)
 {
     const auto value = static_cast<DstT>(stack.pop());
     const auto address = static_cast<uint32_t>(stack.pop());
     // NOTE: alignment is dropped by the parser
     const auto offset = read<uint32_t>(immediates);
     // Addressing is 32-bit, but we keep the value as 64-bit to detect overflows.
-    if ((uint64_t{address} + offset + sizeof(DstT)) > memory.size())
+    const auto effective_address = uint64_t{address} + offset;
+#if !FIZZY_GUARD_PAGES
+    if ((effective_address + sizeof(DstT)) > memory.size())
         return false;
+#endif
 
-    store<DstT>(memory, address + offset, value);
+    store<DstT>(memory, effective_address, value);
     return true;
 }
 
 template <typename Op>
-inline void unary_op(Stack<uint64_t>& stack, Op op) noexcept
+inline void unary_op(OperandStack& stack, Op op) noexcept
 {
     using T = decltype(op(stack.pop()));
     const auto a = static_cast<T>(stack.pop());
@@ -423,7 +663,7 @@ inline void unary_op(Stack<uint64_t>& stack, Op op) noexcept
 }
 
 template <typename Op>
-inline void binary_op(Stack<uint64_t>& stack, Op op) noexcept
+inline void binary_op(OperandStack& stack, Op op) noexcept
 {
     using T = decltype(op(stack.pop(), stack.pop()));
     const auto val2 = static_cast<T>(stack.pop());
@@ -432,7 +672,7 @@ inline void binary_op(Stack<uint64_t>& stack, Op op) noexcept
 }
 
 template <typename T, template <typename> class Op>
-inline void comparison_op(Stack<uint64_t>& stack, Op<T> op) noexcept
+inline void comparison_op(OperandStack& stack, Op<T> op) noexcept
 {
     const auto val2 = static_cast<T>(stack.pop());
     const auto val1 = static_cast<T>(stack.pop());
@@ -524,26 +764,29 @@ inline uint64_t popcnt64(uint64_t value) noexcept
 std::optional<uint32_t> find_export(
     const Instance& instance, ExternalKind kind, std::string_view name)
 {
-    const auto it = std::find_if(instance.module.exportsec.begin(), instance.module.exportsec.end(),
+    const auto& exportsec = instance.module->exportsec;
+    const auto it = std::find_if(exportsec.begin(), exportsec.end(),
         [kind, name](const auto& export_) { return export_.kind == kind && export_.name == name; });
 
-    return (it != instance.module.exportsec.end() ? std::make_optional(it->index) : std::nullopt);
+    return (it != exportsec.end() ? std::make_optional(it->index) : std::nullopt);
 }
 
 }  // namespace
 
-std::unique_ptr<Instance> instantiate(Module module,
+std::unique_ptr<Instance> instantiate(std::shared_ptr<const Module> module,
     std::vector<ExternalFunction> imported_functions, std::vector<ExternalTable> imported_tables,
     std::vector<ExternalMemory> imported_memories, std::vector<ExternalGlobal> imported_globals)
 {
-    assert(module.funcsec.size() == module.codesec.size());
+    assert(module != nullptr);
+    assert(module->funcsec.size() == module->codesec.size() || module->lazy_codesec != nullptr);
 
-    match_imports(module, imported_functions, imported_tables, imported_memories, imported_globals);
+    match_imports(
+        *module, imported_functions, imported_tables, imported_memories, imported_globals);
 
     // Init globals
     std::vector<uint64_t> globals;
-    globals.reserve(module.globalsec.size());
-    for (auto const& global : module.globalsec)
+    globals.reserve(module->globalsec.size());
+    for (auto const& global : module->globalsec)
     {
         // Wasm spec section 3.3.7 constrains initialization by another global to const imports only
         // https://webassembly.github.io/spec/core/valid/instructions.html#expressions
@@ -555,37 +798,39 @@ std::unique_ptr<Instance> instantiate(Module module,
         }
 
         const auto value = eval_constant_expression(
-            global.expression, imported_globals, module.globalsec, globals);
+            global.expression, imported_globals, module->globalsec, globals);
         globals.emplace_back(value);
     }
 
-    auto table = allocate_table(module.tablesec, imported_tables);
+    auto table = allocate_table(module->tablesec, imported_tables);
 
-    // Allocate memory
-    auto [memory, memory_max] = allocate_memory(module.memorysec, imported_memories);
+    // Allocate memory, with the data segments already applied if the memory image is available.
+    const auto* const memory_image = get_memory_image(*module);
+    auto [memory, memory_max] =
+        allocate_memory(module->memorysec, imported_memories, memory_image);
 
     // Before starting to fill memory and table,
     // check that data and element segments are within bounds.
     std::vector<uint64_t> datasec_offsets;
-    datasec_offsets.reserve(module.datasec.size());
-    for (const auto& data : module.datasec)
+    datasec_offsets.reserve(module->datasec.size());
+    for (const auto& data : module->datasec)
     {
         const uint64_t offset =
-            eval_constant_expression(data.offset, imported_globals, module.globalsec, globals);
+            eval_constant_expression(data.offset, imported_globals, module->globalsec, globals);
 
-        if (offset + data.init.size() > memory->size())
+        if (offset + data.payload().size() > memory->size())
             throw instantiate_error("Data segment is out of memory bounds");
 
         datasec_offsets.emplace_back(offset);
     }
 
-    assert(module.elementsec.empty() || table != nullptr);
+    assert(module->elementsec.empty() || table != nullptr);
     std::vector<uint64_t> elementsec_offsets;
-    elementsec_offsets.reserve(module.elementsec.size());
-    for (const auto& element : module.elementsec)
+    elementsec_offsets.reserve(module->elementsec.size());
+    for (const auto& element : module->elementsec)
     {
         const uint64_t offset =
-            eval_constant_expression(element.offset, imported_globals, module.globalsec, globals);
+            eval_constant_expression(element.offset, imported_globals, module->globalsec, globals);
 
         if (offset + element.init.size() > table->size())
             throw instantiate_error("Element segment is out of table bounds");
@@ -594,19 +839,22 @@ std::unique_ptr<Instance> instantiate(Module module,
     }
 
     // Fill the table based on elements segment
-    for (size_t i = 0; i < module.elementsec.size(); ++i)
+    for (size_t i = 0; i < module->elementsec.size(); ++i)
     {
         // Overwrite table[offset..] with element.init
-        std::copy(module.elementsec[i].init.begin(), module.elementsec[i].init.end(),
+        std::copy(module->elementsec[i].init.begin(), module->elementsec[i].init.end(),
             table->data() + elementsec_offsets[i]);
     }
 
-    // Fill out memory based on data segments
-    for (size_t i = 0; i < module.datasec.size(); ++i)
+    // Fill out memory based on data segments, unless the memory image has them applied already
+    if (memory_image == nullptr)
     {
-        // NOTE: these instructions can overlap
-        std::copy(module.datasec[i].init.begin(), module.datasec[i].init.end(),
-            memory->data() + datasec_offsets[i]);
+        for (size_t i = 0; i < module->datasec.size(); ++i)
+        {
+            // NOTE: these instructions can overlap
+            const auto init = module->datasec[i].payload();
+            std::copy(init.begin(), init.end(), memory->data() + datasec_offsets[i]);
+        }
     }
 
     // FIXME: clang-tidy warns about potential memory leak for moving memory (which is in fact
@@ -617,10 +865,10 @@ std::unique_ptr<Instance> instantiate(Module module,
         std::move(imported_globals));
 
     // Run start function if present
-    if (instance->module.startfunc)
+    if (instance->module->startfunc)
     {
-        const auto funcidx = *instance->module.startfunc;
-        assert(funcidx < instance->imported_functions.size() + instance->module.funcsec.size());
+        const auto funcidx = *instance->module->startfunc;
+        assert(funcidx < instance->imported_functions.size() + instance->module->funcsec.size());
         if (execute(*instance, funcidx, {}).trapped)
             throw instantiate_error("Start function failed to execute");
     }
@@ -628,166 +876,492 @@ std::unique_ptr<Instance> instantiate(Module module,
     return instance;
 }
 
-execution_result execute(
-    Instance& instance, FuncIdx func_idx, std::vector<uint64_t> args, int depth)
+std::unique_ptr<Instance> instantiate(Module module,
+    std::vector<ExternalFunction> imported_functions, std::vector<ExternalTable> imported_tables,
+    std::vector<ExternalMemory> imported_memories, std::vector<ExternalGlobal> imported_globals)
 {
-    assert(depth >= 0 && depth <= CallStackLimit);
+    return instantiate(std::make_shared<const Module>(std::move(module)),
+        std::move(imported_functions), std::move(imported_tables), std::move(imported_memories),
+        std::move(imported_globals));
+}
 
-    if (func_idx < instance.imported_functions.size())
-        return instance.imported_functions[func_idx].function(instance, std::move(args));
+namespace
+{
+/// Grows the instance's memory by delta pages, returns the result of memory.grow.
+uint32_t grow_memory(Instance& instance, uint32_t delta) noexcept
+{
+    auto& memory = *instance.memory;
+    const auto cur_pages = memory.size() / PageSize;
+    assert(cur_pages <= size_t(std::numeric_limits<int32_t>::max()));
+    const auto new_pages = cur_pages + delta;
+    assert(new_pages >= cur_pages);
+    try
+    {
+        if (new_pages > instance.memory_max_pages)
+            throw std::bad_alloc();
+        memory.resize(new_pages * PageSize);
+    }
+    catch (std::bad_alloc const&)
+    {
+        return static_cast<uint32_t>(-1);
+    }
+    return static_cast<uint32_t>(cur_pages);
+}
+
+#if FIZZY_COMPUTED_GOTO
+/// Returns the translations of the instance's function bodies for the direct threaded dispatch,
+/// taken from the module's cache on the first use.
+ThreadedCode* get_threaded_functions(Instance& instance)
+{
+    if (instance.threaded_code == nullptr)
+    {
+        instance.threaded_code = (instance.module->threaded_code_cache != nullptr) ?
+                                     instance.module->threaded_code_cache :
+                                     std::make_shared<ThreadedCodeCache>();
+    }
+
+    auto& cache = *instance.threaded_code;
+    std::call_once(cache.allocated, [&] {
+        cache.functions = std::make_unique<ThreadedCode[]>(instance.module->funcsec.size());
+    });
+    return cache.functions.get();
+}
 
+/// Returns the handler addresses of the function body, translating it with the table
+/// of the handlers indexed by opcode on the first use.
+inline const void* const* get_handlers(
+    ThreadedCode& function, const Code& code, const void* const* dispatch_table)
+{
+    if (const auto handlers = function.ready.load(std::memory_order_acquire); handlers != nullptr)
+        return handlers;
+
+    std::call_once(function.translated, [&] {
+        function.handlers.resize(code.instructions.size());
+        std::transform(code.instructions.begin(), code.instructions.end(),
+            function.handlers.begin(),
+            [dispatch_table](Instr instr) { return dispatch_table[static_cast<uint8_t>(instr)]; });
+        function.ready.store(function.handlers.data(), std::memory_order_release);
+    });
+    return function.handlers.data();
+}
+#endif
+
+/// Executes the wasm function (not imported) on the instance's execution stack.
+///
+/// NOTE: In the FIZZY_GUARD_PAGES mode the execution can be abandoned with siglongjmp() at
+/// any memory instruction, therefore no objects with non-trivial destructors may be alive here.
+ExecutionResult execute_function(
+    Instance& instance, FuncIdx func_idx, span<const uint64_t> args)
+{
     const auto code_idx = func_idx - instance.imported_functions.size();
-    assert(code_idx < instance.module.codesec.size());
+    assert(code_idx < instance.module->funcsec.size());
 
-    const auto& code = instance.module.codesec[code_idx];
     auto* const memory = instance.memory.get();
 
-    std::vector<uint64_t> locals = std::move(args);
-    locals.resize(locals.size() + code.local_count);
+    // The functions called from this execution are executed in the loop below, with their frames
+    // pushed to the instance's execution stack, what makes the calls free of heap allocations and
+    // native recursion. The current function state is kept in the local variables.
+    auto& execution_stack = instance.execution_stack;
 
-    // TODO: preallocate fixed stack depth properly
-    Stack<uint64_t> stack;
+    auto* const frames_end = reinterpret_cast<Frame*>(execution_stack.frames_begin);
+    Frame* frames = frames_end;
 
-    Stack<LabelContext> labels;
+    const Code* code = &get_code(*instance.module, code_idx);
+    // The arity is only used when returning to a caller frame.
+    size_t func_arity = 0;
+    uint64_t* locals = execution_stack.values_end;
+
+    if (!have_frame_space(locals, args.size() + code->local_count, *code,
+            reinterpret_cast<uint64_t*>(frames)))
+        return {true, {}};
+
+    std::copy(args.begin(), args.end(), locals);
+    std::fill_n(locals + args.size(), code->local_count, 0);
+
+    OperandStack stack{locals + args.size() + code->local_count};
+
+    // The function called with call or call_indirect instruction.
+    FuncIdx called_func_idx = 0;
 
     bool trap = false;
 
-    const Instr* pc = code.instructions.data();
-    const uint8_t* immediates = code.immediates.data();
+    const Instr* pc = code->instructions.data();
+    const uint8_t* immediates = code->immediates.data();
+
+#if FIZZY_COMPUTED_GOTO
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+    // The table of handler addresses indexed by the instruction opcode.
+    static const void* const dispatch_table[256] = {
+        /* unreachable         = 0x00 */ &&target_unreachable,
+        /* nop                 = 0x01 */ &&target_nop,
+        /* block               = 0x02 */ &&target_block,
+        /* loop                = 0x03 */ &&target_loop,
+        /* if_                 = 0x04 */ &&target_if_,
+        /* else_               = 0x05 */ &&target_else_,
+        /*                       0x06 */ &&target_invalid,
+        /*                       0x07 */ &&target_invalid,
+        /*                       0x08 */ &&target_invalid,
+        /*                       0x09 */ &&target_invalid,
+        /*                       0x0a */ &&target_invalid,
+        /* end                 = 0x0b */ &&target_end,
+        /* br                  = 0x0c */ &&target_br,
+        /* br_if               = 0x0d */ &&target_br_if,
+        /* br_table            = 0x0e */ &&target_br_table,
+        /* return_             = 0x0f */ &&target_return_,
+        /* call                = 0x10 */ &&target_call,
+        /* call_indirect       = 0x11 */ &&target_call_indirect,
+        /*                       0x12 */ &&target_invalid,
+        /*                       0x13 */ &&target_invalid,
+        /*                       0x14 */ &&target_invalid,
+        /*                       0x15 */ &&target_invalid,
+        /*                       0x16 */ &&target_invalid,
+        /*                       0x17 */ &&target_invalid,
+        /*                       0x18 */ &&target_invalid,
+        /*                       0x19 */ &&target_invalid,
+        /* drop                = 0x1a */ &&target_drop,
+        /* select              = 0x1b */ &&target_select,
+        /*                       0x1c */ &&target_invalid,
+        /*                       0x1d */ &&target_invalid,
+        /*                       0x1e */ &&target_invalid,
+        /*                       0x1f */ &&target_invalid,
+        /* local_get           = 0x20 */ &&target_local_get,
+        /* local_set           = 0x21 */ &&target_local_set,
+        /* local_tee           = 0x22 */ &&target_local_tee,
+        /* global_get          = 0x23 */ &&target_global_get,
+        /* global_set          = 0x24 */ &&target_global_set,
+        /*                       0x25 */ &&target_invalid,
+        /*                       0x26 */ &&target_invalid,
+        /*                       0x27 */ &&target_invalid,
+        /* i32_load            = 0x28 */ &&target_i32_load,
+        /* i64_load            = 0x29 */ &&target_i64_load,
+        /* f32_load            = 0x2a */ &&target_f32_load,
+        /* f64_load            = 0x2b */ &&target_f64_load,
+        /* i32_load8_s         = 0x2c */ &&target_i32_load8_s,
+        /* i32_load8_u         = 0x2d */ &&target_i32_load8_u,
+        /* i32_load16_s        = 0x2e */ &&target_i32_load16_s,
+        /* i32_load16_u        = 0x2f */ &&target_i32_load16_u,
+        /* i64_load8_s         = 0x30 */ &&target_i64_load8_s,
+        /* i64_load8_u         = 0x31 */ &&target_i64_load8_u,
+        /* i64_load16_s        = 0x32 */ &&target_i64_load16_s,
+        /* i64_load16_u        = 0x33 */ &&target_i64_load16_u,
+        /* i64_load32_s        = 0x34 */ &&target_i64_load32_s,
+        /* i64_load32_u        = 0x35 */ &&target_i64_load32_u,
+        /* i32_store           = 0x36 */ &&target_i32_store,
+        /* i64_store           = 0x37 */ &&target_i64_store,
+        /* f32_store           = 0x38 */ &&target_f32_store,
+        /* f64_store           = 0x39 */ &&target_f64_store,
+        /* i32_store8          = 0x3a */ &&target_i32_store8,
+        /* i32_store16         = 0x3b */ &&target_i32_store16,
+        /* i64_store8          = 0x3c */ &&target_i64_store8,
+        /* i64_store16         = 0x3d */ &&target_i64_store16,
+        /* i64_store32         = 0x3e */ &&target_i64_store32,
+        /* memory_size         = 0x3f */ &&target_memory_size,
+        /* memory_grow         = 0x40 */ &&target_memory_grow,
+        /* i32_const           = 0x41 */ &&target_i32_const,
+        /* i64_const           = 0x42 */ &&target_i64_const,
+        /* f32_const           = 0x43 */ &&target_f32_const,
+        /* f64_const           = 0x44 */ &&target_f64_const,
+        /* i32_eqz             = 0x45 */ &&target_i32_eqz,
+        /* i32_eq              = 0x46 */ &&target_i32_eq,
+        /* i32_ne              = 0x47 */ &&target_i32_ne,
+        /* i32_lt_s            = 0x48 */ &&target_i32_lt_s,
+        /* i32_lt_u            = 0x49 */ &&target_i32_lt_u,
+        /* i32_gt_s            = 0x4a */ &&target_i32_gt_s,
+        /* i32_gt_u            = 0x4b */ &&target_i32_gt_u,
+        /* i32_le_s            = 0x4c */ &&target_i32_le_s,
+        /* i32_le_u            = 0x4d */ &&target_i32_le_u,
+        /* i32_ge_s            = 0x4e */ &&target_i32_ge_s,
+        /* i32_ge_u            = 0x4f */ &&target_i32_ge_u,
+        /* i64_eqz             = 0x50 */ &&target_i64_eqz,
+        /* i64_eq              = 0x51 */ &&target_i64_eq,
+        /* i64_ne              = 0x52 */ &&target_i64_ne,
+        /* i64_lt_s            = 0x53 */ &&target_i64_lt_s,
+        /* i64_lt_u            = 0x54 */ &&target_i64_lt_u,
+        /* i64_gt_s            = 0x55 */ &&target_i64_gt_s,
+        /* i64_gt_u            = 0x56 */ &&target_i64_gt_u,
+        /* i64_le_s            = 0x57 */ &&target_i64_le_s,
+        /* i64_le_u            = 0x58 */ &&target_i64_le_u,
+        /* i64_ge_s            = 0x59 */ &&target_i64_ge_s,
+        /* i64_ge_u            = 0x5a */ &&target_i64_ge_u,
+        /* f32_eq              = 0x5b */ &&target_f32_eq,
+        /* f32_ne              = 0x5c */ &&target_f32_ne,
+        /* f32_lt              = 0x5d */ &&target_f32_lt,
+        /* f32_gt              = 0x5e */ &&target_f32_gt,
+        /* f32_le              = 0x5f */ &&target_f32_le,
+        /* f32_ge              = 0x60 */ &&target_f32_ge,
+        /* f64_eq              = 0x61 */ &&target_f64_eq,
+        /* f64_ne              = 0x62 */ &&target_f64_ne,
+        /* f64_lt              = 0x63 */ &&target_f64_lt,
+        /* f64_gt              = 0x64 */ &&target_f64_gt,
+        /* f64_le              = 0x65 */ &&target_f64_le,
+        /* f64_ge              = 0x66 */ &&target_f64_ge,
+        /* i32_clz             = 0x67 */ &&target_i32_clz,
+        /* i32_ctz             = 0x68 */ &&target_i32_ctz,
+        /* i32_popcnt          = 0x69 */ &&target_i32_popcnt,
+        /* i32_add             = 0x6a */ &&target_i32_add,
+        /* i32_sub             = 0x6b */ &&target_i32_sub,
+        /* i32_mul             = 0x6c */ &&target_i32_mul,
+        /* i32_div_s           = 0x6d */ &&target_i32_div_s,
+        /* i32_div_u           = 0x6e */ &&target_i32_div_u,
+        /* i32_rem_s           = 0x6f */ &&target_i32_rem_s,
+        /* i32_rem_u           = 0x70 */ &&target_i32_rem_u,
+        /* i32_and             = 0x71 */ &&target_i32_and,
+        /* i32_or              = 0x72 */ &&target_i32_or,
+        /* i32_xor             = 0x73 */ &&target_i32_xor,
+        /* i32_shl             = 0x74 */ &&target_i32_shl,
+        /* i32_shr_s           = 0x75 */ &&target_i32_shr_s,
+        /* i32_shr_u           = 0x76 */ &&target_i32_shr_u,
+        /* i32_rotl            = 0x77 */ &&target_i32_rotl,
+        /* i32_rotr            = 0x78 */ &&target_i32_rotr,
+        /* i64_clz             = 0x79 */ &&target_i64_clz,
+        /* i64_ctz             = 0x7a */ &&target_i64_ctz,
+        /* i64_popcnt          = 0x7b */ &&target_i64_popcnt,
+        /* i64_add             = 0x7c */ &&target_i64_add,
+        /* i64_sub             = 0x7d */ &&target_i64_sub,
+        /* i64_mul             = 0x7e */ &&target_i64_mul,
+        /* i64_div_s           = 0x7f */ &&target_i64_div_s,
+        /* i64_div_u           = 0x80 */ &&target_i64_div_u,
+        /* i64_rem_s           = 0x81 */ &&target_i64_rem_s,
+        /* i64_rem_u           = 0x82 */ &&target_i64_rem_u,
+        /* i64_and             = 0x83 */ &&target_i64_and,
+        /* i64_or              = 0x84 */ &&target_i64_or,
+        /* i64_xor             = 0x85 */ &&target_i64_xor,
+        /* i64_shl             = 0x86 */ &&target_i64_shl,
+        /* i64_shr_s           = 0x87 */ &&target_i64_shr_s,
+        /* i64_shr_u           = 0x88 */ &&target_i64_shr_u,
+        /* i64_rotl            = 0x89 */ &&target_i64_rotl,
+        /* i64_rotr            = 0x8a */ &&target_i64_rotr,
+        /* f32_abs             = 0x8b */ &&target_f32_abs,
+        /* f32_neg             = 0x8c */ &&target_f32_neg,
+        /* f32_ceil            = 0x8d */ &&target_f32_ceil,
+        /* f32_floor           = 0x8e */ &&target_f32_floor,
+        /* f32_trunc           = 0x8f */ &&target_f32_trunc,
+        /* f32_nearest         = 0x90 */ &&target_f32_nearest,
+        /* f32_sqrt            = 0x91 */ &&target_f32_sqrt,
+        /* f32_add             = 0x92 */ &&target_f32_add,
+        /* f32_sub             = 0x93 */ &&target_f32_sub,
+        /* f32_mul             = 0x94 */ &&target_f32_mul,
+        /* f32_div             = 0x95 */ &&target_f32_div,
+        /* f32_min             = 0x96 */ &&target_f32_min,
+        /* f32_max             = 0x97 */ &&target_f32_max,
+        /* f32_copysign        = 0x98 */ &&target_f32_copysign,
+        /* f64_abs             = 0x99 */ &&target_f64_abs,
+        /* f64_neg             = 0x9a */ &&target_f64_neg,
+        /* f64_ceil            = 0x9b */ &&target_f64_ceil,
+        /* f64_floor           = 0x9c */ &&target_f64_floor,
+        /* f64_trunc           = 0x9d */ &&target_f64_trunc,
+        /* f64_nearest         = 0x9e */ &&target_f64_nearest,
+        /* f64_sqrt            = 0x9f */ &&target_f64_sqrt,
+        /* f64_add             = 0xa0 */ &&target_f64_add,
+        /* f64_sub             = 0xa1 */ &&target_f64_sub,
+        /* f64_mul             = 0xa2 */ &&target_f64_mul,
+        /* f64_div             = 0xa3 */ &&target_f64_div,
+        /* f64_min             = 0xa4 */ &&target_f64_min,
+        /* f64_max             = 0xa5 */ &&target_f64_max,
+        /* f64_copysign        = 0xa6 */ &&target_f64_copysign,
+        /* i32_wrap_i64        = 0xa7 */ &&target_i32_wrap_i64,
+        /* i32_trunc_f32_s     = 0xa8 */ &&target_i32_trunc_f32_s,
+        /* i32_trunc_f32_u     = 0xa9 */ &&target_i32_trunc_f32_u,
+        /* i32_trunc_f64_s     = 0xaa */ &&target_i32_trunc_f64_s,
+        /* i32_trunc_f64_u     = 0xab */ &&target_i32_trunc_f64_u,
+        /* i64_extend_i32_s    = 0xac */ &&target_i64_extend_i32_s,
+        /* i64_extend_i32_u    = 0xad */ &&target_i64_extend_i32_u,
+        /* i64_trunc_f32_s     = 0xae */ &&target_i64_trunc_f32_s,
+        /* i64_trunc_f32_u     = 0xaf */ &&target_i64_trunc_f32_u,
+        /* i64_trunc_f64_s     = 0xb0 */ &&target_i64_trunc_f64_s,
+        /* i64_trunc_f64_u     = 0xb1 */ &&target_i64_trunc_f64_u,
+        /* f32_convert_i32_s   = 0xb2 */ &&target_f32_convert_i32_s,
+        /* f32_convert_i32_u   = 0xb3 */ &&target_f32_convert_i32_u,
+        /* f32_convert_i64_s   = 0xb4 */ &&target_f32_convert_i64_s,
+        /* f32_convert_i64_u   = 0xb5 */ &&target_f32_convert_i64_u,
+        /* f32_demote_f64      = 0xb6 */ &&target_f32_demote_f64,
+        /* f64_convert_i32_s   = 0xb7 */ &&target_f64_convert_i32_s,
+        /* f64_convert_i32_u   = 0xb8 */ &&target_f64_convert_i32_u,
+        /* f64_convert_i64_s   = 0xb9 */ &&target_f64_convert_i64_s,
+        /* f64_convert_i64_u   = 0xba */ &&target_f64_convert_i64_u,
+        /* f64_promote_f32     = 0xbb */ &&target_f64_promote_f32,
+        /* i32_reinterpret_f32 = 0xbc */ &&target_i32_reinterpret_f32,
+        /* i64_reinterpret_f64 = 0xbd */ &&target_i64_reinterpret_f64,
+        /* f32_reinterpret_i32 = 0xbe */ &&target_f32_reinterpret_i32,
+        /* f64_reinterpret_i64 = 0xbf */ &&target_f64_reinterpret_i64,
+        /*                       0xc0 */ &&target_invalid,
+        /*                       0xc1 */ &&target_invalid,
+        /*                       0xc2 */ &&target_invalid,
+        /*                       0xc3 */ &&target_invalid,
+        /*                       0xc4 */ &&target_invalid,
+        /*                       0xc5 */ &&target_invalid,
+        /*                       0xc6 */ &&target_invalid,
+        /*                       0xc7 */ &&target_invalid,
+        /*                       0xc8 */ &&target_invalid,
+        /*                       0xc9 */ &&target_invalid,
+        /*                       0xca */ &&target_invalid,
+        /*                       0xcb */ &&target_invalid,
+        /*                       0xcc */ &&target_invalid,
+        /*                       0xcd */ &&target_invalid,
+        /*                       0xce */ &&target_invalid,
+        /*                       0xcf */ &&target_invalid,
+        /*                       0xd0 */ &&target_invalid,
+        /*                       0xd1 */ &&target_invalid,
+        /*                       0xd2 */ &&target_invalid,
+        /*                       0xd3 */ &&target_invalid,
+        /*                       0xd4 */ &&target_invalid,
+        /*                       0xd5 */ &&target_invalid,
+        /*                       0xd6 */ &&target_invalid,
+        /*                       0xd7 */ &&target_invalid,
+        /*                       0xd8 */ &&target_invalid,
+        /*                       0xd9 */ &&target_invalid,
+        /*                       0xda */ &&target_invalid,
+        /*                       0xdb */ &&target_invalid,
+        /*                       0xdc */ &&target_invalid,
+        /*                       0xdd */ &&target_invalid,
+        /*                       0xde */ &&target_invalid,
+        /*                       0xdf */ &&target_invalid,
+        /* local_get_local_get_i32_add = 0xe0 */ &&target_local_get_local_get_i32_add,
+        /* local_get_i32_const_i32_add_local_set = 0xe1 */
+        &&target_local_get_i32_const_i32_add_local_set,
+        /* local_get_i32_load = 0xe2 */ &&target_local_get_i32_load,
+        /* i32_eqz_br_if = 0xe3 */ &&target_i32_eqz_br_if,
+#if FIZZY_METERING
+        /* meter = 0xe4 */ &&target_meter,
+#else
+        /*                       0xe4 */ &&target_invalid,
+#endif
+        /*                       0xe5 */ &&target_invalid,
+        /*                       0xe6 */ &&target_invalid,
+        /*                       0xe7 */ &&target_invalid,
+        /*                       0xe8 */ &&target_invalid,
+        /*                       0xe9 */ &&target_invalid,
+        /*                       0xea */ &&target_invalid,
+        /*                       0xeb */ &&target_invalid,
+        /*                       0xec */ &&target_invalid,
+        /*                       0xed */ &&target_invalid,
+        /*                       0xee */ &&target_invalid,
+        /*                       0xef */ &&target_invalid,
+        /*                       0xf0 */ &&target_invalid,
+        /*                       0xf1 */ &&target_invalid,
+        /*                       0xf2 */ &&target_invalid,
+        /*                       0xf3 */ &&target_invalid,
+        /*                       0xf4 */ &&target_invalid,
+        /*                       0xf5 */ &&target_invalid,
+        /*                       0xf6 */ &&target_invalid,
+        /*                       0xf7 */ &&target_invalid,
+        /*                       0xf8 */ &&target_invalid,
+        /*                       0xf9 */ &&target_invalid,
+        /*                       0xfa */ &&target_invalid,
+        /*                       0xfb */ &&target_invalid,
+        /*                       0xfc */ &&target_invalid,
+        /*                       0xfd */ &&target_invalid,
+        /*                       0xfe */ &&target_invalid,
+        /*                       0xff */ &&target_invalid,
+    };
+
+    // The handler addresses of the current function's instructions.
+    auto* const threaded_functions = get_threaded_functions(instance);
+    const void* const* handlers = get_handlers(threaded_functions[code_idx], *code, dispatch_table);
+    const Instr* instructions_begin = code->instructions.data();
+#endif
 
     while (true)
     {
-        const auto instruction = *pc++;
-        switch (instruction)
+        switch (*pc++)
         {
-        case Instr::unreachable:
+        TARGET(unreachable):
             trap = true;
             goto end;
-        case Instr::nop:
-            break;
-        case Instr::block:
-        {
-            const auto arity = read<uint8_t>(immediates);
+        TARGET(nop):
+        TARGET(block):
+        TARGET(loop):
+            // The branches to blocks and loops are resolved by the parser.
+            DISPATCH();
+        TARGET(if_):
+        {
+            // The jump target for false condition: the else branch or the end of if.
             const auto target_pc = read<uint32_t>(immediates);
             const auto target_imm = read<uint32_t>(immediates);
-            LabelContext label{code.instructions.data() + target_pc,
-                code.immediates.data() + target_imm, arity, stack.size()};
-            labels.emplace_back(label);
-            break;
-        }
-        case Instr::loop:
-        {
-            LabelContext label{pc - 1, immediates, 0, stack.size()};  // Target this instruction.
-            labels.push_back(label);
-            break;
+
+            if (static_cast<uint32_t>(stack.pop()) == 0)
+            {
+                pc = code->instructions.data() + target_pc;
+                immediates = code->immediates.data() + target_imm;
+            }
+            DISPATCH();
         }
-        case Instr::if_:
+        TARGET(else_):
         {
-            const auto arity = read<uint8_t>(immediates);
+            // We reach else only at the end of if branch, jump to the end of if.
             const auto target_pc = read<uint32_t>(immediates);
             const auto target_imm = read<uint32_t>(immediates);
 
-            if (static_cast<uint32_t>(stack.pop()) != 0)
-            {
-                immediates += 2 * sizeof(uint32_t);  // Skip the immediates for else instruction.
-
-                LabelContext label{code.instructions.data() + target_pc,
-                    code.immediates.data() + target_imm, arity, stack.size()};
-                labels.emplace_back(label);
-            }
-            else
-            {
-                const auto target_else_pc = read<uint32_t>(immediates);
-                const auto target_else_imm = read<uint32_t>(immediates);
-
-                if (target_else_pc != 0)  // If else block defined.
-                {
-                    LabelContext label{code.instructions.data() + target_pc,
-                        code.immediates.data() + target_imm, arity, stack.size()};
-                    labels.emplace_back(label);
-                    pc = code.instructions.data() + target_else_pc;
-                    immediates = code.immediates.data() + target_else_imm;
-                }
-                else  // If else block not defined go to end of if.
-                {
-                    assert(arity == 0);  // if without else cannot have type signature.
-                    pc = code.instructions.data() + target_pc;
-                    immediates = code.immediates.data() + target_imm;
-                }
-            }
-            break;
+            pc = code->instructions.data() + target_pc;
+            immediates = code->immediates.data() + target_imm;
+            DISPATCH();
         }
-        case Instr::else_:
+        TARGET(end):
         {
-            // We reach else only at the end of if block.
-            assert(!labels.empty());
-            const auto label = labels.pop();
+            // Nothing to do at the end of a block, but the end of the function is the last
+            // instruction.
+            if (pc != code->instructions.data() + code->instructions.size())
+                DISPATCH();
 
-            pc = label.pc;
-            immediates = label.immediate;
+            if (frames == frames_end)
+                goto end;  // The outermost function returns its whole operand stack.
 
-            break;
+            goto case_return;
         }
-        case Instr::end:
+        TARGET(br):
         {
-            if (!labels.empty())
-                labels.pop_back();
-            else
+            if (!branch(instance, *code, stack, pc, immediates))
+            {
+                trap = true;
                 goto end;
-            break;
+            }
+            DISPATCH();
         }
-        case Instr::br:
-        case Instr::br_if:
+        TARGET(br_if):
         {
-            const auto label_idx = read<uint32_t>(immediates);
-
             // Check condition for br_if.
-            if (instruction == Instr::br_if && static_cast<uint32_t>(stack.pop()) == 0)
-                break;
-
-            if (label_idx == labels.size())
-                goto case_return;
-
-            branch(label_idx, labels, stack, pc, immediates);
-            break;
+            if (static_cast<uint32_t>(stack.pop()) != 0)
+            {
+                if (!branch(instance, *code, stack, pc, immediates))
+                {
+                    trap = true;
+                    goto end;
+                }
+            }
+            else
+                immediates += BranchImmediateSize;
+            DISPATCH();
         }
-        case Instr::br_table:
+        TARGET(br_table):
         {
             // immediates are: size of label vector, labels, default label
             const auto br_table_size = read<uint32_t>(immediates);
             const auto br_table_idx = stack.pop();
 
             const auto label_idx_offset = br_table_idx < br_table_size ?
-                                              br_table_idx * sizeof(uint32_t) :
-                                              br_table_size * sizeof(uint32_t);
+                                              br_table_idx * BranchImmediateSize :
+                                              br_table_size * BranchImmediateSize;
             immediates += label_idx_offset;
 
-            const auto label_idx = read<uint32_t>(immediates);
-
-            if (label_idx == labels.size())
-                goto case_return;
-
-            branch(label_idx, labels, stack, pc, immediates);
-            break;
-        }
-        case Instr::call:
-        {
-            const auto called_func_idx = read<uint32_t>(immediates);
-            const auto& func_type = function_type(instance, called_func_idx);
-
-            if (!invoke_function(func_type, called_func_idx, instance, stack, depth))
+            if (!branch(instance, *code, stack, pc, immediates))
             {
                 trap = true;
                 goto end;
             }
-            break;
+            DISPATCH();
+        }
+        TARGET(call):
+        {
+            called_func_idx = read<uint32_t>(immediates);
+            goto call_function;
         }
-        case Instr::call_indirect:
+        TARGET(call_indirect):
         {
             assert(instance.table != nullptr);
 
             const auto expected_type_idx = read<uint32_t>(immediates);
-            assert(expected_type_idx < instance.module.typesec.size());
+            assert(expected_type_idx < instance.module->typesec.size());
 
             const auto elem_idx = stack.pop();
             if (elem_idx >= instance.table->size())
@@ -796,57 +1370,68 @@ execution_result execute(
                 goto end;
             }
 
-            const auto called_func_idx = (*instance.table)[elem_idx];
-            if (!called_func_idx.has_value())
+            const auto elem = (*instance.table)[elem_idx];
+            if (!elem.has_value())
             {
                 trap = true;
                 goto end;
             }
 
             // check actual type against expected type
-            const auto& actual_type = function_type(instance, *called_func_idx);
-            const auto& expected_type = instance.module.typesec[expected_type_idx];
+            const auto& actual_type = function_type(instance, *elem);
+            const auto& expected_type = instance.module->typesec[expected_type_idx];
             if (expected_type != actual_type)
             {
                 trap = true;
                 goto end;
             }
 
-            if (!invoke_function(actual_type, *called_func_idx, instance, stack, depth))
-            {
-                trap = true;
-                goto end;
-            }
-            break;
+            called_func_idx = *elem;
+            goto call_function;
         }
-        case Instr::return_:
+        TARGET(return_):
         case_return:
         {
-            // TODO: Not needed, but satisfies the assert in the end of the main loop.
-            labels.clear();
-
-            assert(code_idx < instance.module.funcsec.size());
-            const auto type_idx = instance.module.funcsec[code_idx];
-            assert(type_idx < instance.module.typesec.size());
-            const bool have_result = !instance.module.typesec[type_idx].outputs.empty();
-
-            if (have_result)
+            if (frames == frames_end)
             {
-                const auto result = stack.peek();
-                stack.clear();
-                stack.push(result);
+                const bool have_result = !function_type(instance, func_idx).outputs.empty();
+                if (have_result)
+                {
+                    const auto result = stack.peek();
+                    stack.clear();
+                    stack.push(result);
+                }
+                else
+                    stack.clear();
+                goto end;
             }
-            else
-                stack.clear();
 
-            goto end;
-        }
-        case Instr::drop:
+            // The result replaces the function's locals,
+            // i.e. the arguments on the caller's operand stack.
+            assert(func_arity <= 1);
+            if (func_arity != 0)
+                locals[0] = stack.peek();
+
+            // Return to the caller.
+            const auto& caller = *frames++;
+            stack = OperandStack{caller.stack_bottom, locals + func_arity};
+            code = caller.code;
+            pc = caller.pc;
+            immediates = caller.immediates;
+#if FIZZY_COMPUTED_GOTO
+            handlers = caller.handlers;
+            instructions_begin = code->instructions.data();
+#endif
+            locals = caller.locals;
+            func_arity = caller.func_arity;
+            DISPATCH();
+        }
+        TARGET(drop):
         {
             stack.pop();
-            break;
+            DISPATCH();
         }
-        case Instr::select:
+        TARGET(select):
         {
             const auto condition = static_cast<uint32_t>(stack.pop());
             // NOTE: these two are the same type (ensured by validation)
@@ -856,30 +1441,30 @@ execution_result execute(
                 stack.push(val2);
             else
                 stack.push(val1);
-            break;
+            DISPATCH();
         }
-        case Instr::local_get:
+        TARGET(local_get):
         {
             const auto idx = read<uint32_t>(immediates);
-            assert(idx <= locals.size());
+            assert(&locals[idx] < stack.bottom());
             stack.push(locals[idx]);
-            break;
+            DISPATCH();
         }
-        case Instr::local_set:
+        TARGET(local_set):
         {
             const auto idx = read<uint32_t>(immediates);
-            assert(idx <= locals.size());
+            assert(&locals[idx] < stack.bottom());
             locals[idx] = stack.pop();
-            break;
+            DISPATCH();
         }
-        case Instr::local_tee:
+        TARGET(local_tee):
         {
             const auto idx = read<uint32_t>(immediates);
-            assert(idx <= locals.size());
+            assert(&locals[idx] < stack.bottom());
             locals[idx] = stack.peek();
-            break;
+            DISPATCH();
         }
-        case Instr::global_get:
+        TARGET(global_get):
         {
             const auto idx = read<uint32_t>(immediates);
             assert(idx < instance.imported_globals.size() + instance.globals.size());
@@ -890,12 +1475,12 @@ execution_result execute(
             else
             {
                 const auto module_global_idx = idx - instance.imported_globals.size();
-                assert(module_global_idx < instance.module.globalsec.size());
+                assert(module_global_idx < instance.module->globalsec.size());
                 stack.push(instance.globals[module_global_idx]);
             }
-            break;
+            DISPATCH();
         }
-        case Instr::global_set:
+        TARGET(global_set):
         {
             const auto idx = read<uint32_t>(immediates);
             if (idx < instance.imported_globals.size())
@@ -906,347 +1491,331 @@ execution_result execute(
             else
             {
                 const auto module_global_idx = idx - instance.imported_globals.size();
-                assert(module_global_idx < instance.module.globalsec.size());
-                assert(instance.module.globalsec[module_global_idx].is_mutable);
+                assert(module_global_idx < instance.module->globalsec.size());
+                assert(instance.module->globalsec[module_global_idx].is_mutable);
                 instance.globals[module_global_idx] = stack.pop();
             }
-            break;
+            DISPATCH();
         }
-        case Instr::i32_load:
+        TARGET(i32_load):
         {
             if (!load_from_memory<uint32_t>(*memory, stack, immediates))
             {
                 trap = true;
                 goto end;
             }
-            break;
+            DISPATCH();
         }
-        case Instr::i64_load:
+        TARGET(i64_load):
         {
             if (!load_from_memory<uint64_t>(*memory, stack, immediates))
             {
                 trap = true;
                 goto end;
             }
-            break;
+            DISPATCH();
         }
-        case Instr::i32_load8_s:
+        TARGET(i32_load8_s):
         {
             if (!load_from_memory<uint32_t, int8_t>(*memory, stack, immediates))
             {
                 trap = true;
                 goto end;
             }
-            break;
+            DISPATCH();
         }
-        case Instr::i32_load8_u:
+        TARGET(i32_load8_u):
         {
             if (!load_from_memory<uint32_t, uint8_t>(*memory, stack, immediates))
             {
                 trap = true;
                 goto end;
             }
-            break;
+            DISPATCH();
         }
-        case Instr::i32_load16_s:
+        TARGET(i32_load16_s):
         {
             if (!load_from_memory<uint32_t, int16_t>(*memory, stack, immediates))
             {
                 trap = true;
                 goto end;
             }
-            break;
+            DISPATCH();
         }
-        case Instr::i32_load16_u:
+        TARGET(i32_load16_u):
         {
             if (!load_from_memory<uint32_t, uint16_t>(*memory, stack, immediates))
             {
                 trap = true;
                 goto end;
             }
-            break;
+            DISPATCH();
         }
-        case Instr::i64_load8_s:
+        TARGET(i64_load8_s):
         {
             if (!load_from_memory<uint64_t, int8_t>(*memory, stack, immediates))
             {
                 trap = true;
                 goto end;
             }
-            break;
+            DISPATCH();
         }
-        case Instr::i64_load8_u:
+        TARGET(i64_load8_u):
         {
             if (!load_from_memory<uint64_t, uint8_t>(*memory, stack, immediates))
             {
                 trap = true;
                 goto end;
             }
-            break;
+            DISPATCH();
         }
-        case Instr::i64_load16_s:
+        TARGET(i64_load16_s):
         {
             if (!load_from_memory<uint64_t, int16_t>(*memory, stack, immediates))
             {
                 trap = true;
                 goto end;
             }
-            break;
+            DISPATCH();
         }
-        case Instr::i64_load16_u:
+        TARGET(i64_load16_u):
         {
             if (!load_from_memory<uint64_t, uint16_t>(*memory, stack, immediates))
             {
                 trap = true;
                 goto end;
             }
-            break;
+            DISPATCH();
         }
-        case Instr::i64_load32_s:
+        TARGET(i64_load32_s):
         {
             if (!load_from_memory<uint64_t, int32_t>(*memory, stack, immediates))
             {
                 trap = true;
                 goto end;
             }
-            break;
+            DISPATCH();
         }
-        case Instr::i64_load32_u:
+        TARGET(i64_load32_u):
         {
             if (!load_from_memory<uint64_t, uint32_t>(*memory, stack, immediates))
             {
                 trap = true;
                 goto end;
             }
-            break;
+            DISPATCH();
         }
-        case Instr::i32_store:
+        TARGET(i32_store):
         {
             if (!store_into_memory<uint32_t>(*memory, stack, immediates))
             {
                 trap = true;
                 goto end;
             }
-            break;
+            DISPATCH();
         }
-        case Instr::i64_store:
+        TARGET(i64_store):
         {
             if (!store_into_memory<uint64_t>(*memory, stack, immediates))
             {
                 trap = true;
                 goto end;
             }
-            break;
+            DISPATCH();
         }
-        case Instr::i32_store8:
-        case Instr::i64_store8:
+        TARGET(i32_store8):
+        TARGET(i64_store8):
         {
             if (!store_into_memory<uint8_t>(*memory, stack, immediates))
             {
                 trap = true;
                 goto end;
             }
-            break;
+            DISPATCH();
         }
-        case Instr::i32_store16:
-        case Instr::i64_store16:
+        TARGET(i32_store16):
+        TARGET(i64_store16):
         {
             if (!store_into_memory<uint16_t>(*memory, stack, immediates))
             {
                 trap = true;
                 goto end;
             }
-            break;
+            DISPATCH();
         }
-        case Instr::i64_store32:
+        TARGET(i64_store32):
         {
             if (!store_into_memory<uint32_t>(*memory, stack, immediates))
             {
                 trap = true;
                 goto end;
             }
-            break;
+            DISPATCH();
         }
-        case Instr::memory_size:
+        TARGET(memory_size):
         {
             stack.push(static_cast<uint32_t>(memory->size() / PageSize));
-            break;
+            DISPATCH();
         }
-        case Instr::memory_grow:
+        TARGET(memory_grow):
         {
-            const auto delta = static_cast<uint32_t>(stack.pop());
-            const auto cur_pages = memory->size() / PageSize;
-            assert(cur_pages <= size_t(std::numeric_limits<int32_t>::max()));
-            const auto new_pages = cur_pages + delta;
-            assert(new_pages >= cur_pages);
-            uint32_t ret = static_cast<uint32_t>(cur_pages);
-            try
-            {
-                if (new_pages > instance.memory_max_pages)
-                    throw std::bad_alloc();
-                memory->resize(new_pages * PageSize);
-            }
-            catch (std::bad_alloc const&)
-            {
-                ret = static_cast<uint32_t>(-1);
-            }
-            stack.push(ret);
-            break;
+            stack.push(grow_memory(instance, static_cast<uint32_t>(stack.pop())));
+            DISPATCH();
         }
-        case Instr::i32_const:
+        TARGET(i32_const):
         {
             const auto value = read<uint32_t>(immediates);
             stack.push(value);
-            break;
+            DISPATCH();
         }
-        case Instr::i64_const:
+        TARGET(i64_const):
         {
             const auto value = read<uint64_t>(immediates);
             stack.push(value);
-            break;
+            DISPATCH();
         }
-        case Instr::i32_eqz:
+        TARGET(i32_eqz):
         {
             const auto value = static_cast<uint32_t>(stack.pop());
             stack.push(value == 0);
-            break;
+            DISPATCH();
         }
-        case Instr::i32_eq:
+        TARGET(i32_eq):
         {
             comparison_op(stack, std::equal_to<uint32_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i32_ne:
+        TARGET(i32_ne):
         {
             comparison_op(stack, std::not_equal_to<uint32_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i32_lt_s:
+        TARGET(i32_lt_s):
         {
             comparison_op(stack, std::less<int32_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i32_lt_u:
+        TARGET(i32_lt_u):
         {
             comparison_op(stack, std::less<uint32_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i32_gt_s:
+        TARGET(i32_gt_s):
         {
             comparison_op(stack, std::greater<int32_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i32_gt_u:
+        TARGET(i32_gt_u):
         {
             comparison_op(stack, std::greater<uint32_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i32_le_s:
+        TARGET(i32_le_s):
         {
             comparison_op(stack, std::less_equal<int32_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i32_le_u:
+        TARGET(i32_le_u):
         {
             comparison_op(stack, std::less_equal<uint32_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i32_ge_s:
+        TARGET(i32_ge_s):
         {
             comparison_op(stack, std::greater_equal<int32_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i32_ge_u:
+        TARGET(i32_ge_u):
         {
             comparison_op(stack, std::greater_equal<uint32_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i64_eqz:
+        TARGET(i64_eqz):
         {
             stack.push(stack.pop() == 0);
-            break;
+            DISPATCH();
         }
-        case Instr::i64_eq:
+        TARGET(i64_eq):
         {
             comparison_op(stack, std::equal_to<uint64_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i64_ne:
+        TARGET(i64_ne):
         {
             comparison_op(stack, std::not_equal_to<uint64_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i64_lt_s:
+        TARGET(i64_lt_s):
         {
             comparison_op(stack, std::less<int64_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i64_lt_u:
+        TARGET(i64_lt_u):
         {
             comparison_op(stack, std::less<uint64_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i64_gt_s:
+        TARGET(i64_gt_s):
         {
             comparison_op(stack, std::greater<int64_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i64_gt_u:
+        TARGET(i64_gt_u):
         {
             comparison_op(stack, std::greater<uint64_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i64_le_s:
+        TARGET(i64_le_s):
         {
             comparison_op(stack, std::less_equal<int64_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i64_le_u:
+        TARGET(i64_le_u):
         {
             comparison_op(stack, std::less_equal<uint64_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i64_ge_s:
+        TARGET(i64_ge_s):
         {
             comparison_op(stack, std::greater_equal<int64_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i64_ge_u:
+        TARGET(i64_ge_u):
         {
             comparison_op(stack, std::greater_equal<uint64_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i32_clz:
+        TARGET(i32_clz):
         {
             unary_op(stack, clz32);
-            break;
+            DISPATCH();
         }
-        case Instr::i32_ctz:
+        TARGET(i32_ctz):
         {
             unary_op(stack, ctz32);
-            break;
+            DISPATCH();
         }
-        case Instr::i32_popcnt:
+        TARGET(i32_popcnt):
         {
             unary_op(stack, popcnt32);
-            break;
+            DISPATCH();
         }
-        case Instr::i32_add:
+        TARGET(i32_add):
         {
             binary_op(stack, std::plus<uint32_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i32_sub:
+        TARGET(i32_sub):
         {
             binary_op(stack, std::minus<uint32_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i32_mul:
+        TARGET(i32_mul):
         {
             binary_op(stack, std::multiplies<uint32_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i32_div_s:
+        TARGET(i32_div_s):
         {
             auto const rhs = static_cast<int32_t>(stack.peek(0));
             auto const lhs = static_cast<int32_t>(stack.peek(1));
@@ -1256,9 +1825,9 @@ execution_result execute(
                 goto end;
             }
             binary_op(stack, std::divides<int32_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i32_div_u:
+        TARGET(i32_div_u):
         {
             auto const rhs = static_cast<uint32_t>(stack.peek());
             if (rhs == 0)
@@ -1267,9 +1836,9 @@ execution_result execute(
                 goto end;
             }
             binary_op(stack, std::divides<uint32_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i32_rem_s:
+        TARGET(i32_rem_s):
         {
             auto const rhs = static_cast<int32_t>(stack.peek());
             if (rhs == 0)
@@ -1285,9 +1854,9 @@ execution_result execute(
             }
             else
                 binary_op(stack, std::modulus<int32_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i32_rem_u:
+        TARGET(i32_rem_u):
         {
             auto const rhs = static_cast<uint32_t>(stack.peek());
             if (rhs == 0)
@@ -1296,79 +1865,79 @@ execution_result execute(
                 goto end;
             }
             binary_op(stack, std::modulus<uint32_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i32_and:
+        TARGET(i32_and):
         {
             binary_op(stack, std::bit_and<uint32_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i32_or:
+        TARGET(i32_or):
         {
             binary_op(stack, std::bit_or<uint32_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i32_xor:
+        TARGET(i32_xor):
         {
             binary_op(stack, std::bit_xor<uint32_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i32_shl:
+        TARGET(i32_shl):
         {
             binary_op(stack, shift_left<uint32_t>);
-            break;
+            DISPATCH();
         }
-        case Instr::i32_shr_s:
+        TARGET(i32_shr_s):
         {
             binary_op(stack, shift_right<int32_t>);
-            break;
+            DISPATCH();
         }
-        case Instr::i32_shr_u:
+        TARGET(i32_shr_u):
         {
             binary_op(stack, shift_right<uint32_t>);
-            break;
+            DISPATCH();
         }
-        case Instr::i32_rotl:
+        TARGET(i32_rotl):
         {
             binary_op(stack, rotl<uint32_t>);
-            break;
+            DISPATCH();
         }
-        case Instr::i32_rotr:
+        TARGET(i32_rotr):
         {
             binary_op(stack, rotr<uint32_t>);
-            break;
+            DISPATCH();
         }
-        case Instr::i64_clz:
+        TARGET(i64_clz):
         {
             unary_op(stack, clz64);
-            break;
+            DISPATCH();
         }
-        case Instr::i64_ctz:
+        TARGET(i64_ctz):
         {
             unary_op(stack, ctz64);
-            break;
+            DISPATCH();
         }
-        case Instr::i64_popcnt:
+        TARGET(i64_popcnt):
         {
             unary_op(stack, popcnt64);
-            break;
+            DISPATCH();
         }
-        case Instr::i64_add:
+        TARGET(i64_add):
         {
             binary_op(stack, std::plus<uint64_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i64_sub:
+        TARGET(i64_sub):
         {
             binary_op(stack, std::minus<uint64_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i64_mul:
+        TARGET(i64_mul):
         {
             binary_op(stack, std::multiplies<uint64_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i64_div_s:
+        TARGET(i64_div_s):
         {
             auto const rhs = static_cast<int64_t>(stack.peek(0));
             auto const lhs = static_cast<int64_t>(stack.peek(1));
@@ -1378,9 +1947,9 @@ execution_result execute(
                 goto end;
             }
             binary_op(stack, std::divides<int64_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i64_div_u:
+        TARGET(i64_div_u):
         {
             auto const rhs = static_cast<uint64_t>(stack.peek());
             if (rhs == 0)
@@ -1389,9 +1958,9 @@ execution_result execute(
                 goto end;
             }
             binary_op(stack, std::divides<uint64_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i64_rem_s:
+        TARGET(i64_rem_s):
         {
             auto const rhs = static_cast<int64_t>(stack.peek());
             if (rhs == 0)
@@ -1407,9 +1976,9 @@ execution_result execute(
             }
             else
                 binary_op(stack, std::modulus<int64_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i64_rem_u:
+        TARGET(i64_rem_u):
         {
             auto const rhs = static_cast<uint64_t>(stack.peek());
             if (rhs == 0)
@@ -1418,143 +1987,1715 @@ execution_result execute(
                 goto end;
             }
             binary_op(stack, std::modulus<uint64_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i64_and:
+        TARGET(i64_and):
         {
             binary_op(stack, std::bit_and<uint64_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i64_or:
+        TARGET(i64_or):
         {
             binary_op(stack, std::bit_or<uint64_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i64_xor:
+        TARGET(i64_xor):
         {
             binary_op(stack, std::bit_xor<uint64_t>());
-            break;
+            DISPATCH();
         }
-        case Instr::i64_shl:
+        TARGET(i64_shl):
         {
             binary_op(stack, shift_left<uint64_t>);
-            break;
+            DISPATCH();
         }
-        case Instr::i64_shr_s:
+        TARGET(i64_shr_s):
         {
             binary_op(stack, shift_right<int64_t>);
-            break;
+            DISPATCH();
         }
-        case Instr::i64_shr_u:
+        TARGET(i64_shr_u):
         {
             binary_op(stack, shift_right<uint64_t>);
-            break;
+            DISPATCH();
         }
-        case Instr::i64_rotl:
+        TARGET(i64_rotl):
         {
             binary_op(stack, rotl<uint64_t>);
-            break;
+            DISPATCH();
         }
-        case Instr::i64_rotr:
+        TARGET(i64_rotr):
         {
             binary_op(stack, rotr<uint64_t>);
-            break;
+            DISPATCH();
         }
-        case Instr::i32_wrap_i64:
+        TARGET(i32_wrap_i64):
         {
             stack.push(static_cast<uint32_t>(stack.pop()));
-            break;
+            DISPATCH();
         }
-        case Instr::i64_extend_i32_s:
+        TARGET(i64_extend_i32_s):
         {
             const auto value = static_cast<int32_t>(stack.pop());
             stack.push(static_cast<uint64_t>(int64_t{value}));
-            break;
+            DISPATCH();
         }
-        case Instr::i64_extend_i32_u:
+        TARGET(i64_extend_i32_u):
         {
             // effectively no-op
-            break;
-        }
-        case Instr::f32_load:
-        case Instr::f64_load:
-        case Instr::f32_store:
-        case Instr::f64_store:
-        case Instr::f32_const:
-        case Instr::f64_const:
-        case Instr::f32_eq:
-        case Instr::f32_ne:
-        case Instr::f32_lt:
-        case Instr::f32_gt:
-        case Instr::f32_le:
-        case Instr::f32_ge:
-        case Instr::f64_eq:
-        case Instr::f64_ne:
-        case Instr::f64_lt:
-        case Instr::f64_gt:
-        case Instr::f64_le:
-        case Instr::f64_ge:
-        case Instr::f32_abs:
-        case Instr::f32_neg:
-        case Instr::f32_ceil:
-        case Instr::f32_floor:
-        case Instr::f32_trunc:
-        case Instr::f32_nearest:
-        case Instr::f32_sqrt:
-        case Instr::f32_add:
-        case Instr::f32_sub:
-        case Instr::f32_mul:
-        case Instr::f32_div:
-        case Instr::f32_min:
-        case Instr::f32_max:
-        case Instr::f32_copysign:
-        case Instr::f64_abs:
-        case Instr::f64_neg:
-        case Instr::f64_ceil:
-        case Instr::f64_floor:
-        case Instr::f64_trunc:
-        case Instr::f64_nearest:
-        case Instr::f64_sqrt:
-        case Instr::f64_add:
-        case Instr::f64_sub:
-        case Instr::f64_mul:
-        case Instr::f64_div:
-        case Instr::f64_min:
-        case Instr::f64_max:
-        case Instr::f64_copysign:
-        case Instr::i32_trunc_f32_s:
-        case Instr::i32_trunc_f32_u:
-        case Instr::i32_trunc_f64_s:
-        case Instr::i32_trunc_f64_u:
-        case Instr::i64_trunc_f32_s:
-        case Instr::i64_trunc_f32_u:
-        case Instr::i64_trunc_f64_s:
-        case Instr::i64_trunc_f64_u:
-        case Instr::f32_convert_i32_s:
-        case Instr::f32_convert_i32_u:
-        case Instr::f32_convert_i64_s:
-        case Instr::f32_convert_i64_u:
-        case Instr::f32_demote_f64:
-        case Instr::f64_convert_i32_s:
-        case Instr::f64_convert_i32_u:
-        case Instr::f64_convert_i64_s:
-        case Instr::f64_convert_i64_u:
-        case Instr::f64_promote_f32:
-        case Instr::i32_reinterpret_f32:
-        case Instr::i64_reinterpret_f64:
-        case Instr::f32_reinterpret_i32:
-        case Instr::f64_reinterpret_i64:
+            DISPATCH();
+        }
+        TARGET(f32_load):
+        TARGET(f64_load):
+        TARGET(f32_store):
+        TARGET(f64_store):
+        TARGET(f32_const):
+        TARGET(f64_const):
+        TARGET(f32_eq):
+        TARGET(f32_ne):
+        TARGET(f32_lt):
+        TARGET(f32_gt):
+        TARGET(f32_le):
+        TARGET(f32_ge):
+        TARGET(f64_eq):
+        TARGET(f64_ne):
+        TARGET(f64_lt):
+        TARGET(f64_gt):
+        TARGET(f64_le):
+        TARGET(f64_ge):
+        TARGET(f32_abs):
+        TARGET(f32_neg):
+        TARGET(f32_ceil):
+        TARGET(f32_floor):
+        TARGET(f32_trunc):
+        TARGET(f32_nearest):
+        TARGET(f32_sqrt):
+        TARGET(f32_add):
+        TARGET(f32_sub):
+        TARGET(f32_mul):
+        TARGET(f32_div):
+        TARGET(f32_min):
+        TARGET(f32_max):
+        TARGET(f32_copysign):
+        TARGET(f64_abs):
+        TARGET(f64_neg):
+        TARGET(f64_ceil):
+        TARGET(f64_floor):
+        TARGET(f64_trunc):
+        TARGET(f64_nearest):
+        TARGET(f64_sqrt):
+        TARGET(f64_add):
+        TARGET(f64_sub):
+        TARGET(f64_mul):
+        TARGET(f64_div):
+        TARGET(f64_min):
+        TARGET(f64_max):
+        TARGET(f64_copysign):
+        TARGET(i32_trunc_f32_s):
+        TARGET(i32_trunc_f32_u):
+        TARGET(i32_trunc_f64_s):
+        TARGET(i32_trunc_f64_u):
+        TARGET(i64_trunc_f32_s):
+        TARGET(i64_trunc_f32_u):
+        TARGET(i64_trunc_f64_s):
+        TARGET(i64_trunc_f64_u):
+        TARGET(f32_convert_i32_s):
+        TARGET(f32_convert_i32_u):
+        TARGET(f32_convert_i64_s):
+        TARGET(f32_convert_i64_u):
+        TARGET(f32_demote_f64):
+        TARGET(f64_convert_i32_s):
+        TARGET(f64_convert_i32_u):
+        TARGET(f64_convert_i64_s):
+        TARGET(f64_convert_i64_u):
+        TARGET(f64_promote_f32):
+        TARGET(i32_reinterpret_f32):
+        TARGET(i64_reinterpret_f64):
+        TARGET(f32_reinterpret_i32):
+        TARGET(f64_reinterpret_i64):
             throw unsupported_feature("Floating point instruction.");
-        default:
+        TARGET(local_get_local_get_i32_add):
+        {
+            const auto idx1 = read<uint32_t>(immediates);
+            const auto idx2 = read<uint32_t>(immediates);
+            assert(&locals[idx1] < stack.bottom() && &locals[idx2] < stack.bottom());
+            stack.push(static_cast<uint32_t>(locals[idx1]) + static_cast<uint32_t>(locals[idx2]));
+            pc += 2;  // Skip the fused instructions.
+            DISPATCH();
+        }
+        TARGET(local_get_i32_const_i32_add_local_set):
+        {
+            const auto src_idx = read<uint32_t>(immediates);
+            const auto value = read<uint32_t>(immediates);
+            const auto dst_idx = read<uint32_t>(immediates);
+            assert(&locals[src_idx] < stack.bottom() && &locals[dst_idx] < stack.bottom());
+            locals[dst_idx] = static_cast<uint32_t>(static_cast<uint32_t>(locals[src_idx]) + value);
+            pc += 3;  // Skip the fused instructions.
+            DISPATCH();
+        }
+        TARGET(local_get_i32_load):
+        {
+            const auto idx = read<uint32_t>(immediates);
+            assert(&locals[idx] < stack.bottom());
+            stack.push(locals[idx]);
+            if (!load_from_memory<uint32_t>(*memory, stack, immediates))
+            {
+                trap = true;
+                goto end;
+            }
+            pc += 1;  // Skip the fused instruction.
+            DISPATCH();
+        }
+        TARGET(i32_eqz_br_if):
+        {
+            pc += 1;  // Skip the fused instruction.
+            if (static_cast<uint32_t>(stack.pop()) == 0)
+            {
+                if (!branch(instance, *code, stack, pc, immediates))
+                {
+                    trap = true;
+                    goto end;
+                }
+            }
+            else
+                immediates += BranchImmediateSize;
+            DISPATCH();
+        }
+#if FIZZY_METERING
+        TARGET(meter):
+        {
+            instance.gas_left -= read<int64_t>(immediates);
+            if (instance.gas_left < 0)
+            {
+                trap = true;
+                goto end;
+            }
+            DISPATCH();
+        }
+#endif
+
+        TARGET_INVALID:
             assert(false);
-            break;
+            DISPATCH();
+
+        call_function:
+        {
+            if (called_func_idx < instance.imported_functions.size())
+            {
+                if (!invoke_imported_function(
+                        instance, called_func_idx, stack, reinterpret_cast<uint64_t*>(frames)))
+                {
+                    trap = true;
+                    goto end;
+                }
+                DISPATCH();
+            }
+
+            if (interrupt_requested(instance))
+            {
+                trap = true;
+                goto end;
+            }
+
+            const auto called_code_idx = called_func_idx - instance.imported_functions.size();
+            const auto& called_code = get_code(*instance.module, called_code_idx);
+            const auto& called_func_type = function_type(instance, called_func_idx);
+
+            // The arguments on the operand stack become the first locals of the called function.
+            const auto num_args = called_func_type.inputs.size();
+            assert(stack.size() >= num_args);
+            auto* const called_locals = stack.end() - num_args;
+            const auto num_locals = num_args + called_code.local_count;
+
+            if (!have_frame_space(
+                    called_locals, num_locals, called_code, reinterpret_cast<uint64_t*>(frames)))
+            {
+                trap = true;
+                goto end;
+            }
+
+            new (--frames)
+                Frame{code, pc, immediates, locals, stack.bottom(), func_arity};
+#if FIZZY_COMPUTED_GOTO
+            frames->handlers = handlers;
+            handlers =
+                get_handlers(threaded_functions[called_code_idx], called_code, dispatch_table);
+            instructions_begin = called_code.instructions.data();
+#endif
+
+            std::fill_n(called_locals + num_args, called_code.local_count, 0);
+
+            code = &called_code;
+            pc = code->instructions.data();
+            immediates = code->immediates.data();
+            locals = called_locals;
+            stack = OperandStack{called_locals + num_locals};
+            func_arity = called_func_type.outputs.size();
+            DISPATCH();
+        }
         }
     }
 
 end:
-    assert(labels.empty() || trap);
-    // move allows to return derived Stack<uint64_t> instance into base vector<uint64_t> value
-    return {trap, std::move(stack)};
+    if (trap)
+        return {true, {}};
+
+    // NOTE: we can assume this from validation
+    assert(stack.size() <= 1);
+    if (stack.empty())
+        return {false, {}};
+    return {false, true, stack.peek()};
+}
+#if FIZZY_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
+
+/// The call frame of the register-based execution: the state of the calling function.
+struct RegisterFrame
+{
+    const RegisterCode* code = nullptr;
+    const uint32_t* pc = nullptr;
+    uint64_t* regs = nullptr;
+};
+static_assert(sizeof(RegisterFrame) % sizeof(uint64_t) == 0);
+static_assert(alignof(RegisterFrame) <= alignof(uint64_t));
+
+/// The number of the execution stack values a RegisterFrame occupies.
+constexpr size_t RegisterFrameSize = sizeof(RegisterFrame) / sizeof(uint64_t);
+
+/// Checks if the execution stack has space for a function's register frame and the call frame
+/// record.
+inline bool have_register_frame_space(
+    const uint64_t* regs, const RegisterCode& code, const uint64_t* frames_begin) noexcept
+{
+    const auto available = frames_begin - regs;
+    return available >= 0 &&
+           static_cast<size_t>(available) >= code.frame_size + RegisterFrameSize;
+}
+
+/// Initializes the register frame of a function, which has the arguments in place already.
+inline void init_register_frame(uint64_t* regs, const RegisterCode& code) noexcept
+{
+    std::fill_n(regs + code.num_args, code.num_locals - code.num_args, 0);
+    std::copy(code.constants.begin(), code.constants.end(), regs + code.num_locals);
+}
+
+template <typename Op>
+inline void register_unary_op(uint64_t* regs, const uint32_t* pc, Op op) noexcept
+{
+    using T = decltype(op(regs[0]));
+    regs[pc[1]] = op(static_cast<T>(regs[pc[2]]));
+}
+
+template <typename Op>
+inline void register_binary_op(uint64_t* regs, const uint32_t* pc, Op op) noexcept
+{
+    using T = decltype(op(regs[0], regs[0]));
+    const auto a = static_cast<T>(regs[pc[2]]);
+    const auto b = static_cast<T>(regs[pc[3]]);
+    regs[pc[1]] = static_cast<std::make_unsigned_t<T>>(op(a, b));
+}
+
+template <typename T, template <typename> class Op>
+inline void register_comparison_op(uint64_t* regs, const uint32_t* pc, Op<T> op) noexcept
+{
+    const auto a = static_cast<T>(regs[pc[2]]);
+    const auto b = static_cast<T>(regs[pc[3]]);
+    regs[pc[1]] = uint32_t{op(a, b)};
+}
+
+template <typename DstT, typename SrcT = DstT>
+inline bool register_load(const LinearMemory& memory, uint64_t* regs, const uint32_t* pc) noexcept
+{
+    const auto address = static_cast<uint32_t>(regs[pc[2]]);
+    // NOTE: alignment is dropped by the parser
+    const auto offset = pc[3];
+    // Addressing is 32-bit, but we keep the value as 64-bit to detect overflows.
+    const auto effective_address = uint64_t{address} + offset;
+#if !FIZZY_GUARD_PAGES
+    if (effective_address + sizeof(SrcT) > memory.size())
+        return false;
+#endif
+    regs[pc[1]] = extend<DstT>(load<SrcT>(memory, effective_address));
+    return true;
+}
+
+template <typename T>
+inline bool register_store(LinearMemory& memory, const uint64_t* regs, const uint32_t* pc) noexcept
+{
+    const auto address = static_cast<uint32_t>(regs[pc[1]]);
+    const auto value = static_cast<T>(regs[pc[2]]);
+    const auto offset = pc[3];
+    const auto effective_address = uint64_t{address} + offset;
+#if !FIZZY_GUARD_PAGES
+    if (effective_address + sizeof(value) > memory.size())
+        return false;
+#endif
+    store(memory, effective_address, value);
+    return true;
+}
+
+/// Executes the wasm function (not imported) with the register-based code, on the instance's
+/// execution stack. The frame of a function is its slots, see RegisterCode. The frame of the
+/// called function starts at the slot of its first argument in the caller's frame.
+///
+/// NOTE: In the FIZZY_GUARD_PAGES mode the execution can be abandoned with siglongjmp() at
+/// any memory instruction, therefore no objects with non-trivial destructors may be alive here.
+ExecutionResult execute_function_register(
+    Instance& instance, FuncIdx func_idx, span<const uint64_t> args)
+{
+    const auto num_imported_functions = instance.imported_functions.size();
+    const auto code_idx = func_idx - num_imported_functions;
+    const auto& functions = instance.register_module->functions;
+    assert(code_idx < functions.size());
+
+    auto* const memory = instance.memory.get();
+
+    auto& execution_stack = instance.execution_stack;
+    auto* const frames_end = reinterpret_cast<RegisterFrame*>(execution_stack.frames_begin);
+    RegisterFrame* frames = frames_end;
+
+    const RegisterCode* code = &functions[code_idx];
+    uint64_t* regs = execution_stack.values_end;
+
+    if (!have_register_frame_space(regs, *code, reinterpret_cast<uint64_t*>(frames)))
+        return {true, {}};
+
+    assert(args.size() == code->num_args);
+    std::copy(args.begin(), args.end(), regs);
+    init_register_frame(regs, *code);
+
+    // The function called with call or call_indirect instruction and its arguments.
+    FuncIdx called_func_idx = 0;
+    uint64_t* called_args = nullptr;
+
+    // The target of the branch taken.
+    const uint32_t* target = nullptr;
+
+    bool trap = false;
+    bool have_result = false;
+    uint64_t result = 0;
+
+    const uint32_t* pc = code->instructions.data();
+
+#if FIZZY_COMPUTED_GOTO
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+    // The table of handler addresses indexed by the RegisterOp.
+    static const void* const register_dispatch_table[] = {
+        &&register_target_unreachable,
+        &&register_target_unsupported,
+        &&register_target_br,
+        &&register_target_br_if,
+        &&register_target_br_eqz,
+        &&register_target_br_table,
+        &&register_target_call,
+        &&register_target_call_indirect,
+        &&register_target_ret,
+        &&register_target_ret_void,
+        &&register_target_copy,
+        &&register_target_select,
+        &&register_target_global_get,
+        &&register_target_global_set,
+        &&register_target_i32_load,
+        &&register_target_i64_load,
+        &&register_target_i32_load8_s,
+        &&register_target_i32_load8_u,
+        &&register_target_i32_load16_s,
+        &&register_target_i32_load16_u,
+        &&register_target_i64_load8_s,
+        &&register_target_i64_load16_s,
+        &&register_target_i64_load32_s,
+        &&register_target_store8,
+        &&register_target_store16,
+        &&register_target_store32,
+        &&register_target_store64,
+        &&register_target_memory_size,
+        &&register_target_memory_grow,
+        &&register_target_i32_eqz,
+        &&register_target_i32_clz,
+        &&register_target_i32_ctz,
+        &&register_target_i32_popcnt,
+        &&register_target_i64_eqz,
+        &&register_target_i64_clz,
+        &&register_target_i64_ctz,
+        &&register_target_i64_popcnt,
+        &&register_target_i32_wrap_i64,
+        &&register_target_i64_extend_i32_s,
+        &&register_target_i32_eq,
+        &&register_target_i32_ne,
+        &&register_target_i32_lt_s,
+        &&register_target_i32_lt_u,
+        &&register_target_i32_gt_s,
+        &&register_target_i32_gt_u,
+        &&register_target_i32_le_s,
+        &&register_target_i32_le_u,
+        &&register_target_i32_ge_s,
+        &&register_target_i32_ge_u,
+        &&register_target_i32_add,
+        &&register_target_i32_sub,
+        &&register_target_i32_mul,
+        &&register_target_i32_div_s,
+        &&register_target_i32_div_u,
+        &&register_target_i32_rem_s,
+        &&register_target_i32_rem_u,
+        &&register_target_i32_and,
+        &&register_target_i32_or,
+        &&register_target_i32_xor,
+        &&register_target_i32_shl,
+        &&register_target_i32_shr_s,
+        &&register_target_i32_shr_u,
+        &&register_target_i32_rotl,
+        &&register_target_i32_rotr,
+        &&register_target_i64_eq,
+        &&register_target_i64_ne,
+        &&register_target_i64_lt_s,
+        &&register_target_i64_lt_u,
+        &&register_target_i64_gt_s,
+        &&register_target_i64_gt_u,
+        &&register_target_i64_le_s,
+        &&register_target_i64_le_u,
+        &&register_target_i64_ge_s,
+        &&register_target_i64_ge_u,
+        &&register_target_i64_add,
+        &&register_target_i64_sub,
+        &&register_target_i64_mul,
+        &&register_target_i64_div_s,
+        &&register_target_i64_div_u,
+        &&register_target_i64_rem_s,
+        &&register_target_i64_rem_u,
+        &&register_target_i64_and,
+        &&register_target_i64_or,
+        &&register_target_i64_xor,
+        &&register_target_i64_shl,
+        &&register_target_i64_shr_s,
+        &&register_target_i64_shr_u,
+        &&register_target_i64_rotl,
+        &&register_target_i64_rotr,    };
+    static_assert(std::size(register_dispatch_table) == NumRegisterOps);
+#endif
+
+    while (true)
+    {
+        switch (static_cast<RegisterOp>(*pc))
+        {
+        REGISTER_TARGET(unreachable):
+        {
+            trap = true;
+            goto register_end;
+        }
+        REGISTER_TARGET(unsupported):
+            throw unsupported_feature("Floating point instruction.");
+        REGISTER_TARGET(br):
+        {
+            target = code->instructions.data() + pc[1];
+            goto register_branch;
+        }
+        REGISTER_TARGET(br_if):
+        {
+            if (static_cast<uint32_t>(regs[pc[1]]) != 0)
+            {
+                target = code->instructions.data() + pc[2];
+                goto register_branch;
+            }
+            pc += 3;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(br_eqz):
+        {
+            if (static_cast<uint32_t>(regs[pc[1]]) == 0)
+            {
+                target = code->instructions.data() + pc[2];
+                goto register_branch;
+            }
+            pc += 3;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(br_table):
+        {
+            const auto br_table_idx = regs[pc[1]];
+            const auto br_table_size = pc[2];
+            const auto target_idx = br_table_idx < br_table_size ? br_table_idx : br_table_size;
+            target = code->instructions.data() + pc[3 + target_idx];
+            goto register_branch;
+        }
+        REGISTER_TARGET(call):
+        {
+            called_func_idx = pc[1];
+            called_args = regs + pc[2];
+            pc += 3;
+            goto register_call_function;
+        }
+        REGISTER_TARGET(call_indirect):
+        {
+            assert(instance.table != nullptr);
+
+            const auto expected_type_idx = pc[1];
+            assert(expected_type_idx < instance.module->typesec.size());
+
+            const auto elem_idx = regs[pc[2]];
+            if (elem_idx >= instance.table->size())
+            {
+                trap = true;
+                goto register_end;
+            }
+
+            const auto elem = (*instance.table)[elem_idx];
+            if (!elem.has_value())
+            {
+                trap = true;
+                goto register_end;
+            }
+
+            // check actual type against expected type
+            const auto& actual_type = function_type(instance, *elem);
+            const auto& expected_type = instance.module->typesec[expected_type_idx];
+            if (expected_type != actual_type)
+            {
+                trap = true;
+                goto register_end;
+            }
+
+            called_func_idx = *elem;
+            called_args = regs + pc[3];
+            pc += 4;
+            goto register_call_function;
+        }
+        REGISTER_TARGET(ret):
+        {
+            if (frames == frames_end)
+            {
+                have_result = true;
+                result = regs[pc[1]];
+                goto register_end;
+            }
+
+            // The result replaces the first argument in the caller's frame.
+            regs[0] = regs[pc[1]];
+
+            const auto& caller = *frames++;
+            code = caller.code;
+            pc = caller.pc;
+            regs = caller.regs;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(ret_void):
+        {
+            if (frames == frames_end)
+                goto register_end;
+
+            const auto& caller = *frames++;
+            code = caller.code;
+            pc = caller.pc;
+            regs = caller.regs;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(copy):
+        {
+            regs[pc[1]] = regs[pc[2]];
+            pc += 3;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(select):
+        {
+            const auto condition = static_cast<uint32_t>(regs[pc[4]]);
+            regs[pc[1]] = condition != 0 ? regs[pc[2]] : regs[pc[3]];
+            pc += 5;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(global_get):
+        {
+            const auto idx = pc[2];
+            assert(idx < instance.imported_globals.size() + instance.globals.size());
+            if (idx < instance.imported_globals.size())
+                regs[pc[1]] = *instance.imported_globals[idx].value;
+            else
+                regs[pc[1]] = instance.globals[idx - instance.imported_globals.size()];
+            pc += 3;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(global_set):
+        {
+            const auto idx = pc[1];
+            if (idx < instance.imported_globals.size())
+            {
+                assert(instance.imported_globals[idx].is_mutable);
+                *instance.imported_globals[idx].value = regs[pc[2]];
+            }
+            else
+            {
+                const auto module_global_idx = idx - instance.imported_globals.size();
+                assert(module_global_idx < instance.module->globalsec.size());
+                assert(instance.module->globalsec[module_global_idx].is_mutable);
+                instance.globals[module_global_idx] = regs[pc[2]];
+            }
+            pc += 3;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i32_load):
+        {
+            if (!register_load<uint32_t>(*memory, regs, pc))
+            {
+                trap = true;
+                goto register_end;
+            }
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i64_load):
+        {
+            if (!register_load<uint64_t>(*memory, regs, pc))
+            {
+                trap = true;
+                goto register_end;
+            }
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i32_load8_s):
+        {
+            if (!register_load<uint32_t, int8_t>(*memory, regs, pc))
+            {
+                trap = true;
+                goto register_end;
+            }
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i32_load8_u):
+        {
+            if (!register_load<uint32_t, uint8_t>(*memory, regs, pc))
+            {
+                trap = true;
+                goto register_end;
+            }
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i32_load16_s):
+        {
+            if (!register_load<uint32_t, int16_t>(*memory, regs, pc))
+            {
+                trap = true;
+                goto register_end;
+            }
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i32_load16_u):
+        {
+            if (!register_load<uint32_t, uint16_t>(*memory, regs, pc))
+            {
+                trap = true;
+                goto register_end;
+            }
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i64_load8_s):
+        {
+            if (!register_load<uint64_t, int8_t>(*memory, regs, pc))
+            {
+                trap = true;
+                goto register_end;
+            }
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i64_load16_s):
+        {
+            if (!register_load<uint64_t, int16_t>(*memory, regs, pc))
+            {
+                trap = true;
+                goto register_end;
+            }
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i64_load32_s):
+        {
+            if (!register_load<uint64_t, int32_t>(*memory, regs, pc))
+            {
+                trap = true;
+                goto register_end;
+            }
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(store8):
+        {
+            if (!register_store<uint8_t>(*memory, regs, pc))
+            {
+                trap = true;
+                goto register_end;
+            }
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(store16):
+        {
+            if (!register_store<uint16_t>(*memory, regs, pc))
+            {
+                trap = true;
+                goto register_end;
+            }
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(store32):
+        {
+            if (!register_store<uint32_t>(*memory, regs, pc))
+            {
+                trap = true;
+                goto register_end;
+            }
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(store64):
+        {
+            if (!register_store<uint64_t>(*memory, regs, pc))
+            {
+                trap = true;
+                goto register_end;
+            }
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(memory_size):
+        {
+            regs[pc[1]] = static_cast<uint32_t>(memory->size() / PageSize);
+            pc += 2;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(memory_grow):
+        {
+            regs[pc[1]] = grow_memory(instance, static_cast<uint32_t>(regs[pc[2]]));
+            pc += 3;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i32_eqz):
+        {
+            regs[pc[1]] = uint32_t{static_cast<uint32_t>(regs[pc[2]]) == 0};
+            pc += 3;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i32_clz):
+        {
+            register_unary_op(regs, pc, clz32);
+            pc += 3;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i32_ctz):
+        {
+            register_unary_op(regs, pc, ctz32);
+            pc += 3;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i32_popcnt):
+        {
+            register_unary_op(regs, pc, popcnt32);
+            pc += 3;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i64_eqz):
+        {
+            regs[pc[1]] = uint32_t{regs[pc[2]] == 0};
+            pc += 3;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i64_clz):
+        {
+            register_unary_op(regs, pc, clz64);
+            pc += 3;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i64_ctz):
+        {
+            register_unary_op(regs, pc, ctz64);
+            pc += 3;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i64_popcnt):
+        {
+            register_unary_op(regs, pc, popcnt64);
+            pc += 3;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i32_wrap_i64):
+        {
+            regs[pc[1]] = static_cast<uint32_t>(regs[pc[2]]);
+            pc += 3;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i64_extend_i32_s):
+        {
+            regs[pc[1]] = static_cast<uint64_t>(int64_t{static_cast<int32_t>(regs[pc[2]])});
+            pc += 3;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i32_eq):
+        {
+            register_comparison_op(regs, pc, std::equal_to<uint32_t>());
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i32_ne):
+        {
+            register_comparison_op(regs, pc, std::not_equal_to<uint32_t>());
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i32_lt_s):
+        {
+            register_comparison_op(regs, pc, std::less<int32_t>());
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i32_lt_u):
+        {
+            register_comparison_op(regs, pc, std::less<uint32_t>());
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i32_gt_s):
+        {
+            register_comparison_op(regs, pc, std::greater<int32_t>());
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i32_gt_u):
+        {
+            register_comparison_op(regs, pc, std::greater<uint32_t>());
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i32_le_s):
+        {
+            register_comparison_op(regs, pc, std::less_equal<int32_t>());
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i32_le_u):
+        {
+            register_comparison_op(regs, pc, std::less_equal<uint32_t>());
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i32_ge_s):
+        {
+            register_comparison_op(regs, pc, std::greater_equal<int32_t>());
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i32_ge_u):
+        {
+            register_comparison_op(regs, pc, std::greater_equal<uint32_t>());
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i32_add):
+        {
+            register_binary_op(regs, pc, std::plus<uint32_t>());
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i32_sub):
+        {
+            register_binary_op(regs, pc, std::minus<uint32_t>());
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i32_mul):
+        {
+            register_binary_op(regs, pc, std::multiplies<uint32_t>());
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i32_div_s):
+        {
+            const auto rhs = static_cast<int32_t>(regs[pc[3]]);
+            const auto lhs = static_cast<int32_t>(regs[pc[2]]);
+            if (rhs == 0 || (lhs == std::numeric_limits<int32_t>::min() && rhs == -1))
+            {
+                trap = true;
+                goto register_end;
+            }
+            regs[pc[1]] = static_cast<uint32_t>(lhs / rhs);
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i32_div_u):
+        {
+            const auto rhs = static_cast<uint32_t>(regs[pc[3]]);
+            if (rhs == 0)
+            {
+                trap = true;
+                goto register_end;
+            }
+            regs[pc[1]] = static_cast<uint32_t>(regs[pc[2]]) / rhs;
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i32_rem_s):
+        {
+            const auto rhs = static_cast<int32_t>(regs[pc[3]]);
+            if (rhs == 0)
+            {
+                trap = true;
+                goto register_end;
+            }
+            const auto lhs = static_cast<int32_t>(regs[pc[2]]);
+            // The remainder of min / -1 is 0, but the division overflows in C++.
+            regs[pc[1]] = rhs == -1 ? 0 : static_cast<uint32_t>(lhs % rhs);
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i32_rem_u):
+        {
+            const auto rhs = static_cast<uint32_t>(regs[pc[3]]);
+            if (rhs == 0)
+            {
+                trap = true;
+                goto register_end;
+            }
+            regs[pc[1]] = static_cast<uint32_t>(regs[pc[2]]) % rhs;
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i32_and):
+        {
+            register_binary_op(regs, pc, std::bit_and<uint32_t>());
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i32_or):
+        {
+            register_binary_op(regs, pc, std::bit_or<uint32_t>());
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i32_xor):
+        {
+            register_binary_op(regs, pc, std::bit_xor<uint32_t>());
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i32_shl):
+        {
+            register_binary_op(regs, pc, shift_left<uint32_t>);
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i32_shr_s):
+        {
+            register_binary_op(regs, pc, shift_right<int32_t>);
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i32_shr_u):
+        {
+            register_binary_op(regs, pc, shift_right<uint32_t>);
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i32_rotl):
+        {
+            register_binary_op(regs, pc, rotl<uint32_t>);
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i32_rotr):
+        {
+            register_binary_op(regs, pc, rotr<uint32_t>);
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i64_eq):
+        {
+            register_comparison_op(regs, pc, std::equal_to<uint64_t>());
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i64_ne):
+        {
+            register_comparison_op(regs, pc, std::not_equal_to<uint64_t>());
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i64_lt_s):
+        {
+            register_comparison_op(regs, pc, std::less<int64_t>());
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i64_lt_u):
+        {
+            register_comparison_op(regs, pc, std::less<uint64_t>());
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i64_gt_s):
+        {
+            register_comparison_op(regs, pc, std::greater<int64_t>());
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i64_gt_u):
+        {
+            register_comparison_op(regs, pc, std::greater<uint64_t>());
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i64_le_s):
+        {
+            register_comparison_op(regs, pc, std::less_equal<int64_t>());
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i64_le_u):
+        {
+            register_comparison_op(regs, pc, std::less_equal<uint64_t>());
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i64_ge_s):
+        {
+            register_comparison_op(regs, pc, std::greater_equal<int64_t>());
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i64_ge_u):
+        {
+            register_comparison_op(regs, pc, std::greater_equal<uint64_t>());
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i64_add):
+        {
+            register_binary_op(regs, pc, std::plus<uint64_t>());
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i64_sub):
+        {
+            register_binary_op(regs, pc, std::minus<uint64_t>());
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i64_mul):
+        {
+            register_binary_op(regs, pc, std::multiplies<uint64_t>());
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i64_div_s):
+        {
+            const auto rhs = static_cast<int64_t>(regs[pc[3]]);
+            const auto lhs = static_cast<int64_t>(regs[pc[2]]);
+            if (rhs == 0 || (lhs == std::numeric_limits<int64_t>::min() && rhs == -1))
+            {
+                trap = true;
+                goto register_end;
+            }
+            regs[pc[1]] = static_cast<uint64_t>(lhs / rhs);
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i64_div_u):
+        {
+            const auto rhs = static_cast<uint64_t>(regs[pc[3]]);
+            if (rhs == 0)
+            {
+                trap = true;
+                goto register_end;
+            }
+            regs[pc[1]] = static_cast<uint64_t>(regs[pc[2]]) / rhs;
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i64_rem_s):
+        {
+            const auto rhs = static_cast<int64_t>(regs[pc[3]]);
+            if (rhs == 0)
+            {
+                trap = true;
+                goto register_end;
+            }
+            const auto lhs = static_cast<int64_t>(regs[pc[2]]);
+            // The remainder of min / -1 is 0, but the division overflows in C++.
+            regs[pc[1]] = rhs == -1 ? 0 : static_cast<uint64_t>(lhs % rhs);
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i64_rem_u):
+        {
+            const auto rhs = static_cast<uint64_t>(regs[pc[3]]);
+            if (rhs == 0)
+            {
+                trap = true;
+                goto register_end;
+            }
+            regs[pc[1]] = static_cast<uint64_t>(regs[pc[2]]) % rhs;
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i64_and):
+        {
+            register_binary_op(regs, pc, std::bit_and<uint64_t>());
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i64_or):
+        {
+            register_binary_op(regs, pc, std::bit_or<uint64_t>());
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i64_xor):
+        {
+            register_binary_op(regs, pc, std::bit_xor<uint64_t>());
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i64_shl):
+        {
+            register_binary_op(regs, pc, shift_left<uint64_t>);
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i64_shr_s):
+        {
+            register_binary_op(regs, pc, shift_right<int64_t>);
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i64_shr_u):
+        {
+            register_binary_op(regs, pc, shift_right<uint64_t>);
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i64_rotl):
+        {
+            register_binary_op(regs, pc, rotl<uint64_t>);
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+        REGISTER_TARGET(i64_rotr):
+        {
+            register_binary_op(regs, pc, rotr<uint64_t>);
+            pc += 4;
+            REGISTER_DISPATCH();
+        }
+
+        register_branch:
+        {
+            // The interruption is checked when the branch goes back to a loop.
+            if (target <= pc && interrupt_requested(instance))
+            {
+                trap = true;
+                goto register_end;
+            }
+            pc = target;
+            REGISTER_DISPATCH();
+        }
+
+        register_call_function:
+        {
+            if (called_func_idx < num_imported_functions)
+            {
+                // The imported function takes the arguments from the top of the operand stack
+                // formed by the caller's slots up to the last argument.
+                const auto num_args =
+                    instance.imported_functions[called_func_idx].type.inputs.size();
+                OperandStack stack{called_args, called_args + num_args};
+                if (!invoke_imported_function(
+                        instance, called_func_idx, stack, reinterpret_cast<uint64_t*>(frames)))
+                {
+                    trap = true;
+                    goto register_end;
+                }
+                REGISTER_DISPATCH();
+            }
+
+            if (interrupt_requested(instance))
+            {
+                trap = true;
+                goto register_end;
+            }
+
+            const auto& called_code = functions[called_func_idx - num_imported_functions];
+            if (!have_register_frame_space(
+                    called_args, called_code, reinterpret_cast<uint64_t*>(frames)))
+            {
+                trap = true;
+                goto register_end;
+            }
+
+            new (--frames) RegisterFrame{code, pc, regs};
+
+            init_register_frame(called_args, called_code);
+            code = &called_code;
+            pc = code->instructions.data();
+            regs = called_args;
+            REGISTER_DISPATCH();
+        }
+        }
+    }
+
+register_end:
+    if (trap)
+        return {true, {}};
+    if (have_result)
+        return {false, true, result};
+    return {false, {}};
+}
+#if FIZZY_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
+
+/// The native stack kept free below the limit of the JIT-compiled and the native code for their
+/// runtime functions, the host functions they call and the signal handlers.
+constexpr size_t NativeStackReserve = 256 * 1024;
+
+/// The native stack used by the JIT-compiled or the native code if the bounds of the thread's
+/// stack are unknown.
+constexpr size_t FallbackNativeStackSize = 1024 * 1024;
+
+/// Returns the lowest native stack address allowed at the entry of a JIT-compiled or a native
+/// function: the bottom of the current thread's stack plus NativeStackReserve. The limit is
+/// determined once per thread, so the nested executions (by the host functions) share the limit
+/// of the outermost one and the calls of all of them are limited together.
+uintptr_t get_native_stack_limit() noexcept
+{
+    thread_local const uintptr_t limit = [] {
+        const auto entry = reinterpret_cast<uintptr_t>(__builtin_frame_address(0));
+#if defined(__linux__)
+        pthread_attr_t attr;
+        if (pthread_getattr_np(pthread_self(), &attr) == 0)
+        {
+            void* stack_addr = nullptr;
+            size_t stack_size = 0;
+            const auto ok = pthread_attr_getstack(&attr, &stack_addr, &stack_size) == 0;
+            pthread_attr_destroy(&attr);
+            const auto bottom = reinterpret_cast<uintptr_t>(stack_addr);
+            if (ok && bottom + NativeStackReserve < entry)
+                return bottom + NativeStackReserve;
+        }
+#endif
+        return entry - std::min(entry, FallbackNativeStackSize);
+    }();
+    return limit;
+}
+
+#if FIZZY_JIT
+static_assert(JitFrameRecordSize == RegisterFrameSize,
+    "the compiled code must limit the call depth like the register engine");
+
+/// The exception thrown in the runtime function called by the compiled code, rethrown when
+/// the compiled code returns.
+thread_local std::exception_ptr jit_exception;
+
+uint64_t jit_resolve_call_indirect(
+    JitContext* context, uint32_t expected_type_idx, uint64_t elem_idx) noexcept
+{
+    const auto& instance = *context->instance;
+    assert(instance.table != nullptr);
+    constexpr auto trap = ~uint64_t{0};
+
+    if (elem_idx >= instance.table->size())
+        return trap;
+
+    const auto elem = (*instance.table)[elem_idx];
+    if (!elem.has_value())
+        return trap;
+
+    // check actual type against expected type
+    const auto& actual_type = function_type(instance, *elem);
+    const auto& expected_type = instance.module->typesec[expected_type_idx];
+    if (expected_type != actual_type)
+        return trap;
+
+    return *elem;
+}
+
+JitStatus jit_call_imported(JitContext* context, uint32_t func_idx, uint64_t* args) noexcept
+{
+    auto& instance = *context->instance;
+    try
+    {
+        const auto num_args = instance.imported_functions[func_idx].type.inputs.size();
+        OperandStack stack{args, args + num_args};
+        const auto ok = invoke_imported_function(instance, func_idx, stack, context->frames_begin);
+
+        // The imported function may have grown the memory.
+        if (instance.memory != nullptr)
+            context->memory_size = instance.memory->size();
+        return ok ? JitStatus::Ok : JitStatus::Trap;
+    }
+    catch (...)
+    {
+        jit_exception = std::current_exception();
+        return JitStatus::Exception;
+    }
+}
+
+uint32_t jit_memory_grow(JitContext* context, uint32_t delta) noexcept
+{
+    auto& instance = *context->instance;
+    const auto ret = grow_memory(instance, delta);
+    context->memory_size = instance.memory->size();
+    return ret;
+}
+
+JitStatus jit_unsupported(JitContext*) noexcept
+{
+    jit_exception = std::make_exception_ptr(unsupported_feature("Floating point instruction."));
+    return JitStatus::Exception;
+}
+
+constexpr JitRuntime jit_runtime{
+    jit_resolve_call_indirect, jit_call_imported, jit_memory_grow, jit_unsupported};
+
+/// Returns the module's functions compiled to the machine code, compiled once for the module
+/// and its copies like the register-based code. Returns nullptr if the compilation is not possible.
+std::shared_ptr<const JitModule> get_jit_module(
+    const Module& module, const RegisterModule& register_module)
+{
+    auto* const cache = module.register_module_cache.get();
+    if (cache == nullptr)
+        return compile_jit_module(module, register_module, jit_runtime);
+
+    std::call_once(cache->compiled,
+        [&] { cache->jit_module = compile_jit_module(module, register_module, jit_runtime); });
+    return cache->jit_module;
+}
+
+/// Executes the wasm function (not imported) compiled to the machine code. The compiled code
+/// has the frames of the register engine on the instance's execution stack, see JitModule.
+///
+/// NOTE: In the FIZZY_GUARD_PAGES mode the execution can be abandoned with siglongjmp() at
+/// any memory instruction, therefore no objects with non-trivial destructors may be alive here.
+ExecutionResult execute_function_jit(
+    Instance& instance, FuncIdx func_idx, span<const uint64_t> args)
+{
+    const auto code_idx = func_idx - instance.imported_functions.size();
+    const auto& code = instance.register_module->functions[code_idx];
+    const auto& jit_module = *instance.jit_module;
+
+    auto& execution_stack = instance.execution_stack;
+    uint64_t* const regs = execution_stack.values_end;
+    if (!have_register_frame_space(regs, code, execution_stack.frames_begin))
+        return {true, {}};
+
+    assert(args.size() == code.num_args);
+    std::copy(args.begin(), args.end(), regs);
+
+    JitContext context;
+    if (instance.memory != nullptr)
+    {
+        context.memory_data = instance.memory->data();
+        context.memory_size = instance.memory->size();
+    }
+    context.frames_begin = execution_stack.frames_begin;
+    context.native_stack_limit = get_native_stack_limit();
+    context.globals = instance.globals.data();
+    context.imported_globals = instance.imported_globals.data();
+    context.functions = jit_module.functions.data();
+    context.frame_sizes = jit_module.frame_sizes.data();
+    context.instance = &instance;
+    context.interrupt_requested = &instance.interrupt_requested;
+
+    const auto status = jit_module.function(code_idx)(&context, regs);
+    if (status == JitStatus::Exception)
+        std::rethrow_exception(std::exchange(jit_exception, nullptr));
+    if (status == JitStatus::Trap)
+        return {true, {}};
+    if (function_type(instance, func_idx).outputs.empty())
+        return {false, {}};
+    return {false, true, regs[0]};
+}
+#endif
+
+static_assert(NativeFrameRecordSize == static_cast<std::ptrdiff_t>(RegisterFrameSize),
+    "the native code must limit the call depth like the register engine");
+
+/// The trap of the native code, thrown by NativeContext::trap().
+struct NativeTrap
+{
+};
+
+/// Executes the wasm function (not imported) compiled by fizzy-aot, see NativeModule.
+/// The native code keeps its values in native frames, the execution stack only limits
+/// the call depth.
+ExecutionResult execute_function_native(
+    Instance& instance, FuncIdx func_idx, span<const uint64_t> args)
+{
+    const auto code_idx = func_idx - instance.imported_functions.size();
+    const auto& native_module = *instance.native_module;
+    assert(code_idx < native_module.num_functions);
+    assert(args.size() == function_type(instance, func_idx).inputs.size());
+
+    auto& execution_stack = instance.execution_stack;
+    NativeContext context{instance, native_module, nullptr, 0, instance.globals.data(),
+        instance.imported_globals.data(), execution_stack.frames_begin, 0};
+    if (instance.memory != nullptr)
+    {
+        context.memory_data = instance.memory->data();
+        context.memory_size = instance.memory->size();
+    }
+    context.native_stack_limit = get_native_stack_limit();
+
+    try
+    {
+        const auto result = native_module.functions[code_idx](
+            context, execution_stack.frames_begin - execution_stack.values_end, args.data());
+        if (function_type(instance, func_idx).outputs.empty())
+            return {false, {}};
+        return {false, true, result};
+    }
+    catch (const NativeTrap&)
+    {
+        return {true, {}};
+    }
+}
+
+#if FIZZY_GUARD_PAGES
+/// Executes the function with the instance's memory faults converted into a trap.
+ExecutionResult execute_function_guarded(
+    decltype(&execute_function) execute_fn, Instance& instance, FuncIdx func_idx,
+    span<const uint64_t> args)
+{
+    install_memory_fault_handler(handle_memory_trap);
+
+    const auto outer_trap_context = memory_trap_context;
+
+    sigjmp_buf recovery_point;
+    // NOTE: The signal mask is not saved, the handler does not block the signal (SA_NODEFER).
+    if (sigsetjmp(recovery_point, 0) != 0)
+    {
+        memory_trap_context = outer_trap_context;
+        return {true, {}};
+    }
+
+    const auto* const memory_data = instance.memory->data();
+    memory_trap_context = {
+        &recovery_point, memory_data, memory_data + LinearMemory::GuardedReservationSize};
+
+    try
+    {
+        auto result = execute_fn(instance, func_idx, args);
+        memory_trap_context = outer_trap_context;
+        return result;
+    }
+    catch (...)
+    {
+        memory_trap_context = outer_trap_context;
+        throw;
+    }
+}
+#endif
+
+ExecutionResult to_execution_result(const execution_result& result) noexcept
+{
+    // NOTE: we can assume this from validation
+    assert(result.stack.size() <= 1);
+    if (result.trapped)
+        return {true, {}};
+    if (result.stack.empty())
+        return {false, {}};
+    return {false, true, result.stack[0]};
+}
+
+execution_result to_execution_result(const ExecutionResult& result)
+{
+    if (result.trapped)
+        return {true, {}};
+    if (result.has_value)
+        return {false, {result.value}};
+    return {false, {}};
+}
+
+/// The function exported by an instance, the context of call_exported_function().
+struct ExportedFunction
+{
+    Instance& instance;
+    FuncIdx func_idx;
+};
+
+/// The HostFunctionPtr of the ExternalFunction of an exported function: the function is
+/// executed with the arguments of the calling execution in place.
+bool call_exported_function(
+    void* context, Instance&, span<const uint64_t> args, span<uint64_t> results)
+{
+    const auto& func = *static_cast<const ExportedFunction*>(context);
+    const auto result = execute(func.instance, func.func_idx, args);
+    if (result.trapped)
+        return false;
+    if (result.has_value)
+        results[0] = result.value;
+    return true;
+}
+}  // namespace
+
+void NativeContext::trap() const
+{
+    throw NativeTrap{};
+}
+
+void NativeContext::unsupported() const
+{
+    throw unsupported_feature("Floating point instruction.");
+}
+
+uint64_t NativeContext::call_imported(
+    FuncIdx func_idx, std::ptrdiff_t stack_space, const uint64_t* args)
+{
+    // The arguments are placed in the execution stack where the register engine has them,
+    // so the imported function executing wasm functions has the same stack space.
+    const auto& type = instance.imported_functions[func_idx].type;
+    uint64_t* const values = frames_begin - stack_space;
+    std::copy_n(args, type.inputs.size(), values);
+    OperandStack stack{values, values + type.inputs.size()};
+    if (!invoke_imported_function(instance, func_idx, stack, frames_begin))
+        trap();
+
+    // The imported function may have grown the memory.
+    if (instance.memory != nullptr)
+        memory_size = instance.memory->size();
+    return type.outputs.empty() ? 0 : values[0];
+}
+
+uint64_t NativeContext::call_indirect(TypeIdx expected_type_idx, uint64_t elem_idx,
+    std::ptrdiff_t stack_space, const uint64_t* args)
+{
+    assert(instance.table != nullptr);
+
+    if (elem_idx >= instance.table->size())
+        trap();
+
+    const auto elem = (*instance.table)[elem_idx];
+    if (!elem.has_value())
+        trap();
+
+    // check actual type against expected type
+    const auto& actual_type = function_type(instance, *elem);
+    const auto& expected_type = instance.module->typesec[expected_type_idx];
+    if (expected_type != actual_type)
+        trap();
+
+    const auto num_imported_functions = instance.imported_functions.size();
+    if (*elem < num_imported_functions)
+        return call_imported(*elem, stack_space, args);
+    return module.functions[*elem - num_imported_functions](
+        *this, stack_space - NativeFrameRecordSize, args);
+}
+
+uint32_t NativeContext::memory_grow(uint32_t delta)
+{
+    const auto ret = grow_memory(instance, delta);
+    memory_size = instance.memory->size();
+    return ret;
+}
+
+ExecutionResult execute(Instance& instance, FuncIdx func_idx, span<const uint64_t> args)
+{
+    if (func_idx < instance.imported_functions.size())
+    {
+        const auto& func = instance.imported_functions[func_idx];
+        assert(args.size() == func.type.inputs.size());
+        if (func.host_function != nullptr)
+        {
+            uint64_t result = 0;
+            const auto num_outputs = func.type.outputs.size();
+            if (!func.host_function(
+                    func.host_context.get(), instance, args, {&result, num_outputs}))
+                return {true, {}};
+            return {false, num_outputs != 0, result};
+        }
+        return to_execution_result(
+            func.function(instance, std::vector<uint64_t>(args.begin(), args.end())));
+    }
+
+    // The top-level execution clears the interruption request made before it started (e.g. by
+    // the watchdog of the previous execution). The nested one is a part of the outer execution.
+    if (instance.execution_stack.num_executions == 0)
+        instance.interrupt_requested.store(false, std::memory_order_relaxed);
+    else if (interrupt_requested(instance))
+        return {true, {}};
+
+    auto& execution_stack = get_execution_stack(instance);
+
+    // Restores the execution stack usage to the one from before this execution (also when
+    // an exception is thrown or a trap abandons the execution). This execution can be nested
+    // in an imported function call.
+    struct ExecutionStackGuard
+    {
+        ExecutionStack& execution_stack;
+        uint64_t* const values_end = execution_stack.values_end;
+        uint64_t* const frames_begin = execution_stack.frames_begin;
+
+        explicit ExecutionStackGuard(ExecutionStack& stack) noexcept : execution_stack{stack}
+        {
+            ++execution_stack.num_executions;
+        }
+
+        ~ExecutionStackGuard() noexcept
+        {
+            execution_stack.values_end = values_end;
+            execution_stack.frames_begin = frames_begin;
+            --execution_stack.num_executions;
+        }
+    } const execution_stack_guard{execution_stack};
+
+    if (instance.engine == ExecutionEngine::Jit && instance.jit_module == nullptr)
+    {
+#if FIZZY_JIT
+        if (instance.register_module == nullptr)
+            instance.register_module = get_register_module(*instance.module);
+        if (instance.register_module != nullptr)
+            instance.jit_module = get_jit_module(*instance.module, *instance.register_module);
+#endif
+        if (instance.jit_module == nullptr)
+            instance.engine = ExecutionEngine::Register;
+    }
+    if (instance.engine == ExecutionEngine::Native && instance.native_module == nullptr)
+        instance.engine = ExecutionEngine::Stack;
+#if FIZZY_METERING
+    // The native code does not charge the gas.
+    if (instance.engine == ExecutionEngine::Native && instance.module->instruction_costs != nullptr)
+        instance.engine = ExecutionEngine::Stack;
+#endif
+    if (instance.engine == ExecutionEngine::Register && instance.register_module == nullptr)
+    {
+        instance.register_module = get_register_module(*instance.module);
+        if (instance.register_module == nullptr)
+            instance.engine = ExecutionEngine::Stack;
+    }
+
+    auto execute_fn = execute_function;
+    if (instance.engine == ExecutionEngine::Register)
+        execute_fn = execute_function_register;
+#if FIZZY_JIT
+    else if (instance.engine == ExecutionEngine::Jit)
+        execute_fn = execute_function_jit;
+#endif
+    else if (instance.engine == ExecutionEngine::Native)
+        execute_fn = execute_function_native;
+
+#if FIZZY_GUARD_PAGES
+    // The native code checks the bounds of memory accesses explicitly.
+    if (instance.memory != nullptr && instance.engine != ExecutionEngine::Native)
+        return execute_function_guarded(execute_fn, instance, func_idx, args);
+#endif
+    return execute_fn(instance, func_idx, args);
+}
+
+execution_result execute(Instance& instance, FuncIdx func_idx, std::vector<uint64_t> args)
+{
+    return to_execution_result(
+        execute(instance, func_idx, span<const uint64_t>{args.data(), args.size()}));
 }
 
 execution_result execute(const Module& module, FuncIdx func_idx, std::vector<uint64_t> args)
@@ -1581,11 +3722,15 @@ std::optional<ExternalFunction> find_exported_function(Instance& instance, std::
         return std::nullopt;
 
     const auto idx = *opt_index;
-    auto func = [idx, &instance](fizzy::Instance&, std::vector<uint64_t> args) {
-        return execute(instance, idx, std::move(args));
+    // The context is shared by the std::function and the host_function's context.
+    const auto context = std::make_shared<ExportedFunction>(ExportedFunction{instance, idx});
+    auto func = [context](fizzy::Instance&, std::vector<uint64_t> args) {
+        return to_execution_result(execute(context->instance, context->func_idx,
+            span<const uint64_t>{args.data(), args.size()}));
     };
 
-    return ExternalFunction{std::move(func), function_type(instance, idx)};
+    return ExternalFunction{
+        std::move(func), function_type(instance, idx), call_exported_function, context};
 }
 
 std::optional<ExternalGlobal> find_exported_global(Instance& instance, std::string_view name)
@@ -1606,7 +3751,7 @@ std::optional<ExternalGlobal> find_exported_global(Instance& instance, std::stri
         // global owned by instance
         const auto module_global_idx = global_idx - instance.imported_globals.size();
         return ExternalGlobal{&instance.globals[module_global_idx],
-            instance.module.globalsec[module_global_idx].is_mutable};
+            instance.module->globalsec[module_global_idx].is_mutable};
     }
 }
 
@@ -1615,18 +3760,18 @@ std::optional<ExternalTable> find_exported_table(Instance& instance, std::string
     if (!find_export(instance, ExternalKind::Table, name))
         return std::nullopt;
 
-    if (instance.module.tablesec.size() == 1)
+    if (instance.module->tablesec.size() == 1)
     {
         // table owned by instance
-        return ExternalTable{instance.table.get(), instance.module.tablesec[0].limits};
+        return ExternalTable{instance.table.get(), instance.module->tablesec[0].limits};
     }
     else
     {
         // imported table is reexported
         const auto it_import =
-            std::find_if(instance.module.importsec.begin(), instance.module.importsec.end(),
+            std::find_if(instance.module->importsec.begin(), instance.module->importsec.end(),
                 [](const auto& import) { return import.kind == ExternalKind::Table; });
-        assert(it_import != instance.module.importsec.end());
+        assert(it_import != instance.module->importsec.end());
 
         // FIXME: Limits here are not exactly correct: table could have been imported with limits
         // narrower than the ones defined in module's import definition, we don't save those during
@@ -1640,18 +3785,18 @@ std::optional<ExternalMemory> find_exported_memory(Instance& instance, std::stri
     if (!find_export(instance, ExternalKind::Memory, name))
         return std::nullopt;
 
-    if (instance.module.memorysec.size() == 1)
+    if (instance.module->memorysec.size() == 1)
     {
         // memory owned by instance
-        return ExternalMemory{instance.memory.get(), instance.module.memorysec[0].limits};
+        return ExternalMemory{instance.memory.get(), instance.module->memorysec[0].limits};
     }
     else
     {
         // imported memory is reexported
         const auto it_import =
-            std::find_if(instance.module.importsec.begin(), instance.module.importsec.end(),
+            std::find_if(instance.module->importsec.begin(), instance.module->importsec.end(),
                 [](const auto& import) { return import.kind == ExternalKind::Memory; });
-        assert(it_import != instance.module.importsec.end());
+        assert(it_import != instance.module->importsec.end());
 
         // FIXME: Limits min here is not correct: memory could have been imported with limits
         // narrower than the ones defined in module's import definition, we save only max during
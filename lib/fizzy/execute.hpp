@@ -1,9 +1,14 @@
 #pragma once
 
 #include "exceptions.hpp"
+#include "limits.hpp"
+#include "linear_memory.hpp"
+#include "span.hpp"
 #include "types.hpp"
+#include <atomic>
 #include <cstdint>
 #include <functional>
+#include <limits>
 #include <memory>
 
 namespace fizzy
@@ -18,12 +23,33 @@ struct execution_result
     std::vector<uint64_t> stack;
 };
 
+// The result of an execution, without heap allocations: a function returns 0 or 1 values.
+struct ExecutionResult
+{
+    // true if execution resulted in a trap
+    bool trapped = false;
+    // true if the function returned a value
+    bool has_value = false;
+    // the returned value, valid if has_value is true
+    uint64_t value = 0;
+};
+
 struct Instance;
 
+// The imported function called without allocations: it takes the arguments directly from
+// the operand stack of the calling execution and writes the results (0 or 1 value) into
+// the given span. The context is the one set in the ExternalFunction. Returns false to trap.
+using HostFunctionPtr = bool (*)(
+    void* context, Instance& instance, span<const uint64_t> args, span<uint64_t> results);
+
 struct ExternalFunction
 {
     std::function<execution_result(Instance&, std::vector<uint64_t>)> function;
     FuncType type;
+    // If set, the function called instead of the std::function above.
+    HostFunctionPtr host_function = nullptr;
+    // The context passed to host_function, owned by the ExternalFunction (and its copies).
+    std::shared_ptr<void> host_context = nullptr;
 };
 
 using table_elements = std::vector<std::optional<FuncIdx>>;
@@ -37,7 +63,7 @@ struct ExternalTable
 
 struct ExternalMemory
 {
-    bytes* data = nullptr;
+    LinearMemory* data = nullptr;
     Limits limits;
 };
 
@@ -47,16 +73,70 @@ struct ExternalGlobal
     bool is_mutable = false;
 };
 
-using bytes_ptr = std::unique_ptr<bytes, void (*)(bytes*)>;
+using memory_ptr = std::unique_ptr<LinearMemory, void (*)(LinearMemory*)>;
+
+// The execution stack of an instance: the single memory block for locals, operand stacks and
+// call frames of all the wasm functions being executed on the instance.
+//
+// The values (locals and operands) grow from the bottom of the memory block and the call
+// frames grow from the top. The stack is exhausted when these two meet.
+struct ExecutionStack
+{
+    // The memory block, allocated on the first execution.
+    std::unique_ptr<uint64_t[]> memory;
+
+    // The size of the memory block, in values.
+    size_t size = 0;
+
+    // The end of the values in use, i.e. where the next execution starts placing values.
+    uint64_t* values_end = nullptr;
+
+    // The beginning of the call frames in use.
+    uint64_t* frames_begin = nullptr;
+
+    // The number of the executions in progress: the top-level one and the ones nested in
+    // the imported function calls.
+    size_t num_executions = 0;
+};
+
+struct JitModule;
+struct NativeModule;
+struct RegisterModule;
+struct ThreadedCodeCache;
+
+// The interpreters executing the wasm functions.
+enum class ExecutionEngine
+{
+    // Executes the stack machine Code directly.
+    Stack,
+
+    // Executes the register-based code translated from Code, see RegisterCode.
+    // All the module's functions are translated on the first execution (so also decoded then,
+    // if the module is decoded lazily). If the translation is not possible (for some invalid code
+    // accepted by the parser), the instance switches to the Stack engine.
+    Register,
+
+    // Executes the register-based code compiled to x86-64 machine code, see JitModule.
+    // All the module's functions are compiled on the first execution. If the compilation is
+    // not possible (Fizzy built without FIZZY_JIT, other architectures, or the register-based
+    // code not available), the instance switches to the Register engine.
+    Jit,
+
+    // Executes the functions compiled ahead of time to native code by fizzy-aot, set as
+    // the instance's native_module. Without it, or if the module is metered (the native code
+    // does not charge the gas), the instance switches to the Stack engine.
+    Native,
+};
 
 // The module instance.
 struct Instance
 {
-    Module module;
-    // Memory is either allocated and owned by the instance or imported as already allocated bytes
+    // The module is immutable and can be shared by many instances.
+    std::shared_ptr<const Module> module;
+    // Memory is either allocated and owned by the instance or imported as already allocated memory
     // and owned externally.
     // For these cases unique_ptr would either have a normal deleter or noop deleter respectively
-    bytes_ptr memory = {nullptr, [](bytes*) {}};
+    memory_ptr memory = {nullptr, [](LinearMemory*) {}};
     size_t memory_max_pages = 0;
     // Table is either allocated and owned by the instance or imported and owned externally.
     // For these cases unique_ptr would either have a normal deleter or noop deleter respectively.
@@ -64,9 +144,37 @@ struct Instance
     std::vector<uint64_t> globals;
     std::vector<ExternalFunction> imported_functions;
     std::vector<ExternalGlobal> imported_globals;
-
-    Instance(Module _module, bytes_ptr _memory, size_t _memory_max_pages, table_ptr _table,
-        std::vector<uint64_t> _globals, std::vector<ExternalFunction> _imported_functions,
+    // The size limit (in bytes) of the execution stack. A change takes effect with the next
+    // execution not nested in another one (from an imported function) on the instance.
+    size_t execution_stack_limit = DefaultExecutionStackLimit;
+    ExecutionStack execution_stack;
+    // The engine executing the functions, can be changed between executions. The start function
+    // is always executed with the Stack engine.
+    ExecutionEngine engine = ExecutionEngine::Stack;
+    // The module's function bodies translated for the Stack engine, on its first execution.
+    // It is the module's cache, if the module has one.
+    std::shared_ptr<ThreadedCodeCache> threaded_code;
+    // The module's functions translated for the Register engine, on its first execution.
+    std::shared_ptr<const RegisterModule> register_module;
+    // The module's functions compiled for the Jit engine, on its first execution.
+    std::shared_ptr<const JitModule> jit_module;
+    // The module's functions compiled by fizzy-aot for the Native engine, set by the embedder.
+    // It must be compiled from the instance's module.
+    const NativeModule* native_module = nullptr;
+    // Set (from any thread) to interrupt the execution in progress: it traps at the next loop
+    // iteration or function call. Cleared when the next top-level execution starts, so a request
+    // made after the interrupted execution has ended does not interrupt the following one.
+    std::atomic<bool> interrupt_requested{false};
+#if FIZZY_METERING
+    // The gas left for the execution of the metered code (see parse() with the instruction cost
+    // table), charged for each basic block on its entry. The execution traps when the gas goes
+    // below zero, so it can be negative after the trap.
+    int64_t gas_left = std::numeric_limits<int64_t>::max();
+#endif
+
+    Instance(std::shared_ptr<const Module> _module, memory_ptr _memory, size_t _memory_max_pages,
+        table_ptr _table, std::vector<uint64_t> _globals,
+        std::vector<ExternalFunction> _imported_functions,
         std::vector<ExternalGlobal> _imported_globals)
       : module(std::move(_module)),
         memory(std::move(_memory)),
@@ -79,6 +187,13 @@ struct Instance
 };
 
 // Instantiate a module.
+std::unique_ptr<Instance> instantiate(std::shared_ptr<const Module> module,
+    std::vector<ExternalFunction> imported_functions = {},
+    std::vector<ExternalTable> imported_tables = {},
+    std::vector<ExternalMemory> imported_memories = {},
+    std::vector<ExternalGlobal> imported_globals = {});
+
+// Instantiate a module, which is moved into a new shared module.
 std::unique_ptr<Instance> instantiate(Module module,
     std::vector<ExternalFunction> imported_functions = {},
     std::vector<ExternalTable> imported_tables = {},
@@ -86,8 +201,11 @@ std::unique_ptr<Instance> instantiate(Module module,
     std::vector<ExternalGlobal> imported_globals = {});
 
 // Execute a function on an instance.
-execution_result execute(
-    Instance& instance, FuncIdx func_idx, std::vector<uint64_t> args, int depth = 0);
+execution_result execute(Instance& instance, FuncIdx func_idx, std::vector<uint64_t> args);
+
+// Execute a function on an instance, without heap allocations (unless the function is imported
+// as std::function). The args must have the function's number of parameters.
+ExecutionResult execute(Instance& instance, FuncIdx func_idx, span<const uint64_t> args);
 
 // TODO: remove this helper
 execution_result execute(const Module& module, FuncIdx func_idx, std::vector<uint64_t> args);
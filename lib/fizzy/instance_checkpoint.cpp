@@ -0,0 +1,41 @@
+#include "instance_checkpoint.hpp"
+#include <algorithm>
+
+namespace fizzy
+{
+InstanceCheckpoint::InstanceCheckpoint(Instance& instance) : m_instance{instance}
+{
+    update();
+}
+
+InstanceCheckpoint::~InstanceCheckpoint() noexcept
+{
+    if (m_instance.memory != nullptr)
+        m_instance.memory->discard_checkpoint();
+}
+
+void InstanceCheckpoint::update()
+{
+    if (m_instance.memory != nullptr)
+        m_instance.memory->checkpoint();
+
+    m_globals = m_instance.globals;
+    m_imported_globals.clear();
+    for (const auto& global : m_instance.imported_globals)
+        m_imported_globals.push_back(*global.value);
+    if (m_instance.table != nullptr)
+        m_table = *m_instance.table;
+}
+
+void InstanceCheckpoint::rollback()
+{
+    if (m_instance.memory != nullptr)
+        m_instance.memory->rollback();
+
+    std::copy(m_globals.begin(), m_globals.end(), m_instance.globals.begin());
+    for (size_t i = 0; i < m_imported_globals.size(); ++i)
+        *m_instance.imported_globals[i].value = m_imported_globals[i];
+    if (m_instance.table != nullptr)
+        std::copy(m_table.begin(), m_table.end(), m_instance.table->begin());
+}
+}  // namespace fizzy
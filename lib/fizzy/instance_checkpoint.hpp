@@ -0,0 +1,48 @@
+#pragma once
+
+#include "execute.hpp"
+#include <cstdint>
+#include <vector>
+
+namespace fizzy
+{
+/// The checkpoint of the state of an instance, which the instance can be rolled back to,
+/// e.g. when the transaction executed on it traps or is rejected.
+///
+/// The state includes the memory, the globals and the table of the instance, also when
+/// imported. The memory is checkpointed with LinearMemory::checkpoint(), so the rollback
+/// restores only the pages written since the checkpoint. The globals and the table are copied.
+///
+/// A memory can have only one checkpoint set, so the instances sharing the memory cannot have
+/// their checkpoints at the same time.
+class InstanceCheckpoint
+{
+public:
+    /// Sets the checkpoint of the instance's current state.
+    /// Throws std::bad_alloc if the memory checkpoint cannot be set.
+    explicit InstanceCheckpoint(Instance& instance);
+
+    /// Discards the checkpoint, the instance keeps its current state.
+    ~InstanceCheckpoint() noexcept;
+
+    InstanceCheckpoint(const InstanceCheckpoint&) = delete;
+    InstanceCheckpoint& operator=(const InstanceCheckpoint&) = delete;
+
+    /// Restores the state of the instance at the checkpoint. The checkpoint stays set.
+    /// The instance must not be executing.
+    /// Throws std::bad_alloc if the memory cannot be rolled back.
+    void rollback();
+
+    /// Moves the checkpoint to the current state of the instance, e.g. when the transaction
+    /// is committed.
+    /// Throws std::bad_alloc if the memory checkpoint cannot be set.
+    void update();
+
+private:
+    Instance& m_instance;
+
+    std::vector<uint64_t> m_globals;
+    std::vector<uint64_t> m_imported_globals;
+    table_elements m_table;
+};
+}  // namespace fizzy
@@ -0,0 +1,137 @@
+#include "instance_pool.hpp"
+#include <algorithm>
+#include <cassert>
+
+namespace fizzy
+{
+namespace
+{
+/// The size of the chunks of the memory content written to the memory image, the chunks
+/// of zeroes are skipped so the image stays sparse.
+constexpr size_t ImageChunkSize = 4096;
+
+std::unique_ptr<MemoryImage> build_memory_image(const LinearMemory& memory)
+{
+    auto image = MemoryImage::create(memory.size());
+    if (image == nullptr)
+        return nullptr;
+
+    for (size_t offset = 0; offset < memory.size(); offset += ImageChunkSize)
+    {
+        const auto* const chunk = memory.data() + offset;
+        const auto chunk_size = std::min(ImageChunkSize, memory.size() - offset);
+        if (std::all_of(chunk, chunk + chunk_size, [](uint8_t b) { return b == 0; }))
+            continue;
+        if (!image->write(offset, {chunk, chunk_size}))
+            return nullptr;
+    }
+    return image;
+}
+}  // namespace
+
+InstancePool::InstancePool(std::shared_ptr<const Module> module,
+    std::vector<ExternalFunction> imported_functions, std::vector<ExternalTable> imported_tables,
+    std::vector<ExternalMemory> imported_memories, std::vector<ExternalGlobal> imported_globals,
+    size_t initial_size)
+  : m_template{instantiate(std::move(module), std::move(imported_functions),
+        std::move(imported_tables), std::move(imported_memories), std::move(imported_globals))}
+{
+    if (!m_template->module->memorysec.empty())
+    {
+        const auto& memory = *m_template->memory;
+        m_memory_image = build_memory_image(memory);
+        if (m_memory_image == nullptr)
+            m_memory_content.assign(memory.begin(), memory.end());
+    }
+
+    m_instances.reserve(initial_size);
+    for (size_t i = 0; i < initial_size; ++i)
+        m_instances.emplace_back(create_instance());
+}
+
+std::unique_ptr<Instance> InstancePool::create_instance() const
+{
+    static const auto memory_delete = [](LinearMemory* m) noexcept { delete m; };
+    static const auto table_delete = [](table_elements* t) noexcept { delete t; };
+
+    const auto& module = *m_template->module;
+
+    // The memory and the table defined by the module are copied from the template, the imported
+    // ones are shared.
+    memory_ptr memory{m_template->memory.get(), [](LinearMemory*) noexcept {}};
+    if (!module.memorysec.empty())
+    {
+        const auto max_size = m_template->memory->max_size();
+        if (m_memory_image != nullptr)
+            memory = {new LinearMemory(*m_memory_image, max_size), memory_delete};
+        else
+        {
+            memory = {new LinearMemory(m_memory_content.size(), max_size), memory_delete};
+            std::copy(m_memory_content.begin(), m_memory_content.end(), memory->data());
+        }
+    }
+
+    table_ptr table{m_template->table.get(), [](table_elements*) noexcept {}};
+    if (!module.tablesec.empty())
+        table = {new table_elements(*m_template->table), table_delete};
+
+    auto instance = std::make_unique<Instance>(m_template->module, std::move(memory),
+        m_template->memory_max_pages, std::move(table), m_template->globals,
+        m_template->imported_functions, m_template->imported_globals);
+    instance->execution_stack_limit = m_template->execution_stack_limit;
+    instance->engine = m_template->engine;
+    instance->native_module = m_template->native_module;
+    return instance;
+}
+
+void InstancePool::reset(Instance& instance) const
+{
+    const auto& module = *m_template->module;
+
+    if (!module.memorysec.empty())
+    {
+        instance.memory->reset();
+        if (m_memory_image == nullptr)
+            std::copy(m_memory_content.begin(), m_memory_content.end(), instance.memory->data());
+    }
+
+    if (!module.tablesec.empty())
+        std::copy(m_template->table->begin(), m_template->table->end(), instance.table->begin());
+
+    std::copy(m_template->globals.begin(), m_template->globals.end(), instance.globals.begin());
+
+    instance.interrupt_requested = false;
+#if FIZZY_METERING
+    instance.gas_left = m_template->gas_left;
+#endif
+}
+
+std::unique_ptr<Instance> InstancePool::acquire()
+{
+    {
+        const std::lock_guard lock{m_mutex};
+        if (!m_instances.empty())
+        {
+            auto instance = std::move(m_instances.back());
+            m_instances.pop_back();
+            return instance;
+        }
+    }
+    return create_instance();
+}
+
+void InstancePool::release(std::unique_ptr<Instance> instance)
+{
+    assert(instance != nullptr && instance->module == m_template->module);
+    reset(*instance);
+
+    const std::lock_guard lock{m_mutex};
+    m_instances.emplace_back(std::move(instance));
+}
+
+size_t InstancePool::size() const
+{
+    const std::lock_guard lock{m_mutex};
+    return m_instances.size();
+}
+}  // namespace fizzy
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "execute.hpp"
+#include "linear_memory.hpp"
+#include "types.hpp"
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace fizzy
+{
+/// The pool of the instances of a module, for the embedders executing each request on a fresh
+/// instance.
+///
+/// The module is instantiated once, with its start function executed, and this state is
+/// the template of the pooled instances: an instance released to the pool is reset to it
+/// cheaply instead of being instantiated again. The memory pages written by the executions are
+/// discarded (see LinearMemory::reset()) and the memory is restored from the template's
+/// memory image, the globals and the table are copied from the template, and the start function
+/// is not executed again.
+///
+/// The imported functions, tables, memories and globals are shared by all the instances
+/// of the pool and are not reset.
+///
+/// The instances can be acquired and released from many threads concurrently.
+class InstancePool
+{
+public:
+    /// Instantiates the template instance and the given number of the pooled instances.
+    /// Throws the same errors as instantiate().
+    explicit InstancePool(std::shared_ptr<const Module> module,
+        std::vector<ExternalFunction> imported_functions = {},
+        std::vector<ExternalTable> imported_tables = {},
+        std::vector<ExternalMemory> imported_memories = {},
+        std::vector<ExternalGlobal> imported_globals = {}, size_t initial_size = 0);
+
+    InstancePool(const InstancePool&) = delete;
+    InstancePool& operator=(const InstancePool&) = delete;
+
+    /// Takes the instance from the pool, or creates a new one from the template if the pool
+    /// is empty.
+    std::unique_ptr<Instance> acquire();
+
+    /// Resets the instance acquired from this pool to the template and returns it to the pool.
+    /// The instance must not be executing.
+    void release(std::unique_ptr<Instance> instance);
+
+    /// The number of the instances available in the pool.
+    size_t size() const;
+
+private:
+    std::unique_ptr<Instance> create_instance() const;
+
+    void reset(Instance& instance) const;
+
+    std::unique_ptr<Instance> m_template;
+
+    /// The memory of the template, if the memory is defined by the module: the image the pooled
+    /// memories map, or the copy of the content if in-memory files are not supported.
+    std::unique_ptr<MemoryImage> m_memory_image;
+    bytes m_memory_content;
+
+    mutable std::mutex m_mutex;
+    std::vector<std::unique_ptr<Instance>> m_instances;
+};
+}  // namespace fizzy
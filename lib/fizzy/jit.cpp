@@ -0,0 +1,1061 @@
+#include "jit.hpp"
+#include "execute.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <limits>
+#include <optional>
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#include <sys/mman.h>
+#define FIZZY_JIT_X86_64 1
+#else
+#define FIZZY_JIT_X86_64 0
+#endif
+
+namespace fizzy
+{
+JitModule::~JitModule()
+{
+#if FIZZY_JIT_X86_64
+    if (code != nullptr)
+        munmap(code, code_size);
+#endif
+}
+
+#if FIZZY_JIT_X86_64
+namespace
+{
+static_assert(sizeof(ExternalGlobal) == 16 && offsetof(ExternalGlobal, value) == 0,
+    "the compiled code accesses the imported globals by this layout");
+
+enum Reg : uint8_t
+{
+    rax,
+    rcx,
+    rdx,
+    rbx,
+    rsp,
+    rbp,
+    rsi,
+    rdi,
+    r8,
+    r9,
+    r10,
+    r11,
+    r12,
+    r13,
+};
+
+// The registers holding the state of the compiled function (callee-saved).
+constexpr auto regs_reg = rbx;
+constexpr auto context_reg = r12;
+constexpr auto memory_reg = r13;
+
+// The condition codes of Jcc, SETcc and CMOVcc.
+enum Cond : uint8_t
+{
+    cc_b = 0x2,
+    cc_ae = 0x3,
+    cc_e = 0x4,
+    cc_ne = 0x5,
+    cc_be = 0x6,
+    cc_a = 0x7,
+    cc_s = 0x8,
+    cc_l = 0xc,
+    cc_ge = 0xd,
+    cc_le = 0xe,
+    cc_g = 0xf,
+};
+
+constexpr int32_t context_offset(size_t offset) noexcept
+{
+    return static_cast<int32_t>(offset);
+}
+
+constexpr auto memory_data_offset = context_offset(offsetof(JitContext, memory_data));
+constexpr auto memory_size_offset = context_offset(offsetof(JitContext, memory_size));
+constexpr auto frames_begin_offset = context_offset(offsetof(JitContext, frames_begin));
+constexpr auto native_stack_limit_offset =
+    context_offset(offsetof(JitContext, native_stack_limit));
+constexpr auto globals_offset = context_offset(offsetof(JitContext, globals));
+constexpr auto imported_globals_offset = context_offset(offsetof(JitContext, imported_globals));
+constexpr auto functions_offset = context_offset(offsetof(JitContext, functions));
+constexpr auto frame_sizes_offset = context_offset(offsetof(JitContext, frame_sizes));
+constexpr auto interrupt_requested_offset =
+    context_offset(offsetof(JitContext, interrupt_requested));
+
+static_assert(sizeof(std::atomic<bool>) == 1 && std::atomic<bool>::is_always_lock_free,
+    "the compiled code reads the interruption request as a byte");
+
+constexpr int32_t frame_record_bytes = JitFrameRecordSize * sizeof(uint64_t);
+
+/// The encoder of the x86-64 instructions used by the compiler.
+class Assembler
+{
+public:
+    std::vector<uint8_t> code;
+
+    size_t offset() const noexcept { return code.size(); }
+
+    void emit(std::initializer_list<uint8_t> bytes) { code.insert(code.end(), bytes); }
+
+    void emit_u8(uint8_t byte) { code.push_back(byte); }
+
+    template <typename T>
+    void emit_value(T value)
+    {
+        uint8_t bytes[sizeof(value)];
+        std::memcpy(bytes, &value, sizeof(value));
+        code.insert(code.end(), std::begin(bytes), std::end(bytes));
+    }
+
+    /// Stores the 32-bit value at the offset.
+    void patch_i32(size_t at, int32_t value) noexcept { std::memcpy(&code[at], &value, 4); }
+
+    /// Points the rel32 operand at the offset to the target.
+    void patch_rel32(size_t at, size_t target) noexcept
+    {
+        patch_i32(at, static_cast<int32_t>(
+                          static_cast<int64_t>(target) - static_cast<int64_t>(at + 4)));
+    }
+
+    /// The instruction with the register (or the opcode extension) and [base + disp] operands.
+    void rm(uint8_t prefix, bool w, std::initializer_list<uint8_t> opcode, unsigned reg, Reg base,
+        int32_t disp)
+    {
+        if (prefix != 0)
+            emit_u8(prefix);
+        rex(w, reg, 0, base);
+        emit(opcode);
+        const unsigned mod = (disp == 0 && (base & 7) != rbp) ? 0 : (is_int8(disp) ? 1 : 2);
+        emit_u8(modrm(mod, reg, base));
+        if ((base & 7) == rsp)
+            emit_u8(0x24);
+        if (mod == 1)
+            emit_u8(static_cast<uint8_t>(disp));
+        else if (mod == 2)
+            emit_value(disp);
+    }
+
+    /// The instruction with the register and [base + index * 2^scale] operands.
+    void rm_index(uint8_t prefix, bool w, std::initializer_list<uint8_t> opcode, unsigned reg,
+        Reg base, Reg index, unsigned scale)
+    {
+        if (prefix != 0)
+            emit_u8(prefix);
+        rex(w, reg, index, base);
+        emit(opcode);
+        const unsigned mod = (base & 7) == rbp ? 1 : 0;
+        emit_u8(modrm(mod, reg, rsp));
+        emit_u8(static_cast<uint8_t>((scale << 6) | ((index & 7u) << 3) | (base & 7u)));
+        if (mod == 1)
+            emit_u8(0);
+    }
+
+    /// The instruction with two register operands (or the opcode extension and the register).
+    void rr(uint8_t prefix, bool w, std::initializer_list<uint8_t> opcode, unsigned reg, Reg rm)
+    {
+        if (prefix != 0)
+            emit_u8(prefix);
+        rex(w, reg, 0, rm);
+        emit(opcode);
+        emit_u8(modrm(3, reg, rm));
+    }
+
+    /// mov r32, imm32 (zero-extended).
+    void mov_imm32(Reg reg, uint32_t value)
+    {
+        rex(false, 0, 0, reg);
+        emit_u8(static_cast<uint8_t>(0xb8 + (reg & 7)));
+        emit_value(value);
+    }
+
+    /// mov r64, imm64.
+    void mov_imm64(Reg reg, uint64_t value)
+    {
+        rex(true, 0, 0, reg);
+        emit_u8(static_cast<uint8_t>(0xb8 + (reg & 7)));
+        emit_value(value);
+    }
+
+    /// Emits jmp with the rel32 operand to be patched, returns the operand offset.
+    size_t jmp()
+    {
+        emit_u8(0xe9);
+        return placeholder();
+    }
+
+    /// Emits jcc with the rel32 operand to be patched, returns the operand offset.
+    size_t jcc(Cond cond)
+    {
+        emit({0x0f, static_cast<uint8_t>(0x80 + cond)});
+        return placeholder();
+    }
+
+    void jmp_to(size_t target) { patch_rel32(jmp(), target); }
+
+    void jcc_to(Cond cond, size_t target) { patch_rel32(jcc(cond), target); }
+
+    /// Sets eax to 1 if the condition holds, to 0 otherwise.
+    void setcc_eax(Cond cond)
+    {
+        emit({0x0f, static_cast<uint8_t>(0x90 + cond), 0xc0});  // setcc al
+        emit({0x0f, 0xb6, 0xc0});                                // movzx eax, al
+    }
+
+    /// call r64.
+    void call(Reg reg) { rr(0, false, {0xff}, 2, reg); }
+
+private:
+    static constexpr bool is_int8(int32_t value) noexcept { return value >= -128 && value <= 127; }
+
+    static constexpr uint8_t modrm(unsigned mod, unsigned reg, unsigned rm) noexcept
+    {
+        return static_cast<uint8_t>((mod << 6) | ((reg & 7) << 3) | (rm & 7));
+    }
+
+    void rex(bool w, unsigned reg, unsigned index, unsigned base)
+    {
+        const auto prefix = static_cast<uint8_t>(0x40 | (unsigned{w} << 3) | ((reg >> 3) << 2) |
+                                                 ((index >> 3) << 1) | (base >> 3));
+        if (prefix != 0x40)
+            emit_u8(prefix);
+    }
+
+    size_t placeholder()
+    {
+        const auto at = offset();
+        emit_value(int32_t{0});
+        return at;
+    }
+};
+
+/// The single-pass compiler of the module's register-based code.
+class Compiler
+{
+public:
+    Compiler(const Module& module, const RegisterModule& register_module,
+        const JitRuntime& runtime) noexcept
+      : m_register_module{register_module},
+        m_runtime{runtime},
+        m_num_imported_functions{module.imported_function_types.size()},
+        m_num_imported_globals{static_cast<size_t>(
+            std::count_if(module.importsec.begin(), module.importsec.end(),
+                [](const Import& import) { return import.kind == ExternalKind::Global; }))}
+    {}
+
+    /// Returns the machine code and the offsets of the functions in it.
+    bool compile(std::vector<uint8_t>& machine_code, std::vector<size_t>& function_offsets)
+    {
+        for (const auto& code : m_register_module.functions)
+        {
+            // The slots must be addressable with the 32-bit displacements.
+            if (frame_bytes(code) > uint64_t{std::numeric_limits<int32_t>::max()})
+                return false;
+        }
+
+        emit_exits();
+
+        const auto num_functions = m_register_module.functions.size();
+        m_function_offsets.resize(num_functions);
+        for (size_t code_idx = 0; code_idx < num_functions; ++code_idx)
+        {
+            m_function_offsets[code_idx] = m_asm.offset();
+            compile_function(m_register_module.functions[code_idx]);
+        }
+
+        for (const auto& fixup : m_call_fixups)
+            m_asm.patch_rel32(fixup.at, m_function_offsets[fixup.code_idx]);
+
+        machine_code = std::move(m_asm.code);
+        function_offsets = std::move(m_function_offsets);
+        return true;
+    }
+
+private:
+    struct CallFixup
+    {
+        size_t at;
+        size_t code_idx;
+    };
+
+    struct BranchFixup
+    {
+        size_t at;
+        uint32_t target;
+        /// The offset of the br_table jump table the entry is relative to, or 0 for rel32.
+        size_t table = 0;
+    };
+
+    const RegisterModule& m_register_module;
+    const JitRuntime& m_runtime;
+    const size_t m_num_imported_functions;
+    const size_t m_num_imported_globals;
+
+    Assembler m_asm;
+
+    /// The common exits of the compiled functions.
+    size_t m_trap = 0;
+    size_t m_epilogue = 0;
+
+    std::vector<size_t> m_function_offsets;
+    std::vector<CallFixup> m_call_fixups;
+
+    /// The native offsets of the instructions of the function being compiled and the branches
+    /// to them.
+    std::vector<size_t> m_instr_offsets;
+    std::vector<BranchFixup> m_branch_fixups;
+
+    /// The offset of the instruction being compiled.
+    uint32_t m_instr_offset = 0;
+
+    static uint64_t frame_bytes(const RegisterCode& code) noexcept
+    {
+        return (uint64_t{code.frame_size} + JitFrameRecordSize) * sizeof(uint64_t);
+    }
+
+    static constexpr int32_t slot(uint32_t idx) noexcept
+    {
+        return static_cast<int32_t>(idx * sizeof(uint64_t));
+    }
+
+    void load(bool w, Reg reg, uint32_t idx) { m_asm.rm(0, w, {0x8b}, reg, regs_reg, slot(idx)); }
+
+    void store(uint32_t idx, Reg reg) { m_asm.rm(0, true, {0x89}, reg, regs_reg, slot(idx)); }
+
+    void load_context(Reg reg, int32_t offset)
+    {
+        m_asm.rm(0, true, {0x8b}, reg, context_reg, offset);
+    }
+
+    void emit_helper_call(const void* helper)
+    {
+        m_asm.rr(0, true, {0x89}, context_reg, rdi);  // mov rdi, r12
+        m_asm.mov_imm64(rax, reinterpret_cast<uint64_t>(helper));
+        m_asm.call(rax);
+    }
+
+    /// Propagates the status of the call in eax.
+    void emit_check_status()
+    {
+        m_asm.rr(0, false, {0x85}, rax, rax);  // test eax, eax
+        m_asm.jcc_to(cc_ne, m_epilogue);
+    }
+
+    /// Emits the trap and return paths shared by all the functions.
+    void emit_exits()
+    {
+        m_trap = m_asm.offset();
+        m_asm.mov_imm32(rax, static_cast<uint32_t>(JitStatus::Trap));
+        m_epilogue = m_asm.offset();
+        m_asm.emit({0x41, 0x5d});  // pop r13
+        m_asm.emit({0x41, 0x5c});  // pop r12
+        m_asm.emit({0x5b});        // pop rbx
+        m_asm.emit({0xc3});        // ret
+    }
+
+    void emit_prologue(const RegisterCode& code)
+    {
+        m_asm.emit({0x53});        // push rbx
+        m_asm.emit({0x41, 0x54});  // push r12
+        m_asm.emit({0x41, 0x55});  // push r13
+        m_asm.rr(0, true, {0x89}, rdi, context_reg);  // mov r12, rdi
+        m_asm.rr(0, true, {0x89}, rsi, regs_reg);     // mov rbx, rsi
+
+        // The call depth is limited by the execution stack, the native stack is checked
+        // in case the call frames of the native code are bigger.
+        m_asm.rm(0, true, {0x3b}, rsp, context_reg, native_stack_limit_offset);  // cmp rsp, [..]
+        m_asm.jcc_to(cc_b, m_trap);
+
+        emit_interrupt_check();
+
+        load_context(memory_reg, memory_data_offset);
+
+        if (code.num_locals > code.num_args)
+        {
+            m_asm.rr(0, false, {0x31}, rax, rax);  // xor eax, eax
+            for (auto idx = code.num_args; idx < code.num_locals; ++idx)
+                store(idx, rax);
+        }
+        for (size_t i = 0; i < code.constants.size(); ++i)
+        {
+            const auto idx = static_cast<uint32_t>(code.num_locals + i);
+            const auto value = code.constants[i];
+            if (static_cast<int64_t>(value) == static_cast<int32_t>(value))
+            {
+                // mov qword [rbx + slot], imm32 (sign-extended)
+                m_asm.rm(0, true, {0xc7}, 0, regs_reg, slot(idx));
+                m_asm.emit_value(static_cast<int32_t>(value));
+            }
+            else
+            {
+                m_asm.mov_imm64(rax, value);
+                store(idx, rax);
+            }
+        }
+    }
+
+    void emit_branch(size_t at, uint32_t target) { m_branch_fixups.push_back({at, target}); }
+
+    /// Traps if the execution is requested to be interrupted. Only rcx is modified.
+    void emit_interrupt_check()
+    {
+        load_context(rcx, interrupt_requested_offset);
+        m_asm.rm(0, false, {0x80}, 7, rcx, 0);  // cmp byte [rcx], 0
+        m_asm.emit_u8(0);
+        m_asm.jcc_to(cc_ne, m_trap);
+    }
+
+    /// Checks the interruption before the branch if it goes back to a loop.
+    void emit_back_edge_check(uint32_t target)
+    {
+        if (target <= m_instr_offset)
+            emit_interrupt_check();
+    }
+
+    /// Computes the effective address of the memory access of the size in rax, checks it is
+    /// in the memory bounds.
+    void emit_effective_address(uint32_t addr, uint32_t offset, int32_t size)
+    {
+        load(false, rax, addr);
+        if (offset != 0)
+        {
+            m_asm.mov_imm32(rcx, offset);
+            m_asm.rr(0, true, {0x03}, rax, rcx);  // add rax, rcx
+        }
+#if FIZZY_GUARD_PAGES
+        (void)size;
+#else
+        m_asm.rm(0, true, {0x8d}, rcx, rax, size);                         // lea rcx, [rax + size]
+        m_asm.rm(0, true, {0x3b}, rcx, context_reg, memory_size_offset);  // cmp rcx, [..]
+        m_asm.jcc_to(cc_a, m_trap);
+#endif
+    }
+
+    void emit_load(const uint32_t* pc, bool w, std::initializer_list<uint8_t> opcode, int32_t size)
+    {
+        emit_effective_address(pc[2], pc[3], size);
+        m_asm.rm_index(0, w, opcode, rax, memory_reg, rax, 0);
+        store(pc[1], rax);
+    }
+
+    void emit_store(const uint32_t* pc, uint8_t prefix, bool w, uint8_t opcode, int32_t size)
+    {
+        emit_effective_address(pc[1], pc[3], size);
+        load(true, rcx, pc[2]);
+        m_asm.rm_index(prefix, w, {opcode}, rcx, memory_reg, rax, 0);
+    }
+
+    /// The binary operation with the rax and the memory operands.
+    void emit_binary(const uint32_t* pc, bool w, std::initializer_list<uint8_t> opcode)
+    {
+        load(w, rax, pc[2]);
+        m_asm.rm(0, w, opcode, rax, regs_reg, slot(pc[3]));
+        store(pc[1], rax);
+    }
+
+    void emit_comparison(const uint32_t* pc, bool w, Cond cond)
+    {
+        load(w, rax, pc[2]);
+        m_asm.rm(0, w, {0x3b}, rax, regs_reg, slot(pc[3]));  // cmp rax, [b]
+        m_asm.setcc_eax(cond);
+        store(pc[1], rax);
+    }
+
+    /// The shift or rotation of rax by cl, of the given opcode extension.
+    void emit_shift(const uint32_t* pc, bool w, unsigned ext)
+    {
+        load(false, rcx, pc[3]);
+        load(w, rax, pc[2]);
+        m_asm.rr(0, w, {0xd3}, ext, rax);
+        store(pc[1], rax);
+    }
+
+    void emit_division(const uint32_t* pc, bool w, bool is_signed, bool remainder)
+    {
+        load(w, rcx, pc[3]);
+        m_asm.rr(0, w, {0x85}, rcx, rcx);  // test rcx, rcx
+        m_asm.jcc_to(cc_e, m_trap);
+        load(w, rax, pc[2]);
+        if (is_signed)
+        {
+            // The division of the minimal value by -1 overflows, the remainder is 0.
+            m_asm.rr(0, w, {0x83}, 7, rcx);  // cmp rcx, -1
+            m_asm.emit_u8(0xff);
+            const auto not_minus_one = m_asm.jcc(cc_ne);
+            size_t result = 0;
+            if (remainder)
+            {
+                m_asm.rr(0, false, {0x31}, rdx, rdx);  // xor edx, edx
+                result = m_asm.jmp();
+            }
+            else if (w)
+            {
+                m_asm.mov_imm64(rdx, uint64_t{1} << 63);
+                m_asm.rr(0, true, {0x3b}, rax, rdx);  // cmp rax, rdx
+                m_asm.jcc_to(cc_e, m_trap);
+            }
+            else
+            {
+                m_asm.emit_u8(0x3d);  // cmp eax, imm32
+                m_asm.emit_value(uint32_t{1} << 31);
+                m_asm.jcc_to(cc_e, m_trap);
+            }
+            m_asm.patch_rel32(not_minus_one, m_asm.offset());
+            if (w)
+                m_asm.emit({0x48, 0x99});  // cqo
+            else
+                m_asm.emit({0x99});  // cdq
+            m_asm.rr(0, w, {0xf7}, 7, rcx);  // idiv rcx
+            if (remainder)
+                m_asm.patch_rel32(result, m_asm.offset());
+        }
+        else
+        {
+            m_asm.rr(0, false, {0x31}, rdx, rdx);  // xor edx, edx
+            m_asm.rr(0, w, {0xf7}, 6, rcx);        // div rcx
+        }
+        store(pc[1], remainder ? rdx : rax);
+    }
+
+    void emit_eqz(const uint32_t* pc, bool w)
+    {
+        load(w, rax, pc[2]);
+        m_asm.rr(0, w, {0x85}, rax, rax);  // test rax, rax
+        m_asm.setcc_eax(cc_e);
+        store(pc[1], rax);
+    }
+
+    /// Counts the leading (bsr) or trailing (bsf) zero bits.
+    void emit_count_zeros(const uint32_t* pc, bool w, bool leading)
+    {
+        const auto bits = w ? 64u : 32u;
+        load(w, rcx, pc[2]);
+        m_asm.mov_imm32(rax, bits);
+        m_asm.rr(0, w, {0x85}, rcx, rcx);  // test rcx, rcx
+        const auto zero = m_asm.jcc(cc_e);
+        m_asm.rr(0, w, {0x0f, static_cast<uint8_t>(leading ? 0xbd : 0xbc)}, rax, rcx);
+        if (leading)
+        {
+            // The index of the highest set bit to the number of the leading zeros.
+            m_asm.rr(0, false, {0x83}, 6, rax);  // xor eax, bits - 1
+            m_asm.emit_u8(static_cast<uint8_t>(bits - 1));
+        }
+        m_asm.patch_rel32(zero, m_asm.offset());
+        store(pc[1], rax);
+    }
+
+    void emit_popcnt(const uint32_t* pc, bool w)
+    {
+        m_asm.rm(0xf3, w, {0x0f, 0xb8}, rax, regs_reg, slot(pc[2]));
+        store(pc[1], rax);
+    }
+
+    /// Calls the function (of known index or in rax) with the arguments at rsi.
+    void emit_call_imported()
+    {
+        m_asm.rr(0, true, {0x89}, rsi, rdx);  // mov rdx, rsi
+        m_asm.rr(0, false, {0x89}, rax, rsi);  // mov esi, eax
+        emit_helper_call(reinterpret_cast<const void*>(m_runtime.call_imported));
+        emit_check_status();
+    }
+
+    /// Reserves the call frame record around the call of the function in rax or of the known
+    /// code index, with the arguments (the callee's regs) at rsi.
+    void emit_native_call(std::optional<size_t> code_idx)
+    {
+        m_asm.rm(0, true, {0x83}, 5, context_reg, frames_begin_offset);  // sub qword [..], imm8
+        m_asm.emit_u8(static_cast<uint8_t>(frame_record_bytes));
+        m_asm.rr(0, true, {0x89}, context_reg, rdi);  // mov rdi, r12
+        if (code_idx.has_value())
+        {
+            m_asm.emit_u8(0xe8);  // call rel32
+            m_call_fixups.push_back({m_asm.offset(), *code_idx});
+            m_asm.emit_value(int32_t{0});
+        }
+        else
+            m_asm.call(rax);
+        m_asm.rm(0, true, {0x83}, 0, context_reg, frames_begin_offset);  // add qword [..], imm8
+        m_asm.emit_u8(static_cast<uint8_t>(frame_record_bytes));
+        emit_check_status();
+    }
+
+    void emit_call(uint32_t func_idx, uint32_t args)
+    {
+        m_asm.rm(0, true, {0x8d}, rsi, regs_reg, slot(args));  // lea rsi, [rbx + args]
+        if (func_idx < m_num_imported_functions)
+        {
+            m_asm.mov_imm32(rax, func_idx);
+            emit_call_imported();
+            return;
+        }
+
+        const auto code_idx = func_idx - m_num_imported_functions;
+        const auto size = frame_bytes(m_register_module.functions[code_idx]);
+        m_asm.rm(0, true, {0x8d}, rax, rsi, static_cast<int32_t>(size));  // lea rax, [rsi + size]
+        m_asm.rm(0, true, {0x3b}, rax, context_reg, frames_begin_offset);  // cmp rax, [..]
+        m_asm.jcc_to(cc_a, m_trap);
+        emit_native_call(code_idx);
+    }
+
+    void emit_call_indirect(uint32_t type_idx, uint32_t elem, uint32_t args)
+    {
+        m_asm.mov_imm32(rsi, type_idx);
+        load(true, rdx, elem);
+        emit_helper_call(reinterpret_cast<const void*>(m_runtime.resolve_call_indirect));
+        m_asm.rr(0, true, {0x85}, rax, rax);  // test rax, rax
+        m_asm.jcc_to(cc_s, m_trap);
+
+        m_asm.rm(0, true, {0x8d}, rsi, regs_reg, slot(args));  // lea rsi, [rbx + args]
+        m_asm.rr(0, true, {0x81}, 7, rax);                      // cmp rax, imm32
+        m_asm.emit_value(static_cast<uint32_t>(m_num_imported_functions));
+        const auto defined = m_asm.jcc(cc_ae);
+        emit_call_imported();
+        const auto done = m_asm.jmp();
+
+        m_asm.patch_rel32(defined, m_asm.offset());
+        m_asm.rr(0, true, {0x81}, 5, rax);  // sub rax, imm32
+        m_asm.emit_value(static_cast<uint32_t>(m_num_imported_functions));
+        load_context(rcx, frame_sizes_offset);
+        m_asm.rm_index(0, true, {0x8b}, rcx, rcx, rax, 3);  // mov rcx, [rcx + rax * 8]
+        m_asm.rm_index(0, true, {0x8d}, rdx, rsi, rcx, 0);  // lea rdx, [rsi + rcx]
+        m_asm.rm(0, true, {0x3b}, rdx, context_reg, frames_begin_offset);  // cmp rdx, [..]
+        m_asm.jcc_to(cc_a, m_trap);
+        load_context(rcx, functions_offset);
+        m_asm.rm_index(0, true, {0x8b}, rax, rcx, rax, 3);  // mov rax, [rcx + rax * 8]
+        emit_native_call(std::nullopt);
+
+        m_asm.patch_rel32(done, m_asm.offset());
+    }
+
+    /// Loads the address of the global's value to rax, returns its displacement.
+    int32_t emit_global_address(uint32_t global_idx)
+    {
+        if (global_idx < m_num_imported_globals)
+        {
+            load_context(rax, imported_globals_offset);
+            m_asm.rm(0, true, {0x8b}, rax, rax, static_cast<int32_t>(global_idx * 16));
+            return 0;
+        }
+        load_context(rax, globals_offset);
+        return slot(static_cast<uint32_t>(global_idx - m_num_imported_globals));
+    }
+
+    void emit_br_table(const uint32_t* pc)
+    {
+        const auto size = pc[2];
+        if (std::any_of(pc + 3, pc + 4 + size,
+                [this](uint32_t target) { return target <= m_instr_offset; }))
+            emit_interrupt_check();
+
+        load(true, rax, pc[1]);
+        m_asm.mov_imm32(rcx, size);
+        m_asm.rr(0, true, {0x3b}, rax, rcx);        // cmp rax, rcx
+        m_asm.rr(0, true, {0x0f, 0x47}, rax, rcx);  // cmova rax, rcx
+        m_asm.emit({0x48, 0x8d, 0x0d});             // lea rcx, [rip + table]
+        const auto table_ref = m_asm.offset();
+        m_asm.emit_value(int32_t{0});
+        m_asm.rm_index(0, true, {0x63}, rax, rcx, rax, 2);  // movsxd rax, [rcx + rax * 4]
+        m_asm.rr(0, true, {0x01}, rcx, rax);                // add rax, rcx
+        m_asm.rr(0, false, {0xff}, 4, rax);                 // jmp rax
+
+        const auto table = m_asm.offset();
+        m_asm.patch_rel32(table_ref, table);
+        for (uint32_t i = 0; i <= size; ++i)
+        {
+            m_branch_fixups.push_back({m_asm.offset(), pc[3 + i], table});
+            m_asm.emit_value(int32_t{0});
+        }
+    }
+
+    void compile_function(const RegisterCode& code)
+    {
+        const auto& instructions = code.instructions;
+        m_instr_offsets.assign(instructions.size() + 1, 0);
+        m_branch_fixups.clear();
+
+        emit_prologue(code);
+
+        const uint32_t* const begin = instructions.data();
+        const uint32_t* pc = begin;
+        const uint32_t* const end = begin + instructions.size();
+        while (pc < end)
+        {
+            m_instr_offset = static_cast<uint32_t>(pc - begin);
+            m_instr_offsets[m_instr_offset] = m_asm.offset();
+            pc += compile_instruction(pc);
+        }
+        // Not reachable in the translated code, but all the branch targets must be valid.
+        m_instr_offsets[instructions.size()] = m_asm.offset();
+        m_asm.jmp_to(m_trap);
+
+        for (const auto& fixup : m_branch_fixups)
+        {
+            const auto target = m_instr_offsets[fixup.target];
+            if (fixup.table == 0)
+                m_asm.patch_rel32(fixup.at, target);
+            else
+                m_asm.patch_i32(fixup.at, static_cast<int32_t>(static_cast<int64_t>(target) -
+                                                               static_cast<int64_t>(fixup.table)));
+        }
+    }
+
+    /// Compiles the instruction, returns the number of its words.
+    size_t compile_instruction(const uint32_t* pc)
+    {
+        switch (static_cast<RegisterOp>(pc[0]))
+        {
+        case RegisterOp::unreachable:
+            m_asm.jmp_to(m_trap);
+            return 1;
+        case RegisterOp::unsupported:
+            emit_helper_call(reinterpret_cast<const void*>(m_runtime.unsupported));
+            m_asm.jmp_to(m_epilogue);
+            return 1;
+        case RegisterOp::br:
+            emit_back_edge_check(pc[1]);
+            emit_branch(m_asm.jmp(), pc[1]);
+            return 2;
+        case RegisterOp::br_if:
+        case RegisterOp::br_eqz:
+            // The interruption is checked also when the branch is not taken.
+            emit_back_edge_check(pc[2]);
+            load(false, rax, pc[1]);
+            m_asm.rr(0, false, {0x85}, rax, rax);  // test eax, eax
+            emit_branch(
+                m_asm.jcc(static_cast<RegisterOp>(pc[0]) == RegisterOp::br_if ? cc_ne : cc_e),
+                pc[2]);
+            return 3;
+        case RegisterOp::br_table:
+            emit_br_table(pc);
+            return 4 + size_t{pc[2]};
+        case RegisterOp::call:
+            emit_call(pc[1], pc[2]);
+            return 3;
+        case RegisterOp::call_indirect:
+            emit_call_indirect(pc[1], pc[2], pc[3]);
+            return 4;
+        case RegisterOp::ret:
+            load(true, rax, pc[1]);
+            store(0, rax);
+            [[fallthrough]];
+        case RegisterOp::ret_void:
+            m_asm.rr(0, false, {0x31}, rax, rax);  // xor eax, eax (JitStatus::Ok)
+            m_asm.jmp_to(m_epilogue);
+            return static_cast<RegisterOp>(pc[0]) == RegisterOp::ret ? 2 : 1;
+        case RegisterOp::copy:
+            load(true, rax, pc[2]);
+            store(pc[1], rax);
+            return 3;
+        case RegisterOp::select:
+            load(true, rax, pc[2]);
+            load(true, rcx, pc[3]);
+            load(false, rdx, pc[4]);
+            m_asm.rr(0, false, {0x85}, rdx, rdx);       // test edx, edx
+            m_asm.rr(0, true, {0x0f, 0x44}, rax, rcx);  // cmovz rax, rcx
+            store(pc[1], rax);
+            return 5;
+        case RegisterOp::global_get:
+        {
+            const auto disp = emit_global_address(pc[2]);
+            m_asm.rm(0, true, {0x8b}, rax, rax, disp);
+            store(pc[1], rax);
+            return 3;
+        }
+        case RegisterOp::global_set:
+        {
+            const auto disp = emit_global_address(pc[1]);
+            load(true, rcx, pc[2]);
+            m_asm.rm(0, true, {0x89}, rcx, rax, disp);
+            return 3;
+        }
+
+        case RegisterOp::i32_load:
+            emit_load(pc, false, {0x8b}, 4);
+            return 4;
+        case RegisterOp::i64_load:
+            emit_load(pc, true, {0x8b}, 8);
+            return 4;
+        case RegisterOp::i32_load8_s:
+            emit_load(pc, false, {0x0f, 0xbe}, 1);
+            return 4;
+        case RegisterOp::i32_load8_u:
+            emit_load(pc, false, {0x0f, 0xb6}, 1);
+            return 4;
+        case RegisterOp::i32_load16_s:
+            emit_load(pc, false, {0x0f, 0xbf}, 2);
+            return 4;
+        case RegisterOp::i32_load16_u:
+            emit_load(pc, false, {0x0f, 0xb7}, 2);
+            return 4;
+        case RegisterOp::i64_load8_s:
+            emit_load(pc, true, {0x0f, 0xbe}, 1);
+            return 4;
+        case RegisterOp::i64_load16_s:
+            emit_load(pc, true, {0x0f, 0xbf}, 2);
+            return 4;
+        case RegisterOp::i64_load32_s:
+            emit_load(pc, true, {0x63}, 4);
+            return 4;
+        case RegisterOp::store8:
+            emit_store(pc, 0, false, 0x88, 1);
+            return 4;
+        case RegisterOp::store16:
+            emit_store(pc, 0x66, false, 0x89, 2);
+            return 4;
+        case RegisterOp::store32:
+            emit_store(pc, 0, false, 0x89, 4);
+            return 4;
+        case RegisterOp::store64:
+            emit_store(pc, 0, true, 0x89, 8);
+            return 4;
+
+        case RegisterOp::memory_size:
+            load_context(rax, memory_size_offset);
+            m_asm.rr(0, true, {0xc1}, 5, rax);  // shr rax, 16
+            m_asm.emit_u8(16);
+            store(pc[1], rax);
+            return 2;
+        case RegisterOp::memory_grow:
+            load(false, rsi, pc[2]);
+            emit_helper_call(reinterpret_cast<const void*>(m_runtime.memory_grow));
+            m_asm.rr(0, false, {0x89}, rax, rax);  // mov eax, eax
+            store(pc[1], rax);
+            return 3;
+
+        case RegisterOp::i32_eqz:
+            emit_eqz(pc, false);
+            return 3;
+        case RegisterOp::i32_clz:
+            emit_count_zeros(pc, false, true);
+            return 3;
+        case RegisterOp::i32_ctz:
+            emit_count_zeros(pc, false, false);
+            return 3;
+        case RegisterOp::i32_popcnt:
+            emit_popcnt(pc, false);
+            return 3;
+        case RegisterOp::i64_eqz:
+            emit_eqz(pc, true);
+            return 3;
+        case RegisterOp::i64_clz:
+            emit_count_zeros(pc, true, true);
+            return 3;
+        case RegisterOp::i64_ctz:
+            emit_count_zeros(pc, true, false);
+            return 3;
+        case RegisterOp::i64_popcnt:
+            emit_popcnt(pc, true);
+            return 3;
+        case RegisterOp::i32_wrap_i64:
+            load(false, rax, pc[2]);
+            store(pc[1], rax);
+            return 3;
+        case RegisterOp::i64_extend_i32_s:
+            m_asm.rm(0, true, {0x63}, rax, regs_reg, slot(pc[2]));  // movsxd rax, [a]
+            store(pc[1], rax);
+            return 3;
+
+        case RegisterOp::i32_eq:
+            emit_comparison(pc, false, cc_e);
+            return 4;
+        case RegisterOp::i32_ne:
+            emit_comparison(pc, false, cc_ne);
+            return 4;
+        case RegisterOp::i32_lt_s:
+            emit_comparison(pc, false, cc_l);
+            return 4;
+        case RegisterOp::i32_lt_u:
+            emit_comparison(pc, false, cc_b);
+            return 4;
+        case RegisterOp::i32_gt_s:
+            emit_comparison(pc, false, cc_g);
+            return 4;
+        case RegisterOp::i32_gt_u:
+            emit_comparison(pc, false, cc_a);
+            return 4;
+        case RegisterOp::i32_le_s:
+            emit_comparison(pc, false, cc_le);
+            return 4;
+        case RegisterOp::i32_le_u:
+            emit_comparison(pc, false, cc_be);
+            return 4;
+        case RegisterOp::i32_ge_s:
+            emit_comparison(pc, false, cc_ge);
+            return 4;
+        case RegisterOp::i32_ge_u:
+            emit_comparison(pc, false, cc_ae);
+            return 4;
+        case RegisterOp::i32_add:
+            emit_binary(pc, false, {0x03});
+            return 4;
+        case RegisterOp::i32_sub:
+            emit_binary(pc, false, {0x2b});
+            return 4;
+        case RegisterOp::i32_mul:
+            emit_binary(pc, false, {0x0f, 0xaf});
+            return 4;
+        case RegisterOp::i32_div_s:
+            emit_division(pc, false, true, false);
+            return 4;
+        case RegisterOp::i32_div_u:
+            emit_division(pc, false, false, false);
+            return 4;
+        case RegisterOp::i32_rem_s:
+            emit_division(pc, false, true, true);
+            return 4;
+        case RegisterOp::i32_rem_u:
+            emit_division(pc, false, false, true);
+            return 4;
+        case RegisterOp::i32_and:
+            emit_binary(pc, false, {0x23});
+            return 4;
+        case RegisterOp::i32_or:
+            emit_binary(pc, false, {0x0b});
+            return 4;
+        case RegisterOp::i32_xor:
+            emit_binary(pc, false, {0x33});
+            return 4;
+        case RegisterOp::i32_shl:
+            emit_shift(pc, false, 4);
+            return 4;
+        case RegisterOp::i32_shr_s:
+            emit_shift(pc, false, 7);
+            return 4;
+        case RegisterOp::i32_shr_u:
+            emit_shift(pc, false, 5);
+            return 4;
+        case RegisterOp::i32_rotl:
+            emit_shift(pc, false, 0);
+            return 4;
+        case RegisterOp::i32_rotr:
+            emit_shift(pc, false, 1);
+            return 4;
+
+        case RegisterOp::i64_eq:
+            emit_comparison(pc, true, cc_e);
+            return 4;
+        case RegisterOp::i64_ne:
+            emit_comparison(pc, true, cc_ne);
+            return 4;
+        case RegisterOp::i64_lt_s:
+            emit_comparison(pc, true, cc_l);
+            return 4;
+        case RegisterOp::i64_lt_u:
+            emit_comparison(pc, true, cc_b);
+            return 4;
+        case RegisterOp::i64_gt_s:
+            emit_comparison(pc, true, cc_g);
+            return 4;
+        case RegisterOp::i64_gt_u:
+            emit_comparison(pc, true, cc_a);
+            return 4;
+        case RegisterOp::i64_le_s:
+            emit_comparison(pc, true, cc_le);
+            return 4;
+        case RegisterOp::i64_le_u:
+            emit_comparison(pc, true, cc_be);
+            return 4;
+        case RegisterOp::i64_ge_s:
+            emit_comparison(pc, true, cc_ge);
+            return 4;
+        case RegisterOp::i64_ge_u:
+            emit_comparison(pc, true, cc_ae);
+            return 4;
+        case RegisterOp::i64_add:
+            emit_binary(pc, true, {0x03});
+            return 4;
+        case RegisterOp::i64_sub:
+            emit_binary(pc, true, {0x2b});
+            return 4;
+        case RegisterOp::i64_mul:
+            emit_binary(pc, true, {0x0f, 0xaf});
+            return 4;
+        case RegisterOp::i64_div_s:
+            emit_division(pc, true, true, false);
+            return 4;
+        case RegisterOp::i64_div_u:
+            emit_division(pc, true, false, false);
+            return 4;
+        case RegisterOp::i64_rem_s:
+            emit_division(pc, true, true, true);
+            return 4;
+        case RegisterOp::i64_rem_u:
+            emit_division(pc, true, false, true);
+            return 4;
+        case RegisterOp::i64_and:
+            emit_binary(pc, true, {0x23});
+            return 4;
+        case RegisterOp::i64_or:
+            emit_binary(pc, true, {0x0b});
+            return 4;
+        case RegisterOp::i64_xor:
+            emit_binary(pc, true, {0x33});
+            return 4;
+        case RegisterOp::i64_shl:
+            emit_shift(pc, true, 4);
+            return 4;
+        case RegisterOp::i64_shr_s:
+            emit_shift(pc, true, 7);
+            return 4;
+        case RegisterOp::i64_shr_u:
+            emit_shift(pc, true, 5);
+            return 4;
+        case RegisterOp::i64_rotl:
+            emit_shift(pc, true, 0);
+            return 4;
+        case RegisterOp::i64_rotr:
+            emit_shift(pc, true, 1);
+            return 4;
+        }
+        assert(false);
+        return 1;
+    }
+};
+}  // namespace
+
+std::shared_ptr<const JitModule> compile_jit_module(
+    const Module& module, const RegisterModule& register_module, const JitRuntime& runtime)
+{
+    if (!__builtin_cpu_supports("popcnt"))
+        return nullptr;
+
+    std::vector<uint8_t> machine_code;
+    std::vector<size_t> function_offsets;
+    if (!Compiler{module, register_module, runtime}.compile(machine_code, function_offsets))
+        return nullptr;
+
+    // The code is written to the writable pages, which are then made executable (and read-only).
+    auto* const code = mmap(nullptr, machine_code.size(), PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED)
+        return nullptr;
+
+    auto jit_module = std::make_shared<JitModule>();
+    jit_module->code = code;
+    jit_module->code_size = machine_code.size();
+    std::memcpy(code, machine_code.data(), machine_code.size());
+    if (mprotect(code, machine_code.size(), PROT_READ | PROT_EXEC) != 0)
+        return nullptr;
+
+    auto* const code_bytes = static_cast<const uint8_t*>(code);
+    for (size_t i = 0; i < function_offsets.size(); ++i)
+    {
+        jit_module->functions.push_back(code_bytes + function_offsets[i]);
+        jit_module->frame_sizes.push_back(
+            (uint64_t{register_module.functions[i].frame_size} + JitFrameRecordSize) *
+            sizeof(uint64_t));
+    }
+    return jit_module;
+}
+#else
+std::shared_ptr<const JitModule> compile_jit_module(
+    const Module&, const RegisterModule&, const JitRuntime&)
+{
+    return nullptr;
+}
+#endif
+}  // namespace fizzy
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "register_code.hpp"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace fizzy
+{
+struct ExternalGlobal;
+struct Instance;
+
+/// The number of the execution stack values reserved for each call by the compiled code,
+/// the same as the call frame record of the register engine, so the call depth is limited
+/// the same way. The return addresses are kept on the native stack.
+constexpr size_t JitFrameRecordSize = 3;
+
+/// The state of the execution accessed by the compiled code.
+struct JitContext
+{
+    /// The linear memory and its current size in bytes, nullptr and 0 if there is no memory.
+    uint8_t* memory_data = nullptr;
+    uint64_t memory_size = 0;
+
+    /// The beginning of the call frames in the execution stack, lowered by JitFrameRecordSize
+    /// for each call in progress.
+    uint64_t* frames_begin = nullptr;
+
+    /// The lowest native stack address allowed at the function entry, the call traps below it.
+    /// Derived from the bounds of the executing thread's stack.
+    uintptr_t native_stack_limit = 0;
+
+    /// The instance's globals.
+    uint64_t* globals = nullptr;
+    const ExternalGlobal* imported_globals = nullptr;
+
+    /// The entries of the compiled functions and their frame sizes in bytes, including the call
+    /// frame record, in the code section order.
+    const void* const* functions = nullptr;
+    const uint64_t* frame_sizes = nullptr;
+
+    Instance* instance = nullptr;
+
+    /// The instance's interruption request, checked at the function entries and the branches
+    /// back to loops.
+    const std::atomic<bool>* interrupt_requested = nullptr;
+};
+
+/// The result of a compiled function.
+enum class JitStatus : uint32_t
+{
+    Ok,
+    Trap,
+    /// The exception thrown by the runtime function is pending.
+    Exception,
+};
+
+/// The runtime functions called by the compiled code.
+struct JitRuntime
+{
+    /// Returns the index of the function for call_indirect, or -1 if the call traps.
+    uint64_t (*resolve_call_indirect)(
+        JitContext* context, uint32_t type_idx, uint64_t elem_idx) noexcept;
+
+    /// Calls the imported function with the arguments and the result at args.
+    JitStatus (*call_imported)(JitContext* context, uint32_t func_idx, uint64_t* args) noexcept;
+
+    /// Executes memory.grow, returns its result.
+    uint32_t (*memory_grow)(JitContext* context, uint32_t delta) noexcept;
+
+    /// Executes the instruction not supported by Fizzy, returns JitStatus::Exception.
+    JitStatus (*unsupported)(JitContext* context) noexcept;
+};
+
+/// The module's functions compiled to x86-64 machine code from the register-based code.
+///
+/// A compiled function has the frame of the register engine (see RegisterCode), addressed by
+/// the regs argument, and returns its result in regs[0]. The memory is accessed directly,
+/// the calls of other compiled functions are native calls.
+struct JitModule
+{
+    using Function = JitStatus (*)(JitContext* context, uint64_t* regs);
+
+    /// The executable pages.
+    void* code = nullptr;
+    size_t code_size = 0;
+
+    /// The entries of the functions, in the code section order.
+    std::vector<const void*> functions;
+
+    /// The frame sizes of the functions in bytes, including the call frame record.
+    std::vector<uint64_t> frame_sizes;
+
+    JitModule() = default;
+    JitModule(const JitModule&) = delete;
+    JitModule& operator=(const JitModule&) = delete;
+    ~JitModule();
+
+    Function function(size_t code_idx) const noexcept
+    {
+        return reinterpret_cast<Function>(const_cast<void*>(functions[code_idx]));
+    }
+};
+
+/// Compiles the module's functions translated to the register-based code.
+/// Returns nullptr if the compilation is not possible: not on x86-64, the CPU without POPCNT,
+/// the frames too big for 32-bit displacements or executable memory not available.
+std::shared_ptr<const JitModule> compile_jit_module(
+    const Module& module, const RegisterModule& register_module, const JitRuntime& runtime);
+}  // namespace fizzy
@@ -0,0 +1,119 @@
+#include "leb128.hpp"
+#include <algorithm>
+#include <tuple>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace fizzy
+{
+namespace
+{
+using DecodeU32VecFn = decltype(&leb128u_decode_u32_vec_scalar);
+
+DecodeU32VecFn select_decode_u32_vec() noexcept
+{
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("avx2"))
+        return leb128u_decode_u32_vec_avx2;
+    return leb128u_decode_u32_vec_sse2;
+#else
+    return leb128u_decode_u32_vec_scalar;
+#endif
+}
+}  // namespace
+
+const uint8_t* leb128u_decode_u32_vec(
+    const uint8_t* input, const uint8_t* end, uint32_t* out, size_t count)
+{
+    static const auto decode_u32_vec = select_decode_u32_vec();
+    return decode_u32_vec(input, end, out, count);
+}
+
+const uint8_t* leb128u_decode_u32_vec_scalar(
+    const uint8_t* input, const uint8_t* end, uint32_t* out, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+        std::tie(out[i], input) = leb128u_decode<uint32_t>(input, end);
+    return input;
+}
+
+#if defined(__x86_64__)
+const uint8_t* leb128u_decode_u32_vec_sse2(
+    const uint8_t* input, const uint8_t* end, uint32_t* out, size_t count)
+{
+    constexpr size_t block_size = 16;
+    const auto zero = _mm_setzero_si128();
+    while (count >= block_size && static_cast<size_t>(end - input) >= block_size)
+    {
+        const auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input));
+        const auto continuation_mask = static_cast<unsigned>(_mm_movemask_epi8(block));
+        if (continuation_mask == 0)
+        {
+            // All the bytes are single-byte values, zero-extend them to u32.
+            const auto lo = _mm_unpacklo_epi8(block, zero);
+            const auto hi = _mm_unpackhi_epi8(block, zero);
+            auto* const out_vec = reinterpret_cast<__m128i*>(out);
+            _mm_storeu_si128(out_vec + 0, _mm_unpacklo_epi16(lo, zero));
+            _mm_storeu_si128(out_vec + 1, _mm_unpackhi_epi16(lo, zero));
+            _mm_storeu_si128(out_vec + 2, _mm_unpacklo_epi16(hi, zero));
+            _mm_storeu_si128(out_vec + 3, _mm_unpackhi_epi16(hi, zero));
+            input += block_size;
+            out += block_size;
+            count -= block_size;
+        }
+        else
+        {
+            // Copy the single-byte values preceding the first multi-byte one and decode
+            // the next values one by one, block_size values in total. The fixed number
+            // of values keeps the loop predictable for the inputs of many multi-byte values.
+            const auto num_single_byte = static_cast<size_t>(__builtin_ctz(continuation_mask));
+            out = std::copy_n(input, num_single_byte, out);
+            input += num_single_byte;
+            input = leb128u_decode_u32_vec_scalar(input, end, out, block_size - num_single_byte);
+            out += block_size - num_single_byte;
+            count -= block_size;
+        }
+    }
+    return leb128u_decode_u32_vec_scalar(input, end, out, count);
+}
+
+__attribute__((target("avx2"))) const uint8_t* leb128u_decode_u32_vec_avx2(
+    const uint8_t* input, const uint8_t* end, uint32_t* out, size_t count)
+{
+    constexpr size_t block_size = 32;
+    while (count >= block_size && static_cast<size_t>(end - input) >= block_size)
+    {
+        const auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input));
+        const auto continuation_mask = static_cast<unsigned>(_mm256_movemask_epi8(block));
+        if (continuation_mask == 0)
+        {
+            // All the bytes are single-byte values, zero-extend them to u32 8 at a time.
+            auto* const out_vec = reinterpret_cast<__m256i*>(out);
+            for (size_t i = 0; i < 4; ++i)
+            {
+                const auto* const in_vec = reinterpret_cast<const __m128i*>(input + 8 * i);
+                _mm256_storeu_si256(out_vec + i, _mm256_cvtepu8_epi32(_mm_loadl_epi64(in_vec)));
+            }
+            input += block_size;
+            out += block_size;
+            count -= block_size;
+        }
+        else
+        {
+            // Copy the single-byte values preceding the first multi-byte one and decode
+            // the next values one by one, block_size values in total. The fixed number
+            // of values keeps the loop predictable for the inputs of many multi-byte values.
+            const auto num_single_byte = static_cast<size_t>(__builtin_ctz(continuation_mask));
+            out = std::copy_n(input, num_single_byte, out);
+            input += num_single_byte;
+            input = leb128u_decode_u32_vec_scalar(input, end, out, block_size - num_single_byte);
+            out += block_size - num_single_byte;
+            count -= block_size;
+        }
+    }
+    return leb128u_decode_u32_vec_sse2(input, end, out, count);
+}
+#endif
+}  // namespace fizzy
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "exceptions.hpp"
+#include <cstddef>
 #include <cstdint>
 #include <limits>
 #include <utility>
@@ -83,4 +84,23 @@ inline std::pair<T, const uint8_t*> leb128s_decode(const uint8_t* input, const u
     throw parser_error("Invalid LEB128 encoding: too many bytes.");
 }
 
-}  // namespace fizzy
\ No newline at end of file
+/// Decodes count unsigned LEB128-encoded u32 values, stored one after another, into out.
+/// The values are checked like by leb128u_decode<uint32_t>(). Uses the fastest of
+/// the implementations below supported by the CPU.
+const uint8_t* leb128u_decode_u32_vec(
+    const uint8_t* input, const uint8_t* end, uint32_t* out, size_t count);
+
+/// The implementations of leb128u_decode_u32_vec(). The vectorized ones decode the runs
+/// of single-byte values 16 (SSE2) or 32 (AVX2) input bytes at a time and the other values
+/// one by one with leb128u_decode<uint32_t>().
+const uint8_t* leb128u_decode_u32_vec_scalar(
+    const uint8_t* input, const uint8_t* end, uint32_t* out, size_t count);
+#if defined(__x86_64__)
+const uint8_t* leb128u_decode_u32_vec_sse2(
+    const uint8_t* input, const uint8_t* end, uint32_t* out, size_t count);
+
+/// Requires the CPU supporting AVX2.
+const uint8_t* leb128u_decode_u32_vec_avx2(
+    const uint8_t* input, const uint8_t* end, uint32_t* out, size_t count);
+#endif
+}  // namespace fizzy
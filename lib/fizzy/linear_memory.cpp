@@ -0,0 +1,456 @@
+#include "linear_memory.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <vector>
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace fizzy
+{
+namespace
+{
+size_t page_size() noexcept
+{
+    static const auto size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return size;
+}
+
+size_t align_to_page(size_t size) noexcept
+{
+    const auto mask = page_size() - 1;
+    return (size + mask) & ~mask;
+}
+
+/// Returns the size of the address range reserved for the memory of the given max size.
+size_t reservation_size(size_t max_size) noexcept
+{
+    if constexpr (FIZZY_GUARD_PAGES)
+    {
+        (void)max_size;
+        return LinearMemory::GuardedReservationSize;
+    }
+    else
+        return align_to_page(max_size);
+}
+}  // namespace
+
+struct MemoryCheckpoint
+{
+    /// The memory data and its size at the checkpoint.
+    uint8_t* data = nullptr;
+    size_t size = 0;
+
+    /// The number of the pages tracked: the pages committed at the checkpoint.
+    size_t num_pages = 0;
+
+    /// The content of the dirty pages at the checkpoint, at their offsets in the memory.
+    /// The address range is reserved for all the tracked pages, only the saved ones are
+    /// backed by physical memory.
+    uint8_t* saved_pages = nullptr;
+
+    /// The dirty flags of the tracked pages.
+    std::unique_ptr<std::atomic<bool>[]> dirty;
+
+    /// The indexes of the dirty pages, in the order of the first writes.
+    std::unique_ptr<uint32_t[]> dirty_pages;
+    std::atomic<size_t> num_dirty_pages{0};
+
+    ~MemoryCheckpoint() noexcept
+    {
+        if (saved_pages != nullptr)
+            munmap(saved_pages, num_pages * page_size());
+    }
+
+    /// Saves the page before the first write to it and makes it writable.
+    bool save_page(size_t index) noexcept
+    {
+        // Another thread is saving the page, the write is retried until it is done.
+        if (dirty[index].exchange(true))
+            return true;
+
+        const auto offset = index * page_size();
+        std::memcpy(saved_pages + offset, data + offset, page_size());
+        if (mprotect(data + offset, page_size(), PROT_READ | PROT_WRITE) != 0)
+        {
+            dirty[index] = false;
+            return false;
+        }
+        dirty_pages[num_dirty_pages.fetch_add(1)] = static_cast<uint32_t>(index);
+        return true;
+    }
+};
+
+namespace
+{
+/// The checkpoints of the memories ordered by the address of the memory data.
+using CheckpointTable = std::vector<MemoryCheckpoint*>;
+
+/// The registry of the checkpoints, looked up by the write fault handler.
+///
+/// The table is immutable once published, the changes publish a new table. The handler does not
+/// lock: it counts itself as active and searches the table it has loaded. The tables replaced
+/// and the checkpoints discarded are retired, and destroyed by a later change of the registry
+/// made when no handler is active, i.e. none may be accessing them.
+struct CheckpointRegistry
+{
+    std::atomic<const CheckpointTable*> table{nullptr};
+    std::atomic<int> num_active_handlers{0};
+
+    /// The state below is accessed only with the mutex locked.
+    std::mutex mutex;
+    std::unique_ptr<const CheckpointTable> current_table;
+    std::vector<std::unique_ptr<const CheckpointTable>> retired_tables;
+    std::vector<std::unique_ptr<MemoryCheckpoint>> retired_checkpoints;
+
+    /// Publishes the new table and destroys the retired state if no handler may be accessing it.
+    void publish(CheckpointTable entries)
+    {
+        auto new_table = std::make_unique<const CheckpointTable>(std::move(entries));
+        table = new_table.get();
+        if (current_table != nullptr)
+            retired_tables.emplace_back(std::move(current_table));
+        current_table = std::move(new_table);
+
+        // A handler not counted here loads the table published above.
+        if (num_active_handlers.load() == 0)
+        {
+            retired_tables.clear();
+            retired_checkpoints.clear();
+        }
+    }
+
+    void add(MemoryCheckpoint& checkpoint)
+    {
+        const std::lock_guard lock{mutex};
+        auto entries = (current_table != nullptr) ? *current_table : CheckpointTable{};
+        entries.insert(std::upper_bound(entries.begin(), entries.end(), &checkpoint,
+                           [](const auto* a, const auto* b) { return a->data < b->data; }),
+            &checkpoint);
+        publish(std::move(entries));
+    }
+
+    void remove(std::unique_ptr<MemoryCheckpoint> checkpoint)
+    {
+        const std::lock_guard lock{mutex};
+        auto entries = *current_table;
+        entries.erase(std::find(entries.begin(), entries.end(), checkpoint.get()));
+        retired_checkpoints.emplace_back(std::move(checkpoint));
+        publish(std::move(entries));
+    }
+
+    /// Returns the checkpoint of the memory containing the address in its tracked pages.
+    /// It is async-signal-safe.
+    MemoryCheckpoint* find(const uint8_t* address) const noexcept
+    {
+        const auto* const entries = table.load();
+        if (entries == nullptr)
+            return nullptr;
+
+        // The last checkpoint of the memory data starting at or before the address.
+        const auto it = std::upper_bound(entries->begin(), entries->end(), address,
+            [](const uint8_t* a, const MemoryCheckpoint* checkpoint) {
+                return a < checkpoint->data;
+            });
+        if (it == entries->begin())
+            return nullptr;
+        auto* const checkpoint = *(it - 1);
+        return (address < checkpoint->data + checkpoint->num_pages * page_size()) ? checkpoint :
+                                                                                    nullptr;
+    }
+};
+
+/// The registry is never destroyed: the memories having the checkpoint set may outlive
+/// the static objects.
+CheckpointRegistry& checkpoint_registry()
+{
+    static auto* const registry = new CheckpointRegistry;
+    return *registry;
+}
+
+/// Handles the write fault of a page of a memory having the checkpoint set.
+/// Returns true if the faulting access can be retried, false if the fault is not
+/// the write to such page.
+bool handle_write_fault(const void* address) noexcept
+{
+    auto& registry = checkpoint_registry();
+    ++registry.num_active_handlers;
+    const auto* const fault_address = static_cast<const uint8_t*>(address);
+
+    bool handled = false;
+    if (auto* const checkpoint = registry.find(fault_address); checkpoint != nullptr)
+    {
+        handled = checkpoint->save_page(
+            static_cast<size_t>(fault_address - checkpoint->data) / page_size());
+    }
+
+    --registry.num_active_handlers;
+    return handled;
+}
+
+std::atomic<MemoryFaultHandler> execution_fault_handler{nullptr};
+
+struct sigaction previous_sigsegv_action;
+struct sigaction previous_sigbus_action;
+
+void handle_memory_fault(int sig, siginfo_t* info, void* ucontext)
+{
+    // The first write to a page of a checkpointed memory is retried once the page is saved.
+    if (handle_write_fault(info->si_addr))
+        return;
+
+    // The execution handler does not return if the fault is its trap.
+    if (const auto handler = execution_fault_handler.load(); handler != nullptr)
+        handler(info->si_addr);
+
+    // Not a wasm memory access: pass the signal to the previously installed handler.
+    const auto& previous_action =
+        (sig == SIGBUS) ? previous_sigbus_action : previous_sigsegv_action;
+    if ((previous_action.sa_flags & SA_SIGINFO) != 0)
+        previous_action.sa_sigaction(sig, info, ucontext);
+    else if (previous_action.sa_handler != SIG_DFL && previous_action.sa_handler != SIG_IGN)
+        previous_action.sa_handler(sig);
+    else
+    {
+        // The faulting instruction is executed again after return, now with the default action.
+        signal(sig, SIG_DFL);
+    }
+}
+}  // namespace
+
+void install_memory_fault_handler(MemoryFaultHandler execution_handler)
+{
+    static const bool installed = [] {
+        struct sigaction action = {};
+        action.sa_sigaction = handle_memory_fault;
+        action.sa_flags = SA_SIGINFO | SA_NODEFER | SA_ONSTACK;
+        sigemptyset(&action.sa_mask);
+        // Linux reports accesses to protected pages as SIGSEGV, macOS as SIGBUS.
+        sigaction(SIGSEGV, &action, &previous_sigsegv_action);
+        sigaction(SIGBUS, &action, &previous_sigbus_action);
+        return true;
+    }();
+    (void)installed;
+
+    if (execution_handler != nullptr)
+        execution_fault_handler = execution_handler;
+}
+
+std::unique_ptr<MemoryImage> MemoryImage::create(size_t size)
+{
+#if defined(__linux__)
+    const int fd = memfd_create("fizzy-memory-image", MFD_CLOEXEC);
+    if (fd == -1)
+        return nullptr;
+
+    // The file is sparse, the pages never written do not use memory.
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0)
+    {
+        close(fd);
+        return nullptr;
+    }
+
+    return std::unique_ptr<MemoryImage>{new MemoryImage{fd, size}};
+#else
+    (void)size;
+    return nullptr;
+#endif
+}
+
+MemoryImage::~MemoryImage() noexcept
+{
+    close(m_fd);
+}
+
+bool MemoryImage::write(size_t offset, bytes_view data) noexcept
+{
+    assert(offset + data.size() <= m_size);
+    while (!data.empty())
+    {
+        const auto written = pwrite(m_fd, data.data(), data.size(), static_cast<off_t>(offset));
+        if (written <= 0)
+            return false;
+        data.remove_prefix(static_cast<size_t>(written));
+        offset += static_cast<size_t>(written);
+    }
+    return true;
+}
+
+LinearMemory::LinearMemory(size_t size, size_t max_size) : m_max_size{max_size}
+{
+    if (size > max_size)
+        throw std::bad_alloc();
+
+    const auto reserved_size = reservation_size(max_size);
+    if (reserved_size == 0)
+        return;
+
+    // Reserve the address range without making it accessible.
+    void* const reservation = mmap(nullptr, reserved_size, PROT_NONE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (reservation == MAP_FAILED)
+        throw std::bad_alloc();
+    m_data = static_cast<uint8_t*>(reservation);
+
+    try
+    {
+        resize(size);
+    }
+    catch (...)
+    {
+        munmap(m_data, reserved_size);
+        throw;
+    }
+    m_initial_size = size;
+}
+
+LinearMemory::LinearMemory(const MemoryImage& image, size_t max_size) : LinearMemory{0, max_size}
+{
+    if (image.size() > max_size)
+        throw std::bad_alloc();
+
+    if (image.size() == 0)
+        return;
+
+    // Map the image privately at the beginning of the reserved range: the pages are shared
+    // with the image until written to.
+    void* const pages = mmap(m_data, align_to_page(image.size()), PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_FIXED, image.m_fd, 0);
+    if (pages == MAP_FAILED)
+        throw std::bad_alloc();
+    m_size = image.size();
+    m_initial_size = image.size();
+}
+
+LinearMemory::~LinearMemory() noexcept
+{
+    discard_checkpoint();
+    if (m_data != nullptr)
+        munmap(m_data, reservation_size(m_max_size));
+}
+
+void LinearMemory::resize(size_t new_size)
+{
+    assert(new_size >= m_size);
+    if (new_size > m_max_size)
+        throw std::bad_alloc();
+
+    // Commit the new pages by mapping fresh anonymous memory over the reserved range.
+    // These pages are zero-filled and are backed by physical memory only when touched.
+    const auto committed_end = align_to_page(m_size);
+    const auto new_committed_end = align_to_page(new_size);
+    if (new_committed_end > committed_end)
+    {
+        void* const pages = mmap(m_data + committed_end, new_committed_end - committed_end,
+            PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+        if (pages == MAP_FAILED)
+            throw std::bad_alloc();
+    }
+    m_size = new_size;
+}
+
+void LinearMemory::reset()
+{
+    discard_checkpoint();
+
+    const auto initial_end = align_to_page(m_initial_size);
+    const auto committed_end = align_to_page(m_size);
+    if (committed_end > initial_end)
+    {
+        // Return the pages committed by growing to the reservation.
+        void* const pages = mmap(m_data + initial_end, committed_end - initial_end, PROT_NONE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0);
+        if (pages == MAP_FAILED)
+            throw std::bad_alloc();
+    }
+
+    // The discarded pages of the anonymous mapping are zero-filled on the next access,
+    // the ones of the private image mapping are read from the image again.
+    if (initial_end != 0 && madvise(m_data, initial_end, MADV_DONTNEED) != 0)
+        throw std::bad_alloc();
+    m_size = m_initial_size;
+}
+
+void LinearMemory::checkpoint()
+{
+    discard_checkpoint();
+
+    auto checkpoint = std::make_unique<MemoryCheckpoint>();
+    checkpoint->data = m_data;
+    checkpoint->size = m_size;
+    checkpoint->num_pages = align_to_page(m_size) / page_size();
+    const auto tracked_size = checkpoint->num_pages * page_size();
+    if (tracked_size != 0)
+    {
+        void* const saved_pages = mmap(nullptr, tracked_size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (saved_pages == MAP_FAILED)
+            throw std::bad_alloc();
+        checkpoint->saved_pages = static_cast<uint8_t*>(saved_pages);
+    }
+    checkpoint->dirty = std::make_unique<std::atomic<bool>[]>(checkpoint->num_pages);
+    checkpoint->dirty_pages.reset(new uint32_t[checkpoint->num_pages]);
+
+    install_memory_fault_handler();
+
+    checkpoint_registry().add(*checkpoint);
+    m_checkpoint = std::move(checkpoint);
+
+    if (tracked_size != 0 && mprotect(m_data, tracked_size, PROT_READ) != 0)
+    {
+        discard_checkpoint();
+        throw std::bad_alloc();
+    }
+}
+
+void LinearMemory::rollback()
+{
+    assert(m_checkpoint != nullptr);
+    auto& checkpoint = *m_checkpoint;
+
+    const auto num_dirty_pages = checkpoint.num_dirty_pages.load();
+    for (size_t i = 0; i < num_dirty_pages; ++i)
+    {
+        const auto index = checkpoint.dirty_pages[i];
+        const auto offset = index * page_size();
+        std::memcpy(m_data + offset, checkpoint.saved_pages + offset, page_size());
+        if (mprotect(m_data + offset, page_size(), PROT_READ) != 0)
+            throw std::bad_alloc();
+        checkpoint.dirty[index] = false;
+    }
+    checkpoint.num_dirty_pages = 0;
+
+    const auto tracked_end = checkpoint.num_pages * page_size();
+    const auto committed_end = align_to_page(m_size);
+    if (committed_end > tracked_end)
+    {
+        // Return the pages committed by growing to the reservation.
+        void* const pages = mmap(m_data + tracked_end, committed_end - tracked_end, PROT_NONE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0);
+        if (pages == MAP_FAILED)
+            throw std::bad_alloc();
+    }
+    m_size = checkpoint.size;
+}
+
+void LinearMemory::discard_checkpoint() noexcept
+{
+    if (m_checkpoint == nullptr)
+        return;
+
+    const auto tracked_size = m_checkpoint->num_pages * page_size();
+    if (tracked_size != 0)
+        mprotect(m_data, tracked_size, PROT_READ | PROT_WRITE);
+
+    checkpoint_registry().remove(std::move(m_checkpoint));
+}
+
+size_t LinearMemory::num_dirty_pages() const noexcept
+{
+    return (m_checkpoint != nullptr) ? m_checkpoint->num_dirty_pages.load() : 0;
+}
+}  // namespace fizzy
@@ -0,0 +1,176 @@
+#pragma once
+
+#include "bytes.hpp"
+#include "limits.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#ifndef FIZZY_GUARD_PAGES
+#define FIZZY_GUARD_PAGES 0
+#endif
+
+namespace fizzy
+{
+/// The initial content of linear memories, kept in an in-memory file. The linear memories
+/// created from the image map the file privately (copy-on-write), so creating them does not copy
+/// the content and the pages which are only read are shared by all of them.
+class MemoryImage
+{
+public:
+    /// Creates the image of the given size in bytes, filled with zeroes.
+    /// Returns nullptr if in-memory files are not supported or cannot be created.
+    static std::unique_ptr<MemoryImage> create(size_t size);
+
+    ~MemoryImage() noexcept;
+
+    MemoryImage(const MemoryImage&) = delete;
+    MemoryImage& operator=(const MemoryImage&) = delete;
+
+    size_t size() const noexcept { return m_size; }
+
+    /// Writes the data at the given offset of the image, the data must fit in the image.
+    /// Returns false in case of a write error.
+    bool write(size_t offset, bytes_view data) noexcept;
+
+private:
+    MemoryImage(int fd, size_t size) noexcept : m_fd{fd}, m_size{size} {}
+
+    int m_fd = -1;
+    size_t m_size = 0;
+
+    friend class LinearMemory;
+};
+
+/// The memory image of a module, built on the first instantiation and shared by the copies
+/// of the module.
+struct MemoryImageCache
+{
+    std::once_flag built;
+
+    /// The image, nullptr if the module memory cannot be initialized from an image.
+    std::unique_ptr<MemoryImage> image;
+};
+
+/// The dirty page tracking state of a LinearMemory having the checkpoint set.
+struct MemoryCheckpoint;
+
+/// The handler of the memory faults of the wasm execution, called with the fault address.
+/// It does not return if the fault is a trap of the execution.
+using MemoryFaultHandler = void (*)(const void* address);
+
+/// Installs the process-wide handler of the memory faults (SIGSEGV and SIGBUS), once.
+/// The handler retries the first write to each page of a memory having the checkpoint set,
+/// then passes the fault to the execution handler (if set) and then to the handler installed
+/// before. The execution handler is set if not nullptr.
+void install_memory_fault_handler(MemoryFaultHandler execution_handler = nullptr);
+
+/// The wasm linear memory: a zero-initialized, growable block of bytes.
+///
+/// The memory reserves the address range for its maximum size up front and commits pages
+/// of it only when growing, so the memory never moves (pointers to it stay valid after
+/// resizing), growing does not copy the existing content and the pages never accessed do not
+/// use physical memory.
+///
+/// When built with FIZZY_GUARD_PAGES, the memory reserves the whole address range which
+/// a memory instruction can access (see GuardedReservationSize) and only the bytes
+/// of the current memory size are accessible. Accessing the rest of the reservation raises
+/// SIGSEGV (or SIGBUS), what the interpreter converts into a trap instead of checking
+/// the bounds explicitly.
+///
+/// The memory can have a checkpoint set, which it can be rolled back to. The pages written
+/// since the checkpoint are tracked with the write faults of the pages protected
+/// as read-only, see checkpoint().
+class LinearMemory
+{
+public:
+    /// The size of the address range reserved for each memory in the FIZZY_GUARD_PAGES mode:
+    /// a 32-bit address plus a 32-bit offset plus the largest access size, rounded up
+    /// to a page.
+    static constexpr uint64_t GuardedReservationSize = (uint64_t{1} << 33) + PageSize;
+
+    /// Creates the memory of the given size in bytes, filled with zeroes, which can grow up to
+    /// max_size bytes.
+    /// Throws std::bad_alloc in case of allocation failure or when size exceeds max_size.
+    explicit LinearMemory(size_t size = 0, size_t max_size = size_t{MemoryPagesLimit} * PageSize);
+
+    /// Creates the memory with the content and the size of the image, which can grow up to
+    /// max_size bytes. The image may be destroyed afterwards.
+    /// Throws std::bad_alloc in case of allocation failure or when the image size exceeds
+    /// max_size.
+    LinearMemory(const MemoryImage& image, size_t max_size);
+
+    ~LinearMemory() noexcept;
+
+    LinearMemory(const LinearMemory&) = delete;
+    LinearMemory& operator=(const LinearMemory&) = delete;
+
+    uint8_t* data() noexcept { return m_data; }
+    const uint8_t* data() const noexcept { return m_data; }
+
+    size_t size() const noexcept { return m_size; }
+
+    size_t max_size() const noexcept { return m_max_size; }
+
+    uint8_t* begin() noexcept { return m_data; }
+    uint8_t* end() noexcept { return m_data + m_size; }
+    const uint8_t* begin() const noexcept { return m_data; }
+    const uint8_t* end() const noexcept { return m_data + m_size; }
+
+    uint8_t& operator[](size_t index) noexcept { return m_data[index]; }
+    const uint8_t& operator[](size_t index) const noexcept { return m_data[index]; }
+
+    /// Returns the copy of the given range of the memory.
+    bytes substr(size_t pos, size_t count) const { return {m_data + pos, count}; }
+
+    /// Resizes the memory in place, the new bytes are filled with zeroes.
+    /// Shrinking the memory is not supported.
+    /// Throws std::bad_alloc in case of allocation failure or when new_size exceeds max_size,
+    /// the memory is not modified then.
+    void resize(size_t new_size);
+
+    /// Restores the memory as created: its initial size and content, the zeroes or the image
+    /// content. The written pages are discarded (madvise(MADV_DONTNEED)) and the pages
+    /// the memory has grown by are decommitted, so the cost depends on the pages used,
+    /// not on the memory size.
+    /// Throws std::bad_alloc if the pages cannot be decommitted.
+    /// The checkpoint of the memory is discarded.
+    void reset();
+
+    /// Sets the checkpoint the memory can be rolled back to, replacing the previous one.
+    ///
+    /// The pages of the memory are made read-only and the first write to each of them after
+    /// the checkpoint (by the wasm code of any engine, the host functions or the embedder)
+    /// faults: the handler of the fault saves the page content, marks the page dirty
+    /// and makes the page writable again. The writes by the system calls fail with EFAULT
+    /// instead.
+    /// Throws std::bad_alloc in case of allocation failure.
+    void checkpoint();
+
+    /// Restores the content and the size of the memory at the checkpoint. Only the dirty pages
+    /// are copied and the pages the memory has grown by are decommitted, so the cost depends on
+    /// the pages written, not on the memory size. The checkpoint stays set.
+    /// Throws std::bad_alloc if the pages cannot be decommitted or protected.
+    void rollback();
+
+    /// Discards the checkpoint, the pages become writable.
+    void discard_checkpoint() noexcept;
+
+    bool has_checkpoint() const noexcept { return m_checkpoint != nullptr; }
+
+    /// The number of the pages written since the checkpoint (or the last rollback).
+    size_t num_dirty_pages() const noexcept;
+
+private:
+    uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+    size_t m_max_size = 0;
+
+    /// The size the memory has been created with.
+    size_t m_initial_size = 0;
+
+    /// The dirty page tracking state, set by checkpoint().
+    std::unique_ptr<MemoryCheckpoint> m_checkpoint;
+};
+}  // namespace fizzy
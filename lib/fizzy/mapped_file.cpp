@@ -0,0 +1,49 @@
+#include "mapped_file.hpp"
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace fizzy
+{
+MappedFile::MappedFile(const std::string& path)
+{
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        throw std::system_error{errno, std::generic_category(), "cannot open " + path};
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0)
+    {
+        const auto error = errno;
+        close(fd);
+        throw std::system_error{error, std::generic_category(), "cannot stat " + path};
+    }
+
+    // Empty files cannot be mapped.
+    const auto size = static_cast<size_t>(file_stat.st_size);
+    if (size != 0)
+    {
+        void* const data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            const auto error = errno;
+            close(fd);
+            throw std::system_error{error, std::generic_category(), "cannot map " + path};
+        }
+        m_data = static_cast<const uint8_t*>(data);
+        m_size = size;
+    }
+
+    // The mapping stays valid after closing the file.
+    close(fd);
+}
+
+MappedFile::~MappedFile() noexcept
+{
+    if (m_data != nullptr)
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+}
+}  // namespace fizzy
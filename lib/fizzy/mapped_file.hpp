@@ -0,0 +1,32 @@
+#pragma once
+
+#include "bytes.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace fizzy
+{
+/// The read-only memory mapping of a whole file.
+///
+/// The file content is read by the OS on demand, when accessed, and the pages are shared with
+/// the page cache, so loading the file does not allocate or copy.
+class MappedFile
+{
+public:
+    /// Maps the file of the given path.
+    /// Throws std::system_error if the file cannot be opened or mapped.
+    explicit MappedFile(const std::string& path);
+
+    ~MappedFile() noexcept;
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bytes_view content() const noexcept { return {m_data, m_size}; }
+
+private:
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+};
+}  // namespace fizzy
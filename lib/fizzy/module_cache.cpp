@@ -0,0 +1,651 @@
+#include "module_cache.hpp"
+#include "linear_memory.hpp"
+#include "mapped_file.hpp"
+#include "parser.hpp"
+#include "register_code.hpp"
+#include "threaded_code.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <string>
+#include <system_error>
+#include <tuple>
+#include <type_traits>
+#include <unistd.h>
+
+namespace fizzy
+{
+namespace
+{
+constexpr uint8_t SerializedModuleMagic[]{'f', 'i', 'z', 'z', 'y', 'm', 'o', 'd'};
+
+/// Written in the host byte order, identifies the byte order of the serialized module.
+constexpr uint32_t SerializedModuleByteOrderMark = 0x01020304;
+
+class Sha256
+{
+    static constexpr uint32_t k[64] = {0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b,
+        0x59f111f1, 0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+        0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6,
+        0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da, 0x983e5152, 0xa831c66d,
+        0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967, 0x27b70a85,
+        0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585,
+        0x106aa070, 0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+        0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa,
+        0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+    uint32_t m_state[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c,
+        0x1f83d9ab, 0x5be0cd19};
+
+    static uint32_t rotr(uint32_t x, int n) noexcept { return (x >> n) | (x << (32 - n)); }
+
+    void compress(const uint8_t* block) noexcept
+    {
+        uint32_t w[64];
+        for (int i = 0; i < 16; ++i)
+        {
+            w[i] = uint32_t{block[4 * i]} << 24 | uint32_t{block[4 * i + 1]} << 16 |
+                   uint32_t{block[4 * i + 2]} << 8 | uint32_t{block[4 * i + 3]};
+        }
+        for (int i = 16; i < 64; ++i)
+        {
+            const auto s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            const auto s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        auto a = m_state[0], b = m_state[1], c = m_state[2], d = m_state[3];
+        auto e = m_state[4], f = m_state[5], g = m_state[6], h = m_state[7];
+        for (int i = 0; i < 64; ++i)
+        {
+            const auto s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+            const auto t1 = h + s1 + ((e & f) ^ (~e & g)) + k[i] + w[i];
+            const auto s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+            const auto t2 = s0 + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        m_state[0] += a;
+        m_state[1] += b;
+        m_state[2] += c;
+        m_state[3] += d;
+        m_state[4] += e;
+        m_state[5] += f;
+        m_state[6] += g;
+        m_state[7] += h;
+    }
+
+public:
+    ContentHash hash(bytes_view input) noexcept
+    {
+        const auto input_bit_size = uint64_t{input.size()} * 8;
+
+        while (input.size() >= 64)
+        {
+            compress(input.data());
+            input.remove_prefix(64);
+        }
+
+        // The padding: 0x80, zeros and the big-endian input bit size, in one or two blocks.
+        uint8_t last_blocks[128] = {};
+        std::copy(input.begin(), input.end(), last_blocks);
+        last_blocks[input.size()] = 0x80;
+        const size_t last_blocks_size = (input.size() < 56) ? 64 : 128;
+        for (size_t i = 0; i < 8; ++i)
+            last_blocks[last_blocks_size - 1 - i] = static_cast<uint8_t>(input_bit_size >> (8 * i));
+        for (size_t offset = 0; offset < last_blocks_size; offset += 64)
+            compress(last_blocks + offset);
+
+        ContentHash result;
+        for (size_t i = 0; i < 8; ++i)
+        {
+            for (size_t j = 0; j < 4; ++j)
+                result[4 * i + j] = static_cast<uint8_t>(m_state[i] >> (24 - 8 * j));
+        }
+        return result;
+    }
+};
+
+/// Writes the values of the serialized module in the host byte order: the decoded code contains
+/// the immediate values in this order anyway. The order is recorded in the header and
+/// the serialized modules of the other order are rejected.
+class Writer
+{
+    bytes m_output;
+
+public:
+    template <typename T>
+    void write(T value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        uint8_t buffer[sizeof(T)];
+        std::memcpy(buffer, &value, sizeof(T));
+        m_output.append(buffer, sizeof(T));
+    }
+
+    void write_size(size_t size) { write(static_cast<uint32_t>(size)); }
+
+    void write_bytes(const uint8_t* data, size_t size)
+    {
+        write_size(size);
+        m_output.append(data, size);
+    }
+
+    void write_bytes(bytes_view data) { write_bytes(data.data(), data.size()); }
+
+    void write_string(std::string_view str)
+    {
+        write_bytes(reinterpret_cast<const uint8_t*>(str.data()), str.size());
+    }
+
+    void write_limits(const Limits& limits)
+    {
+        write(limits.min);
+        write(limits.max.has_value());
+        write(limits.max.value_or(0));
+    }
+
+    void write_constant_expression(const ConstantExpression& expr)
+    {
+        write(expr.kind);
+        write(expr.kind == ConstantExpression::Kind::Constant ? expr.value.constant :
+                                                                  expr.value.global_index);
+    }
+
+    template <typename T, typename WriteFn>
+    void write_vec(const std::vector<T>& vec, WriteFn write_fn)
+    {
+        write_size(vec.size());
+        for (const auto& item : vec)
+            write_fn(item);
+    }
+
+    bytes& output() noexcept { return m_output; }
+};
+
+/// Reads the values of the serialized module, checking the input bounds.
+class Reader
+{
+    const uint8_t* m_pos;
+    const uint8_t* const m_end;
+
+public:
+    explicit Reader(bytes_view input) noexcept
+      : m_pos{input.data()}, m_end{input.data() + input.size()}
+    {}
+
+    bool at_end() const noexcept { return m_pos == m_end; }
+
+    const uint8_t* read_raw(size_t size)
+    {
+        if (size > static_cast<size_t>(m_end - m_pos))
+            throw parser_error{"unexpected end of serialized module"};
+        const auto* const data = m_pos;
+        m_pos += size;
+        return data;
+    }
+
+    template <typename T>
+    T read()
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        T value;
+        std::memcpy(&value, read_raw(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    bool read_bool()
+    {
+        const auto value = read<uint8_t>();
+        if (value > 1)
+            throw parser_error{"invalid bool in serialized module"};
+        return value != 0;
+    }
+
+    /// Reads the number of items, each taking at least min_item_size bytes of the input.
+    size_t read_size(size_t min_item_size = 1)
+    {
+        const auto size = size_t{read<uint32_t>()};
+        if (size > static_cast<size_t>(m_end - m_pos) / min_item_size)
+            throw parser_error{"unexpected end of serialized module"};
+        return size;
+    }
+
+    bytes_view read_bytes()
+    {
+        const auto size = read_size();
+        return {read_raw(size), size};
+    }
+
+    std::string_view read_string()
+    {
+        const auto data = read_bytes();
+        return {reinterpret_cast<const char*>(data.data()), data.size()};
+    }
+
+    ValType read_valtype()
+    {
+        const auto type = static_cast<ValType>(read<uint8_t>());
+        if (type != ValType::i32 && type != ValType::i64 && type != ValType::f32 &&
+            type != ValType::f64)
+            throw parser_error{"invalid valtype in serialized module"};
+        return type;
+    }
+
+    ExternalKind read_external_kind()
+    {
+        const auto kind = read<uint8_t>();
+        if (kind > static_cast<uint8_t>(ExternalKind::Global))
+            throw parser_error{"invalid external kind in serialized module"};
+        return static_cast<ExternalKind>(kind);
+    }
+
+    Limits read_limits()
+    {
+        Limits limits;
+        limits.min = read<uint32_t>();
+        const auto has_max = read_bool();
+        const auto max = read<uint32_t>();
+        if (has_max)
+            limits.max = max;
+        return limits;
+    }
+
+    ConstantExpression read_constant_expression()
+    {
+        ConstantExpression expr;
+        const auto kind = read<uint8_t>();
+        const auto value = read<uint64_t>();
+        if (kind == static_cast<uint8_t>(ConstantExpression::Kind::Constant))
+            expr.value.constant = value;
+        else if (kind == static_cast<uint8_t>(ConstantExpression::Kind::GlobalGet))
+        {
+            expr.kind = ConstantExpression::Kind::GlobalGet;
+            expr.value.global_index = static_cast<uint32_t>(value);
+        }
+        else
+            throw parser_error{"invalid constant expression in serialized module"};
+        return expr;
+    }
+
+    template <typename T, typename ReadFn>
+    std::vector<T> read_vec(ReadFn read_fn, size_t min_item_size = 1)
+    {
+        const auto size = read_size(min_item_size);
+        std::vector<T> vec;
+        vec.reserve(size);
+        for (size_t i = 0; i < size; ++i)
+            vec.emplace_back(read_fn());
+        return vec;
+    }
+};
+
+/// Checks the indices and the code properties of the deserialized module which the execution
+/// relies on.
+void validate_serialized_module(const Module& module)
+{
+    const auto malformed = [](const char* what) {
+        throw parser_error{std::string{"malformed serialized module: "} + what};
+    };
+
+    size_t num_functions = module.funcsec.size();
+    size_t num_tables = module.tablesec.size();
+    size_t num_memories = module.memorysec.size();
+    size_t num_globals = module.globalsec.size();
+    for (const auto& import : module.importsec)
+    {
+        switch (import.kind)
+        {
+        case ExternalKind::Function:
+            if (import.desc.function_type_index >= module.typesec.size())
+                malformed("invalid type index");
+            ++num_functions;
+            break;
+        case ExternalKind::Table:
+            ++num_tables;
+            break;
+        case ExternalKind::Memory:
+            ++num_memories;
+            break;
+        case ExternalKind::Global:
+            ++num_globals;
+            break;
+        }
+    }
+
+    const auto check_type_idx = [&](TypeIdx idx) {
+        if (idx >= module.typesec.size())
+            malformed("invalid type index");
+    };
+    const auto check_func_idx = [&](FuncIdx idx) {
+        if (idx >= num_functions)
+            malformed("invalid function index");
+    };
+    const auto check_expression = [&](const ConstantExpression& expr) {
+        if (expr.kind == ConstantExpression::Kind::GlobalGet &&
+            expr.value.global_index >= num_globals)
+            malformed("invalid global index");
+    };
+
+    for (const auto type_idx : module.funcsec)
+        check_type_idx(type_idx);
+    for (const auto type_idx : module.imported_function_types)
+        check_type_idx(type_idx);
+    if (module.imported_function_types.size() + module.funcsec.size() != num_functions)
+        malformed("number of imported functions differs");
+    if (module.codesec.size() != module.funcsec.size())
+        malformed("number of functions and codes differ");
+    for (const auto& code : module.codesec)
+    {
+        if (code.max_stack_height < 0)
+            malformed("invalid max stack height");
+    }
+
+    for (const auto& global : module.globalsec)
+        check_expression(global.expression);
+    for (const auto& export_ : module.exportsec)
+    {
+        const size_t num_items[]{num_functions, num_tables, num_memories, num_globals};
+        if (export_.index >= num_items[static_cast<uint8_t>(export_.kind)])
+            malformed("invalid export index");
+    }
+    if (module.startfunc.has_value())
+        check_func_idx(*module.startfunc);
+    for (const auto& element : module.elementsec)
+    {
+        check_expression(element.offset);
+        for (const auto func_idx : element.init)
+            check_func_idx(func_idx);
+    }
+    for (const auto& data : module.datasec)
+        check_expression(data.offset);
+}
+
+/// Loads the module from the serialized form. The module references the bytes of the input,
+/// it is up to the caller to set Module::storage.
+Module deserialize_binary(bytes_view input, const ContentHash& hash)
+{
+    Reader r{input};
+    if (std::memcmp(r.read_raw(sizeof(SerializedModuleMagic)), SerializedModuleMagic,
+            sizeof(SerializedModuleMagic)) != 0)
+        throw parser_error{"invalid serialized module prefix"};
+    if (r.read<uint32_t>() != SerializedModuleByteOrderMark)
+        throw parser_error{"serialized module byte order mismatch"};
+    if (r.read<uint32_t>() != SerializedModuleVersion)
+        throw parser_error{"unsupported serialized module version"};
+    if (std::memcmp(r.read_raw(hash.size()), hash.data(), hash.size()) != 0)
+        throw parser_error{"serialized module content hash mismatch"};
+
+    // The decoded code is executed without the validation, so the corrupted entries must not be
+    // loaded.
+    const auto* const checksum = r.read_raw(std::tuple_size_v<ContentHash>);
+    const auto checksum_end = static_cast<size_t>(checksum - input.data()) + sizeof(ContentHash);
+    const auto body_checksum = Sha256{}.hash(input.substr(checksum_end));
+    if (std::memcmp(checksum, body_checksum.data(), body_checksum.size()) != 0)
+        throw parser_error{"serialized module checksum mismatch"};
+
+    const auto read_valtype = [&] { return r.read_valtype(); };
+    const auto read_u32 = [&] { return r.read<uint32_t>(); };
+    const auto read_limits = [&] { return r.read_limits(); };
+
+    Module module;
+    module.typesec = r.read_vec<FuncType>([&] {
+        FuncType type;
+        type.inputs = r.read_vec<ValType>(read_valtype);
+        type.outputs = r.read_vec<ValType>(read_valtype);
+        return type;
+    });
+    module.importsec = r.read_vec<Import>([&] {
+        Import import{};
+        import.module = r.read_string();
+        import.name = r.read_string();
+        import.kind = r.read_external_kind();
+        switch (import.kind)
+        {
+        case ExternalKind::Function:
+            import.desc.function_type_index = r.read<uint32_t>();
+            break;
+        case ExternalKind::Table:
+            import.desc.table.limits = r.read_limits();
+            break;
+        case ExternalKind::Memory:
+            import.desc.memory.limits = r.read_limits();
+            break;
+        case ExternalKind::Global:
+            import.desc.global_mutable = r.read_bool();
+            break;
+        }
+        return import;
+    });
+    module.funcsec = r.read_vec<TypeIdx>(read_u32, sizeof(uint32_t));
+    module.tablesec = r.read_vec<Table>([&] { return Table{read_limits()}; });
+    module.memorysec = r.read_vec<Memory>([&] { return Memory{read_limits()}; });
+    module.globalsec = r.read_vec<Global>([&] {
+        Global global;
+        global.is_mutable = r.read_bool();
+        global.expression = r.read_constant_expression();
+        return global;
+    });
+    module.exportsec = r.read_vec<Export>([&] {
+        Export export_;
+        export_.name = r.read_string();
+        export_.kind = r.read_external_kind();
+        export_.index = r.read<uint32_t>();
+        return export_;
+    });
+    const auto has_startfunc = r.read_bool();
+    const auto startfunc = r.read<uint32_t>();
+    if (has_startfunc)
+        module.startfunc = startfunc;
+    module.elementsec = r.read_vec<Element>([&] {
+        Element element;
+        element.offset = r.read_constant_expression();
+        element.init = r.read_vec<FuncIdx>(read_u32, sizeof(uint32_t));
+        return element;
+    });
+    module.codesec = r.read_vec<Code>([&] {
+        Code code;
+        code.local_count = r.read<uint32_t>();
+        code.max_stack_height = r.read<int>();
+        const auto instructions = r.read_bytes();
+        code.instructions.resize(instructions.size());
+        std::memcpy(code.instructions.data(), instructions.data(), instructions.size());
+        code.immediates = r.read_bytes();
+        return code;
+    });
+    module.datasec = r.read_vec<Data>([&] {
+        Data data;
+        data.offset = r.read_constant_expression();
+        data.mapped_init = r.read_bytes();
+        return data;
+    });
+    module.imported_function_types = r.read_vec<TypeIdx>(read_u32, sizeof(uint32_t));
+
+    if (!r.at_end())
+        throw parser_error{"unexpected data at the end of serialized module"};
+    validate_serialized_module(module);
+
+    module.memory_image_cache = std::make_shared<MemoryImageCache>();
+
+    module.register_module_cache = std::make_shared<RegisterModuleCache>();
+
+    module.threaded_code_cache = std::make_shared<ThreadedCodeCache>();
+    return module;
+}
+
+std::string to_hex(const ContentHash& hash)
+{
+    static constexpr auto hex_digits = "0123456789abcdef";
+    std::string str;
+    for (const auto b : hash)
+    {
+        str += hex_digits[b >> 4];
+        str += hex_digits[b & 0xf];
+    }
+    return str;
+}
+
+/// Loads the module from the mapped cache file, the module references the mapping.
+/// Returns an empty result if the file cannot be read or is not valid.
+std::optional<Module> load_cached_module(const std::string& path, const ContentHash& hash)
+{
+    try
+    {
+        auto file = std::make_shared<const MappedFile>(path);
+        auto module = deserialize_binary(file->content(), hash);
+        module.storage = std::move(file);
+        return module;
+    }
+    catch (const std::system_error&)
+    {
+        // No entry yet.
+    }
+    catch (const parser_error&)
+    {
+        // Invalid or outdated entry, to be replaced.
+    }
+    return std::nullopt;
+}
+
+/// Stores the serialized module in the cache. The file is written under a unique temporary name
+/// and renamed when complete, so the concurrent readers and writers (also the threads of this
+/// process) never see a partially written entry.
+void store_cached_module(const std::string& path, bytes_view serialized) noexcept
+{
+    std::string tmp_path = path + ".tmp.XXXXXX";
+    // The file is created with O_EXCL.
+    const int fd = mkostemp(tmp_path.data(), O_CLOEXEC);
+    if (fd == -1)
+        return;
+
+    bool ok = true;
+    while (ok && !serialized.empty())
+    {
+        const auto written = write(fd, serialized.data(), serialized.size());
+        ok = written > 0;
+        if (ok)
+            serialized.remove_prefix(static_cast<size_t>(written));
+    }
+    ok = ok && (fchmod(fd, 0644) == 0);
+    ok = (close(fd) == 0) && ok;
+
+    if (!ok || std::rename(tmp_path.c_str(), path.c_str()) != 0)
+        unlink(tmp_path.c_str());
+}
+}  // namespace
+
+ContentHash content_hash(bytes_view wasm_binary) noexcept
+{
+    return Sha256{}.hash(wasm_binary);
+}
+
+bytes serialize(const Module& module, const ContentHash& hash)
+{
+    Writer w;
+    w.output().append(SerializedModuleMagic, sizeof(SerializedModuleMagic));
+    w.write(SerializedModuleByteOrderMark);
+    w.write(SerializedModuleVersion);
+    w.output().append(hash.data(), hash.size());
+    // The checksum of the body, written when the body is complete.
+    const auto checksum_offset = w.output().size();
+    w.output().append(std::tuple_size_v<ContentHash>, 0);
+
+    const auto write_valtype = [&](ValType type) { w.write(type); };
+    const auto write_u32 = [&](uint32_t value) { w.write(value); };
+
+    w.write_vec(module.typesec, [&](const FuncType& type) {
+        w.write_vec(type.inputs, write_valtype);
+        w.write_vec(type.outputs, write_valtype);
+    });
+    w.write_vec(module.importsec, [&](const Import& import) {
+        w.write_string(import.module);
+        w.write_string(import.name);
+        w.write(import.kind);
+        switch (import.kind)
+        {
+        case ExternalKind::Function:
+            w.write(import.desc.function_type_index);
+            break;
+        case ExternalKind::Table:
+            w.write_limits(import.desc.table.limits);
+            break;
+        case ExternalKind::Memory:
+            w.write_limits(import.desc.memory.limits);
+            break;
+        case ExternalKind::Global:
+            w.write(import.desc.global_mutable);
+            break;
+        }
+    });
+    w.write_vec(module.funcsec, write_u32);
+    w.write_vec(module.tablesec, [&](const Table& table) { w.write_limits(table.limits); });
+    w.write_vec(module.memorysec, [&](const Memory& memory) { w.write_limits(memory.limits); });
+    w.write_vec(module.globalsec, [&](const Global& global) {
+        w.write(global.is_mutable);
+        w.write_constant_expression(global.expression);
+    });
+    w.write_vec(module.exportsec, [&](const Export& export_) {
+        w.write_string(export_.name);
+        w.write(export_.kind);
+        w.write(export_.index);
+    });
+    w.write(module.startfunc.has_value());
+    w.write(module.startfunc.value_or(0));
+    w.write_vec(module.elementsec, [&](const Element& element) {
+        w.write_constant_expression(element.offset);
+        w.write_vec(element.init, write_u32);
+    });
+
+    w.write_size(module.funcsec.size());
+    for (size_t i = 0; i < module.funcsec.size(); ++i)
+    {
+        const auto& code = get_code(module, i);
+        w.write(code.local_count);
+        w.write(code.max_stack_height);
+        w.write_bytes(
+            reinterpret_cast<const uint8_t*>(code.instructions.data()), code.instructions.size());
+        w.write_bytes(code.immediates);
+    }
+
+    w.write_vec(module.datasec, [&](const Data& data) {
+        w.write_constant_expression(data.offset);
+        w.write_bytes(data.payload());
+    });
+    w.write_vec(module.imported_function_types, write_u32);
+
+    auto& output = w.output();
+    const auto checksum_end = checksum_offset + sizeof(ContentHash);
+    const auto checksum = Sha256{}.hash(bytes_view{output}.substr(checksum_end));
+    std::copy(checksum.begin(), checksum.end(), &output[checksum_offset]);
+    return std::move(output);
+}
+
+Module deserialize(bytes_view input, const ContentHash& hash)
+{
+    auto module = deserialize_binary(input, hash);
+    copy_referenced_bytes(module);
+    return module;
+}
+
+Module parse_cached(bytes_view wasm_binary, const std::string& cache_directory)
+{
+    const auto hash = content_hash(wasm_binary);
+    const auto path = cache_directory + '/' + to_hex(hash);
+
+    if (auto module = load_cached_module(path, hash); module.has_value())
+        return std::move(*module);
+
+    auto module = parse(wasm_binary);
+    store_cached_module(path, serialize(module, hash));
+    return module;
+}
+}  // namespace fizzy
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "bytes.hpp"
+#include "types.hpp"
+#include <array>
+#include <cstdint>
+#include <string>
+
+namespace fizzy
+{
+/// The version of the serialized module format. It must be increased whenever the format or
+/// the representation of the decoded code changes, the serialized modules of other versions are
+/// rejected.
+constexpr uint32_t SerializedModuleVersion = 3;
+
+/// The SHA-256 hash of a wasm binary, identifying the module in the module cache.
+using ContentHash = std::array<uint8_t, 32>;
+
+/// Computes the content hash of the wasm binary.
+ContentHash content_hash(bytes_view wasm_binary) noexcept;
+
+/// Serializes the module parsed from the wasm binary of the given content hash. The serialized
+/// form contains the validated module with the decoded code, so loading it requires
+/// no decoding or validation. The function bodies of a lazily decoded module are decoded now.
+/// The values are stored in the host byte order, the serialized form can be loaded only on
+/// the hosts of the same byte order.
+bytes serialize(const Module& module, const ContentHash& hash);
+
+/// Loads the module from the serialized form, checking the format version and that the module
+/// was serialized from the wasm binary of the given content hash.
+/// The serialized form is trusted to be produced by serialize(): the checksum of its content
+/// detects the corrupted or truncated input and the indices the execution relies on are checked,
+/// but the decoded code is not validated again. The checksum does not protect from deliberate
+/// changes: the code of an edited serialized module can access memory out of bounds (e.g. with
+/// invalid local indices, branch targets or max stack heights).
+/// Throws parser_error if the input is malformed, corrupted or does not match the version
+/// or the hash.
+Module deserialize(bytes_view input, const ContentHash& hash);
+
+/// Parses the wasm binary using the module cache in the given directory.
+/// The module is loaded from the file named after the content hash of the binary, if it exists
+/// and is valid, with the names and the data segment payloads referencing the mapped file.
+/// Otherwise the binary is parsed and the serialized module is stored in the cache
+/// (failures to store it are ignored). Throws the same errors as parse().
+/// The cache directory must be trusted: anyone able to write to it can make the loaded modules
+/// execute arbitrary code (see deserialize()), so it must be writable only by the users
+/// allowed to run the code of the process.
+Module parse_cached(bytes_view wasm_binary, const std::string& cache_directory);
+}  // namespace fizzy
@@ -0,0 +1,215 @@
+#pragma once
+
+#include "bytes.hpp"
+#include "execute.hpp"
+#include "types.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+namespace fizzy
+{
+struct NativeContext;
+
+/// The number of the execution stack values reserved for each call by the native code, the same
+/// as the call frame record of the register engine, so the call depth is limited the same way.
+constexpr std::ptrdiff_t NativeFrameRecordSize = 3;
+
+/// The function compiled to native code by fizzy-aot, see NativeModule.
+///
+/// It takes the space of the execution stack (in values) available for the function's frame
+/// of the register-based code (see RegisterCode) and the arguments, and returns the result
+/// (0 if the function has none). A trap is thrown as an exception caught by execute().
+using NativeFunction = uint64_t (*)(
+    NativeContext& context, std::ptrdiff_t stack_space, const uint64_t* args);
+
+/// The module's functions compiled ahead of time to C++ by fizzy-aot, from the register-based
+/// code of the module. The memory, the globals, the table and the imported functions are
+/// the ones of the instance, so an instance of the module executes the native code when
+/// its native_module is set to this module and its engine to ExecutionEngine::Native.
+struct NativeModule
+{
+    /// The wasm binary the functions are compiled from, to be instantiated with parse().
+    bytes_view wasm;
+
+    /// The functions, in the code section order.
+    const NativeFunction* functions = nullptr;
+    size_t num_functions = 0;
+};
+
+/// The state of the execution accessed by the native code.
+struct NativeContext
+{
+    Instance& instance;
+    const NativeModule& module;
+
+    /// The linear memory and its current size in bytes, nullptr and 0 if there is no memory.
+    uint8_t* memory_data = nullptr;
+    uint64_t memory_size = 0;
+
+    /// The instance's globals.
+    uint64_t* globals = nullptr;
+    const ExternalGlobal* imported_globals = nullptr;
+
+    /// The beginning of the call frames in the execution stack when the execution started.
+    /// The stack space of a function is measured from it.
+    uint64_t* frames_begin = nullptr;
+
+    /// The lowest native stack address allowed at the function entry, the call traps below it.
+    /// Derived from the bounds of the executing thread's stack.
+    uintptr_t native_stack_limit = 0;
+
+    /// Abandons the execution with a trap.
+    [[noreturn]] void trap() const;
+
+    /// Executes the instruction not supported by Fizzy, throws unsupported_feature.
+    [[noreturn]] void unsupported() const;
+
+    /// Calls the imported function, with the arguments at the given stack space (see
+    /// NativeFunction). Returns its result, 0 if it has none.
+    uint64_t call_imported(FuncIdx func_idx, std::ptrdiff_t stack_space, const uint64_t* args);
+
+    /// Executes call_indirect, with the arguments at the given stack space.
+    uint64_t call_indirect(TypeIdx expected_type_idx, uint64_t elem_idx,
+        std::ptrdiff_t stack_space, const uint64_t* args);
+
+    /// Executes memory.grow, returns its result.
+    uint32_t memory_grow(uint32_t delta);
+};
+
+/// The helpers of the native code generated by fizzy-aot.
+namespace native
+{
+/// Traps if the execution is requested to be interrupted, see Instance::interrupt_requested.
+/// Checked at the function entries and the branches back to loops.
+inline void check_interrupt(const NativeContext& context)
+{
+    if (context.instance.interrupt_requested.load(std::memory_order_relaxed))
+        context.trap();
+}
+
+/// Checks if the execution stack has space for the function's frame and the native stack
+/// for its call, traps otherwise.
+inline void enter(NativeContext& context, std::ptrdiff_t stack_space, std::ptrdiff_t frame_size)
+{
+    // The address of a local approximates the native stack pointer.
+    const char probe = 0;
+    if (stack_space < frame_size ||
+        reinterpret_cast<uintptr_t>(&probe) < context.native_stack_limit)
+        context.trap();
+    check_interrupt(context);
+}
+
+template <typename DstT, typename SrcT = DstT>
+inline uint64_t load(const NativeContext& context, uint64_t addr, uint32_t offset)
+{
+    const auto effective_address = addr + offset;
+    if (effective_address + sizeof(SrcT) > context.memory_size)
+        context.trap();
+    SrcT value;
+    std::memcpy(&value, context.memory_data + effective_address, sizeof(value));
+    return static_cast<uint64_t>(static_cast<DstT>(value));
+}
+
+template <typename T>
+inline void store(const NativeContext& context, uint64_t addr, uint64_t value, uint32_t offset)
+{
+    const auto effective_address = addr + offset;
+    if (effective_address + sizeof(T) > context.memory_size)
+        context.trap();
+    const auto v = static_cast<T>(value);
+    std::memcpy(context.memory_data + effective_address, &v, sizeof(v));
+}
+
+template <typename T>
+inline uint64_t div_s(const NativeContext& context, uint64_t a, uint64_t b)
+{
+    const auto lhs = static_cast<T>(a);
+    const auto rhs = static_cast<T>(b);
+    if (rhs == 0 || (lhs == std::numeric_limits<T>::min() && rhs == -1))
+        context.trap();
+    return static_cast<std::make_unsigned_t<T>>(lhs / rhs);
+}
+
+template <typename T>
+inline uint64_t rem_s(const NativeContext& context, uint64_t a, uint64_t b)
+{
+    const auto lhs = static_cast<T>(a);
+    const auto rhs = static_cast<T>(b);
+    if (rhs == 0)
+        context.trap();
+    if (rhs == -1)
+        return 0;  // The remainder of INT_MIN / -1 is 0, but the C++ division overflows.
+    return static_cast<std::make_unsigned_t<T>>(lhs % rhs);
+}
+
+template <typename T>
+inline uint64_t div_u(const NativeContext& context, uint64_t a, uint64_t b)
+{
+    if (static_cast<T>(b) == 0)
+        context.trap();
+    return static_cast<T>(a) / static_cast<T>(b);
+}
+
+template <typename T>
+inline uint64_t rem_u(const NativeContext& context, uint64_t a, uint64_t b)
+{
+    if (static_cast<T>(b) == 0)
+        context.trap();
+    return static_cast<T>(a) % static_cast<T>(b);
+}
+
+template <typename T>
+inline uint64_t rotl(uint64_t a, uint64_t b) noexcept
+{
+    constexpr unsigned num_bits = sizeof(T) * 8;
+    const auto value = static_cast<T>(a);
+    const auto k = static_cast<unsigned>(b) & (num_bits - 1);
+    return k == 0 ? value : static_cast<T>((value << k) | (value >> (num_bits - k)));
+}
+
+template <typename T>
+inline uint64_t rotr(uint64_t a, uint64_t b) noexcept
+{
+    constexpr unsigned num_bits = sizeof(T) * 8;
+    const auto value = static_cast<T>(a);
+    const auto k = static_cast<unsigned>(b) & (num_bits - 1);
+    return k == 0 ? value : static_cast<T>((value >> k) | (value << (num_bits - k)));
+}
+
+inline uint64_t clz32(uint64_t a) noexcept
+{
+    const auto value = static_cast<uint32_t>(a);
+    return value == 0 ? 32 : static_cast<uint64_t>(__builtin_clz(value));
+}
+
+inline uint64_t ctz32(uint64_t a) noexcept
+{
+    const auto value = static_cast<uint32_t>(a);
+    return value == 0 ? 32 : static_cast<uint64_t>(__builtin_ctz(value));
+}
+
+inline uint64_t popcnt32(uint64_t a) noexcept
+{
+    return static_cast<uint64_t>(__builtin_popcount(static_cast<uint32_t>(a)));
+}
+
+inline uint64_t clz64(uint64_t a) noexcept
+{
+    return a == 0 ? 64 : static_cast<uint64_t>(__builtin_clzll(a));
+}
+
+inline uint64_t ctz64(uint64_t a) noexcept
+{
+    return a == 0 ? 64 : static_cast<uint64_t>(__builtin_ctzll(a));
+}
+
+inline uint64_t popcnt64(uint64_t a) noexcept
+{
+    return static_cast<uint64_t>(__builtin_popcountll(a));
+}
+}  // namespace native
+}  // namespace fizzy
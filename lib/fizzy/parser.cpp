@@ -1,8 +1,20 @@
 #include "parser.hpp"
 #include "leb128.hpp"
+#include "linear_memory.hpp"
+#include "mapped_file.hpp"
+#include "register_code.hpp"
+#include "threaded_code.hpp"
+#include "superinstructions.hpp"
 #include "types.hpp"
 #include "utf8.hpp"
 #include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <exception>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <type_traits>
 
 namespace fizzy
 {
@@ -29,6 +41,24 @@ inline parser_result<std::vector<T>> parse_vec(const uint8_t* pos, const uint8_t
     return {result, pos};
 }
 
+/// Parses the vec of u32 values (e.g. type or function indices), decoding them in bulk.
+template <>
+inline parser_result<std::vector<uint32_t>> parse_vec(const uint8_t* pos, const uint8_t* end)
+{
+    uint32_t size;
+    std::tie(size, pos) = leb128u_decode<uint32_t>(pos, end);
+
+    // Each value takes at least one byte, so the output size is limited by the input size.
+    // If the input is too short, the values it contains are still decoded to report
+    // the first error in them, like parsing value by value.
+    const auto input_size = static_cast<size_t>(end - pos);
+    std::vector<uint32_t> result(std::min(size_t{size}, input_size));
+    pos = leb128u_decode_u32_vec(pos, end, result.data(), result.size());
+    if (size > input_size)
+        throw parser_error{"Unexpected EOF"};
+    return {std::move(result), pos};
+}
+
 template <>
 inline parser_result<uint32_t> parse(const uint8_t* pos, const uint8_t* end)
 {
@@ -231,7 +261,7 @@ inline parser_result<Memory> parse(const uint8_t* pos, const uint8_t* end)
     return {{limits}, pos};
 }
 
-parser_result<std::string> parse_string(const uint8_t* pos, const uint8_t* end)
+parser_result<std::string_view> parse_string(const uint8_t* pos, const uint8_t* end)
 {
     // NOTE: this is an optimised version of parse_vec<uint8_t>
     uint32_t size;
@@ -243,8 +273,7 @@ parser_result<std::string> parse_string(const uint8_t* pos, const uint8_t* end)
     if (!utf8_validate(pos, pos + size))
         throw parser_error{"Invalid UTF-8"};
 
-    const auto str_end = pos + size;
-    return {std::string{pos, str_end}, str_end};
+    return {{reinterpret_cast<const char*>(pos), size}, pos + size};
 }
 
 template <>
@@ -354,17 +383,11 @@ inline parser_result<code_view> parse(const uint8_t* pos, const uint8_t* end)
     return {{code_begin, code_size}, code_end};
 }
 
-inline Code parse_code(code_view code_binary, bool have_memory)
+/// Parses the locals declarations of a function body and returns the total number of locals.
+inline parser_result<uint32_t> parse_locals(const uint8_t* pos, const uint8_t* end)
 {
-    const auto begin = code_binary.begin();
-    const auto end = code_binary.end();
-    const auto [locals_vec, pos1] = parse_vec<Locals>(begin, end);
-
-    auto [code, pos2] = parse_expr(pos1, end, have_memory);
-
-    // Size is the total bytes of locals and expressions.
-    if (pos2 != end)
-        throw parser_error{"malformed size field for function"};
+    std::vector<Locals> locals_vec;
+    std::tie(locals_vec, pos) = parse_vec<Locals>(pos, end);
 
     uint64_t local_count = 0;
     for (const auto& l : locals_vec)
@@ -373,10 +396,123 @@ inline Code parse_code(code_view code_binary, bool have_memory)
         if (local_count > std::numeric_limits<uint32_t>::max())
             throw parser_error{"too many local variables"};
     }
-    code.local_count = static_cast<uint32_t>(local_count);
+    return {static_cast<uint32_t>(local_count), pos};
+}
+
+inline Code parse_code(bytes_view code_binary, FuncIdx func_idx, const Module& module)
+{
+    const auto begin = code_binary.data();
+    const auto end = begin + code_binary.size();
+    const auto [local_count, pos1] = parse_locals(begin, end);
+
+    auto [code, pos2] = parse_expr(pos1, end, func_idx, module);
+
+    // Size is the total bytes of locals and expressions.
+    if (pos2 != end)
+        throw parser_error{"malformed size field for function"};
+
+    code.local_count = local_count;
     return code;
 }
 
+/// Decodes the function bodies using the given number of threads.
+std::vector<Code> parse_codes(
+    const std::vector<code_view>& code_binaries, const Module& module, unsigned num_threads)
+{
+    const auto imported_func_count = module.imported_function_types.size();
+    std::vector<Code> codesec(code_binaries.size());
+
+    // The functions are decoded in the order of their indices, so the bodies after
+    // the failed one can be skipped, but all before it must still be checked.
+    std::atomic<size_t> next_idx{0};
+    std::atomic<size_t> error_idx{code_binaries.size()};
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    const auto decode = [&]() noexcept {
+        for (auto i = next_idx++; i < error_idx.load(); i = next_idx++)
+        {
+            try
+            {
+                const auto func_idx = static_cast<FuncIdx>(imported_func_count + i);
+                codesec[i] = parse_code(code_binaries[i], func_idx, module);
+            }
+            catch (...)
+            {
+                const std::lock_guard lock{error_mutex};
+                if (i < error_idx)
+                {
+                    error_idx = i;
+                    error = std::current_exception();
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    const auto num_workers = std::min(size_t{num_threads}, code_binaries.size());
+    if (num_workers > 1)
+    {
+        workers.reserve(num_workers - 1);
+        try
+        {
+            while (workers.size() < num_workers - 1)
+                workers.emplace_back(decode);
+        }
+        catch (const std::system_error&)
+        {
+            // Continue with the threads started so far.
+        }
+    }
+    decode();
+    for (auto& worker : workers)
+        worker.join();
+
+    if (error)
+        std::rethrow_exception(error);
+    return codesec;
+}
+
+/// Checks the structure of the function bodies and collects them for the lazy decoding.
+std::shared_ptr<LazyCodeSection> make_lazy_codesec(const std::vector<code_view>& code_binaries)
+{
+    auto lazy_codesec = std::make_shared<LazyCodeSection>();
+    if (code_binaries.empty())
+        return lazy_codesec;
+
+    // The function bodies are consecutive in the code section.
+    const auto* const binary_begin = code_binaries.front().data();
+    const auto* const binary_end = code_binaries.back().data() + code_binaries.back().size();
+    lazy_codesec->binary = {binary_begin, static_cast<size_t>(binary_end - binary_begin)};
+
+    lazy_codesec->functions = std::vector<LazyCodeSection::Function>(code_binaries.size());
+    for (size_t i = 0; i < code_binaries.size(); ++i)
+    {
+        const auto& code_binary = code_binaries[i];
+        parse_locals(code_binary.data(), code_binary.data() + code_binary.size());
+
+        auto& function = lazy_codesec->functions[i];
+        function.offset = static_cast<size_t>(code_binary.data() - binary_begin);
+        function.size = code_binary.size();
+    }
+    return lazy_codesec;
+}
+
+/// Returns the function bodies of the copy of the module, not decoded yet.
+std::shared_ptr<LazyCodeSection> copy_lazy_codesec(const LazyCodeSection& lazy_codesec)
+{
+    auto copy = std::make_shared<LazyCodeSection>();
+    copy->binary = lazy_codesec.binary;
+    copy->superinstructions = lazy_codesec.superinstructions;
+    copy->functions = std::vector<LazyCodeSection::Function>(lazy_codesec.functions.size());
+    for (size_t i = 0; i < lazy_codesec.functions.size(); ++i)
+    {
+        copy->functions[i].offset = lazy_codesec.functions[i].offset;
+        copy->functions[i].size = lazy_codesec.functions[i].size;
+    }
+    return copy;
+}
+
 template <>
 inline parser_result<Data> parse(const uint8_t* pos, const uint8_t* end)
 {
@@ -395,93 +531,89 @@ inline parser_result<Data> parse(const uint8_t* pos, const uint8_t* end)
     if ((pos + size) > end)
         throw parser_error{"Unexpected EOF"};
 
-    auto init = bytes(pos, pos + size);
+    // The payload references the input, see copy_referenced_bytes().
+    const bytes_view init{pos, size};
     pos += size;
 
-    return {{offset, std::move(init)}, pos};
+    return {{offset, {}, init}, pos};
 }
 
-Module parse(bytes_view input)
+/// Checks the order of the sections, the custom sections can be anywhere.
+void check_section_order(SectionId id, SectionId& last_id)
 {
-    if (input.substr(0, wasm_prefix.size()) != wasm_prefix)
-        throw parser_error{"invalid wasm module prefix"};
-
-    input.remove_prefix(wasm_prefix.size());
-
-    Module module;
-    std::vector<code_view> code_binaries;
-    SectionId last_id = SectionId::custom;
-    for (auto it = input.begin(); it != input.end();)
+    if (id != SectionId::custom)
     {
-        const auto id = static_cast<SectionId>(*it++);
-        if (id != SectionId::custom)
-        {
-            if (id <= last_id)
-                throw parser_error{"Unexpected out-of-order section type"};
-            last_id = id;
-        }
-
-        uint32_t size;
-        std::tie(size, it) = leb128u_decode<uint32_t>(it, input.end());
-
-        const auto expected_section_end = it + size;
-        if (expected_section_end > input.end())
-            throw parser_error("Unexpected EOF");
+        if (id <= last_id)
+            throw parser_error{"Unexpected out-of-order section type"};
+        last_id = id;
+    }
+}
 
-        switch (id)
-        {
-        case SectionId::type:
-            std::tie(module.typesec, it) = parse_vec<FuncType>(it, input.end());
-            break;
-        case SectionId::import:
-            std::tie(module.importsec, it) = parse_vec<Import>(it, input.end());
-            break;
-        case SectionId::function:
-            std::tie(module.funcsec, it) = parse_vec<TypeIdx>(it, input.end());
-            break;
-        case SectionId::table:
-            std::tie(module.tablesec, it) = parse_vec<Table>(it, input.end());
-            break;
-        case SectionId::memory:
-            std::tie(module.memorysec, it) = parse_vec<Memory>(it, input.end());
-            break;
-        case SectionId::global:
-            std::tie(module.globalsec, it) = parse_vec<Global>(it, input.end());
-            break;
-        case SectionId::export_:
-            std::tie(module.exportsec, it) = parse_vec<Export>(it, input.end());
-            break;
-        case SectionId::start:
-            std::tie(module.startfunc, it) = leb128u_decode<uint32_t>(it, input.end());
-            break;
-        case SectionId::element:
-            std::tie(module.elementsec, it) = parse_vec<Element>(it, input.end());
-            break;
-        case SectionId::code:
-            std::tie(code_binaries, it) = parse_vec<code_view>(it, input.end());
-            break;
-        case SectionId::data:
-            std::tie(module.datasec, it) = parse_vec<Data>(it, input.end());
-            break;
-        case SectionId::custom:
-            // NOTE: this section can be ignored, but the name must be parseable (and valid UTF-8)
-            parse_string(it, expected_section_end);
-            // These sections are ignored for now.
-            it += size;
-            break;
-        default:
-            throw parser_error{
-                "unknown section encountered " + std::to_string(static_cast<int>(id))};
-        }
+/// Parses the content of the section other than the code section, which starts at it and
+/// is expected to end at expected_section_end. The input ends at end.
+const uint8_t* parse_section(Module& module, SectionId id, const uint8_t* it,
+    const uint8_t* expected_section_end, const uint8_t* end)
+{
+    switch (id)
+    {
+    case SectionId::type:
+        std::tie(module.typesec, it) = parse_vec<FuncType>(it, end);
+        break;
+    case SectionId::import:
+        std::tie(module.importsec, it) = parse_vec<Import>(it, end);
+        break;
+    case SectionId::function:
+        std::tie(module.funcsec, it) = parse_vec<TypeIdx>(it, end);
+        break;
+    case SectionId::table:
+        std::tie(module.tablesec, it) = parse_vec<Table>(it, end);
+        break;
+    case SectionId::memory:
+        std::tie(module.memorysec, it) = parse_vec<Memory>(it, end);
+        break;
+    case SectionId::global:
+        std::tie(module.globalsec, it) = parse_vec<Global>(it, end);
+        break;
+    case SectionId::export_:
+        std::tie(module.exportsec, it) = parse_vec<Export>(it, end);
+        break;
+    case SectionId::start:
+        std::tie(module.startfunc, it) = leb128u_decode<uint32_t>(it, end);
+        break;
+    case SectionId::element:
+        std::tie(module.elementsec, it) = parse_vec<Element>(it, end);
+        break;
+    case SectionId::data:
+        std::tie(module.datasec, it) = parse_vec<Data>(it, end);
+        break;
+    case SectionId::custom:
+        // NOTE: this section can be ignored, but the name must be parseable (and valid UTF-8)
+        parse_string(it, expected_section_end);
+        // These sections are ignored for now.
+        it = expected_section_end;
+        break;
+    case SectionId::code:
+        assert(false);  // The code section is parsed by the callers.
+        break;
+    default:
+        throw parser_error{"unknown section encountered " + std::to_string(static_cast<int>(id))};
+    }
+    return it;
+}
 
-        if (it != expected_section_end)
-        {
-            throw parser_error{"incorrect section " + std::to_string(static_cast<int>(id)) +
-                               " size, difference: " + std::to_string(it - expected_section_end)};
-        }
+void check_section_size(SectionId id, const uint8_t* it, const uint8_t* expected_section_end)
+{
+    if (it != expected_section_end)
+    {
+        throw parser_error{"incorrect section " + std::to_string(static_cast<int>(id)) +
+                           " size, difference: " + std::to_string(it - expected_section_end)};
     }
+}
 
-    // Validation checks
+/// Validates the sections preceding the code section and collects the imported function types.
+/// This must be done before decoding the function bodies.
+void validate_declarations(Module& module, size_t code_count)
+{
     if (module.tablesec.size() > 1)
         throw parser_error{"too many table sections (at most one is allowed)"};
 
@@ -515,30 +647,380 @@ Module parse(bytes_view input)
     if (!module.elementsec.empty() && module.tablesec.empty() && imported_tbl_count == 0)
         throw parser_error("element section encountered without a table section");
 
-    if (module.funcsec.size() != code_binaries.size())
+    if (module.funcsec.size() != code_count)
         throw parser_error("malformed binary: number of function and code entries must match");
 
-    const auto imported_func_count = std::count_if(module.importsec.begin(), module.importsec.end(),
-        [](const auto& import) noexcept { return import.kind == ExternalKind::Function; });
-    const auto total_func_count = static_cast<size_t>(imported_func_count) + module.funcsec.size();
+    for (const auto& import : module.importsec)
+    {
+        if (import.kind == ExternalKind::Function)
+            module.imported_function_types.emplace_back(import.desc.function_type_index);
+    }
+    const auto imported_func_count = module.imported_function_types.size();
+    const auto total_func_count = imported_func_count + module.funcsec.size();
 
     if (module.startfunc && *module.startfunc >= total_func_count)
         throw parser_error{"invalid start function index"};
 
-    const auto have_memory = !module.memorysec.empty() || imported_mem_count != 0;
-    // Process code. TODO: This can be done lazily.
-    module.codesec.reserve(code_binaries.size());
-    for (size_t i = 0; i < code_binaries.size(); ++i)
+    for (const auto type_idx : module.funcsec)
     {
-        const auto type_idx = module.funcsec[i];
         if (type_idx >= module.typesec.size())
             throw validation_error{"invalid function type index"};
-        module.codesec.emplace_back(parse_code(code_binaries[i], have_memory));
     }
+}
+
+/// Parses the module binary. The module references the bytes of the input binary, it is up to
+/// the caller to set Module::storage. The module is metered if instruction_costs is not null.
+Module parse_binary(bytes_view input, CodeDecoding code_decoding, unsigned num_threads,
+    [[maybe_unused]] const InstructionCostTable* instruction_costs = nullptr)
+{
+    if (input.substr(0, wasm_prefix.size()) != wasm_prefix)
+        throw parser_error{"invalid wasm module prefix"};
+
+    input.remove_prefix(wasm_prefix.size());
+
+    Module module;
+#if FIZZY_METERING
+    if (instruction_costs != nullptr)
+        module.instruction_costs = std::make_shared<const InstructionCostTable>(*instruction_costs);
+#endif
+    std::vector<code_view> code_binaries;
+    SectionId last_id = SectionId::custom;
+    for (auto it = input.begin(); it != input.end();)
+    {
+        const auto id = static_cast<SectionId>(*it++);
+        check_section_order(id, last_id);
+
+        uint32_t size;
+        std::tie(size, it) = leb128u_decode<uint32_t>(it, input.end());
+
+        const auto expected_section_end = it + size;
+        if (expected_section_end > input.end())
+            throw parser_error("Unexpected EOF");
+
+        if (id == SectionId::code)
+            std::tie(code_binaries, it) = parse_vec<code_view>(it, input.end());
+        else
+            it = parse_section(module, id, it, expected_section_end, input.end());
+
+        check_section_size(id, it, expected_section_end);
+    }
+
+    validate_declarations(module, code_binaries.size());
+
+    // Process code.
+    if (code_decoding == CodeDecoding::Lazy)
+        module.lazy_codesec = make_lazy_codesec(code_binaries);
+    else if (num_threads > 1)
+        module.codesec = parse_codes(code_binaries, module, num_threads);
+    else
+    {
+        const auto imported_func_count = module.imported_function_types.size();
+        module.codesec.reserve(code_binaries.size());
+        for (size_t i = 0; i < code_binaries.size(); ++i)
+        {
+            const auto func_idx = static_cast<FuncIdx>(imported_func_count + i);
+            module.codesec.emplace_back(parse_code(code_binaries[i], func_idx, module));
+        }
+    }
+
+    module.memory_image_cache = std::make_shared<MemoryImageCache>();
+
+    module.register_module_cache = std::make_shared<RegisterModuleCache>();
+
+    module.threaded_code_cache = std::make_shared<ThreadedCodeCache>();
+
+    return module;
+}
+
+Module parse(bytes_view input, CodeDecoding code_decoding, unsigned num_threads)
+{
+    auto module = parse_binary(input, code_decoding, num_threads);
+    copy_referenced_bytes(module);
+    return module;
+}
+
+#if FIZZY_METERING
+Module parse(bytes_view input, const InstructionCostTable& instruction_costs,
+    CodeDecoding code_decoding, unsigned num_threads)
+{
+    auto module = parse_binary(input, code_decoding, num_threads, &instruction_costs);
+    copy_referenced_bytes(module);
+    return module;
+}
+#endif
 
+Module parse_file(const std::string& path, CodeDecoding code_decoding, unsigned num_threads)
+{
+    auto file = std::make_shared<const MappedFile>(path);
+    auto module = parse_binary(file->content(), code_decoding, num_threads);
+    module.storage = std::move(file);
     return module;
 }
 
+void copy_referenced_bytes(Module& module)
+{
+    for (auto& data : module.datasec)
+    {
+        if (data.mapped_init.has_value())
+        {
+            data.init = bytes{*data.mapped_init};
+            data.mapped_init.reset();
+        }
+    }
+
+    if (module.lazy_codesec != nullptr)
+    {
+        auto storage = std::make_shared<const bytes>(module.lazy_codesec->binary);
+        module.lazy_codesec->binary = *storage;
+        module.storage = std::move(storage);
+    }
+    else
+        module.storage = nullptr;
+}
+
+/// Decodes the u32 value from the beginning of the partially received input.
+/// Returns nothing if the value is incomplete and more input may follow.
+inline std::optional<parser_result<uint32_t>> try_leb128u_decode_u32(
+    const uint8_t* pos, const uint8_t* end, bool input_complete)
+{
+    constexpr size_t max_leb128_u32_size = 5;
+    const auto has_last_byte = std::any_of(pos, std::min(end, pos + max_leb128_u32_size),
+        [](uint8_t byte) noexcept { return (byte & 0x80) == 0; });
+    if (!has_last_byte && !input_complete &&
+        static_cast<size_t>(end - pos) < max_leb128_u32_size)
+        return std::nullopt;
+    return leb128u_decode<uint32_t>(pos, end);
+}
+
+void StreamingParser::push(bytes_view chunk)
+{
+    if (m_buffer.empty())
+    {
+        // Parse directly from the chunk and buffer only the incomplete rest.
+        const auto consumed = process(chunk, false);
+        m_buffer.assign(chunk.substr(consumed));
+    }
+    else
+    {
+        m_buffer.append(chunk);
+        const auto consumed = process(m_buffer, false);
+        m_buffer.erase(0, consumed);
+    }
+}
+
+Module StreamingParser::finish()
+{
+    const auto consumed = process(m_buffer, true);
+    m_buffer.erase(0, consumed);
+
+    if (m_state == State::Prefix)
+        throw parser_error{"invalid wasm module prefix"};
+    if (m_state != State::SectionHeader || !m_buffer.empty())
+        throw parser_error{"Unexpected EOF"};
+
+    if (!m_declarations_validated)
+        validate_declarations(m_module, 0);
+
+    m_module.memory_image_cache = std::make_shared<MemoryImageCache>();
+
+    m_module.register_module_cache = std::make_shared<RegisterModuleCache>();
+
+    m_module.threaded_code_cache = std::make_shared<ThreadedCodeCache>();
+    return std::move(m_module);
+}
+
+size_t StreamingParser::process(bytes_view input, bool input_complete)
+{
+    const auto* const begin = input.data();
+    const auto* const end = begin + input.size();
+    const auto* pos = begin;
+    while (true)
+    {
+        const auto available = static_cast<size_t>(end - pos);
+        switch (m_state)
+        {
+        case State::Prefix:
+        {
+            // Reject the invalid prefix early, the complete prefix is needed to accept it.
+            const auto size = std::min(available, wasm_prefix.size());
+            if (bytes_view{pos, size} != wasm_prefix.substr(0, size))
+                throw parser_error{"invalid wasm module prefix"};
+            if (size < wasm_prefix.size())
+                return static_cast<size_t>(pos - begin);
+            pos += wasm_prefix.size();
+            m_state = State::SectionHeader;
+            break;
+        }
+
+        case State::SectionHeader:
+        {
+            if (available == 0)
+                return static_cast<size_t>(pos - begin);
+
+            const auto size = try_leb128u_decode_u32(pos + 1, end, input_complete);
+            if (!size.has_value())
+                return static_cast<size_t>(pos - begin);
+
+            const auto id = static_cast<SectionId>(*pos);
+            check_section_order(id, m_last_id);
+            if (id > SectionId::data)
+            {
+                throw parser_error{
+                    "unknown section encountered " + std::to_string(static_cast<int>(id))};
+            }
+
+            m_section_id = id;
+            std::tie(m_section_remaining, pos) = *size;
+            m_state = (id == SectionId::code) ? State::CodeCount : State::SectionContent;
+            break;
+        }
+
+        case State::SectionContent:
+        {
+            if (available < m_section_remaining)
+            {
+                if (input_complete)
+                    throw parser_error{"Unexpected EOF"};
+                return static_cast<size_t>(pos - begin);
+            }
+
+            const auto* const content_end = pos + m_section_remaining;
+            const auto* const it =
+                parse_section(m_module, m_section_id, pos, content_end, content_end);
+            check_section_size(m_section_id, it, content_end);
+            if (m_section_id == SectionId::data)
+                copy_referenced_bytes(m_module);
+
+            pos += m_section_remaining;
+            m_state = State::SectionHeader;
+            break;
+        }
+
+        case State::CodeCount:
+        {
+            const auto section_complete = available >= m_section_remaining;
+            const auto* const section_end = section_complete ? pos + m_section_remaining : end;
+            const auto count =
+                try_leb128u_decode_u32(pos, section_end, input_complete || section_complete);
+            if (!count.has_value())
+                return static_cast<size_t>(pos - begin);
+
+            const auto* const count_end = std::get<1>(*count);
+            m_section_remaining -= static_cast<size_t>(count_end - pos);
+            pos = count_end;
+            m_code_count = std::get<0>(*count);
+
+            // Each function body takes at least one byte.
+            if (m_code_count > m_section_remaining)
+                throw parser_error{"Unexpected EOF"};
+
+            validate_declarations(m_module, m_code_count);
+            m_declarations_validated = true;
+            m_module.codesec.reserve(m_code_count);
+            m_state = State::CodeBody;
+            break;
+        }
+
+        case State::CodeBody:
+        {
+            if (m_module.codesec.size() == m_code_count)
+            {
+                if (m_section_remaining != 0)
+                {
+                    throw parser_error{
+                        "incorrect section " + std::to_string(static_cast<int>(SectionId::code)) +
+                        " size, difference: -" + std::to_string(m_section_remaining)};
+                }
+                m_state = State::SectionHeader;
+                break;
+            }
+
+            const auto section_complete = available >= m_section_remaining;
+            const auto* const section_end = section_complete ? pos + m_section_remaining : end;
+            const auto size =
+                try_leb128u_decode_u32(pos, section_end, input_complete || section_complete);
+            if (!size.has_value())
+                return static_cast<size_t>(pos - begin);
+
+            const auto [code_size, code_begin] = *size;
+            const auto entry_size = static_cast<size_t>(code_begin - pos) + code_size;
+            if (entry_size > m_section_remaining)
+                throw parser_error{"Unexpected EOF"};
+            if (entry_size > available)
+            {
+                if (input_complete)
+                    throw parser_error{"Unexpected EOF"};
+                return static_cast<size_t>(pos - begin);
+            }
+
+            const auto func_idx =
+                static_cast<FuncIdx>(m_module.imported_function_types.size() +
+                                     m_module.codesec.size());
+            m_module.codesec.emplace_back(
+                parse_code({code_begin, code_size}, func_idx, m_module));
+
+            pos += entry_size;
+            m_section_remaining -= entry_size;
+            break;
+        }
+        }
+    }
+}
+
+const Code& decode_code(const Module& module, size_t code_idx)
+{
+    assert(module.lazy_codesec != nullptr);
+    auto& lazy_codesec = *module.lazy_codesec;
+    assert(code_idx < lazy_codesec.functions.size());
+    auto& function = lazy_codesec.functions[code_idx];
+
+    std::call_once(function.decoded, [&] {
+        const auto func_idx =
+            static_cast<FuncIdx>(module.imported_function_types.size() + code_idx);
+        const auto code_binary = lazy_codesec.binary.substr(function.offset, function.size);
+        function.code = parse_code(code_binary, func_idx, module);
+        if (lazy_codesec.superinstructions)
+            fuse_superinstructions(function.code);
+    });
+    return function.code;
+}
+
+Module::Module(const Module& other)
+  : typesec{other.typesec},
+    importsec{other.importsec},
+    funcsec{other.funcsec},
+    tablesec{other.tablesec},
+    memorysec{other.memorysec},
+    globalsec{other.globalsec},
+    exportsec{other.exportsec},
+    startfunc{other.startfunc},
+    elementsec{other.elementsec},
+    codesec{other.codesec},
+    datasec{other.datasec},
+    imported_function_types{other.imported_function_types},
+#if FIZZY_METERING
+    instruction_costs{other.instruction_costs},
+#endif
+    storage{other.storage}
+{
+    // The caches are built from the module's sections, which the copy can change.
+    if (other.lazy_codesec != nullptr)
+        lazy_codesec = copy_lazy_codesec(*other.lazy_codesec);
+    if (other.memory_image_cache != nullptr)
+        memory_image_cache = std::make_shared<MemoryImageCache>();
+    if (other.register_module_cache != nullptr)
+        register_module_cache = std::make_shared<RegisterModuleCache>();
+    if (other.threaded_code_cache != nullptr)
+        threaded_code_cache = std::make_shared<ThreadedCodeCache>();
+}
+
+Module& Module::operator=(const Module& other)
+{
+    if (this != &other)
+        *this = Module{other};
+    return *this;
+}
+
 parser_result<std::vector<uint32_t>> parse_vec_i32(const uint8_t* pos, const uint8_t* end)
 {
     return parse_vec<uint32_t>(pos, end);
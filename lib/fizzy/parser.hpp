@@ -3,6 +3,9 @@
 #include "exceptions.hpp"
 #include "leb128.hpp"
 #include "types.hpp"
+#include <mutex>
+#include <string>
+#include <string_view>
 #include <tuple>
 
 namespace fizzy
@@ -13,7 +16,132 @@ constexpr bytes_view wasm_prefix{wasm_prefix_data, sizeof(wasm_prefix_data)};
 template <typename T>
 using parser_result = std::tuple<T, const uint8_t*>;
 
-Module parse(bytes_view input);
+/// The way of decoding the function bodies by parse().
+enum class CodeDecoding
+{
+    /// All function bodies are decoded and validated by parse().
+    Eager,
+
+    /// Only the structure of function bodies (the size and the locals declarations) is checked
+    /// by parse(). A function body is decoded and validated on its first use, see get_code().
+    Lazy,
+};
+
+/// Parses the module binary. The input is not referenced after parsing.
+/// With CodeDecoding::Lazy the function bodies are copied to Module::storage, referenced
+/// by Module::lazy_codesec, and Module::codesec is left empty.
+/// With CodeDecoding::Eager the function bodies are decoded by num_threads threads (including
+/// the calling one). In case of errors in many function bodies, the error of the body of
+/// the lowest index is reported, independently of the number of threads.
+Module parse(bytes_view input, CodeDecoding code_decoding = CodeDecoding::Eager,
+    unsigned num_threads = 1);
+
+#if FIZZY_METERING
+/// Parses the module binary like parse(), with the metered code: each basic block of
+/// the function bodies begins with the Instr::meter instruction charging the costs of the block's
+/// instructions, taken from the given table, to Instance::gas_left. A block is charged once
+/// on its entry, also when it is left early by a trap or a call which does not return.
+Module parse(bytes_view input, const InstructionCostTable& instruction_costs,
+    CodeDecoding code_decoding = CodeDecoding::Eager, unsigned num_threads = 1);
+#endif
+
+/// Parses the module binary from the file of the given path, like parse().
+/// The file is mapped to memory, which becomes Module::storage. The data segment payloads
+/// (see Data::mapped_init) and the function bodies kept by the module reference the mapping,
+/// so none of them is copied. The file must not be modified while the module is used.
+/// Throws std::system_error if the file cannot be read.
+Module parse_file(const std::string& path, CodeDecoding code_decoding = CodeDecoding::Eager,
+    unsigned num_threads = 1);
+
+/// Copies the bytes of the input referenced by the parsed module: the data segment payloads
+/// to Data::init and the function bodies to be decoded lazily to a new buffer set
+/// as Module::storage.
+void copy_referenced_bytes(Module& module);
+
+/// The parser of the module binary received in chunks of any size, e.g. from a socket.
+///
+/// The sections are parsed as soon as they are complete and the function bodies are decoded
+/// one by one as they arrive, so parsing overlaps with receiving the binary. Only the incomplete
+/// section (or the incomplete function body in the code section) is buffered.
+///
+/// The function bodies are always decoded eagerly. The module and the errors are the same
+/// as of parse(), except that in case of many errors in a binary a different one may be reported
+/// and the section contents exceeding the section size are reported as "Unexpected EOF".
+class StreamingParser
+{
+public:
+    /// Parses the next chunk of the binary.
+    /// Throws parser_error or validation_error when the binary is invalid, the parser must not
+    /// be used afterwards.
+    void push(bytes_view chunk);
+
+    /// Finishes parsing after the last chunk and returns the module.
+    /// Throws parser_error or validation_error when the binary is invalid or incomplete.
+    Module finish();
+
+private:
+    enum class State
+    {
+        Prefix,
+        SectionHeader,
+        SectionContent,
+        CodeCount,
+        CodeBody,
+    };
+
+    /// Parses the input as far as possible and returns the number of bytes consumed.
+    /// The input_complete flag tells that no more input will follow.
+    size_t process(bytes_view input, bool input_complete);
+
+    State m_state = State::Prefix;
+
+    /// The input received and not consumed yet.
+    bytes m_buffer;
+
+    Module m_module;
+    SectionId m_last_id = SectionId::custom;
+    SectionId m_section_id = SectionId::custom;
+    size_t m_section_remaining = 0;
+    size_t m_code_count = 0;
+    bool m_declarations_validated = false;
+};
+
+/// The function bodies of a module parsed with CodeDecoding::Lazy. Each of them is decoded
+/// into the Code on the first use, in a thread-safe way.
+struct LazyCodeSection
+{
+    struct Function
+    {
+        /// The location of the function body (the locals and the expr) in the binary.
+        size_t offset = 0;
+        size_t size = 0;
+
+        std::once_flag decoded;
+        Code code;
+    };
+
+    /// The function bodies from the code section, referencing Module::storage.
+    bytes_view binary;
+
+    std::vector<Function> functions;
+
+    /// Whether the function bodies are rewritten with fuse_superinstructions() when decoded.
+    bool superinstructions = false;
+};
+
+/// Decodes the function body of a module parsed with CodeDecoding::Lazy, on the first use.
+/// Use get_code() instead.
+const Code& decode_code(const Module& module, size_t code_idx);
+
+/// Returns the code of the function of the given index in the code section. If the module was
+/// parsed with CodeDecoding::Lazy the function body is decoded on the first use, what throws
+/// parser_error or validation_error if the body is invalid.
+inline const Code& get_code(const Module& module, size_t code_idx)
+{
+    if (module.lazy_codesec == nullptr)
+        return module.codesec[code_idx];
+    return decode_code(module, code_idx);
+}
 
 inline const uint8_t* skip(size_t num_bytes, const uint8_t* input, const uint8_t* end)
 {
@@ -26,12 +154,15 @@ inline const uint8_t* skip(size_t num_bytes, const uint8_t* input, const uint8_t
 /// Parse `expr`, i.e. a function's instructions residing in the code section.
 /// https://webassembly.github.io/spec/core/binary/instructions.html#binary-expr
 ///
-/// @param input        The beginning of the expr binary input.
-/// @param end          The end of the binary input.
-/// @param have_memory  If the module (the context) contains imported or defined memory.
-parser_result<Code> parse_expr(const uint8_t* input, const uint8_t* end, bool have_memory);
+/// @param input     The beginning of the expr binary input.
+/// @param end       The end of the binary input.
+/// @param func_idx  The index of the function the expr belongs to.
+/// @param module    The module (the context) with the type, import, function and memory sections
+///                  already parsed.
+parser_result<Code> parse_expr(
+    const uint8_t* input, const uint8_t* end, FuncIdx func_idx, const Module& module);
 
-parser_result<std::string> parse_string(const uint8_t* pos, const uint8_t* end);
+parser_result<std::string_view> parse_string(const uint8_t* pos, const uint8_t* end);
 
 /// Parses the vec of i32 values.
 /// This is used in parse_expr() (parser_expr.cpp).
@@ -1,7 +1,9 @@
 #include "instructions.hpp"
 #include "parser.hpp"
+#include <algorithm>
 #include <cassert>
-#include <stack>
+#include <limits>
+#include <vector>
 
 namespace fizzy
 {
@@ -21,22 +23,77 @@ inline void push(bytes& b, T value)
     b.append(storage, sizeof(storage));
 }
 
+/// Pushes the placeholder for the branch immediates (see BranchImmediateSize) to be filled
+/// by store_branch_immediates().
+inline void push_branch_placeholder(bytes& b)
+{
+    b.append(BranchImmediateSize, 0);
+}
+
+/// Stores the branch immediates: the target instruction and immediates offsets,
+/// the operand stack height to restore and the number of result values to keep.
+inline void store_branch_immediates(uint8_t* dst, uint32_t target_pc, uint32_t target_imm,
+    uint32_t stack_height, uint32_t arity) noexcept
+{
+    store(dst, target_pc);
+    store(dst + sizeof(uint32_t), target_imm);
+    store(dst + 2 * sizeof(uint32_t), stack_height);
+    store(dst + 3 * sizeof(uint32_t), arity);
+}
+
 /// The control frame to keep information about labels and blocks as defined in
 /// Wasm Validation Algorithm https://webassembly.github.io/spec/core/appendix/algorithm.html.
 struct ControlFrame
 {
     /// The instruction that created the label.
-    const Instr instruction{Instr::unreachable};
+    /// For if instruction it is replaced with else instruction when the else branch is entered.
+    Instr instruction{Instr::unreachable};
 
-    /// The immediates offset for block instructions.
-    const size_t immediates_offset{0};
+    /// The immediates offset for if/else instruction jump targets to be filled at the else or end
+    /// instruction. For loop this is the immediates offset of the loop's branch target.
+    size_t immediates_offset{0};
+
+    /// The instruction offset of the loop's branch target.
+    const size_t code_offset{0};
+
+    /// The result arity of the block.
+    const uint8_t arity{0};
+
+    /// The operand stack height of all the outer frames.
+    const int parent_stack_height{0};
 
     /// The frame stack height.
     int stack_height{0};
 
+    /// The number of stack items left by the nested blocks in excess of their result arity.
+    /// Possible only in invalid code, but the parser does not reject it yet.
+    int stack_height_excess{0};
+
     /// Whether the remainder of the block is unreachable (used to handle stack-polymorphic typing
     /// after branches).
     bool unreachable{false};
+
+    /// The immediates offsets of the branches to the end of this block, to be filled at the
+    /// end instruction.
+    std::vector<size_t> br_immediate_offsets{};
+
+    /// The number of values a branch to this label keeps on the stack.
+    /// A branch to a loop goes to its beginning and takes no values.
+    uint32_t branch_arity() const noexcept { return instruction == Instr::loop ? 0 : arity; }
+
+    /// The operand stack height of this and all the outer frames.
+    int absolute_stack_height() const noexcept
+    {
+        return parent_stack_height + stack_height + stack_height_excess;
+    }
+
+    /// The number of stack items left in excess of the result arity when the block is exited.
+    int exit_stack_height_excess() const noexcept
+    {
+        // In the unreachable state the block can only be exited by a branch, what leaves exactly
+        // the arity number of items.
+        return (unreachable ? 0 : std::max(stack_height - arity, 0)) + stack_height_excess;
+    }
 };
 
 /// Parses blocktype.
@@ -60,28 +117,120 @@ parser_result<uint8_t> parse_blocktype(const uint8_t* pos, const uint8_t* end)
     pos = validate_valtype(pos, end);
     return {1, pos};
 }
+
+/// Fills in or schedules the branch immediates for the branch to the given label.
+void push_branch_immediates(
+    Code& code, std::vector<ControlFrame>& control_stack, uint32_t label_idx)
+{
+    auto& label = control_stack[control_stack.size() - label_idx - 1];
+    const auto stack_height = static_cast<uint32_t>(label.parent_stack_height);
+    const auto arity = label.branch_arity();
+
+    const auto offset = code.immediates.size();
+    push_branch_placeholder(code.immediates);
+
+    if (label.instruction == Instr::loop)
+    {
+        store_branch_immediates(code.immediates.data() + offset,
+            static_cast<uint32_t>(label.code_offset),
+            static_cast<uint32_t>(label.immediates_offset), stack_height, arity);
+    }
+    else
+    {
+        // The target is known at the end of the block: store what is known already.
+        store_branch_immediates(code.immediates.data() + offset, 0, 0, stack_height, arity);
+        label.br_immediate_offsets.push_back(offset);
+    }
+}
+
+/// Validates the label index of a branch and that the stack has the label's result values.
+void validate_branch(
+    const std::vector<ControlFrame>& control_stack, const ControlFrame& frame, uint32_t label_idx)
+{
+    if (label_idx >= control_stack.size())
+        throw validation_error{"invalid label index"};
+
+    const auto& label = control_stack[control_stack.size() - label_idx - 1];
+    if (!frame.unreachable && frame.stack_height < static_cast<int>(label.branch_arity()))
+        throw validation_error{"stack underflow"};
+}
+
+/// Updates the frame stack height by the call's effect: the arguments are taken from the stack
+/// and the results are put on it.
+void update_stack_height_for_call(ControlFrame& frame, const FuncType& func_type)
+{
+    const auto num_inputs = static_cast<int>(func_type.inputs.size());
+    const auto num_outputs = static_cast<int>(func_type.outputs.size());
+
+    if (frame.stack_height < num_inputs && !frame.unreachable)
+        throw validation_error{"stack underflow"};
+
+    frame.stack_height += num_outputs - num_inputs;
+}
+
+/// Returns the type of the function of the given index. The imported functions go first.
+const FuncType& get_function_type(const Module& module, FuncIdx func_idx)
+{
+    const auto num_imported = module.imported_function_types.size();
+    const auto type_idx = func_idx < num_imported ?
+                              module.imported_function_types[func_idx] :
+                              module.funcsec[func_idx - num_imported];
+    if (type_idx >= module.typesec.size())
+        throw validation_error{"invalid function type index"};
+    return module.typesec[type_idx];
+}
 }  // namespace
 
-parser_result<Code> parse_expr(const uint8_t* pos, const uint8_t* end, bool have_memory)
+parser_result<Code> parse_expr(
+    const uint8_t* pos, const uint8_t* end, FuncIdx func_idx, const Module& module)
 {
     Code code;
 
+    const auto have_memory =
+        !module.memorysec.empty() ||
+        std::any_of(module.importsec.begin(), module.importsec.end(),
+            [](const auto& import) noexcept { return import.kind == ExternalKind::Memory; });
+
+    const auto total_func_count = module.imported_function_types.size() + module.funcsec.size();
+    assert(func_idx < total_func_count);
+    const auto& func_type = get_function_type(module, func_idx);
+    const auto func_arity = static_cast<uint8_t>(func_type.outputs.size());
+
     // The stack of control frames allowing to distinguish between block/if/else and label
     // instructions as defined in Wasm Validation Algorithm.
-    // For a block/if/else instruction the value is the block/if/else's immediate offset.
-    std::stack<ControlFrame> control_stack;
+    std::vector<ControlFrame> control_stack;
 
-    control_stack.push({Instr::block});  // The function's implicit block.
+    control_stack.push_back({Instr::block, 0, 0, func_arity});  // The function's implicit block.
 
     const auto metrics_table = get_instruction_metrics_table();
 
+#if FIZZY_METERING
+    // The metered code has the meter instruction at the beginning of the function and after
+    // each instruction the branches go to or come back to: loop, if, else, br_if and the end
+    // of a block being a branch target.
+    const auto* const instruction_costs = module.instruction_costs.get();
+
+    // The immediates offset of the meter instruction of the current basic block, no_meter while
+    // the code is not reachable.
+    constexpr auto no_meter = std::numeric_limits<size_t>::max();
+    size_t meter_offset = no_meter;
+
+    const auto begin_basic_block = [&] {
+        meter_offset = code.immediates.size();
+        code.instructions.emplace_back(Instr::meter);
+        push(code.immediates, int64_t{0});
+    };
+    if (instruction_costs != nullptr)
+        begin_basic_block();
+#endif
+
     bool continue_parsing = true;
     while (continue_parsing)
     {
         if (pos == end)
             throw parser_error{"Unexpected EOF"};
 
-        auto& frame = control_stack.top();
+        auto& frame = control_stack.back();
 
         const auto opcode = *pos++;
         const auto& metrics = metrics_table[opcode];
@@ -92,6 +241,25 @@ parser_result<Code> parse_expr(const uint8_t* pos, const uint8_t* end, bool have
         frame.stack_height += metrics.stack_height_change;
 
         const auto instr = static_cast<Instr>(opcode);
+
+#if FIZZY_METERING
+        if (meter_offset != no_meter)
+        {
+            auto* const block_cost = code.immediates.data() + meter_offset;
+            int64_t cost;
+            __builtin_memcpy(&cost, block_cost, sizeof(cost));
+            store(block_cost, cost + (*instruction_costs)[opcode]);
+        }
+
+        // The code after the end of a block is reached only by the fall through unless
+        // there are branches to it, then it continues the current basic block.
+        const bool begins_basic_block =
+            instr == Instr::loop || instr == Instr::if_ || instr == Instr::else_ ||
+            instr == Instr::br_if ||
+            (instr == Instr::end && (frame.instruction == Instr::if_ ||
+                                        frame.instruction == Instr::else_ ||
+                                        !frame.br_immediate_offsets.empty()));
+#endif
         switch (instr)
         {
         default:
@@ -251,20 +419,37 @@ parser_result<Code> parse_expr(const uint8_t* pos, const uint8_t* end, bool have
 
         case Instr::end:
         {
+            // The branches to the function's block go to its end instruction to return.
+            // For other blocks they go to the instruction after the end.
+            const auto target_pc =
+                static_cast<uint32_t>(code.instructions.size() + (control_stack.size() > 1));
+            const auto target_imm = static_cast<uint32_t>(code.immediates.size());
+
+            if (frame.instruction == Instr::if_ || frame.instruction == Instr::else_)
+            {
+                // Set the jump target for if without else or for the end of if branch.
+                auto* const if_imm = code.immediates.data() + frame.immediates_offset;
+                store(if_imm, target_pc);
+                store(if_imm + sizeof(target_pc), target_imm);
+            }
+
+            for (const auto br_imm_offset : frame.br_immediate_offsets)
+            {
+                auto* const br_imm = code.immediates.data() + br_imm_offset;
+                store(br_imm, target_pc);
+                store(br_imm + sizeof(target_pc), target_imm);
+            }
+
             if (control_stack.size() > 1)
             {
-                if (frame.instruction != Instr::loop)  // If end of block/if/else instruction.
-                {
-                    const auto target_pc = static_cast<uint32_t>(code.instructions.size() + 1);
-                    const auto target_imm = static_cast<uint32_t>(code.immediates.size());
-
-                    // Set the imm values for block instruction.
-                    auto* block_imm = code.immediates.data() + frame.immediates_offset;
-                    store(block_imm, target_pc);
-                    block_imm += sizeof(target_pc);
-                    store(block_imm, target_imm);
-                }
-                control_stack.pop();  // Pop the current frame.
+                const auto arity = frame.arity;
+                const auto excess = frame.exit_stack_height_excess();
+                control_stack.pop_back();  // Pop the current frame.
+
+                // Parent frame gets additional items on stack after this block exit.
+                auto& parent_frame = control_stack.back();
+                parent_frame.stack_height += arity;
+                parent_frame.stack_height_excess += excess;
             }
             else
                 continue_parsing = false;
@@ -275,17 +460,11 @@ parser_result<Code> parse_expr(const uint8_t* pos, const uint8_t* end, bool have
         {
             uint8_t arity;
             std::tie(arity, pos) = parse_blocktype(pos, end);
-            code.immediates.push_back(arity);
 
-            // Parent frame gets additional items on stack after this block exit.
-            frame.stack_height += arity;
-
-            // Push label with immediates offset after arity.
-            control_stack.push({Instr::block, code.immediates.size()});
-
-            // Placeholders for immediate values, filled at the matching end instruction.
-            push(code.immediates, uint32_t{0});  // Diff to the end instruction.
-            push(code.immediates, uint32_t{0});  // Diff for the immediates.
+            // The block instruction has no immediates, the branches to it get the target
+            // at the matching end instruction.
+            control_stack.push_back({Instr::block, code.immediates.size(), 0, arity,
+                frame.absolute_stack_height()});
             break;
         }
 
@@ -294,10 +473,9 @@ parser_result<Code> parse_expr(const uint8_t* pos, const uint8_t* end, bool have
             uint8_t arity;
             std::tie(arity, pos) = parse_blocktype(pos, end);
 
-            // Parent frame gets additional items on stack after this block exit.
-            frame.stack_height += arity;
-
-            control_stack.push({Instr::loop});
+            // The branch target is the first instruction of the loop body.
+            control_stack.push_back({Instr::loop, code.immediates.size(),
+                code.instructions.size() + 1, arity, frame.absolute_stack_height()});
             break;
         }
 
@@ -305,20 +483,14 @@ parser_result<Code> parse_expr(const uint8_t* pos, const uint8_t* end, bool have
         {
             uint8_t arity;
             std::tie(arity, pos) = parse_blocktype(pos, end);
-            code.immediates.push_back(arity);
-
-            // Parent frame gets additional items on stack after this block exit.
-            frame.stack_height += arity;
-
-            control_stack.push({Instr::if_, code.immediates.size()});
-
-            // Placeholders for immediate values, filled at the matching end and else instructions.
-            push(code.immediates, uint32_t{0});  // Diff to the end instruction.
-            push(code.immediates, uint32_t{0});  // Diff for the immediates
 
-            push(code.immediates, uint32_t{0});  // Diff to the else instruction
-            push(code.immediates, uint32_t{0});  // Diff for the immediates.
+            control_stack.push_back({Instr::if_, code.immediates.size(), 0, arity,
+                frame.absolute_stack_height()});
 
+            // Placeholders for the jump target when the condition is false (the else branch or
+            // the end), filled at the matching else or end instruction.
+            push(code.immediates, uint32_t{0});  // The target instruction offset.
+            push(code.immediates, uint32_t{0});  // The target immediates offset.
             break;
         }
 
@@ -328,19 +500,27 @@ parser_result<Code> parse_expr(const uint8_t* pos, const uint8_t* end, bool have
                 throw parser_error{"unexpected else instruction (if instruction missing)"};
 
             // Reset frame after if. The if result type validation not implemented yet.
+            // The excess items of the if branch are kept as the else branch continues on top
+            // of them.
+            frame.stack_height_excess = frame.exit_stack_height_excess();
             frame.stack_height = 0;
             frame.unreachable = false;
 
+            // The else instruction is reached at the end of the if branch and jumps to the end.
+            // Its target is filled at the end instruction.
+            const auto else_imm_offset = code.immediates.size();
+            push(code.immediates, uint32_t{0});  // The target instruction offset.
+            push(code.immediates, uint32_t{0});  // The target immediates offset.
+
+            // Set the jump target of the if instruction to the else branch.
             const auto target_pc = static_cast<uint32_t>(code.instructions.size() + 1);
             const auto target_imm = static_cast<uint32_t>(code.immediates.size());
+            auto* const if_imm = code.immediates.data() + frame.immediates_offset;
+            store(if_imm, target_pc);
+            store(if_imm + sizeof(target_pc), target_imm);
 
-            // Set the imm values for else instruction.
-            auto* block_imm = code.immediates.data() + frame.immediates_offset + sizeof(target_pc) +
-                              sizeof(target_imm);
-            store(block_imm, target_pc);
-            block_imm += sizeof(target_pc);
-            store(block_imm, target_imm);
-
+            frame.instruction = Instr::else_;
+            frame.immediates_offset = else_imm_offset;
             break;
         }
 
@@ -350,10 +530,8 @@ parser_result<Code> parse_expr(const uint8_t* pos, const uint8_t* end, bool have
             uint32_t label_idx;
             std::tie(label_idx, pos) = leb128u_decode<uint32_t>(pos, end);
 
-            if (label_idx >= control_stack.size())
-                throw validation_error{"invalid label index"};
-
-            push(code.immediates, label_idx);
+            validate_branch(control_stack, frame, label_idx);
+            push_branch_immediates(code, control_stack, label_idx);
 
             if (instr == Instr::br)
                 frame.unreachable = true;
@@ -361,12 +539,25 @@ parser_result<Code> parse_expr(const uint8_t* pos, const uint8_t* end, bool have
             break;
         }
 
+        case Instr::call:
+        {
+            FuncIdx callee_func_idx;
+            std::tie(callee_func_idx, pos) = leb128u_decode<uint32_t>(pos, end);
+
+            if (callee_func_idx >= total_func_count)
+                throw validation_error{"invalid funcidx encountered with call"};
+
+            update_stack_height_for_call(frame, get_function_type(module, callee_func_idx));
+
+            push(code.immediates, callee_func_idx);
+            break;
+        }
+
         case Instr::local_get:
         case Instr::local_set:
         case Instr::local_tee:
         case Instr::global_get:
         case Instr::global_set:
-        case Instr::call:
         {
             uint32_t imm;
             std::tie(imm, pos) = leb128u_decode<uint32_t>(pos, end);
@@ -382,18 +573,13 @@ parser_result<Code> parse_expr(const uint8_t* pos, const uint8_t* end, bool have
             std::tie(default_label_idx, pos) = leb128u_decode<uint32_t>(pos, end);
 
             for (auto label_idx : label_indices)
-            {
-                if (label_idx >= control_stack.size())
-                    throw validation_error{"invalid label index"};
-            }
-
-            if (default_label_idx >= control_stack.size())
-                throw validation_error{"invalid label index"};
+                validate_branch(control_stack, frame, label_idx);
+            validate_branch(control_stack, frame, default_label_idx);
 
             push(code.immediates, static_cast<uint32_t>(label_indices.size()));
             for (const auto idx : label_indices)
-                push(code.immediates, idx);
-            push(code.immediates, default_label_idx);
+                push_branch_immediates(code, control_stack, idx);
+            push_branch_immediates(code, control_stack, default_label_idx);
 
             frame.unreachable = true;
 
@@ -402,9 +588,9 @@ parser_result<Code> parse_expr(const uint8_t* pos, const uint8_t* end, bool have
 
         case Instr::call_indirect:
         {
-            uint32_t imm;
-            std::tie(imm, pos) = leb128u_decode<uint32_t>(pos, end);
-            push(code.immediates, imm);
+            TypeIdx callee_type_idx;
+            std::tie(callee_type_idx, pos) = leb128u_decode<uint32_t>(pos, end);
+            push(code.immediates, callee_type_idx);
 
             if (pos == end)
                 throw parser_error{"Unexpected EOF"};
@@ -412,6 +598,11 @@ parser_result<Code> parse_expr(const uint8_t* pos, const uint8_t* end, bool have
             const uint8_t tableidx{*pos++};
             if (tableidx != 0)
                 throw parser_error{"invalid tableidx encountered with call_indirect"};
+
+            if (callee_type_idx >= module.typesec.size())
+                throw validation_error{"invalid type index encountered with call_indirect"};
+
+            update_stack_height_for_call(frame, module.typesec[callee_type_idx]);
             break;
         }
 
@@ -479,6 +670,22 @@ parser_result<Code> parse_expr(const uint8_t* pos, const uint8_t* end, bool have
         }
         }
         code.instructions.emplace_back(instr);
+
+        if (const auto& current_frame = control_stack.back(); !current_frame.unreachable)
+        {
+            code.max_stack_height =
+                std::max(code.max_stack_height, current_frame.absolute_stack_height());
+        }
+
+#if FIZZY_METERING
+        if (instruction_costs != nullptr && continue_parsing)
+        {
+            if (begins_basic_block)
+                begin_basic_block();
+            else if (control_stack.back().unreachable)
+                meter_offset = no_meter;
+        }
+#endif
     }
     assert(control_stack.size() == 1);
     return {code, pos};
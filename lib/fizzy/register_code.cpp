@@ -0,0 +1,1010 @@
+#include "register_code.hpp"
+#include "instructions.hpp"
+#include "parser.hpp"
+#include <algorithm>
+#include <cassert>
+#include <unordered_map>
+
+namespace fizzy
+{
+namespace
+{
+template <typename T>
+inline T read(const uint8_t*& input) noexcept
+{
+    T ret;
+    __builtin_memcpy(&ret, input, sizeof(ret));
+    input += sizeof(ret);
+    return ret;
+}
+
+/// Returns the size of the immediates of the instruction in Code.
+size_t immediates_size(Instr instr, const uint8_t* immediates) noexcept
+{
+    switch (instr)
+    {
+    case Instr::if_:
+    case Instr::else_:
+        return 2 * sizeof(uint32_t);
+    case Instr::br:
+    case Instr::br_if:
+        return BranchImmediateSize;
+    case Instr::br_table:
+        return sizeof(uint32_t) + (read<uint32_t>(immediates) + 1) * BranchImmediateSize;
+    case Instr::call:
+    case Instr::call_indirect:
+    case Instr::local_get:
+    case Instr::local_set:
+    case Instr::local_tee:
+    case Instr::global_get:
+    case Instr::global_set:
+    case Instr::i32_const:
+    case Instr::i32_load:
+    case Instr::i64_load:
+    case Instr::i32_load8_s:
+    case Instr::i32_load8_u:
+    case Instr::i32_load16_s:
+    case Instr::i32_load16_u:
+    case Instr::i64_load8_s:
+    case Instr::i64_load8_u:
+    case Instr::i64_load16_s:
+    case Instr::i64_load16_u:
+    case Instr::i64_load32_s:
+    case Instr::i64_load32_u:
+    case Instr::i32_store:
+    case Instr::i64_store:
+    case Instr::i32_store8:
+    case Instr::i32_store16:
+    case Instr::i64_store8:
+    case Instr::i64_store16:
+    case Instr::i64_store32:
+    // The superinstructions starting with local.get have its immediate first.
+    case Instr::local_get_local_get_i32_add:
+    case Instr::local_get_i32_const_i32_add_local_set:
+    case Instr::local_get_i32_load:
+        return sizeof(uint32_t);
+    case Instr::i64_const:
+    case Instr::meter:
+        return sizeof(uint64_t);
+    default:
+        return 0;
+    }
+}
+
+/// Maps the instruction to its equivalent without the superinstructions: the superinstruction
+/// is translated as the first instruction of its sequence, the rest of the sequence follows it
+/// in Code.
+Instr unfused(Instr instr) noexcept
+{
+    switch (instr)
+    {
+    case Instr::local_get_local_get_i32_add:
+    case Instr::local_get_i32_const_i32_add_local_set:
+    case Instr::local_get_i32_load:
+        return Instr::local_get;
+    case Instr::i32_eqz_br_if:
+        return Instr::i32_eqz;
+    default:
+        return instr;
+    }
+}
+
+/// Returns the register instruction of the unary (1 operand) or binary (2 operands) numeric
+/// instruction.
+std::pair<RegisterOp, int> numeric_op(Instr instr) noexcept
+{
+    switch (instr)
+    {
+    case Instr::i32_eqz:
+        return {RegisterOp::i32_eqz, 1};
+    case Instr::i32_clz:
+        return {RegisterOp::i32_clz, 1};
+    case Instr::i32_ctz:
+        return {RegisterOp::i32_ctz, 1};
+    case Instr::i32_popcnt:
+        return {RegisterOp::i32_popcnt, 1};
+    case Instr::i64_eqz:
+        return {RegisterOp::i64_eqz, 1};
+    case Instr::i64_clz:
+        return {RegisterOp::i64_clz, 1};
+    case Instr::i64_ctz:
+        return {RegisterOp::i64_ctz, 1};
+    case Instr::i64_popcnt:
+        return {RegisterOp::i64_popcnt, 1};
+    case Instr::i32_wrap_i64:
+        return {RegisterOp::i32_wrap_i64, 1};
+    case Instr::i64_extend_i32_s:
+        return {RegisterOp::i64_extend_i32_s, 1};
+    case Instr::i32_eq:
+        return {RegisterOp::i32_eq, 2};
+    case Instr::i32_ne:
+        return {RegisterOp::i32_ne, 2};
+    case Instr::i32_lt_s:
+        return {RegisterOp::i32_lt_s, 2};
+    case Instr::i32_lt_u:
+        return {RegisterOp::i32_lt_u, 2};
+    case Instr::i32_gt_s:
+        return {RegisterOp::i32_gt_s, 2};
+    case Instr::i32_gt_u:
+        return {RegisterOp::i32_gt_u, 2};
+    case Instr::i32_le_s:
+        return {RegisterOp::i32_le_s, 2};
+    case Instr::i32_le_u:
+        return {RegisterOp::i32_le_u, 2};
+    case Instr::i32_ge_s:
+        return {RegisterOp::i32_ge_s, 2};
+    case Instr::i32_ge_u:
+        return {RegisterOp::i32_ge_u, 2};
+    case Instr::i32_add:
+        return {RegisterOp::i32_add, 2};
+    case Instr::i32_sub:
+        return {RegisterOp::i32_sub, 2};
+    case Instr::i32_mul:
+        return {RegisterOp::i32_mul, 2};
+    case Instr::i32_div_s:
+        return {RegisterOp::i32_div_s, 2};
+    case Instr::i32_div_u:
+        return {RegisterOp::i32_div_u, 2};
+    case Instr::i32_rem_s:
+        return {RegisterOp::i32_rem_s, 2};
+    case Instr::i32_rem_u:
+        return {RegisterOp::i32_rem_u, 2};
+    case Instr::i32_and:
+        return {RegisterOp::i32_and, 2};
+    case Instr::i32_or:
+        return {RegisterOp::i32_or, 2};
+    case Instr::i32_xor:
+        return {RegisterOp::i32_xor, 2};
+    case Instr::i32_shl:
+        return {RegisterOp::i32_shl, 2};
+    case Instr::i32_shr_s:
+        return {RegisterOp::i32_shr_s, 2};
+    case Instr::i32_shr_u:
+        return {RegisterOp::i32_shr_u, 2};
+    case Instr::i32_rotl:
+        return {RegisterOp::i32_rotl, 2};
+    case Instr::i32_rotr:
+        return {RegisterOp::i32_rotr, 2};
+    case Instr::i64_eq:
+        return {RegisterOp::i64_eq, 2};
+    case Instr::i64_ne:
+        return {RegisterOp::i64_ne, 2};
+    case Instr::i64_lt_s:
+        return {RegisterOp::i64_lt_s, 2};
+    case Instr::i64_lt_u:
+        return {RegisterOp::i64_lt_u, 2};
+    case Instr::i64_gt_s:
+        return {RegisterOp::i64_gt_s, 2};
+    case Instr::i64_gt_u:
+        return {RegisterOp::i64_gt_u, 2};
+    case Instr::i64_le_s:
+        return {RegisterOp::i64_le_s, 2};
+    case Instr::i64_le_u:
+        return {RegisterOp::i64_le_u, 2};
+    case Instr::i64_ge_s:
+        return {RegisterOp::i64_ge_s, 2};
+    case Instr::i64_ge_u:
+        return {RegisterOp::i64_ge_u, 2};
+    case Instr::i64_add:
+        return {RegisterOp::i64_add, 2};
+    case Instr::i64_sub:
+        return {RegisterOp::i64_sub, 2};
+    case Instr::i64_mul:
+        return {RegisterOp::i64_mul, 2};
+    case Instr::i64_div_s:
+        return {RegisterOp::i64_div_s, 2};
+    case Instr::i64_div_u:
+        return {RegisterOp::i64_div_u, 2};
+    case Instr::i64_rem_s:
+        return {RegisterOp::i64_rem_s, 2};
+    case Instr::i64_rem_u:
+        return {RegisterOp::i64_rem_u, 2};
+    case Instr::i64_and:
+        return {RegisterOp::i64_and, 2};
+    case Instr::i64_or:
+        return {RegisterOp::i64_or, 2};
+    case Instr::i64_xor:
+        return {RegisterOp::i64_xor, 2};
+    case Instr::i64_shl:
+        return {RegisterOp::i64_shl, 2};
+    case Instr::i64_shr_s:
+        return {RegisterOp::i64_shr_s, 2};
+    case Instr::i64_shr_u:
+        return {RegisterOp::i64_shr_u, 2};
+    case Instr::i64_rotl:
+        return {RegisterOp::i64_rotl, 2};
+    case Instr::i64_rotr:
+        return {RegisterOp::i64_rotr, 2};
+    default:
+        return {RegisterOp::unsupported, 0};
+    }
+}
+
+/// Returns the register instruction of the memory load or store instruction.
+RegisterOp memory_op(Instr instr) noexcept
+{
+    switch (instr)
+    {
+    case Instr::i32_load:
+    case Instr::i64_load32_u:
+        return RegisterOp::i32_load;
+    case Instr::i64_load:
+        return RegisterOp::i64_load;
+    case Instr::i32_load8_s:
+        return RegisterOp::i32_load8_s;
+    case Instr::i32_load8_u:
+    case Instr::i64_load8_u:
+        return RegisterOp::i32_load8_u;
+    case Instr::i32_load16_s:
+        return RegisterOp::i32_load16_s;
+    case Instr::i32_load16_u:
+    case Instr::i64_load16_u:
+        return RegisterOp::i32_load16_u;
+    case Instr::i64_load8_s:
+        return RegisterOp::i64_load8_s;
+    case Instr::i64_load16_s:
+        return RegisterOp::i64_load16_s;
+    case Instr::i64_load32_s:
+        return RegisterOp::i64_load32_s;
+    case Instr::i32_store8:
+    case Instr::i64_store8:
+        return RegisterOp::store8;
+    case Instr::i32_store16:
+    case Instr::i64_store16:
+        return RegisterOp::store16;
+    case Instr::i32_store:
+    case Instr::i64_store32:
+        return RegisterOp::store32;
+    case Instr::i64_store:
+        return RegisterOp::store64;
+    default:
+        return RegisterOp::unsupported;
+    }
+}
+
+/// Thrown when the code cannot be translated, see translate_to_register_code().
+struct unsupported_code
+{};
+
+/// The translation of a function body.
+///
+/// The operand stack of the wasm code is simulated at translation time. Each operand stack value
+/// is the slot it is kept in: the slot of the local for the values of local.get, the constant
+/// slot for the values of *.const and the operand stack slot for the results of the other
+/// instructions. The values are moved to their operand stack slots only when needed: at the block
+/// boundaries, as call arguments and before the local they refer to is modified.
+class Translator
+{
+public:
+    Translator(const Module& module, size_t code_idx, RegisterCode& result)
+      : m_module{module},
+        m_code{get_code(module, code_idx)},
+        m_func_type{module.typesec[module.funcsec[code_idx]]},
+        m_result{result}
+    {}
+
+    void translate();
+
+private:
+    /// The block, loop or if of the wasm code.
+    struct Label
+    {
+        /// The block, loop, if_ or else_ (after the else instruction).
+        Instr instr = Instr::block;
+
+        /// The operand stack height at the beginning of the block.
+        size_t stack_height = 0;
+
+        /// The number of the result values, unknown until the first branch or the end.
+        std::optional<size_t> arity;
+
+        /// The target instruction offset of the branches to this label in Code.
+        size_t code_target = 0;
+
+        /// The offset of the first instruction of the loop.
+        size_t loop_start = 0;
+
+        /// The operands to be filled with the offset of the end of the block.
+        std::vector<size_t> end_fixups;
+    };
+
+    uint32_t operand_slot(size_t stack_height) const noexcept
+    {
+        return static_cast<uint32_t>(m_operands_begin + stack_height);
+    }
+
+    void push(uint32_t slot)
+    {
+        m_stack.push_back(slot);
+        m_max_stack_height = std::max(m_max_stack_height, m_stack.size());
+    }
+
+    uint32_t pop()
+    {
+        if (m_stack.empty())
+            throw unsupported_code{};
+        const auto slot = m_stack.back();
+        m_stack.pop_back();
+        return slot;
+    }
+
+    size_t offset() const noexcept { return m_result.instructions.size(); }
+
+    /// Marks the current offset as a branch target, where the previous instruction cannot be
+    /// modified anymore.
+    void bind() noexcept { m_last_result_offset = std::nullopt; }
+
+    void patch(size_t fixup, size_t target) noexcept
+    {
+        m_result.instructions[fixup] = static_cast<uint32_t>(target);
+    }
+
+    void emit(RegisterOp op, std::initializer_list<uint32_t> operands)
+    {
+        m_result.instructions.push_back(static_cast<uint32_t>(op));
+        m_result.instructions.insert(m_result.instructions.end(), operands);
+        m_last_result_offset = std::nullopt;
+    }
+
+    /// Emits the instruction with the result (the first operand) put on the operand stack.
+    void emit_with_result(RegisterOp op, std::initializer_list<uint32_t> operands)
+    {
+        const auto dst = operand_slot(m_stack.size());
+        emit(op, {dst});
+        m_result.instructions.insert(m_result.instructions.end(), operands);
+        m_last_result_offset = offset() - operands.size() - 1;
+        push(dst);
+    }
+
+    /// Emits the branch to be filled at the end of the label.
+    void emit_forward_branch(RegisterOp op, std::initializer_list<uint32_t> operands, Label& label)
+    {
+        emit(op, operands);
+        m_result.instructions.push_back(0);
+        label.end_fixups.push_back(offset() - 1);
+    }
+
+    /// Moves the operand stack value of the given height to its operand stack slot.
+    void materialize(size_t stack_height)
+    {
+        const auto slot = operand_slot(stack_height);
+        if (m_stack[stack_height] != slot)
+        {
+            emit(RegisterOp::copy, {slot, m_stack[stack_height]});
+            m_stack[stack_height] = slot;
+        }
+    }
+
+    void materialize_all()
+    {
+        for (size_t i = 0; i < m_stack.size(); ++i)
+            materialize(i);
+    }
+
+    /// Moves the values referring to the slot of the local to their operand stack slots.
+    void materialize_local(uint32_t local_idx)
+    {
+        for (size_t i = 0; i < m_stack.size(); ++i)
+        {
+            if (m_stack[i] == local_idx)
+                materialize(i);
+        }
+    }
+
+    uint32_t constant_slot(uint64_t value) const { return m_constant_slots.at(value); }
+
+    Label& get_label(uint32_t code_target, uint32_t arity);
+
+    void set_arity(Label& label, size_t arity)
+    {
+        if (label.arity.has_value() && *label.arity != arity)
+            throw unsupported_code{};
+        label.arity = arity;
+    }
+
+    void emit_return();
+    void emit_branch(Label& label);
+    void emit_conditional_branch(uint32_t cond, Label& label);
+    void emit_local_set(uint32_t local_idx);
+
+    void enter_block(Instr instr, size_t instr_offset);
+    void enter_else();
+    void exit_block();
+
+    const Module& m_module;
+    const Code& m_code;
+    const FuncType& m_func_type;
+    RegisterCode& m_result;
+
+    std::unordered_map<uint64_t, uint32_t> m_constant_slots;
+
+    /// The slot of the bottom of the operand stack.
+    size_t m_operands_begin = 0;
+
+    /// The slots of the operand stack values.
+    std::vector<uint32_t> m_stack;
+    size_t m_max_stack_height = 0;
+
+    std::vector<Label> m_labels;
+
+    /// The offsets of the matching end instruction for the block, loop and if instructions.
+    std::vector<size_t> m_block_ends;
+
+    /// The offset of the result operand of the last instruction, if it can be changed.
+    std::optional<size_t> m_last_result_offset;
+
+    /// Whether the current instruction is unreachable, and the number of the unreachable blocks
+    /// entered since.
+    bool m_unreachable = false;
+    size_t m_unreachable_depth = 0;
+};
+
+Translator::Label& Translator::get_label(uint32_t code_target, uint32_t arity)
+{
+    // The block ending right before the end of the function has the same target as the function.
+    // The branches to either have the same effect if they have the same arity.
+    auto& function_label = m_labels.front();
+    if (function_label.code_target == code_target && *function_label.arity == arity)
+        return function_label;
+
+    for (auto it = m_labels.rbegin(); it != m_labels.rend(); ++it)
+    {
+        if (it->code_target == code_target)
+            return *it;
+    }
+    throw unsupported_code{};
+}
+
+void Translator::emit_return()
+{
+    if (m_func_type.outputs.empty())
+        emit(RegisterOp::ret_void, {});
+    else
+    {
+        if (m_stack.empty())
+            throw unsupported_code{};
+        emit(RegisterOp::ret, {m_stack.back()});
+    }
+}
+
+void Translator::emit_branch(Label& label)
+{
+    if (&label == &m_labels.front())
+        emit_return();
+    else if (label.instr == Instr::loop)
+    {
+        emit(RegisterOp::br, {static_cast<uint32_t>(label.loop_start)});
+    }
+    else
+    {
+        assert(label.arity.has_value());
+        if (*label.arity != 0)
+        {
+            if (m_stack.empty())
+                throw unsupported_code{};
+            const auto dst = operand_slot(label.stack_height);
+            if (m_stack.back() != dst)
+                emit(RegisterOp::copy, {dst, m_stack.back()});
+        }
+        emit_forward_branch(RegisterOp::br, {}, label);
+    }
+}
+
+void Translator::emit_conditional_branch(uint32_t cond, Label& label)
+{
+    const auto need_copy = &label != &m_labels.front() && label.instr != Instr::loop &&
+                           *label.arity != 0 &&
+                           (m_stack.empty() || m_stack.back() != operand_slot(label.stack_height));
+    if (label.instr == Instr::loop)
+        emit(RegisterOp::br_if, {cond, static_cast<uint32_t>(label.loop_start)});
+    else if (&label != &m_labels.front() && !need_copy)
+        emit_forward_branch(RegisterOp::br_if, {cond}, label);
+    else
+    {
+        // Skip the return or the result copy and the branch if the condition is false.
+        emit(RegisterOp::br_eqz, {cond, 0});
+        const auto skip_fixup = offset() - 1;
+        emit_branch(label);
+        patch(skip_fixup, offset());
+        bind();
+    }
+}
+
+void Translator::emit_local_set(uint32_t local_idx)
+{
+    const auto src = pop();
+    materialize_local(local_idx);
+
+    // Make the previous instruction put its result in the local directly, if it is the value
+    // being set. Not possible if any values have been materialized above.
+    if (m_last_result_offset.has_value() && src == operand_slot(m_stack.size()) &&
+        m_result.instructions[*m_last_result_offset] == src)
+    {
+        m_result.instructions[*m_last_result_offset] = local_idx;
+        m_last_result_offset = std::nullopt;
+    }
+    else if (src != local_idx)
+        emit(RegisterOp::copy, {local_idx, src});
+}
+
+void Translator::enter_block(Instr instr, size_t instr_offset)
+{
+    // The values of the outer blocks are kept in their slots during the block execution,
+    // so they are the same on all paths through the block.
+    materialize_all();
+
+    Label label;
+    label.instr = instr;
+    label.stack_height = m_stack.size();
+    if (instr == Instr::loop)
+    {
+        label.code_target = instr_offset + 1;
+        label.loop_start = offset();
+        bind();
+    }
+    else
+        label.code_target = m_block_ends.at(instr_offset) + 1;
+    m_labels.push_back(std::move(label));
+}
+
+void Translator::enter_else()
+{
+    auto& label = m_labels.back();
+    if (label.instr != Instr::if_)
+        throw unsupported_code{};
+
+    if (!m_unreachable)
+    {
+        set_arity(label, m_stack.size() - label.stack_height);
+        for (auto i = label.stack_height; i < m_stack.size(); ++i)
+            materialize(i);
+        emit_forward_branch(RegisterOp::br, {}, label);
+    }
+
+    // The if jumps here when the condition is false.
+    patch(label.end_fixups.front(), offset());
+    label.end_fixups.erase(label.end_fixups.begin());
+    bind();
+
+    label.instr = Instr::else_;
+    m_stack.resize(label.stack_height);
+    m_unreachable = false;
+}
+
+void Translator::exit_block()
+{
+    auto label = std::move(m_labels.back());
+    m_labels.pop_back();
+
+    if (!m_unreachable)
+    {
+        if (m_stack.size() < label.stack_height)
+            throw unsupported_code{};
+        const auto arity = m_stack.size() - label.stack_height;
+        if (label.instr != Instr::loop)
+            set_arity(label, arity);
+        else
+            label.arity = arity;
+        for (auto i = label.stack_height; i < m_stack.size(); ++i)
+            materialize(i);
+    }
+
+    if (label.instr == Instr::if_)
+    {
+        // The if without else has no results as the false condition skips to the end.
+        set_arity(label, 0);
+    }
+
+    const auto end = offset();
+    for (const auto fixup : label.end_fixups)
+        patch(fixup, end);
+    bind();
+
+    const auto reachable = !m_unreachable || !label.end_fixups.empty();
+    if (reachable)
+    {
+        assert(label.arity.has_value());
+        m_stack.resize(label.stack_height);
+        for (size_t i = 0; i < *label.arity; ++i)
+            push(operand_slot(m_stack.size()));
+    }
+    m_unreachable = !reachable;
+}
+
+void Translator::translate()
+{
+    const auto& instructions = m_code.instructions;
+
+    // Find the matching ends of the blocks and collect the constants.
+    std::vector<uint64_t> constants;
+    {
+        m_block_ends.resize(instructions.size());
+        std::vector<size_t> open_blocks;
+        const auto* immediates = m_code.immediates.data();
+        for (size_t i = 0; i < instructions.size(); ++i)
+        {
+            const auto instr = instructions[i];
+            const auto* const next_immediates = immediates + immediates_size(instr, immediates);
+            switch (instr)
+            {
+            case Instr::block:
+            case Instr::loop:
+            case Instr::if_:
+                open_blocks.push_back(i);
+                break;
+            case Instr::end:
+                if (!open_blocks.empty())
+                {
+                    m_block_ends[open_blocks.back()] = i;
+                    open_blocks.pop_back();
+                }
+                break;
+            case Instr::i32_const:
+            case Instr::i64_const:
+            {
+                const auto value = instr == Instr::i32_const ? read<uint32_t>(immediates) :
+                                                               read<uint64_t>(immediates);
+                if (m_constant_slots.count(value) == 0)
+                {
+                    m_constant_slots.emplace(value, static_cast<uint32_t>(constants.size()));
+                    constants.push_back(value);
+                }
+                break;
+            }
+            default:
+                break;
+            }
+            immediates = next_immediates;
+        }
+    }
+
+    const auto num_args = m_func_type.inputs.size();
+    const auto num_locals = num_args + m_code.local_count;
+    for (auto& [value, slot] : m_constant_slots)
+        slot += static_cast<uint32_t>(num_locals);
+    m_operands_begin = num_locals + constants.size();
+
+    // The function's implicit block, the branches to it return.
+    Label function_label;
+    function_label.arity = m_func_type.outputs.size();
+    function_label.code_target = instructions.size() - 1;
+    m_labels.push_back(std::move(function_label));
+
+    const auto* immediates = m_code.immediates.data();
+    for (size_t i = 0; i < instructions.size(); ++i)
+    {
+        const auto instr = unfused(instructions[i]);
+        const auto* const next_immediates =
+            immediates + immediates_size(instructions[i], immediates);
+
+        if (m_unreachable)
+        {
+            // Skip to the end of the block (or the else branch), counting the nested blocks.
+            const auto is_block_end = instr == Instr::end || instr == Instr::else_;
+            if (!is_block_end || m_unreachable_depth != 0)
+            {
+                if (instr == Instr::block || instr == Instr::loop || instr == Instr::if_)
+                    ++m_unreachable_depth;
+                else if (instr == Instr::end)
+                    --m_unreachable_depth;
+                immediates = next_immediates;
+                continue;
+            }
+        }
+
+        switch (instr)
+        {
+        case Instr::meter:
+            // The metered code is executed by the stack-based interpreter only.
+            throw unsupported_code{};
+
+        case Instr::unreachable:
+            emit(RegisterOp::unreachable, {});
+            m_unreachable = true;
+            break;
+
+        case Instr::nop:
+            break;
+
+        case Instr::block:
+        case Instr::loop:
+            enter_block(instr, i);
+            break;
+
+        case Instr::if_:
+        {
+            const auto cond = pop();
+            enter_block(instr, i);
+            // Jump to the else branch or the end when the condition is false.
+            emit_forward_branch(RegisterOp::br_eqz, {cond}, m_labels.back());
+            break;
+        }
+
+        case Instr::else_:
+            enter_else();
+            break;
+
+        case Instr::end:
+            if (m_labels.size() > 1)
+                exit_block();
+            else
+            {
+                // The end of the function.
+                if (!m_unreachable)
+                    emit_return();
+                m_labels.pop_back();
+            }
+            break;
+
+        case Instr::br:
+        case Instr::br_if:
+        {
+            const auto code_target = read<uint32_t>(immediates);
+            immediates += sizeof(uint32_t);  // The target immediates offset.
+            immediates += sizeof(uint32_t);  // The operand stack height.
+            const auto arity = read<uint32_t>(immediates);
+
+            auto& label = get_label(code_target, arity);
+            if (label.instr != Instr::loop)
+                set_arity(label, arity);
+
+            if (instr == Instr::br)
+            {
+                emit_branch(label);
+                m_unreachable = true;
+            }
+            else
+                emit_conditional_branch(pop(), label);
+            break;
+        }
+
+        case Instr::br_table:
+        {
+            const auto idx = pop();
+            const auto num_targets = read<uint32_t>(immediates) + 1;
+
+            emit(RegisterOp::br_table, {idx, num_targets - 1});
+            const auto table_offset = offset();
+            m_result.instructions.resize(table_offset + num_targets);
+
+            for (size_t t = 0; t < num_targets; ++t)
+            {
+                const auto code_target = read<uint32_t>(immediates);
+                immediates += sizeof(uint32_t);  // The target immediates offset.
+                immediates += sizeof(uint32_t);  // The operand stack height.
+                const auto arity = read<uint32_t>(immediates);
+
+                auto& label = get_label(code_target, arity);
+                if (label.instr != Instr::loop)
+                    set_arity(label, arity);
+
+                const auto need_copy =
+                    &label != &m_labels.front() && label.instr != Instr::loop &&
+                    *label.arity != 0 &&
+                    (m_stack.empty() || m_stack.back() != operand_slot(label.stack_height));
+                if (label.instr == Instr::loop)
+                    patch(table_offset + t, label.loop_start);
+                else if (&label != &m_labels.front() && !need_copy)
+                    label.end_fixups.push_back(table_offset + t);
+                else
+                {
+                    // The return or the result copy and the branch following the table.
+                    patch(table_offset + t, offset());
+                    emit_branch(label);
+                }
+            }
+            m_unreachable = true;
+            break;
+        }
+
+        case Instr::return_:
+            emit_return();
+            m_unreachable = true;
+            break;
+
+        case Instr::call:
+        case Instr::call_indirect:
+        {
+            const auto idx = read<uint32_t>(immediates);
+            const auto elem_idx = instr == Instr::call_indirect ? pop() : 0;
+
+            const auto num_imported = m_module.imported_function_types.size();
+            TypeIdx type_idx = idx;
+            if (instr == Instr::call)
+            {
+                type_idx = idx < num_imported ? m_module.imported_function_types[idx] :
+                                                m_module.funcsec[idx - num_imported];
+            }
+            const auto& func_type = m_module.typesec[type_idx];
+
+            const auto num_call_args = func_type.inputs.size();
+            if (m_stack.size() < num_call_args)
+                throw unsupported_code{};
+            const auto args_height = m_stack.size() - num_call_args;
+            for (auto h = args_height; h < m_stack.size(); ++h)
+                materialize(h);
+            const auto args = operand_slot(args_height);
+
+            if (instr == Instr::call_indirect)
+                emit(RegisterOp::call_indirect, {idx, elem_idx, args});
+            else
+                emit(RegisterOp::call, {idx, args});
+
+            m_stack.resize(args_height);
+            if (!func_type.outputs.empty())
+                push(args);
+            break;
+        }
+
+        case Instr::drop:
+            pop();
+            break;
+
+        case Instr::select:
+        {
+            const auto cond = pop();
+            const auto b = pop();
+            const auto a = pop();
+            emit_with_result(RegisterOp::select, {a, b, cond});
+            break;
+        }
+
+        case Instr::local_get:
+        {
+            const auto local_idx = read<uint32_t>(immediates);
+            push(local_idx);
+            break;
+        }
+
+        case Instr::local_set:
+            emit_local_set(read<uint32_t>(immediates));
+            break;
+
+        case Instr::local_tee:
+        {
+            const auto local_idx = read<uint32_t>(immediates);
+            emit_local_set(local_idx);
+            push(local_idx);
+            break;
+        }
+
+        case Instr::global_get:
+            emit_with_result(RegisterOp::global_get, {read<uint32_t>(immediates)});
+            break;
+
+        case Instr::global_set:
+        {
+            const auto global_idx = read<uint32_t>(immediates);
+            emit(RegisterOp::global_set, {global_idx, pop()});
+            break;
+        }
+
+        case Instr::i32_load:
+        case Instr::i64_load:
+        case Instr::i32_load8_s:
+        case Instr::i32_load8_u:
+        case Instr::i32_load16_s:
+        case Instr::i32_load16_u:
+        case Instr::i64_load8_s:
+        case Instr::i64_load8_u:
+        case Instr::i64_load16_s:
+        case Instr::i64_load16_u:
+        case Instr::i64_load32_s:
+        case Instr::i64_load32_u:
+        {
+            const auto mem_offset = read<uint32_t>(immediates);
+            const auto addr = pop();
+            emit_with_result(memory_op(instr), {addr, mem_offset});
+            break;
+        }
+
+        case Instr::i32_store:
+        case Instr::i64_store:
+        case Instr::i32_store8:
+        case Instr::i32_store16:
+        case Instr::i64_store8:
+        case Instr::i64_store16:
+        case Instr::i64_store32:
+        {
+            const auto mem_offset = read<uint32_t>(immediates);
+            const auto value = pop();
+            const auto addr = pop();
+            emit(memory_op(instr), {addr, value, mem_offset});
+            break;
+        }
+
+        case Instr::memory_size:
+            emit_with_result(RegisterOp::memory_size, {});
+            break;
+
+        case Instr::memory_grow:
+            emit_with_result(RegisterOp::memory_grow, {pop()});
+            break;
+
+        case Instr::i32_const:
+            push(constant_slot(read<uint32_t>(immediates)));
+            break;
+
+        case Instr::i64_const:
+            push(constant_slot(read<uint64_t>(immediates)));
+            break;
+
+        case Instr::i64_extend_i32_u:
+            // The i32 values are zero-extended already, the value stays in the same slot.
+            break;
+
+        default:
+        {
+            const auto [op, num_operands] = numeric_op(instr);
+            if (num_operands == 1)
+            {
+                const auto a = pop();
+                emit_with_result(op, {a});
+            }
+            else if (num_operands == 2)
+            {
+                const auto b = pop();
+                const auto a = pop();
+                emit_with_result(op, {a, b});
+            }
+            else
+            {
+                // The floating point instructions are not supported and abort the execution,
+                // what makes the remainder of the block unreachable.
+                emit(RegisterOp::unsupported, {});
+                m_unreachable = true;
+            }
+            break;
+        }
+        }
+
+        immediates = next_immediates;
+    }
+
+    if (!m_labels.empty())
+        throw unsupported_code{};
+
+    m_result.num_args = static_cast<uint32_t>(num_args);
+    m_result.num_locals = static_cast<uint32_t>(num_locals);
+    m_result.frame_size = static_cast<uint32_t>(m_operands_begin + m_max_stack_height);
+    m_result.constants = std::move(constants);
+}
+}  // namespace
+
+bool translate_to_register_code(const Module& module, size_t code_idx, RegisterCode& result)
+{
+    try
+    {
+        result = {};
+        Translator{module, code_idx, result}.translate();
+        return true;
+    }
+    catch (const unsupported_code&)
+    {
+        return false;
+    }
+}
+
+std::shared_ptr<const RegisterModule> translate_to_register_module(const Module& module)
+{
+    auto register_module = std::make_shared<RegisterModule>();
+    register_module->functions.resize(module.funcsec.size());
+    for (size_t i = 0; i < module.funcsec.size(); ++i)
+    {
+        if (!translate_to_register_code(module, i, register_module->functions[i]))
+            return nullptr;
+    }
+    return register_module;
+}
+
+std::shared_ptr<const RegisterModule> get_register_module(const Module& module)
+{
+    if (module.register_module_cache == nullptr)
+        return translate_to_register_module(module);
+
+    auto& cache = *module.register_module_cache;
+    std::call_once(
+        cache.translated, [&] { cache.register_module = translate_to_register_module(module); });
+    return cache.register_module;
+}
+}  // namespace fizzy
@@ -0,0 +1,184 @@
+#pragma once
+
+#include "types.hpp"
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace fizzy
+{
+struct JitModule;
+
+/// The instructions of the register-based code. Each instruction is followed by its operands,
+/// all being uint32_t words. The operands named dst, src, a, b, cond, addr, value and idx are
+/// slot indexes relative to the beginning of the function's frame, target is the instruction
+/// offset in RegisterCode::instructions.
+///
+/// The i32 values are kept in slots zero-extended to 64 bits, like on the operand stack.
+enum class RegisterOp : uint32_t
+{
+    unreachable,  // -
+    unsupported,  // -, the floating point instruction
+    br,           // target
+    br_if,        // cond, target
+    br_eqz,       // cond, target
+    br_table,     // idx, n, target * (n + 1)
+    call,         // func_idx, args (the result replaces the first argument)
+    call_indirect,  // type_idx, elem_idx, args (the result replaces the first argument)
+    ret,            // src
+    ret_void,       // -
+    copy,           // dst, src
+    select,         // dst, a, b, cond
+    global_get,     // dst, global_idx
+    global_set,     // global_idx, src
+
+    // dst, addr, offset
+    i32_load,
+    i64_load,
+    i32_load8_s,
+    i32_load8_u,
+    i32_load16_s,
+    i32_load16_u,
+    i64_load8_s,
+    i64_load16_s,
+    i64_load32_s,
+
+    // addr, value, offset
+    store8,
+    store16,
+    store32,
+    store64,
+
+    memory_size,  // dst
+    memory_grow,  // dst, src
+
+    // dst, a
+    i32_eqz,
+    i32_clz,
+    i32_ctz,
+    i32_popcnt,
+    i64_eqz,
+    i64_clz,
+    i64_ctz,
+    i64_popcnt,
+    i32_wrap_i64,
+    i64_extend_i32_s,
+
+    // dst, a, b
+    i32_eq,
+    i32_ne,
+    i32_lt_s,
+    i32_lt_u,
+    i32_gt_s,
+    i32_gt_u,
+    i32_le_s,
+    i32_le_u,
+    i32_ge_s,
+    i32_ge_u,
+    i32_add,
+    i32_sub,
+    i32_mul,
+    i32_div_s,
+    i32_div_u,
+    i32_rem_s,
+    i32_rem_u,
+    i32_and,
+    i32_or,
+    i32_xor,
+    i32_shl,
+    i32_shr_s,
+    i32_shr_u,
+    i32_rotl,
+    i32_rotr,
+    i64_eq,
+    i64_ne,
+    i64_lt_s,
+    i64_lt_u,
+    i64_gt_s,
+    i64_gt_u,
+    i64_le_s,
+    i64_le_u,
+    i64_ge_s,
+    i64_ge_u,
+    i64_add,
+    i64_sub,
+    i64_mul,
+    i64_div_s,
+    i64_div_u,
+    i64_rem_s,
+    i64_rem_u,
+    i64_and,
+    i64_or,
+    i64_xor,
+    i64_shl,
+    i64_shr_s,
+    i64_shr_u,
+    i64_rotl,
+    i64_rotr,
+};
+
+/// The number of the RegisterOp instructions.
+constexpr size_t NumRegisterOps = static_cast<size_t>(RegisterOp::i64_rotr) + 1;
+
+/// The function translated from the stack-based Code to the register-based code.
+///
+/// The frame of the function consists of the slots of the locals (the arguments first),
+/// the constants and the operand stack values. The wasm stack machine values are assigned
+/// to the slots at translation time, so the local.get, *.const and drop instructions vanish,
+/// and the other instructions read and write the slots directly.
+struct RegisterCode
+{
+    /// The number of the arguments, being the first locals.
+    uint32_t num_args = 0;
+
+    /// The number of all the locals, including the arguments.
+    uint32_t num_locals = 0;
+
+    /// The number of all the slots of the frame.
+    uint32_t frame_size = 0;
+
+    /// The values of the constant slots, following the locals.
+    std::vector<uint64_t> constants;
+
+    /// The instructions with their operands.
+    std::vector<uint32_t> instructions;
+};
+
+/// The functions of the module translated to the register-based code, in the code section order.
+struct RegisterModule
+{
+    std::vector<RegisterCode> functions;
+};
+
+/// The module's functions translated (and compiled for the Jit engine) on the first use,
+/// see get_register_module().
+struct RegisterModuleCache
+{
+    std::once_flag translated;
+
+    /// The translated functions, nullptr if the module cannot be translated.
+    std::shared_ptr<const RegisterModule> register_module;
+
+    std::once_flag compiled;
+
+    /// The translated functions compiled to the machine code, nullptr if the compilation is not
+    /// possible, see compile_jit_module().
+    std::shared_ptr<const JitModule> jit_module;
+};
+
+/// Translates the function body of the given index in the code section.
+/// Returns false if the code has the structure not supported by the translation, possible only
+/// in the code not valid according to the specification but accepted by the parser (e.g. with
+/// the blocks leaving inconsistent numbers of values).
+bool translate_to_register_code(const Module& module, size_t code_idx, RegisterCode& result);
+
+/// Translates all the function bodies of the module, returns nullptr if any of them
+/// is not supported, see translate_to_register_code().
+std::shared_ptr<const RegisterModule> translate_to_register_module(const Module& module);
+
+/// Returns the module's functions translated to the register-based code, translated once for
+/// the module and its copies if the module has the RegisterModuleCache (created by the parser).
+/// Returns nullptr if the module cannot be translated.
+std::shared_ptr<const RegisterModule> get_register_module(const Module& module);
+}  // namespace fizzy
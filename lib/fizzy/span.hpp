@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+
+namespace fizzy
+{
+/// The view of a contiguous sequence of objects, the minimal implementation of C++20's std::span
+/// with the dynamic extent.
+///
+/// There is no default constructor and the pointer type is deduced, so neither {} nor {0, n}
+/// converts to the span: the arguments like these select the std::vector overloads of execute().
+template <typename T>
+class span
+{
+public:
+    using element_type = T;
+    using value_type = std::remove_cv_t<T>;
+
+    template <typename P, typename = std::enable_if_t<std::is_convertible_v<P, T*>>>
+    constexpr span(P data, std::size_t size) noexcept : m_data{data}, m_size{size}
+    {}
+
+    /// The span of non-const objects converts to the span of const ones.
+    template <typename U, typename = std::enable_if_t<std::is_same_v<const U, T>>>
+    constexpr span(span<U> other) noexcept : m_data{other.data()}, m_size{other.size()}
+    {}
+
+    constexpr T* data() const noexcept { return m_data; }
+    constexpr std::size_t size() const noexcept { return m_size; }
+    constexpr bool empty() const noexcept { return m_size == 0; }
+
+    constexpr T& operator[](std::size_t index) const noexcept { return m_data[index]; }
+
+    constexpr T* begin() const noexcept { return m_data; }
+    constexpr T* end() const noexcept { return m_data + m_size; }
+
+private:
+    T* m_data = nullptr;
+    std::size_t m_size = 0;
+};
+}  // namespace fizzy
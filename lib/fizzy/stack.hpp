@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <vector>
 
@@ -35,4 +36,50 @@ public:
     /// Drops @a num_elements elements from the top of the stack.
     void drop(size_t num_elements = 1) noexcept { resize(size() - num_elements); }
 };
+
+/// The operand stack of an executing function.
+///
+/// It works on the memory provided from outside (a region of the instance's execution stack)
+/// and does not check bounds. The owner of the memory must make sure there is enough space for
+/// all the items pushed.
+class OperandStack
+{
+    /// The pointer to the bottom of the stack (the first item).
+    uint64_t* m_bottom = nullptr;
+
+    /// The pointer to the item just after the top one.
+    uint64_t* m_end = nullptr;
+
+public:
+    /// Creates the empty stack with the bottom at @a bottom.
+    explicit OperandStack(uint64_t* bottom) noexcept : m_bottom{bottom}, m_end{bottom} {}
+
+    /// Creates the stack of the items between @a bottom and @a end.
+    OperandStack(uint64_t* bottom, uint64_t* end) noexcept : m_bottom{bottom}, m_end{end} {}
+
+    uint64_t* bottom() const noexcept { return m_bottom; }
+
+    uint64_t* end() const noexcept { return m_end; }
+
+    size_t size() const noexcept { return static_cast<size_t>(m_end - m_bottom); }
+
+    bool empty() const noexcept { return m_end == m_bottom; }
+
+    void push(uint64_t val) noexcept { *m_end++ = val; }
+
+    uint64_t pop() noexcept { return *--m_end; }
+
+    uint64_t peek(size_t depth = 0) const noexcept
+    {
+        return *(m_end - static_cast<ptrdiff_t>(depth) - 1);
+    }
+
+    /// Drops @a num_elements elements from the top of the stack.
+    void drop(size_t num_elements = 1) noexcept { m_end -= num_elements; }
+
+    /// Changes the stack size to @a new_size, it must not be greater than the current size.
+    void resize(size_t new_size) noexcept { m_end = m_bottom + new_size; }
+
+    void clear() noexcept { m_end = m_bottom; }
+};
 }  // namespace fizzy
@@ -0,0 +1,57 @@
+#include "superinstructions.hpp"
+#include "parser.hpp"
+#include <algorithm>
+
+namespace fizzy
+{
+namespace
+{
+/// The sequence of instructions replaced with the superinstruction.
+struct Superinstruction
+{
+    Instr instr;
+    size_t length;
+    Instr sequence[4];
+};
+
+/// The superinstructions, the longest sequences first.
+/// The number of the instructions skipped by the handlers in execute() must match the lengths.
+constexpr Superinstruction superinstructions[] = {
+    {Instr::local_get_i32_const_i32_add_local_set, 4,
+        {Instr::local_get, Instr::i32_const, Instr::i32_add, Instr::local_set}},
+    {Instr::local_get_local_get_i32_add, 3, {Instr::local_get, Instr::local_get, Instr::i32_add}},
+    {Instr::local_get_i32_load, 2, {Instr::local_get, Instr::i32_load}},
+    {Instr::i32_eqz_br_if, 2, {Instr::i32_eqz, Instr::br_if}},
+};
+}  // namespace
+
+void fuse_superinstructions(Code& code) noexcept
+{
+    auto& instructions = code.instructions;
+    for (size_t i = 0; i < instructions.size();)
+    {
+        const auto remaining = instructions.size() - i;
+        const auto it = std::find_if(std::begin(superinstructions), std::end(superinstructions),
+            [&](const Superinstruction& s) noexcept {
+                return s.length <= remaining &&
+                       std::equal(s.sequence, s.sequence + s.length, &instructions[i]);
+            });
+        if (it != std::end(superinstructions))
+        {
+            instructions[i] = it->instr;
+            i += it->length;
+        }
+        else
+            ++i;
+    }
+}
+
+void fuse_superinstructions(Module& module) noexcept
+{
+    for (auto& code : module.codesec)
+        fuse_superinstructions(code);
+
+    if (module.lazy_codesec != nullptr)
+        module.lazy_codesec->superinstructions = true;
+}
+}  // namespace fizzy
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "types.hpp"
+
+namespace fizzy
+{
+/// Rewrites the common sequences of instructions in the code into the superinstructions
+/// (the internal instructions of Instr), each executed with a single dispatch and without
+/// passing the intermediate values through the operand stack.
+///
+/// Only the first instruction of a sequence is replaced, the other instructions and all
+/// the immediates stay in place, so the branch targets resolved by the parser remain valid.
+/// The superinstruction skips the rest of the sequence and a branch into the middle of
+/// the sequence executes the remaining instructions one by one.
+void fuse_superinstructions(Code& code) noexcept;
+
+/// Applies fuse_superinstructions() to all the function bodies of the module. The function
+/// bodies of a module parsed with CodeDecoding::Lazy are rewritten when decoded.
+/// Must be called before the module is executed.
+void fuse_superinstructions(Module& module) noexcept;
+}  // namespace fizzy
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace fizzy
+{
+/// A function body translated for the direct threaded dispatch of the Stack engine interpreter:
+/// the address of the interpreter's handler of each instruction.
+struct ThreadedCode
+{
+    std::once_flag translated;
+
+    /// The handler addresses, in the order of Code::instructions.
+    std::vector<const void*> handlers;
+
+    /// The handler addresses once translated, nullptr before.
+    std::atomic<const void* const*> ready{nullptr};
+};
+
+/// The module's function bodies translated on their first execution, shared by the instances.
+/// Used only if the interpreter is built with the computed goto dispatch (see execute.cpp).
+struct ThreadedCodeCache
+{
+    std::once_flag allocated;
+
+    /// The translations of the functions, indexed as the code section.
+    std::unique_ptr<ThreadedCode[]> functions;
+};
+}  // namespace fizzy
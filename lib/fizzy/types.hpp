@@ -1,7 +1,9 @@
 #pragma once
 
 #include "bytes.hpp"
+#include <array>
 #include <cstdint>
+#include <memory>
 #include <optional>
 #include <string>
 #include <vector>
@@ -9,6 +11,11 @@
 
 namespace fizzy
 {
+struct LazyCodeSection;
+struct MemoryImageCache;
+struct RegisterModuleCache;
+struct ThreadedCodeCache;
+
 // https://webassembly.github.io/spec/core/binary/types.html#binary-valtype
 enum class ValType : uint8_t
 {
@@ -248,6 +255,17 @@ enum class Instr : uint8_t
     f32_reinterpret_i32 = 0xbe,
     f64_reinterpret_i64 = 0xbf,
 
+    // The internal superinstructions, replacing the first instruction of the common sequences
+    // of instructions in Code (see fuse_superinstructions()). These are not valid in the binary.
+    local_get_local_get_i32_add = 0xe0,
+    local_get_i32_const_i32_add_local_set = 0xe1,
+    local_get_i32_load = 0xe2,
+    i32_eqz_br_if = 0xe3,
+
+    // The internal instruction beginning each basic block of the metered Code, charging
+    // the costs of the block's instructions (the int64_t immediate) to the instance's gas.
+    // Inserted by the parser when built with FIZZY_METERING, see InstructionCostTable.
+    meter = 0xe4,
 };
 
 // https://webassembly.github.io/spec/core/binary/modules.html#table-section
@@ -324,12 +342,20 @@ struct Element
     std::vector<FuncIdx> init;
 };
 
+/// The costs of the instructions charged by the metered code, indexed by the opcode.
+using InstructionCostTable = std::array<uint32_t, 256>;
+
 /// The element of the code section.
 /// https://webassembly.github.io/spec/core/binary/modules.html#code-section
 struct Code
 {
     uint32_t local_count = 0;
 
+    // The maximum operand stack height of the function, computed by the parser.
+    // The interpreter reserves this much stack space for the function and does not check
+    // the operand stack bounds afterwards.
+    int max_stack_height = 0;
+
     // The instructions bytecode without immediate values.
     // https://webassembly.github.io/spec/core/binary/instructions.html
     std::vector<Instr> instructions;
@@ -339,6 +365,11 @@ struct Code
     bytes immediates;
 };
 
+/// The size of the immediates of a branch resolved by the parser (br, br_if or a br_table entry).
+/// These are uint32_t values: the target instruction offset, the target immediates offset,
+/// the operand stack height to restore and the number of values to keep on top of it.
+constexpr auto BranchImmediateSize = 4 * sizeof(uint32_t);
+
 /// The reference to the `code` in the wasm binary.
 ///
 /// The distinct type is needed for parse_vec<> specialization.
@@ -353,6 +384,12 @@ struct Data
 {
     ConstantExpression offset;
     bytes init;
+
+    // The payload referencing the mapped module file (see Module::storage), used instead of init.
+    // Set by parse_file() and parse_cached(), which do not copy the payloads.
+    std::optional<bytes_view> mapped_init = std::nullopt;
+
+    bytes_view payload() const noexcept { return mapped_init.has_value() ? *mapped_init : init; }
 };
 
 enum class SectionId : uint8_t
@@ -371,8 +408,19 @@ enum class SectionId : uint8_t
     data = 11
 };
 
+// The module is immutable once parsed (or once instantiated, if built manually): the caches
+// below are built from its sections on the first instantiation or execution and shared
+// by the moved-from module's successors. A copy gets its own empty caches, so it can be
+// modified before being instantiated.
 struct Module
 {
+    Module() = default;
+    Module(const Module& other);
+    Module(Module&& other) noexcept = default;
+    Module& operator=(const Module& other);
+    Module& operator=(Module&& other) noexcept = default;
+    ~Module() noexcept = default;
+
     // https://webassembly.github.io/spec/core/binary/modules.html#type-section
     std::vector<FuncType> typesec;
     // https://webassembly.github.io/spec/core/binary/modules.html#import-section
@@ -395,6 +443,38 @@ struct Module
     std::vector<Code> codesec;
     // https://webassembly.github.io/spec/core/binary/modules.html#data-section
     std::vector<Data> datasec;
+
+    // The type indices of the imported functions, in the order of the import section.
+    // Collected by the parser for the validation of calls.
+    std::vector<TypeIdx> imported_function_types;
+
+    // The function bodies to be decoded on the first use, if the module was parsed with
+    // the lazy code decoding (codesec is empty then).
+    std::shared_ptr<LazyCodeSection> lazy_codesec;
+
+    // The initial memory image. Created empty by the parser and built by the first
+    // instantiation, therefore the module must not be modified after being instantiated.
+    std::shared_ptr<MemoryImageCache> memory_image_cache;
+
+    // The functions translated to the register-based code. Created empty by the parser
+    // and built by the first execution with the register engine.
+    std::shared_ptr<RegisterModuleCache> register_module_cache;
+
+    // The function bodies translated to the handler addresses of the interpreter. Created empty
+    // by the parser and built by the executions with the Stack engine.
+    std::shared_ptr<ThreadedCodeCache> threaded_code_cache;
+
+#if FIZZY_METERING
+    // The costs of the instructions charged by the code, if the module is metered. Shared by
+    // the copies of the module, for the function bodies decoded lazily.
+    std::shared_ptr<const InstructionCostTable> instruction_costs;
+#endif
+
+    // The storage of the bytes referenced by the module: the function bodies to be decoded
+    // lazily and the mapped data segment payloads (see Data::mapped_init). It is either the copy
+    // of the function bodies made by the parser or the mapped module file. Shared by the copies
+    // of the module.
+    std::shared_ptr<const void> storage;
 };
 
 }  // namespace fizzy
@@ -1,5 +1,10 @@
 #include "utf8.hpp"
 #include <cassert>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 /*
  * The Unicode Standard, Version 6.0
@@ -42,115 +47,351 @@ enum class Rule
 
 namespace fizzy
 {
-bool utf8_validate(const uint8_t* pos, const uint8_t* end) noexcept
+namespace
 {
-    while (pos < end)
+/// Validates the UTF-8 sequence of a single code point starting at pos.
+/// Returns the position after the sequence or nullptr if the sequence is invalid.
+inline const uint8_t* validate_code_point(const uint8_t* pos, const uint8_t* end) noexcept
+{
+    unsigned required_bytes = 1;
+    auto byte2_rule = Rule::Range80BF;
+
+    const uint8_t byte1 = *pos++;
+    if (byte1 <= 0x7F)
+        // Shortcut for valid ASCII (also valid UTF-8)
+        return pos;
+    else if (byte1 < 0xC2)
+        return nullptr;  // NOLINT(bugprone-branch-clone)
+    else if (byte1 <= 0xDF)
+    {
+        required_bytes = 2;
+        byte2_rule = Rule::Range80BF;
+    }
+    else if (byte1 == 0xE0)
+    {
+        required_bytes = 3;
+        byte2_rule = Rule::RangeA0BF;
+    }
+    else if (byte1 <= 0xEC)
+    {  // NOLINT(bugprone-branch-clone)
+        required_bytes = 3;
+        byte2_rule = Rule::Range80BF;
+    }
+    else if (byte1 == 0xED)
+    {
+        required_bytes = 3;
+        byte2_rule = Rule::Range809F;
+    }
+    else if (byte1 <= 0xEF)
+    {
+        required_bytes = 3;
+        byte2_rule = Rule::Range80BF;
+    }
+    else if (byte1 == 0xF0)
     {
-        unsigned required_bytes = 1;
-        auto byte2_rule = Rule::Range80BF;
+        required_bytes = 4;
+        byte2_rule = Rule::Range90BF;
+    }
+    else if (byte1 <= 0xF3)
+    {
+        required_bytes = 4;
+        byte2_rule = Rule::Range80BF;
+    }
+    else if (byte1 == 0xF4)
+    {
+        required_bytes = 4;
+        byte2_rule = Rule::Range808F;
+    }
+    else
+        return nullptr;
 
-        const uint8_t byte1 = *pos++;
-        if (byte1 <= 0x7F)
-            // Shortcut for valid ASCII (also valid UTF-8)
-            continue;
-        else if (byte1 < 0xC2)
-            return false;  // NOLINT(bugprone-branch-clone)
-        else if (byte1 <= 0xDF)
-        {
-            required_bytes = 2;
-            byte2_rule = Rule::Range80BF;
-        }
-        else if (byte1 == 0xE0)
-        {
-            required_bytes = 3;
-            byte2_rule = Rule::RangeA0BF;
-        }
-        else if (byte1 <= 0xEC)
-        {  // NOLINT(bugprone-branch-clone)
-            required_bytes = 3;
-            byte2_rule = Rule::Range80BF;
-        }
-        else if (byte1 == 0xED)
-        {
-            required_bytes = 3;
-            byte2_rule = Rule::Range809F;
-        }
-        else if (byte1 <= 0xEF)
-        {
-            required_bytes = 3;
-            byte2_rule = Rule::Range80BF;
-        }
-        else if (byte1 == 0xF0)
-        {
-            required_bytes = 4;
-            byte2_rule = Rule::Range90BF;
-        }
-        else if (byte1 <= 0xF3)
-        {
-            required_bytes = 4;
-            byte2_rule = Rule::Range80BF;
-        }
-        else if (byte1 == 0xF4)
-        {
-            required_bytes = 4;
-            byte2_rule = Rule::Range808F;
-        }
-        else
-            return false;
+    // At this point need to read at least one more byte
+    if ((pos + required_bytes - 1) > end)
+        return nullptr;
+
+    assert(required_bytes > 1);
+
+    // Byte2 may have exceptional encodings
+    const uint8_t byte2 = *pos++;
+    switch (byte2_rule)
+    {
+    case Rule::Range80BF:
+        if (byte2 < 0x80 || byte2 > 0xBF)
+            return nullptr;
+        break;
+    case Rule::RangeA0BF:
+        if (byte2 < 0xA0 || byte2 > 0xBF)
+            return nullptr;
+        break;
+    case Rule::Range809F:
+        if (byte2 < 0x80 || byte2 > 0x9F)
+            return nullptr;
+        break;
+    case Rule::Range90BF:
+        if (byte2 < 0x90 || byte2 > 0xBF)
+            return nullptr;
+        break;
+    case Rule::Range808F:
+        if (byte2 < 0x80 || byte2 > 0x8F)
+            return nullptr;
+        break;
+        // NOTE: no default case required since it is enum class
+    }
+
+    // Byte3 always has regular encoding
+    if (required_bytes > 2)
+    {
+        const uint8_t byte3 = *pos++;
+        if (byte3 < 0x80 || byte3 > 0xBF)
+            return nullptr;
+    }
+
+    // Byte4 always has regular encoding
+    if (required_bytes > 3)
+    {
+        const uint8_t byte4 = *pos++;
+        if (byte4 < 0x80 || byte4 > 0xBF)
+            return nullptr;
+    }
+
+    return pos;
+}
+
+#if defined(__x86_64__)
+/*
+ * The vectorized validation of the multi-byte sequences by the lookup algorithm of
+ * J. Keiser and D. Lemire, "Validating UTF-8 In Less Than One Instruction Per Byte"
+ * (https://arxiv.org/abs/2010.03090).
+ *
+ * Each error in the table above is detected in a pair of consecutive bytes, from the high
+ * nibble of the first byte, the low nibble of the first byte and the high nibble of the second
+ * byte. Each of the nibbles is mapped by a 16-entry table to the set of the errors it may be part
+ * of, and an error is found where all three sets intersect. The missing third and fourth bytes
+ * are found by comparing the bytes 2 and 3 positions earlier against the 3- and 4-byte leads.
+ */
+
+// The errors found in the pairs of bytes.
+constexpr uint8_t TOO_SHORT = 1 << 0;       // 11______ 0_______, 11______ 11______
+constexpr uint8_t TOO_LONG = 1 << 1;        // 0_______ 10______
+constexpr uint8_t OVERLONG_3 = 1 << 2;      // 11100000 100_____
+constexpr uint8_t TOO_LARGE = 1 << 3;       // 11110100 1001____, 11110100 101_____,
+                                            // 11110101..11111111 ________
+constexpr uint8_t SURROGATE = 1 << 4;       // 11101101 101_____
+constexpr uint8_t OVERLONG_2 = 1 << 5;      // 1100000_ 10______
+constexpr uint8_t TOO_LARGE_1000 = 1 << 6;  // 11110101..11111111 1000____
+constexpr uint8_t OVERLONG_4 = 1 << 6;      // 11110000 1000____
+constexpr uint8_t TWO_CONTS = 1 << 7;       // 10______ 10______
+constexpr uint8_t CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+/// The state of the AVX2 validation carried between the 32-byte blocks.
+struct Utf8Avx2State
+{
+    __m256i error;
+    __m256i prev_input;
+    __m256i prev_incomplete;
+};
 
-        // At this point need to read at least one more byte
-        if ((pos + required_bytes - 1) > end)
+/// Returns the input shifted by N bytes towards the higher positions, with the last N bytes
+/// of prev_input shifted in.
+template <int N>
+__attribute__((target("avx2"))) inline __m256i prev_bytes(__m256i input, __m256i prev_input)
+{
+    return _mm256_alignr_epi8(input, _mm256_permute2x128_si256(prev_input, input, 0x21), 16 - N);
+}
+
+/// The errors possible for the high nibble of the first byte of a pair.
+constexpr uint8_t byte_1_high_table[16]{
+    // 0_______ ________
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    // 10______ ________
+    TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+    // 1100____ ________
+    TOO_SHORT | OVERLONG_2,
+    // 1101____ ________
+    TOO_SHORT,
+    // 1110____ ________
+    TOO_SHORT | OVERLONG_3 | SURROGATE,
+    // 1111____ ________
+    TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4,
+};
+
+/// The errors possible for the low nibble of the first byte of a pair.
+constexpr uint8_t byte_1_low_table[16]{
+    // ____0000 ________
+    CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+    // ____0001 ________
+    CARRY | OVERLONG_2,
+    // ____001_ ________
+    CARRY,
+    CARRY,
+    // ____0100 ________
+    CARRY | TOO_LARGE,
+    // ____0101 ________
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    // ____011_ ________
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    // ____1___ ________
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    // ____1101 ________
+    CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+};
+
+/// The errors possible for the high nibble of the second byte of a pair.
+constexpr uint8_t byte_2_high_table[16]{
+    // ________ 0_______
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    // ________ 1000____
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+    // ________ 1001____
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+    // ________ 101_____
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    // ________ 11______
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+};
+
+/// Maps each of the nibbles (the values 0..15) to the table entry.
+__attribute__((target("avx2"))) inline __m256i lookup16(__m256i nibbles, const uint8_t* table)
+{
+    const auto table_vec = _mm_loadu_si128(reinterpret_cast<const __m128i*>(table));
+    return _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(table_vec), nibbles);
+}
+
+__attribute__((target("avx2"))) inline void validate_block_avx2(
+    Utf8Avx2State& state, __m256i input)
+{
+    if (_mm256_movemask_epi8(input) == 0)
+    {
+        // All bytes are ASCII, only the sequence incomplete at the end of the previous block
+        // is an error.
+        state.error = _mm256_or_si256(state.error, state.prev_incomplete);
+        state.prev_input = input;
+        return;
+    }
+
+    const auto low_nibble_mask = _mm256_set1_epi8(0x0F);
+    const auto prev1 = prev_bytes<1>(input, state.prev_input);
+    const auto prev1_high = _mm256_and_si256(_mm256_srli_epi16(prev1, 4), low_nibble_mask);
+    const auto prev1_low = _mm256_and_si256(prev1, low_nibble_mask);
+    const auto input_high = _mm256_and_si256(_mm256_srli_epi16(input, 4), low_nibble_mask);
+
+    const auto byte_1_high = lookup16(prev1_high, byte_1_high_table);
+    const auto byte_1_low = lookup16(prev1_low, byte_1_low_table);
+    const auto byte_2_high = lookup16(input_high, byte_2_high_table);
+    const auto special_cases =
+        _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+    // Only the bytes following the 3-byte leads by 2 positions and the 4-byte leads
+    // by 2 or 3 positions must be continuations (have the TWO_CONTS error found).
+    const auto prev2 = prev_bytes<2>(input, state.prev_input);
+    const auto prev3 = prev_bytes<3>(input, state.prev_input);
+    const auto is_third_byte = _mm256_subs_epu8(prev2, _mm256_set1_epi8(0xE0 - 0x80));
+    const auto is_fourth_byte = _mm256_subs_epu8(prev3, _mm256_set1_epi8(0xF0 - 0x80));
+    const auto is_third_or_fourth_byte = _mm256_or_si256(is_third_byte, is_fourth_byte);
+    const auto must_be_continuation =
+        _mm256_and_si256(is_third_or_fourth_byte, _mm256_set1_epi8(static_cast<char>(TWO_CONTS)));
+
+    state.error =
+        _mm256_or_si256(state.error, _mm256_xor_si256(must_be_continuation, special_cases));
+
+    // The leads of the sequences not fitting in the block, checked against the next block.
+    const auto max_complete = _mm256_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        static_cast<char>(0xF0 - 1), static_cast<char>(0xE0 - 1), static_cast<char>(0xC0 - 1));
+    state.prev_incomplete = _mm256_subs_epu8(input, max_complete);
+    state.prev_input = input;
+}
+#endif
+
+using ValidateFn = decltype(&utf8_validate_scalar);
+
+ValidateFn select_validate() noexcept
+{
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("avx2"))
+        return utf8_validate_avx2;
+    return utf8_validate_sse2;
+#else
+    return utf8_validate_scalar;
+#endif
+}
+}  // namespace
+
+bool utf8_validate(const uint8_t* pos, const uint8_t* end) noexcept
+{
+    static const auto validate = select_validate();
+    return validate(pos, end);
+}
+
+bool utf8_validate_scalar(const uint8_t* pos, const uint8_t* end) noexcept
+{
+    while (pos < end)
+    {
+        pos = validate_code_point(pos, end);
+        if (pos == nullptr)
             return false;
+    }
 
-        assert(required_bytes > 1);
+    assert(pos == end);
 
-        // Byte2 may have exceptional encodings
-        const uint8_t byte2 = *pos++;
-        switch (byte2_rule)
-        {
-        case Rule::Range80BF:
-            if (byte2 < 0x80 || byte2 > 0xBF)
-                return false;
-            break;
-        case Rule::RangeA0BF:
-            if (byte2 < 0xA0 || byte2 > 0xBF)
-                return false;
-            break;
-        case Rule::Range809F:
-            if (byte2 < 0x80 || byte2 > 0x9F)
-                return false;
-            break;
-        case Rule::Range90BF:
-            if (byte2 < 0x90 || byte2 > 0xBF)
-                return false;
-            break;
-        case Rule::Range808F:
-            if (byte2 < 0x80 || byte2 > 0x8F)
-                return false;
-            break;
-            // NOTE: no default case required since it is enum class
-        }
+    return true;
+}
 
-        // Byte3 always has regular encoding
-        if (required_bytes > 2)
+#if defined(__x86_64__)
+bool utf8_validate_sse2(const uint8_t* pos, const uint8_t* end) noexcept
+{
+    constexpr size_t block_size = 16;
+    while (static_cast<size_t>(end - pos) >= block_size)
+    {
+        const auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
+        const auto non_ascii_mask = static_cast<unsigned>(_mm_movemask_epi8(block));
+        if (non_ascii_mask == 0)
         {
-            const uint8_t byte3 = *pos++;
-            if (byte3 < 0x80 || byte3 > 0xBF)
-                return false;
+            pos += block_size;
+            continue;
         }
 
-        // Byte4 always has regular encoding
-        if (required_bytes > 3)
+        // Skip the ASCII bytes and validate the code points starting in the rest of the block.
+        // The last one may end in the next block.
+        const auto block_end = pos + block_size;
+        pos += __builtin_ctz(non_ascii_mask);
+        while (pos < block_end)
         {
-            const uint8_t byte4 = *pos++;
-            if (byte4 < 0x80 || byte4 > 0xBF)
+            pos = validate_code_point(pos, end);
+            if (pos == nullptr)
                 return false;
         }
     }
+    return utf8_validate_scalar(pos, end);
+}
 
-    assert(pos == end);
+__attribute__((target("avx2"))) bool utf8_validate_avx2(
+    const uint8_t* pos, const uint8_t* end) noexcept
+{
+    constexpr size_t block_size = 32;
+    Utf8Avx2State state{_mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256()};
+    for (; static_cast<size_t>(end - pos) >= block_size; pos += block_size)
+        validate_block_avx2(state, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pos)));
 
-    return true;
-}
+    if (pos != end)
+    {
+        // Pad the last block with zeros, which are valid ASCII.
+        uint8_t last_block[block_size]{};
+        std::memcpy(last_block, pos, static_cast<size_t>(end - pos));
+        validate_block_avx2(
+            state, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(last_block)));
+    }
 
+    state.error = _mm256_or_si256(state.error, state.prev_incomplete);
+    return _mm256_testz_si256(state.error, state.error) != 0;
+}
+#endif
 }  // namespace fizzy
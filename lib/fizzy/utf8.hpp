@@ -4,5 +4,19 @@
 
 namespace fizzy
 {
+/// Checks if the input is a valid UTF-8 string. Uses the fastest of the implementations below
+/// supported by the CPU.
 bool utf8_validate(const uint8_t* start, const uint8_t* end) noexcept;
+
+/// The implementations of utf8_validate(), accepting the same inputs. The scalar one validates
+/// one code point at a time. The SSE2 one skips the ASCII bytes 16 at a time and validates
+/// the other code points one by one. The AVX2 one validates 32 bytes at a time, including
+/// the multi-byte sequences.
+bool utf8_validate_scalar(const uint8_t* start, const uint8_t* end) noexcept;
+#if defined(__x86_64__)
+bool utf8_validate_sse2(const uint8_t* start, const uint8_t* end) noexcept;
+
+/// Requires the CPU supporting AVX2.
+bool utf8_validate_avx2(const uint8_t* start, const uint8_t* end) noexcept;
+#endif
 }  // namespace fizzy
@@ -1,3 +1,5 @@
+#include "mapped_file.hpp"
+#include "parser.hpp"
 #include <benchmark/benchmark.h>
 #include <test/utils/hex.hpp>
 #include <test/utils/wasm_engine.hpp>
@@ -25,6 +27,11 @@ struct EngineRegistryEntry
 
 constexpr EngineRegistryEntry engine_registry[] = {
     {"fizzy", fizzy::test::create_fizzy_engine},
+    {"fizzy-fused", fizzy::test::create_fizzy_fused_engine},
+    {"fizzy-reg", fizzy::test::create_fizzy_register_engine},
+#if FIZZY_JIT
+    {"fizzy-jit", fizzy::test::create_fizzy_jit_engine},
+#endif
     {" wabt", fizzy::test::create_wabt_engine},
     {"wasm3", fizzy::test::create_wasm3_engine},
 };
@@ -38,7 +45,7 @@ inline std::string strip_space(const std::string& input)
 }
 
 void benchmark_parse(
-    benchmark::State& state, EngineCreateFn create_fn, const fizzy::bytes& wasm_binary)
+    benchmark::State& state, EngineCreateFn create_fn, fizzy::bytes_view wasm_binary)
 {
     const auto engine = create_fn();
 
@@ -58,8 +65,63 @@ void benchmark_parse(
         benchmark::Counter(static_cast<double>(num_bytes_parsed), benchmark::Counter::kIsRate);
 }
 
+/// Benchmarks the fizzy parser decoding the function bodies with the number of threads
+/// given as the benchmark argument.
+void benchmark_parse_threads(benchmark::State& state, fizzy::bytes_view wasm_binary)
+{
+    const auto num_threads = static_cast<unsigned>(state.range(0));
+
+    // Pre-run for validation
+    try
+    {
+        fizzy::parse(wasm_binary, fizzy::CodeDecoding::Eager, num_threads);
+    }
+    catch (const fizzy::parser_error&)
+    {
+        return state.SkipWithError("Parsing failed");
+    }
+
+    const auto input_size = wasm_binary.size();
+    auto num_bytes_parsed = uint64_t{0};
+    for ([[maybe_unused]] auto _ : state)
+    {
+        benchmark::DoNotOptimize(
+            fizzy::parse(wasm_binary, fizzy::CodeDecoding::Eager, num_threads));
+        num_bytes_parsed += input_size;
+    }
+    state.counters["size"] = benchmark::Counter(static_cast<double>(input_size));
+    state.counters["rate"] =
+        benchmark::Counter(static_cast<double>(num_bytes_parsed), benchmark::Counter::kIsRate);
+}
+
+/// Benchmarks the fizzy parser loading the module from the mapped file, without copying
+/// the binary.
+void benchmark_parse_file(benchmark::State& state, const std::string& path)
+{
+    // Pre-run for validation
+    try
+    {
+        fizzy::parse_file(path);
+    }
+    catch (const fizzy::parser_error&)
+    {
+        return state.SkipWithError("Parsing failed");
+    }
+
+    const auto input_size = fs::file_size(path);
+    auto num_bytes_parsed = uint64_t{0};
+    for ([[maybe_unused]] auto _ : state)
+    {
+        benchmark::DoNotOptimize(fizzy::parse_file(path));
+        num_bytes_parsed += input_size;
+    }
+    state.counters["size"] = benchmark::Counter(static_cast<double>(input_size));
+    state.counters["rate"] =
+        benchmark::Counter(static_cast<double>(num_bytes_parsed), benchmark::Counter::kIsRate);
+}
+
 void benchmark_instantiate(
-    benchmark::State& state, EngineCreateFn create_fn, const fizzy::bytes& wasm_binary)
+    benchmark::State& state, EngineCreateFn create_fn, fizzy::bytes_view wasm_binary)
 {
     const auto engine = create_fn();
 
@@ -78,7 +140,7 @@ void benchmark_instantiate(
 
 struct ExecutionBenchmarkCase
 {
-    std::shared_ptr<const fizzy::bytes> wasm_binary;
+    std::shared_ptr<const fizzy::MappedFile> wasm_file;
     std::string func_name;
     std::vector<uint64_t> func_args;
     fizzy::bytes memory;
@@ -90,7 +152,7 @@ void benchmark_execute(
     benchmark::State& state, EngineCreateFn create_fn, const ExecutionBenchmarkCase& benchmark_case)
 {
     const auto engine = create_fn();
-    if (!engine->parse(*benchmark_case.wasm_binary))
+    if (!engine->parse(benchmark_case.wasm_file->content()))
         return state.SkipWithError("Parsing failed");
     const auto func_ref = engine->find_function(benchmark_case.func_name);
     if (!func_ref)
@@ -149,15 +211,16 @@ void benchmark_execute(
 }
 
 template <typename Lambda>
-void register_benchmark(const std::string& name, Lambda&& fn)
+benchmark::internal::Benchmark* register_benchmark(const std::string& name, Lambda&& fn)
 {
 #ifdef __clang_analyzer__
     // Clang analyzer reports potential memory leak in benchmark::RegisterBenchmark().
     // TODO: Upgrade benchmark library to newer version and recheck.
     (void)name;
     (void)fn;
+    return nullptr;
 #else
-    benchmark::RegisterBenchmark(name.c_str(), std::forward<Lambda>(fn));
+    return benchmark::RegisterBenchmark(name.c_str(), std::forward<Lambda>(fn));
 #endif
 }
 
@@ -165,22 +228,32 @@ void load_benchmark(const fs::path& path, const std::string& name_prefix)
 {
     const auto base_name = name_prefix + path.stem().string();
 
-    std::ifstream wasm_file{path};
-    const auto wasm_binary = std::make_shared<const fizzy::bytes>(
-        std::istreambuf_iterator<char>{wasm_file}, std::istreambuf_iterator<char>{});
+    const auto wasm_file = std::make_shared<const fizzy::MappedFile>(path.string());
 
     for (const auto& entry : engine_registry)  // Register parse benchmarks.
     {
         register_benchmark(std::string{entry.name} + "/parse/" + base_name,
-            [create_fn = entry.create_fn, wasm_binary](
-                benchmark::State& state) { benchmark_parse(state, create_fn, *wasm_binary); });
+            [create_fn = entry.create_fn, wasm_file](benchmark::State& state) {
+                benchmark_parse(state, create_fn, wasm_file->content());
+            });
     }
 
+    // Register fizzy parse benchmarks with function bodies decoded by many threads.
+    auto* const parse_threads_benchmark = register_benchmark(
+        "fizzy/parse_threads/" + base_name, [wasm_file](benchmark::State& state) {
+            benchmark_parse_threads(state, wasm_file->content());
+        });
+    if (parse_threads_benchmark != nullptr)
+        parse_threads_benchmark->RangeMultiplier(2)->Range(1, 16)->UseRealTime();
+
+    register_benchmark("fizzy/parse_file/" + base_name,
+        [path = path.string()](benchmark::State& state) { benchmark_parse_file(state, path); });
+
     for (const auto& entry : engine_registry)  // Register instantiate benchmark.
     {
         register_benchmark(std::string{entry.name} + "/instantiate/" + base_name,
-            [create_fn = entry.create_fn, wasm_binary](benchmark::State& state) {
-                benchmark_instantiate(state, create_fn, *wasm_binary);
+            [create_fn = entry.create_fn, wasm_file](benchmark::State& state) {
+                benchmark_instantiate(state, create_fn, wasm_file->content());
             });
     }
     enum class InputsReadingState
@@ -209,7 +282,7 @@ void load_benchmark(const fs::path& path, const std::string& name_prefix)
                     continue;
                 input_name = std::move(l);
                 benchmark_case = std::make_shared<ExecutionBenchmarkCase>();
-                benchmark_case->wasm_binary = wasm_binary;
+                benchmark_case->wasm_file = wasm_file;
                 st = InputsReadingState::FuncName;
                 break;
 
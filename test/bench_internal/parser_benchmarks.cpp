@@ -1,4 +1,5 @@
 #include "parser.hpp"
+#include "utf8.hpp"
 #include <benchmark/benchmark.h>
 #include <test/utils/leb128_encode.hpp>
 #include <algorithm>
@@ -36,6 +37,58 @@ fizzy::bytes generate_ascii_vec(size_t size)
     std::generate_n(std::back_inserter(result), size, [&] { return dist(g_gen); });
     return result;
 }
+
+/// Generates the vec of bytes of the given size, being a valid UTF-8 string of random code
+/// points. Every n-th code point is non-ASCII, where n is the ascii_ratio + 1.
+fizzy::bytes generate_utf8_vec(size_t size, unsigned ascii_ratio)
+{
+    std::uniform_int_distribution<uint32_t> ascii_dist{0, 0x7f};
+    std::uniform_int_distribution<uint32_t> non_ascii_dist{0x80, 0x10ffff};
+
+    const auto size_encoded = fizzy::test::leb128u_encode(size);
+    fizzy::bytes result;
+    result.reserve(size + size_encoded.size());
+    result += size_encoded;
+    const auto end_size = result.size() + size;
+    for (unsigned i = 0; result.size() < end_size; ++i)
+    {
+        auto c =
+            (i % (ascii_ratio + 1) == ascii_ratio) ? non_ascii_dist(g_gen) : ascii_dist(g_gen);
+        if (c >= 0xd800 && c <= 0xdfff)
+            continue;  // Surrogates are not valid code points.
+
+        // Encode an ASCII character instead if the code point does not fit.
+        const auto encoded_size = c <= 0x7f ? 1u : c <= 0x7ff ? 2u : c <= 0xffff ? 3u : 4u;
+        if (result.size() + encoded_size > end_size)
+            c = ascii_dist(g_gen);
+
+        if (c <= 0x7f)
+            result.push_back(static_cast<uint8_t>(c));
+        else if (c <= 0x7ff)
+            result += {static_cast<uint8_t>(0xc0 | (c >> 6)),
+                static_cast<uint8_t>(0x80 | (c & 0x3f))};
+        else if (c <= 0xffff)
+            result += {static_cast<uint8_t>(0xe0 | (c >> 12)),
+                static_cast<uint8_t>(0x80 | ((c >> 6) & 0x3f)),
+                static_cast<uint8_t>(0x80 | (c & 0x3f))};
+        else
+            result += {static_cast<uint8_t>(0xf0 | (c >> 18)),
+                static_cast<uint8_t>(0x80 | ((c >> 12) & 0x3f)),
+                static_cast<uint8_t>(0x80 | ((c >> 6) & 0x3f)),
+                static_cast<uint8_t>(0x80 | (c & 0x3f))};
+    }
+    return result;
+}
+
+fizzy::bytes generate_non_ascii_vec(size_t size)
+{
+    return generate_utf8_vec(size, 0);
+}
+
+fizzy::bytes generate_mixed_vec(size_t size)
+{
+    return generate_utf8_vec(size, 7);
+}
 }  // namespace
 
 template <decltype(fizzy::leb128u_decode<uint64_t>) Fn>
@@ -70,10 +123,51 @@ BENCHMARK_TEMPLATE(leb128u_decode_u64, fizzy::leb128u_decode<uint64_t>);
 BENCHMARK_TEMPLATE(leb128u_decode_u64, leb128u_decode_u64_noinline);
 BENCHMARK_TEMPLATE(leb128u_decode_u64, decodeULEB128);
 
+/// Benchmarks decoding the vec of u32 values of the number of bits given as the benchmark
+/// argument, e.g. type indices in the function section (7 bits).
+template <decltype(fizzy::leb128u_decode_u32_vec) Fn>
+static void leb128u_decode_u32_vec(benchmark::State& state)
+{
+    constexpr size_t size = 1024;
+    const auto value_bits = static_cast<int>(state.range(0));
+    const auto samples = generate_samples<uint32_t>(size);
+
+    fizzy::bytes input;
+    for (const auto sample : samples)
+        input += fizzy::test::leb128u_encode(sample >> (32 - value_bits));
+
+    std::vector<uint32_t> output(size);
+    benchmark::ClobberMemory();
+
+    const auto begin = input.data();
+    const auto end = begin + input.size();
+    while (state.KeepRunningBatch(size))
+    {
+        if (Fn(begin, end, output.data(), size) != end)
+            state.SkipWithError("Not all input processed");
+        benchmark::DoNotOptimize(output.data());
+    }
+}
+BENCHMARK_TEMPLATE(leb128u_decode_u32_vec, fizzy::leb128u_decode_u32_vec_scalar)
+    ->Arg(7)
+    ->Arg(14)
+    ->Arg(32);
+#if defined(__x86_64__)
+BENCHMARK_TEMPLATE(leb128u_decode_u32_vec, fizzy::leb128u_decode_u32_vec_sse2)
+    ->Arg(7)
+    ->Arg(14)
+    ->Arg(32);
+BENCHMARK_TEMPLATE(leb128u_decode_u32_vec, fizzy::leb128u_decode_u32_vec_avx2)
+    ->Arg(7)
+    ->Arg(14)
+    ->Arg(32);
+#endif
+
+template <decltype(generate_ascii_vec) GenerateFn>
 static void parse_string(benchmark::State& state)
 {
     const auto size = static_cast<size_t>(state.range(0));
-    const auto input = generate_ascii_vec(size);
+    const auto input = GenerateFn(size);
     const auto input_begin = input.data();
     const auto input_end = input_begin + input.size();
     benchmark::ClobberMemory();
@@ -85,4 +179,46 @@ static void parse_string(benchmark::State& state)
 
     state.SetItemsProcessed(static_cast<int64_t>(size));
 }
-BENCHMARK(parse_string)->RangeMultiplier(2)->Range(16, 4 * 1024);
+BENCHMARK_TEMPLATE(parse_string, generate_ascii_vec)->RangeMultiplier(2)->Range(16, 4 * 1024);
+BENCHMARK_TEMPLATE(parse_string, generate_non_ascii_vec)
+    ->RangeMultiplier(2)
+    ->Range(16, 4 * 1024);
+BENCHMARK_TEMPLATE(parse_string, generate_mixed_vec)->RangeMultiplier(2)->Range(16, 4 * 1024);
+
+template <decltype(fizzy::utf8_validate) Fn, decltype(generate_ascii_vec) GenerateFn>
+static void utf8_validate(benchmark::State& state)
+{
+    const auto size = static_cast<size_t>(state.range(0));
+    const auto input = GenerateFn(size);
+    const auto input_end = input.data() + input.size();
+    const auto input_begin = input_end - size;  // Skip the size prefix.
+    benchmark::ClobberMemory();
+
+    for ([[maybe_unused]] auto _ : state)
+    {
+        const auto valid = Fn(input_begin, input_end);
+        benchmark::DoNotOptimize(valid);
+    }
+
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(size));
+}
+BENCHMARK_TEMPLATE(utf8_validate, fizzy::utf8_validate_scalar, generate_ascii_vec)
+    ->Arg(1024);
+BENCHMARK_TEMPLATE(utf8_validate, fizzy::utf8_validate_scalar, generate_non_ascii_vec)
+    ->Arg(1024);
+BENCHMARK_TEMPLATE(utf8_validate, fizzy::utf8_validate_scalar, generate_mixed_vec)
+    ->Arg(1024);
+#if defined(__x86_64__)
+BENCHMARK_TEMPLATE(utf8_validate, fizzy::utf8_validate_sse2, generate_ascii_vec)
+    ->Arg(1024);
+BENCHMARK_TEMPLATE(utf8_validate, fizzy::utf8_validate_sse2, generate_non_ascii_vec)
+    ->Arg(1024);
+BENCHMARK_TEMPLATE(utf8_validate, fizzy::utf8_validate_sse2, generate_mixed_vec)
+    ->Arg(1024);
+BENCHMARK_TEMPLATE(utf8_validate, fizzy::utf8_validate_avx2, generate_ascii_vec)
+    ->Arg(1024);
+BENCHMARK_TEMPLATE(utf8_validate, fizzy::utf8_validate_avx2, generate_non_ascii_vec)
+    ->Arg(1024);
+BENCHMARK_TEMPLATE(utf8_validate, fizzy::utf8_validate_avx2, generate_mixed_vec)
+    ->Arg(1024);
+#endif
@@ -1,5 +1,6 @@
 #include "execute.hpp"
 #include "parser.hpp"
+#include "superinstructions.hpp"
 #include <nlohmann/json.hpp>
 #include <test/utils/hex.hpp>
 #include <filesystem>
@@ -63,6 +64,9 @@ fizzy::bytes load_wasm_file(const fs::path& json_file_path, std::string_view fil
 struct test_settings
 {
     bool skip_validation = false;
+    bool superinstructions = false;
+    bool register_engine = false;
+    bool jit = false;
 };
 
 struct test_results
@@ -115,6 +119,8 @@ public:
                 try
                 {
                     fizzy::Module module = fizzy::parse(wasm_binary);
+                    if (m_settings.superinstructions)
+                        fizzy::fuse_superinstructions(module);
 
                     auto [imports, error] = create_imports(module);
                     if (!error.empty())
@@ -127,6 +133,10 @@ public:
                     m_instances[name] = fizzy::instantiate(std::move(module),
                         std::move(imports.functions), std::move(imports.tables),
                         std::move(imports.memories), std::move(imports.globals));
+                    if (m_settings.register_engine)
+                        m_instances[name]->engine = fizzy::ExecutionEngine::Register;
+                    if (m_settings.jit)
+                        m_instances[name]->engine = fizzy::ExecutionEngine::Jit;
 
                     m_last_module_name = name;
                 }
@@ -328,6 +338,8 @@ public:
                 try
                 {
                     fizzy::Module module = fizzy::parse(wasm_binary);
+                    if (m_settings.superinstructions)
+                        fizzy::fuse_superinstructions(module);
 
                     auto [imports, error] = create_imports(module);
                     if (!error.empty())
@@ -411,7 +423,7 @@ private:
             return std::nullopt;
 
         const auto func_name = action.at("field").get<std::string>();
-        const auto func_idx = fizzy::find_exported_function(instance->module, func_name);
+        const auto func_idx = fizzy::find_exported_function(*instance->module, func_name);
         if (!func_idx.has_value())
         {
             skip("Function '" + func_name + "' not found.");
@@ -618,6 +630,12 @@ int main(int argc, char** argv)
             {
                 if (argv[i] == std::string{"--skip-validation"})
                     settings.skip_validation = true;
+                else if (argv[i] == std::string{"--superinstructions"})
+                    settings.superinstructions = true;
+                else if (argv[i] == std::string{"--register-engine"})
+                    settings.register_engine = true;
+                else if (argv[i] == std::string{"--jit"})
+                    settings.jit = true;
                 else
                 {
                     std::cerr << "Unknown argument: " << argv[i] << "\n";
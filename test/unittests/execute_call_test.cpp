@@ -53,6 +53,22 @@ TEST(execute_call, call_with_arguments)
     EXPECT_RESULT(execute(parse(wasm), 1, {}), 4);
 }
 
+TEST(execute_call, call_lazily_decoded)
+{
+    /* wat2wasm --no-check
+    (func (result i32) (i32.const 0x2a002a))
+    (func (result i32) (call 0))
+    (func (result i32) (i32.add))
+    */
+    const auto wasm = from_hex(
+        "0061736d010000000105016000017f0304030000000a1203070041aa80a8010b040010000b03006a0b");
+
+    const auto instance = instantiate(parse(wasm, CodeDecoding::Lazy));
+    EXPECT_RESULT(execute(*instance, 1, {}), 0x2a002a);
+    EXPECT_RESULT(execute(*instance, 0, {}), 0x2a002a);
+    EXPECT_THROW_MESSAGE(execute(*instance, 2, {}), validation_error, "stack underflow");
+}
+
 TEST(execute_call, call_indirect)
 {
     /* wat2wasm
@@ -372,18 +388,219 @@ TEST(execute_call, call_indirect_infinite_recursion)
     EXPECT_TRUE(execute(module, 0, {}).trapped);
 }
 
-TEST(execute, call_max_depth)
+TEST(execute, call_stack_limit)
 {
     /* wat2wasm
-    (func (result i32) (i32.const 42))
-    (func (result i32) (call 0))
+    (func (param i32) (result i32)
+      local.get 0
+      if (result i32)
+        local.get 0
+        i32.const 1
+        i32.sub
+        call 0
+        i32.const 1
+        i32.add
+      else
+        i32.const 0
+      end
+    )
     */
+    const auto bin = from_hex(
+        "0061736d0100000001060160017f017f030201000a160114002000047f200041016b100041016a0541000b0b");
+
+    const auto module = parse(bin);
+
+    auto instance = instantiate(module);
+    // The call depth is not limited by the native stack.
+    EXPECT_RESULT(execute(*instance, 0, {5000}), 5000);
+
+    auto small_instance = instantiate(module);
+    small_instance->execution_stack_limit = 4096;
+    EXPECT_RESULT(execute(*small_instance, 0, {10}), 10);
+    EXPECT_TRUE(execute(*small_instance, 0, {1000}).trapped);
+    // The instance is usable after the call stack has been exhausted.
+    EXPECT_RESULT(execute(*small_instance, 0, {10}), 10);
+
+    // The limit can be changed between executions.
+    small_instance->execution_stack_limit = DefaultExecutionStackLimit;
+    EXPECT_RESULT(execute(*small_instance, 0, {1000}), 1000);
+    instance->execution_stack_limit = 4096;
+    EXPECT_TRUE(execute(*instance, 0, {1000}).trapped);
+}
+
+TEST(execute_call, execution_stack_limit_changed_in_imported_function)
+{
+    /* wat2wasm
+    (func $f (import "env" "f"))
+    (func call $f)
+    (func)
+    */
+    const auto wasm = from_hex(
+        "0061736d0100000001040160000002090103656e760166000003030200000a0902040010000b02000b");
+    const auto module = parse(wasm);
+
+    // The execution stack in use by the outer execution is not reallocated by the nested one,
+    // also if the outer one has no values on it.
+    constexpr auto host_f = [](Instance& instance, std::vector<uint64_t>) {
+        const auto* const memory = instance.execution_stack.memory.get();
+        instance.execution_stack_limit = 4096;
+        const auto result = execute(instance, 2, {});
+        EXPECT_EQ(instance.execution_stack.memory.get(), memory);
+        return result;
+    };
+    auto instance = instantiate(module, {{host_f, module.typesec[0]}});
+    EXPECT_FALSE(execute(*instance, 1, {}).trapped);
+
+    // The following execution reallocates it.
+    EXPECT_FALSE(execute(*instance, 2, {}).trapped);
+    EXPECT_EQ(instance->execution_stack.size, 4096 / sizeof(uint64_t));
+}
 
-    const auto bin = from_hex("0061736d010000000105016000017f03030200000a0b020400412a0b040010000b");
+TEST(execute, call_infinite_recursion)
+{
+    /* wat2wasm
+    (func (call 0))
+    */
+    const auto bin = from_hex("0061736d01000000010401600000030201000a0601040010000b");
 
     const auto module = parse(bin);
+
     auto instance = instantiate(module);
+    EXPECT_TRUE(execute(*instance, 0, {}).trapped);
+}
+
+TEST(execute_call, imported_function_call_reentrant)
+{
+    /* wat2wasm
+    (import "env" "f" (func (param i32) (result i32)))
+    (func (param i32) (result i32)
+      local.get 0
+      if (result i32)
+        local.get 0
+        i32.const 1
+        i32.sub
+        call 0
+        i32.const 1
+        i32.add
+      else
+        i32.const 0
+      end
+    )
+    */
+    const auto wasm = from_hex(
+        "0061736d0100000001060160017f017f02090103656e7601660000030201000a160114002000047f2000410"
+        "16b100041016a0541000b0b");
+
+    const auto module = parse(wasm);
+
+    // The imported function executes the wasm function on the same instance.
+    auto host_f = [](Instance& instance, std::vector<uint64_t> args) {
+        return execute(instance, 1, std::move(args));
+    };
+
+    auto instance = instantiate(module, {{host_f, module.typesec[0]}});
+
+    EXPECT_RESULT(execute(*instance, 1, {100}), 100);
+
+    auto small_instance = instantiate(module, {{host_f, module.typesec[0]}});
+    small_instance->execution_stack_limit = 4096;
+    EXPECT_TRUE(execute(*small_instance, 1, {1000}).trapped);
+    EXPECT_RESULT(execute(*small_instance, 1, {10}), 10);
+}
+
+TEST(execute_call, imported_host_function_ptr_call)
+{
+    /* wat2wasm
+    (import "mod" "foo" (func (param i32) (result i32)))
+    (func (param i32) (result i32)
+      get_local 0
+      call 0
+      i32.const 2
+      i32.add
+    )
+    */
+    const auto wasm = from_hex(
+        "0061736d0100000001060160017f017f020b01036d6f6403666f6f0000030201000a0b0109002000100041026a"
+        "0b");
+
+    const auto module = parse(wasm);
+
+    constexpr HostFunctionPtr host_foo = [](void* context, Instance&, span<const uint64_t> args,
+                                             span<uint64_t> results) {
+        EXPECT_EQ(args.size(), 1);
+        EXPECT_EQ(results.size(), 1);
+        results[0] = args[0] * *static_cast<uint64_t*>(context);
+        return true;
+    };
+    // The context is owned by the ExternalFunction.
+    const auto factor = std::make_shared<uint64_t>(2);
+
+    for (const auto engine : {ExecutionEngine::Stack, ExecutionEngine::Register})
+    {
+        auto instance = instantiate(module, {{{}, module.typesec[0], host_foo, factor}});
+        instance->engine = engine;
+        EXPECT_RESULT(execute(*instance, 1, {20}), 42);
+        EXPECT_RESULT(execute(*instance, 0, {20}), 40);
+    }
+}
+
+TEST(execute_call, imported_host_function_ptr_trap)
+{
+    /* wat2wasm
+    (import "mod" "foo" (func (result i32)))
+    (func (result i32)
+      call 0
+    )
+    */
+    const auto wasm = from_hex(
+        "0061736d010000000105016000017f020b01036d6f6403666f6f0000030201000a0601040010000b");
+
+    const auto module = parse(wasm);
+
+    constexpr HostFunctionPtr host_foo = [](void*, Instance&, span<const uint64_t>,
+                                             span<uint64_t>) { return false; };
+
+    auto instance = instantiate(module, {{{}, module.typesec[0], host_foo, nullptr}});
+    EXPECT_TRUE(execute(*instance, 1, {}).trapped);
+    EXPECT_TRUE(execute(*instance, 0, {}).trapped);
+}
+
+TEST(execute_call, imported_host_function_ptr_reentrant)
+{
+    /* wat2wasm
+    (import "env" "f" (func (param i32) (result i32)))
+    (func (param i32) (result i32)
+      local.get 0
+      if (result i32)
+        local.get 0
+        i32.const 1
+        i32.sub
+        call 0
+        i32.const 1
+        i32.add
+      else
+        i32.const 0
+      end
+    )
+    */
+    const auto wasm = from_hex(
+        "0061736d0100000001060160017f017f02090103656e7601660000030201000a160114002000047f2000410"
+        "16b100041016a0541000b0b");
+
+    const auto module = parse(wasm);
+
+    // The imported function executes the wasm function on the same instance, the arguments
+    // on the operand stack are not overwritten by this execution.
+    constexpr HostFunctionPtr host_f = [](void*, Instance& instance, span<const uint64_t> args,
+                                           span<uint64_t> results) {
+        const auto arg = args[0];
+        const auto ret = execute(instance, 1, {arg});
+        if (ret.trapped || args[0] != arg)
+            return false;
+        results[0] = ret.stack[0];
+        return true;
+    };
 
-    EXPECT_RESULT(execute(*instance, 0, {}, 2048), 42);
-    EXPECT_TRUE(execute(*instance, 1, {}, 2048).trapped);
+    auto instance = instantiate(module, {{{}, module.typesec[0], host_f, nullptr}});
+    EXPECT_RESULT(execute(*instance, 1, {100}), 100);
 }
@@ -12,7 +12,7 @@ execution_result execute_unary_operation(Instr instr, uint64_t arg)
 {
     Module module;
     module.funcsec.emplace_back(TypeIdx{0});
-    module.codesec.emplace_back(Code{0, {Instr::local_get, instr, Instr::end}, {0, 0, 0, 0}});
+    module.codesec.emplace_back(Code{0, 1, {Instr::local_get, instr, Instr::end}, {0, 0, 0, 0}});
 
     return execute(module, 0, {arg});
 }
@@ -21,8 +21,8 @@ execution_result execute_binary_operation(Instr instr, uint64_t lhs, uint64_t rh
 {
     Module module;
     module.funcsec.emplace_back(TypeIdx{0});
-    module.codesec.emplace_back(
-        Code{0, {Instr::local_get, Instr::local_get, instr, Instr::end}, {0, 0, 0, 0, 1, 0, 0, 0}});
+    module.codesec.emplace_back(Code{
+        0, 2, {Instr::local_get, Instr::local_get, instr, Instr::end}, {0, 0, 0, 0, 1, 0, 0, 0}});
 
     return execute(module, 0, {lhs, rhs});
 }
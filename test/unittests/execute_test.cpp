@@ -251,7 +251,7 @@ TEST(execute, i32_load_imported_memory)
     const auto wasm = from_hex(
         "0061736d0100000001060160017f017f020b01036d6f64016d02010101030201000a0901070020002802000b");
 
-    bytes memory(PageSize, 0);
+    LinearMemory memory{PageSize};
     auto instance = instantiate(parse(wasm), {}, {}, {{&memory, {1, 1}}});
     memory[1] = 42;
     EXPECT_RESULT(execute(*instance, 0, {1}), 42);
@@ -395,7 +395,7 @@ TEST(execute, i32_store_imported_memory)
         "0061736d0100000001060160027f7f00020b01036d6f64016d02010101030201000a0b01090020012000360200"
         "0b");
 
-    bytes memory(PageSize, 0);
+    LinearMemory memory{PageSize};
     auto instance = instantiate(parse(wasm), {}, {}, {{&memory, {1, 1}}});
     const auto [trap, ret] = execute(*instance, 0, {42, 0});
     ASSERT_FALSE(trap);
@@ -989,3 +989,68 @@ TEST(execute, fp_instructions)
     // Second function with floating point parameters.
     ASSERT_TRUE(execute(*instance, 1, {}).trapped);
 }
+
+TEST(execute, span_args)
+{
+    /* wat2wasm
+    (func (param i32 i32) (result i32)
+      local.get 0
+      local.get 1
+      i32.add
+    )
+    (func)
+    (func unreachable)
+    */
+    const auto wasm = from_hex(
+        "0061736d01000000010a0260027f7f017f6000000304030001010a10030700200020016a0b02000b0300000b");
+
+    for (const auto engine : {ExecutionEngine::Stack, ExecutionEngine::Register})
+    {
+        auto instance = instantiate(parse(wasm));
+        instance->engine = engine;
+
+        const uint64_t args[] = {20, 22};
+        const auto result = execute(*instance, 0, span<const uint64_t>{args, 2});
+        EXPECT_FALSE(result.trapped);
+        EXPECT_TRUE(result.has_value);
+        EXPECT_EQ(result.value, 42);
+
+        const auto void_result = execute(*instance, 1, span<const uint64_t>{nullptr, 0});
+        EXPECT_FALSE(void_result.trapped);
+        EXPECT_FALSE(void_result.has_value);
+
+        EXPECT_TRUE(execute(*instance, 2, span<const uint64_t>{nullptr, 0}).trapped);
+    }
+}
+
+TEST(execute, span_args_imported_function)
+{
+    /* wat2wasm
+    (import "mod" "foo" (func (param i32 i32) (result i32)))
+    */
+    const auto wasm = from_hex("0061736d0100000001070160027f7f017f020b01036d6f6403666f6f0000");
+    const auto module = parse(wasm);
+
+    constexpr auto host_foo = [](Instance&, std::vector<uint64_t> args) -> execution_result {
+        return {false, {args[0] + args[1]}};
+    };
+    constexpr HostFunctionPtr host_foo_ptr = [](void*, Instance&, span<const uint64_t> args,
+                                                 span<uint64_t> results) {
+        results[0] = args[0] * args[1];
+        return true;
+    };
+
+    const uint64_t args[] = {20, 22};
+
+    auto instance = instantiate(module, {{host_foo, module.typesec[0]}});
+    const auto result = execute(*instance, 0, span<const uint64_t>{args, 2});
+    EXPECT_FALSE(result.trapped);
+    EXPECT_TRUE(result.has_value);
+    EXPECT_EQ(result.value, 42);
+
+    auto instance_ptr = instantiate(module, {{{}, module.typesec[0], host_foo_ptr, nullptr}});
+    const auto result_ptr = execute(*instance_ptr, 0, span<const uint64_t>{args, 2});
+    EXPECT_FALSE(result_ptr.trapped);
+    EXPECT_TRUE(result_ptr.has_value);
+    EXPECT_EQ(result_ptr.value, 440);
+}
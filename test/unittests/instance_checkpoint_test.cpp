@@ -0,0 +1,117 @@
+#include "instance_checkpoint.hpp"
+#include "parser.hpp"
+#include <gtest/gtest.h>
+#include <test/utils/hex.hpp>
+
+using namespace fizzy;
+
+namespace
+{
+/* wat2wasm
+(func $host (import "env" "host"))
+(table 2 funcref)
+(elem (i32.const 0) $host)
+(memory 1 2)
+(global (mut i32) (i32.const 1))
+(func (param i32)
+  (i32.store8 (local.get 0) (i32.const 0x2a))
+  (global.set 0 (i32.const 2))
+  (drop (memory.grow (i32.const 1)))
+  (i32.store8 (i32.const 65536) (i32.const 0x2b))
+  call $host
+  unreachable
+)
+*/
+const auto wasm = from_hex(
+    "0061736d0100000001080260000060017f00020c0103656e7604686f73740000030201010404017000020504"
+    "010101020606017f0141010b0907010041000b01000a20011e002000412a3a000041022400410140001a4180"
+    "8004412b3a00001000000b");
+
+std::unique_ptr<Instance> instantiate_wasm()
+{
+    // The imported function writes to the memory too.
+    constexpr auto host = [](Instance& instance, std::vector<uint64_t>) -> execution_result {
+        (*instance.memory)[100] = 0x55;
+        return {false, {}};
+    };
+    return instantiate(parse(wasm), {{host, {}}});
+}
+}  // namespace
+
+TEST(instance_checkpoint, rollback_after_trap)
+{
+    auto instance = instantiate_wasm();
+    InstanceCheckpoint checkpoint{*instance};
+
+    for (const uint64_t address : {0, 4096, 65535})
+    {
+        ASSERT_TRUE(execute(*instance, 1, {address}).trapped);
+        EXPECT_EQ(instance->memory->size(), 2 * PageSize);
+        EXPECT_EQ((*instance->memory)[address], 0x2a);
+        EXPECT_EQ((*instance->memory)[100], 0x55);
+        EXPECT_EQ((*instance->memory)[PageSize], 0x2b);
+        EXPECT_EQ(instance->globals[0], 2);
+        (*instance->table)[1] = FuncIdx{1};
+
+        checkpoint.rollback();
+        ASSERT_EQ(instance->memory->size(), PageSize);
+        EXPECT_EQ(instance->memory->substr(0, PageSize), bytes(PageSize, 0));
+        EXPECT_EQ(instance->globals[0], 1);
+        EXPECT_EQ((*instance->table)[0], FuncIdx{0});
+        EXPECT_FALSE((*instance->table)[1].has_value());
+    }
+}
+
+TEST(instance_checkpoint, update)
+{
+    auto instance = instantiate_wasm();
+    InstanceCheckpoint checkpoint{*instance};
+
+    (*instance->memory)[1] = 0x11;
+    instance->globals[0] = 3;
+    checkpoint.update();
+
+    ASSERT_TRUE(execute(*instance, 1, {1}).trapped);
+    EXPECT_EQ((*instance->memory)[1], 0x2a);
+
+    checkpoint.rollback();
+    EXPECT_EQ(instance->memory->size(), PageSize);
+    EXPECT_EQ((*instance->memory)[1], 0x11);
+    EXPECT_EQ((*instance->memory)[100], 0);
+    EXPECT_EQ(instance->globals[0], 3);
+}
+
+TEST(instance_checkpoint, imported_globals)
+{
+    /* wat2wasm
+    (global (import "m" "g") (mut i32))
+    (func (global.set 0 (i32.const 2)))
+    */
+    const auto bin = from_hex(
+        "0061736d01000000010401600000020801016d0167037f01030201000a0801060041022400"
+        "0b");
+
+    uint64_t global = 1;
+    auto instance = instantiate(parse(bin), {}, {}, {}, {{&global, true}});
+    InstanceCheckpoint checkpoint{*instance};
+
+    ASSERT_FALSE(execute(*instance, 0, {}).trapped);
+    EXPECT_EQ(global, 2);
+
+    checkpoint.rollback();
+    EXPECT_EQ(global, 1);
+}
+
+TEST(instance_checkpoint, destruction_discards_checkpoint)
+{
+    auto instance = instantiate_wasm();
+    {
+        InstanceCheckpoint checkpoint{*instance};
+        EXPECT_TRUE(instance->memory->has_checkpoint());
+        (*instance->memory)[0] = 0x11;
+    }
+    EXPECT_FALSE(instance->memory->has_checkpoint());
+    EXPECT_EQ((*instance->memory)[0], 0x11);
+    (*instance->memory)[1] = 0x22;
+    EXPECT_EQ((*instance->memory)[1], 0x22);
+}
@@ -0,0 +1,145 @@
+#include "instance_pool.hpp"
+#include "parser.hpp"
+#include <gtest/gtest.h>
+#include <test/utils/hex.hpp>
+#include <thread>
+
+using namespace fizzy;
+
+namespace
+{
+/* wat2wasm
+(table 2 funcref)
+(elem (i32.const 0) $start)
+(memory 1 2)
+(data (i32.const 0) "\aa")
+(global (mut i32) (i32.const 1))
+(start $start)
+(func $start
+  (global.set 0 (i32.const 2))
+  (i32.store8 (i32.const 1) (i32.const 0xbb))
+)
+(func
+  (drop (memory.grow (i32.const 1)))
+  (i32.store8 (i32.const 0) (i32.const 0x11))
+  (i32.store8 (i32.const 65536) (i32.const 0x22))
+  (global.set 0 (i32.const 3))
+)
+*/
+const auto wasm = from_hex(
+    "0061736d0100000001040160000003030200000404017000020504010101020606017f0141010b0801000907"
+    "010041000b01000a2c020e0041022400410141bb013a00000b1b00410140001a410041113a00004180800441"
+    "223a0000410324000b0b07010041000b01aa");
+
+void expect_template_state(const Instance& instance)
+{
+    ASSERT_EQ(instance.memory->size(), PageSize);
+    EXPECT_EQ(instance.memory->substr(0, 3), "aabb00"_bytes);
+    EXPECT_EQ(instance.globals, std::vector<uint64_t>{2});
+    ASSERT_EQ(instance.table->size(), 2);
+    EXPECT_EQ((*instance.table)[0], FuncIdx{0});
+    EXPECT_FALSE((*instance.table)[1].has_value());
+}
+
+void modify(Instance& instance)
+{
+    ASSERT_FALSE(execute(instance, 1, {}).trapped);
+    ASSERT_EQ(instance.memory->size(), 2 * PageSize);
+    EXPECT_EQ((*instance.memory)[0], 0x11);
+    EXPECT_EQ((*instance.memory)[PageSize], 0x22);
+    EXPECT_EQ(instance.globals, std::vector<uint64_t>{3});
+    (*instance.table)[1] = FuncIdx{1};
+}
+}  // namespace
+
+TEST(instance_pool, initial_size)
+{
+    InstancePool pool{std::make_shared<const Module>(parse(wasm)), {}, {}, {}, {}, 2};
+    EXPECT_EQ(pool.size(), 2);
+
+    auto instance1 = pool.acquire();
+    auto instance2 = pool.acquire();
+    EXPECT_EQ(pool.size(), 0);
+    expect_template_state(*instance1);
+    expect_template_state(*instance2);
+    EXPECT_NE(instance1->memory.get(), instance2->memory.get());
+    EXPECT_NE(instance1->table.get(), instance2->table.get());
+
+    // The empty pool creates new instances.
+    auto instance3 = pool.acquire();
+    expect_template_state(*instance3);
+
+    pool.release(std::move(instance1));
+    pool.release(std::move(instance2));
+    pool.release(std::move(instance3));
+    EXPECT_EQ(pool.size(), 3);
+}
+
+TEST(instance_pool, release_resets_instance)
+{
+    InstancePool pool{std::make_shared<const Module>(parse(wasm))};
+    EXPECT_EQ(pool.size(), 0);
+
+    auto instance = pool.acquire();
+    const auto* const memory = instance->memory.get();
+    modify(*instance);
+    instance->interrupt_requested = true;
+
+    pool.release(std::move(instance));
+    ASSERT_EQ(pool.size(), 1);
+
+    instance = pool.acquire();
+    EXPECT_EQ(instance->memory.get(), memory);
+    expect_template_state(*instance);
+    EXPECT_FALSE(instance->interrupt_requested);
+
+    // The reset instance can grow again.
+    modify(*instance);
+}
+
+TEST(instance_pool, imported_memory_is_shared)
+{
+    /* wat2wasm
+    (memory (import "m" "m") 1)
+    (func (i32.store8 (i32.const 0) (i32.const 0x11)))
+    */
+    const auto bin = from_hex(
+        "0061736d01000000010401600000020801016d016d02000103020100"
+        "0a0b010900410041113a00000b");
+
+    LinearMemory memory{PageSize};
+    InstancePool pool{
+        std::make_shared<const Module>(parse(bin)), {}, {}, {{&memory, {1, std::nullopt}}}};
+
+    auto instance = pool.acquire();
+    EXPECT_EQ(instance->memory.get(), &memory);
+    EXPECT_FALSE(execute(*instance, 0, {}).trapped);
+    pool.release(std::move(instance));
+
+    // The imported memory is not reset.
+    EXPECT_EQ(memory[0], 0x11);
+}
+
+TEST(instance_pool, concurrent)
+{
+    InstancePool pool{std::make_shared<const Module>(parse(wasm))};
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([&pool] {
+            for (int i = 0; i < 50; ++i)
+            {
+                auto instance = pool.acquire();
+                expect_template_state(*instance);
+                modify(*instance);
+                pool.release(std::move(instance));
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    EXPECT_GE(pool.size(), 1);
+    EXPECT_LE(pool.size(), 4);
+}
@@ -168,7 +168,7 @@ TEST(instantiate, imported_memory)
     imp.desc.memory = Memory{{1, 3}};
     module.importsec.emplace_back(imp);
 
-    bytes memory(PageSize, 0);
+    LinearMemory memory{PageSize};
     auto instance = instantiate(module, {}, {}, {{&memory, {1, 3}}});
 
     ASSERT_TRUE(instance->memory);
@@ -184,7 +184,7 @@ TEST(instantiate, imported_memory_unlimited)
     imp.desc.memory = Memory{{1, std::nullopt}};
     module.importsec.emplace_back(imp);
 
-    bytes memory(PageSize, 0);
+    LinearMemory memory{PageSize};
     auto instance = instantiate(module, {}, {}, {{&memory, {1, std::nullopt}}});
 
     ASSERT_TRUE(instance->memory);
@@ -200,7 +200,7 @@ TEST(instantiate, imported_memory_stricter_limits)
     imp.desc.memory = Memory{{1, 3}};
     module.importsec.emplace_back(imp);
 
-    bytes memory(PageSize * 2, 0);
+    LinearMemory memory{PageSize * 2};
     auto instance = instantiate(module, {}, {}, {{&memory, {2, 2}}});
 
     ASSERT_TRUE(instance->memory);
@@ -216,7 +216,7 @@ TEST(instantiate, imported_memory_invalid)
     imp.desc.memory = Memory{{1, 3}};
     module.importsec.emplace_back(imp);
 
-    bytes memory(PageSize, 0);
+    LinearMemory memory{PageSize};
 
     // Providing more than 1 memory
     EXPECT_THROW_MESSAGE(instantiate(module, {}, {}, {{&memory, {1, 3}}, {&memory, {1, 1}}}),
@@ -233,7 +233,7 @@ TEST(instantiate, imported_memory_invalid)
         "Module defines an imported memory but none was provided.");
 
     // Provided min too low
-    bytes memory_empty;
+    LinearMemory memory_empty;
     EXPECT_THROW_MESSAGE(instantiate(module, {}, {}, {{&memory_empty, {0, 3}}}), instantiate_error,
         "Provided import's min is below import's min defined in module.");
 
@@ -254,7 +254,7 @@ TEST(instantiate, imported_memory_invalid)
         "Provided imported memory doesn't fit provided limits");
 
     // Allocated more than max
-    bytes memory_big(PageSize * 4, 0);
+    LinearMemory memory_big{PageSize * 4};
     EXPECT_THROW_MESSAGE(instantiate(module, {}, {}, {{&memory_big, {1, 3}}}), instantiate_error,
         "Provided imported memory doesn't fit provided limits");
 
@@ -348,6 +348,28 @@ TEST(instantiate, imported_globals_nullptr)
         "Global 0 has a null pointer to value");
 }
 
+TEST(instantiate, shared_module)
+{
+    Module module;
+    module.memorysec.emplace_back(Memory{{1, 1}});
+    module.globalsec.emplace_back(Global{true, {ConstantExpression::Kind::Constant, {42}}});
+    const auto shared_module = std::make_shared<const Module>(std::move(module));
+
+    auto instance1 = instantiate(shared_module);
+    auto instance2 = instantiate(shared_module);
+    EXPECT_EQ(instance1->module, shared_module);
+    EXPECT_EQ(instance2->module, shared_module);
+    EXPECT_EQ(shared_module.use_count(), 3);
+
+    // The instance state is not shared.
+    EXPECT_NE(instance1->memory->data(), instance2->memory->data());
+    instance1->globals[0] = 1;
+    EXPECT_EQ(instance2->globals[0], 42);
+
+    instance1.reset();
+    EXPECT_EQ(shared_module.use_count(), 2);
+}
+
 TEST(instantiate, memory_default)
 {
     Module module;
@@ -557,6 +579,48 @@ TEST(instantiate, data_section)
     EXPECT_EQ(instance->memory->substr(0, 6), from_hex("00aa55550000"));
 }
 
+TEST(instantiate, data_section_memory_image)
+{
+    Module module;
+    module.memorysec.emplace_back(Memory{{1, 2}});
+    module.datasec.emplace_back(Data{{ConstantExpression::Kind::Constant, {1}}, {0xaa, 0xff}});
+    module.memory_image_cache = std::make_shared<MemoryImageCache>();
+
+    auto instance1 = instantiate(module);
+    auto instance2 = instantiate(module);
+
+    EXPECT_EQ(instance1->memory->substr(0, 4), from_hex("00aaff00"));
+    EXPECT_EQ(instance2->memory->substr(0, 4), from_hex("00aaff00"));
+
+    (*instance1->memory)[1] = 0x11;
+    instance1->memory->resize(2 * PageSize);
+    EXPECT_EQ(instance1->memory->substr(0, 4), from_hex("0011ff00"));
+    EXPECT_EQ(instance2->memory->substr(0, 4), from_hex("00aaff00"));
+    EXPECT_EQ(instance2->memory->size(), PageSize);
+
+    auto instance3 = instantiate(module);
+    EXPECT_EQ(instance3->memory->substr(0, 4), from_hex("00aaff00"));
+}
+
+TEST(instantiate, data_section_memory_image_of_module_copy)
+{
+    Module module;
+    module.memorysec.emplace_back(Memory{{1, 1}});
+    module.datasec.emplace_back(Data{{ConstantExpression::Kind::Constant, {1}}, {0xaa, 0xff}});
+    module.memory_image_cache = std::make_shared<MemoryImageCache>();
+
+    const auto shared_module = std::make_shared<const Module>(module);
+    auto instance1 = instantiate(shared_module);
+    EXPECT_EQ(instance1->memory->substr(0, 4), from_hex("00aaff00"));
+
+    // The copy does not reuse the memory image built for the original module.
+    auto copy = *shared_module;
+    EXPECT_NE(copy.memory_image_cache, shared_module->memory_image_cache);
+    copy.datasec[0].init = "5555"_bytes;
+    auto instance2 = instantiate(std::make_shared<const Module>(copy));
+    EXPECT_EQ(instance2->memory->substr(0, 4), from_hex("00555500"));
+}
+
 TEST(instantiate, data_section_offset_from_global)
 {
     Module module;
@@ -620,7 +684,7 @@ TEST(instantiate, data_section_fills_imported_memory)
     // Memory contents: 0, 0xaa, 0x55, 0x55, 0, ...
     module.datasec.emplace_back(Data{{ConstantExpression::Kind::Constant, {2}}, {0x55, 0x55}});
 
-    bytes memory(PageSize, 0);
+    LinearMemory memory{PageSize};
     auto instance = instantiate(module, {}, {}, {{&memory, {1, 1}}});
 
     EXPECT_EQ(memory.substr(0, 6), from_hex("00aa55550000"));
@@ -639,7 +703,7 @@ TEST(instantiate, data_section_out_of_bounds_doesnt_change_imported_memory)
         from_hex("0061736d01000000020a01016d036d656d0200010b0f020041000b016100418080040b0161");
     Module module = parse(bin);
 
-    bytes memory(PageSize, 0);
+    LinearMemory memory{PageSize};
     EXPECT_THROW_MESSAGE(instantiate(module, {}, {}, {{&memory, {1, 1}}}), instantiate_error,
         "Data segment is out of memory bounds");
 
@@ -664,7 +728,7 @@ TEST(instantiate, data_elem_section_errors_dont_change_imports)
     Module module_data_error = parse(bin_data_error);
 
     table_elements table(3);
-    bytes memory(PageSize, 0);
+    LinearMemory memory{PageSize};
     EXPECT_THROW_MESSAGE(
         instantiate(module_data_error, {}, {{&table, {3, std::nullopt}}}, {{&memory, {1, 1}}}),
         instantiate_error, "Data segment is out of memory bounds");
@@ -0,0 +1,125 @@
+#include "execute.hpp"
+#include "parser.hpp"
+#include <gtest/gtest.h>
+#include <test/utils/asserts.hpp>
+#include <test/utils/hex.hpp>
+#include <test/utils/instantiate.hpp>
+#include <chrono>
+#include <thread>
+
+using namespace fizzy;
+using namespace fizzy::test;
+
+namespace
+{
+/* wat2wasm
+(func $interrupt (import "env" "set"))
+(func (loop br 0))
+(func (param i32) (result i32)
+  (loop
+    local.get 0
+    i32.const 1
+    i32.sub
+    local.tee 0
+    br_if 0
+  )
+  local.get 0
+)
+(func $empty)
+(func call $interrupt call $empty)
+(func call $interrupt (loop br 0))
+(func call $interrupt (loop (br_table 0 0 (i32.const 0))))
+(func call $interrupt (loop (br_if 0 (i32.const 1))))
+*/
+const auto wasm = from_hex(
+    "0061736d0100000001090260000060017f017f020b0103656e76037365740000030807000100000000000a48070700"
+    "03400c000b0b10000340200041016b22000d000b20000b02000b0600100010030b0900100003400c000b0b0d0010"
+    "00034041000e0100000b0b0b001000034041010d000b0b");
+
+std::vector<ExecutionEngine> engines()
+{
+    return {ExecutionEngine::Stack, ExecutionEngine::Register
+#if FIZZY_JIT
+        ,
+        ExecutionEngine::Jit
+#endif
+    };
+}
+
+std::unique_ptr<Instance> instantiate_interrupt_test_module(ExecutionEngine engine)
+{
+    // The imported function requests the interruption of the execution calling it.
+    constexpr auto set = [](Instance& instance, std::vector<uint64_t>) -> execution_result {
+        instance.interrupt_requested = true;
+        return {false, {}};
+    };
+    return instantiate_with_engine(
+        engine, std::make_shared<const Module>(parse(wasm)), {{set, {}}});
+}
+}  // namespace
+
+TEST(interrupt, not_requested)
+{
+    for (const auto engine : engines())
+    {
+        const auto instance = instantiate_interrupt_test_module(engine);
+        EXPECT_RESULT(execute(*instance, 2, {1000}), 0);
+        EXPECT_FALSE(execute(*instance, 3, {}).trapped);
+        EXPECT_EQ(instance->engine, engine);
+    }
+}
+
+TEST(interrupt, requested_before_execution)
+{
+    for (const auto engine : engines())
+    {
+        // The request made before the execution (e.g. by the watchdog of the previous one)
+        // is cleared when it starts.
+        const auto instance = instantiate_interrupt_test_module(engine);
+        instance->interrupt_requested = true;
+        EXPECT_RESULT(execute(*instance, 2, {1000}), 0);
+        EXPECT_FALSE(instance->interrupt_requested);
+    }
+}
+
+TEST(interrupt, call)
+{
+    for (const auto engine : engines())
+    {
+        const auto instance = instantiate_interrupt_test_module(engine);
+        EXPECT_TRUE(execute(*instance, 4, {}).trapped);
+        EXPECT_TRUE(instance->interrupt_requested);
+
+        // The following execution is not interrupted.
+        EXPECT_FALSE(execute(*instance, 3, {}).trapped);
+        EXPECT_FALSE(instance->interrupt_requested);
+    }
+}
+
+TEST(interrupt, loop)
+{
+    for (const auto engine : engines())
+    {
+        for (const FuncIdx func_idx : {5u, 6u, 7u})
+        {
+            const auto instance = instantiate_interrupt_test_module(engine);
+            EXPECT_TRUE(execute(*instance, func_idx, {}).trapped);
+        }
+    }
+}
+
+TEST(interrupt, watchdog)
+{
+    for (const auto engine : engines())
+    {
+        const auto instance = instantiate_interrupt_test_module(engine);
+
+        std::thread watchdog{[&instance] {
+            std::this_thread::sleep_for(std::chrono::milliseconds{10});
+            instance->interrupt_requested = true;
+        }};
+        // The infinite loop.
+        EXPECT_TRUE(execute(*instance, 1, {}).trapped);
+        watchdog.join();
+    }
+}
@@ -0,0 +1,284 @@
+#include "execute.hpp"
+#include "jit.hpp"
+#include "parser.hpp"
+#include <gtest/gtest.h>
+#include <test/utils/asserts.hpp>
+#include <test/utils/hex.hpp>
+#include <test/utils/instantiate.hpp>
+#include <pthread.h>
+#include <stdexcept>
+
+using namespace fizzy;
+using namespace fizzy::test;
+
+namespace
+{
+/* wat2wasm
+(func $host (import "env" "host") (param i32) (result i32))
+(global (import "env" "g") (mut i64))
+(memory 1 3)
+(table 3 funcref)
+(global (mut i64) (i64.const 5))
+(elem (i32.const 0) $i32_rem_s $i32_ctz)
+(data (i32.const 0) "\de\b0\b1\b2\b3\ed\fe\ff")
+(func (param i32 i32) (result i32) local.get 0 local.get 1 i32.div_s)
+(func $i32_rem_s (param i32 i32) (result i32) local.get 0 local.get 1 i32.rem_s)
+(func (param i32 i32) (result i32) local.get 0 local.get 1 i32.div_u)
+(func (param i32 i32) (result i32) local.get 0 local.get 1 i32.rem_u)
+(func (param i32 i32) (result i32) local.get 0 local.get 1 i32.shl)
+(func (param i32 i32) (result i32) local.get 0 local.get 1 i32.shr_s)
+(func (param i32 i32) (result i32) local.get 0 local.get 1 i32.shr_u)
+(func (param i32 i32) (result i32) local.get 0 local.get 1 i32.rotl)
+(func (param i32 i32) (result i32) local.get 0 local.get 1 i32.rotr)
+(func (param i32 i32) (result i32) local.get 0 local.get 1 i32.lt_s)
+(func (param i32 i32) (result i32) local.get 0 local.get 1 i32.ge_u)
+(func (param i64 i64) (result i64) local.get 0 local.get 1 i64.div_s)
+(func (param i64 i64) (result i64) local.get 0 local.get 1 i64.rem_s)
+(func (param i64 i64) (result i64) local.get 0 local.get 1 i64.div_u)
+(func (param i64 i64) (result i64) local.get 0 local.get 1 i64.rem_u)
+(func (param i64 i64) (result i64) local.get 0 local.get 1 i64.shr_s)
+(func (param i64 i64) (result i64) local.get 0 local.get 1 i64.rotl)
+(func (param i64 i64) (result i64) local.get 0 local.get 1 i64.mul)
+(func (param i64 i64) (result i32) local.get 0 local.get 1 i64.gt_u)
+(func (param i64 i64) (result i32) local.get 0 local.get 1 i64.le_s)
+(func (param i32) (result i32) local.get 0 i32.clz)
+(func $i32_ctz (param i32) (result i32) local.get 0 i32.ctz)
+(func (param i32) (result i32) local.get 0 i32.popcnt)
+(func (param i64) (result i64) local.get 0 i64.clz)
+(func (param i64) (result i64) local.get 0 i64.ctz)
+(func (param i64) (result i64) local.get 0 i64.popcnt)
+(func (param i64) (result i32) local.get 0 i64.eqz)
+(func (param i32) (result i64) local.get 0 i64.extend_i32_s)
+(func (param i64) (result i32) local.get 0 i32.wrap_i64)
+(func (param i32) (result i64) local.get 0 i64.load32_s offset=1)
+(func (param i32) (result i32) local.get 0 i32.load16_s offset=2)
+(func (param i32 i64) (result i64)
+  local.get 0
+  local.get 1
+  i64.store16 offset=3
+  local.get 0
+  i64.load offset=3
+)
+(func (param i32) (result i32)
+  local.get 0
+  memory.grow
+  memory.size
+  i32.const 16
+  i32.shl
+  i32.add
+)
+(func (param i64) (result i64)
+  global.get 0
+  local.get 0
+  i64.add
+  global.set 0
+  global.get 1
+  global.get 0
+  i64.add
+  global.set 1
+  global.get 1
+)
+(func (param i32) (result i32)
+  (block
+    (block
+      (block
+        local.get 0
+        br_table 0 1 2
+      )
+      i32.const 100
+      return
+    )
+    i32.const 200
+    return
+  )
+  i32.const 7
+)
+(func (param i32) (result i32) local.get 0 call $host i32.const 1 i32.add)
+(func $recursive (param i32) (result i32) local.get 0 i32.const 1 i32.add call $recursive)
+(func (param i32 i32) (result i32)
+  local.get 0
+  local.get 0
+  local.get 1
+  call_indirect (param i32 i32) (result i32)
+)
+(func (param f32 f32) (result f32) local.get 0 local.get 1 f32.add)
+(func (param i64 i64 i32) (result i64) local.get 0 local.get 1 local.get 2 select)
+*/
+const auto wasm = from_hex(
+    "0061736d01000000013a0a60017f017f60027f7f017f60027e7e017e60027e7e017f60017e017e60017e017f6001"
+    "7f017e60027f7e017e60027d7d017d60037e7e7f017e02150203656e7604686f7374000003656e760167037e0103"
+    "29280101010101010101010101020202020202020303000000040404050605060007000400000001080904040170"
+    "00030504010101030606017e0142050b0908010041000b0202160ae502280700200020016d0b0700200020016f0b"
+    "0700200020016e0b070020002001700b070020002001740b070020002001750b070020002001760b070020002001"
+    "770b070020002001780b070020002001480b0700200020014f0b0700200020017f0b070020002001810b07002000"
+    "2001800b070020002001820b070020002001870b070020002001890b0700200020017e0b070020002001560b0700"
+    "20002001570b05002000670b05002000680b05002000690b05002000790b050020007a0b050020007b0b05002000"
+    "500b05002000ac0b05002000a70b070020003402010b070020002e01020b0e00200020013d010320002903030b0c"
+    "00200040003f004110746a0b1200230020007c2400230123007c240123010b1c0002400240024020000e02000102"
+    "0b41e4000f0b41c8010f0b41070b09002000100041016a0b0900200041016a10250b0b002000200020011101000b"
+    "070020002001920b09002000200120021b0b0b0e010041000b08deb0b1b2b3edfeff");
+
+std::unique_ptr<Instance> instantiate_jit_test_module(
+    const Module& module, ExecutionEngine engine, uint64_t& global)
+{
+    // The imported function executes $i32_rem_s on the same instance.
+    constexpr auto host = [](Instance& instance, std::vector<uint64_t> args) -> execution_result {
+        if (args[0] == 98)
+            return {true, {}};
+        if (args[0] == 99)
+            throw std::runtime_error{"host"};
+        return execute(instance, 2, {args[0], 5});
+    };
+    return instantiate_with_engine(engine, std::make_shared<const Module>(module),
+        {{host, module.typesec[0]}}, {ExternalGlobal{&global, true}});
+}
+}  // namespace
+
+TEST(jit, compile)
+{
+    const auto module = parse(wasm);
+    const auto register_module = translate_to_register_module(module);
+    ASSERT_NE(register_module, nullptr);
+
+    // The runtime functions are only referenced by the compiled code.
+    const auto jit_module = compile_jit_module(module, *register_module, JitRuntime{});
+    ASSERT_NE(jit_module, nullptr);
+    ASSERT_EQ(jit_module->functions.size(), module.funcsec.size());
+    for (size_t i = 0; i < module.funcsec.size(); ++i)
+    {
+        EXPECT_NE(jit_module->functions[i], nullptr);
+        EXPECT_EQ(jit_module->frame_sizes[i],
+            (register_module->functions[i].frame_size + JitFrameRecordSize) * sizeof(uint64_t));
+    }
+}
+
+TEST(jit, execute_same_as_stack_engine)
+{
+    const auto module = parse(wasm);
+    uint64_t global = 0;
+    const auto stack_instance = instantiate_jit_test_module(module, ExecutionEngine::Stack, global);
+    const auto jit_instance = instantiate_jit_test_module(module, ExecutionEngine::Jit, global);
+
+    constexpr uint64_t values32[]{0, 1, 2, 5, 31, 32, 33, 0x12345678, 0x7fffffff, 0x80000000,
+        0xfffffffb, 0xffffffff};
+    constexpr uint64_t values64[]{0, 1, 2, 5, 63, 64, 65, 0x123456789abcdef0,
+        0x7fffffffffffffff, 0x8000000000000000, 0xfffffffffffffffb, 0xffffffffffffffff};
+
+    const auto expect_same = [&](FuncIdx func_idx, std::vector<uint64_t> args) {
+        const auto expected = execute(*stack_instance, func_idx, args);
+        const auto result = execute(*jit_instance, func_idx, args);
+        EXPECT_EQ(result.trapped, expected.trapped) << func_idx;
+        EXPECT_EQ(result.stack, expected.stack) << func_idx;
+    };
+
+    for (FuncIdx func_idx = 1; func_idx <= 11; ++func_idx)
+    {
+        for (const auto a : values32)
+            for (const auto b : values32)
+                expect_same(func_idx, {a, b});
+    }
+    for (FuncIdx func_idx = 12; func_idx <= 20; ++func_idx)
+    {
+        for (const auto a : values64)
+            for (const auto b : values64)
+                expect_same(func_idx, {a, b});
+    }
+    for (FuncIdx func_idx = 21; func_idx <= 23; ++func_idx)
+    {
+        for (const auto a : values32)
+            expect_same(func_idx, {a});
+    }
+    for (FuncIdx func_idx = 24; func_idx <= 27; ++func_idx)
+    {
+        for (const auto a : values64)
+            expect_same(func_idx, {a});
+    }
+    for (const auto a : values32)
+        expect_same(28, {a});
+    for (const auto a : values64)
+        expect_same(29, {a});
+    for (const auto a : values64)
+    {
+        for (const auto b : values64)
+            for (const auto c : {0, 1, 2})
+                expect_same(40, {a, b, uint64_t(c)});
+    }
+
+    EXPECT_EQ(jit_instance->engine, ExecutionEngine::Jit);
+}
+
+TEST(jit, execute)
+{
+    const auto module = parse(wasm);
+    uint64_t global = 10;
+    const auto instance = instantiate_jit_test_module(module, ExecutionEngine::Jit, global);
+
+    EXPECT_RESULT(execute(*instance, 30, {0}), 0xffffffffb3b2b1b0);
+    EXPECT_RESULT(execute(*instance, 30, {65531}), 0);
+    EXPECT_TRUE(execute(*instance, 30, {65532}).trapped);
+    EXPECT_TRUE(execute(*instance, 30, {0xffffffff}).trapped);
+    EXPECT_RESULT(execute(*instance, 31, {0}), 0xffffb2b1);
+    EXPECT_RESULT(execute(*instance, 32, {0, 0x1234}), 0xfffeed1234);
+    EXPECT_TRUE(execute(*instance, 32, {65530, 0}).trapped);
+
+    // The memory grows up to the maximum size, then the memory accesses check the new size.
+    EXPECT_RESULT(execute(*instance, 33, {1}), 0x20001);
+    EXPECT_RESULT(execute(*instance, 33, {2}), 0x1ffff);
+    EXPECT_RESULT(execute(*instance, 30, {65532}), 0);
+
+    EXPECT_RESULT(execute(*instance, 34, {1}), 16);
+    EXPECT_EQ(global, 11);
+
+    EXPECT_RESULT(execute(*instance, 35, {0}), 100);
+    EXPECT_RESULT(execute(*instance, 35, {1}), 200);
+    EXPECT_RESULT(execute(*instance, 35, {2}), 7);
+    EXPECT_RESULT(execute(*instance, 35, {0xffffffff}), 7);
+
+    EXPECT_RESULT(execute(*instance, 36, {13}), 4);
+    EXPECT_TRUE(execute(*instance, 36, {98}).trapped);
+    EXPECT_THROW(execute(*instance, 36, {99}), std::runtime_error);
+
+    EXPECT_TRUE(execute(*instance, 37, {0}).trapped);
+
+    EXPECT_RESULT(execute(*instance, 38, {7, 0}), 0);
+    EXPECT_TRUE(execute(*instance, 38, {0, 0}).trapped);
+    EXPECT_TRUE(execute(*instance, 38, {7, 1}).trapped);
+    EXPECT_TRUE(execute(*instance, 38, {7, 2}).trapped);
+    EXPECT_TRUE(execute(*instance, 38, {7, 3}).trapped);
+
+    EXPECT_THROW_MESSAGE(
+        execute(*instance, 39, {0, 0}), unsupported_feature, "Floating point instruction.");
+
+    // The execution stack is restored after the traps and exceptions.
+    EXPECT_RESULT(execute(*instance, 36, {13}), 4);
+    EXPECT_EQ(instance->engine, ExecutionEngine::Jit);
+}
+
+TEST(jit, native_stack_limit)
+{
+    const auto module = parse(wasm);
+    uint64_t global = 0;
+    const auto instance = instantiate_jit_test_module(module, ExecutionEngine::Jit, global);
+    // The execution stack allows a call depth the thread's native stack cannot hold.
+    instance->execution_stack_limit = 256 * 1024 * 1024;
+
+    // The infinite recursion traps at the bottom of the small stack of the thread.
+    struct Execution
+    {
+        Instance& instance;
+        bool trapped = false;
+    } execution{*instance};
+    const auto run = [](void* arg) -> void* {
+        auto& e = *static_cast<Execution*>(arg);
+        e.trapped = execute(e.instance, 37, {0}).trapped;
+        return nullptr;
+    };
+    pthread_attr_t attr;
+    ASSERT_EQ(pthread_attr_init(&attr), 0);
+    ASSERT_EQ(pthread_attr_setstacksize(&attr, 1024 * 1024), 0);
+    pthread_t thread;
+    ASSERT_EQ(pthread_create(&thread, &attr, run, &execution), 0);
+    ASSERT_EQ(pthread_join(thread, nullptr), 0);
+    pthread_attr_destroy(&attr);
+    EXPECT_TRUE(execution.trapped);
+}
@@ -2,6 +2,7 @@
 #include <gtest/gtest.h>
 #include <test/utils/asserts.hpp>
 #include <test/utils/hex.hpp>
+#include <test/utils/leb128_encode.hpp>
 
 using namespace fizzy;
 
@@ -14,6 +15,19 @@ inline auto leb128u_decode(bytes_view input)
     return fizzy::leb128u_decode<T>(input.begin(), input.end());
 }
 
+/// All the implementations of leb128u_decode_u32_vec() supported by the CPU.
+std::vector<decltype(&leb128u_decode_u32_vec)> u32_vec_decoders()
+{
+    std::vector<decltype(&leb128u_decode_u32_vec)> decoders{
+        leb128u_decode_u32_vec, leb128u_decode_u32_vec_scalar};
+#if defined(__x86_64__)
+    decoders.emplace_back(leb128u_decode_u32_vec_sse2);
+    if (__builtin_cpu_supports("avx2"))
+        decoders.emplace_back(leb128u_decode_u32_vec_avx2);
+#endif
+    return decoders;
+}
+
 /// A leb128s_decode() wrapper for convenient testing.
 template <typename T>
 inline auto leb128s_decode(bytes_view input)
@@ -365,4 +379,60 @@ TEST(leb128, decode_s_out_of_buffer)
     EXPECT_THROW_MESSAGE(leb128s_decode<int16_t>(input.data(), input.data()), parser_error, m);
     EXPECT_THROW_MESSAGE(leb128s_decode<int16_t>(input.data(), input.data() + 1), parser_error, m);
     EXPECT_THROW_MESSAGE(leb128s_decode<int16_t>(input), parser_error, m);
-}
\ No newline at end of file
+}
+
+TEST(leb128, decode_u32_vec)
+{
+    // The runs of single-byte values of different lengths, crossing the SIMD block boundaries,
+    // separated by multi-byte values and values with leading zeroes.
+    std::vector<uint32_t> values;
+    bytes input;
+    for (const auto run_length : {0u, 1u, 15u, 16u, 17u, 31u, 32u, 33u, 64u, 100u})
+    {
+        for (uint32_t i = 0; i < run_length; ++i)
+        {
+            values.emplace_back(i % 128);
+            input += test::leb128u_encode(values.back());
+        }
+        values.emplace_back(run_length * 1000);
+        input += test::leb128u_encode(values.back());
+        values.emplace_back(1);
+        input += "8100"_bytes;
+    }
+    values.emplace_back(std::numeric_limits<uint32_t>::max());
+    input += test::leb128u_encode(values.back());
+
+    for (const auto decoder : u32_vec_decoders())
+    {
+        std::vector<uint32_t> decoded(values.size());
+        const auto* const end = input.data() + input.size();
+        EXPECT_EQ(decoder(input.data(), end, decoded.data(), decoded.size()), end);
+        EXPECT_EQ(decoded, values);
+
+        // Decoding fewer values than in the input.
+        std::vector<uint32_t> decoded_prefix(40);
+        decoder(input.data(), end, decoded_prefix.data(), decoded_prefix.size());
+        EXPECT_EQ(decoded_prefix, std::vector(values.begin(), values.begin() + 40));
+    }
+}
+
+TEST(leb128, decode_u32_vec_invalid)
+{
+    const bytes single_byte_values(40, 0x01);
+    for (const auto decoder : u32_vec_decoders())
+    {
+        std::vector<uint32_t> decoded(50);
+        const auto decode = [&](const bytes& input) {
+            return decoder(input.data(), input.data() + input.size(), decoded.data(),
+                decoded.size());
+        };
+
+        EXPECT_THROW_MESSAGE(decode(single_byte_values), parser_error, "Unexpected EOF");
+        EXPECT_THROW_MESSAGE(
+            decode(single_byte_values + "8080"_bytes), parser_error, "Unexpected EOF");
+        EXPECT_THROW_MESSAGE(decode(single_byte_values + "ffffffff7f"_bytes + bytes(32, 0)),
+            parser_error, "Invalid LEB128 encoding: unused bits set.");
+        EXPECT_THROW_MESSAGE(decode(single_byte_values + "8080808080"_bytes + bytes(32, 0)),
+            parser_error, "Invalid LEB128 encoding: too many bytes.");
+    }
+}
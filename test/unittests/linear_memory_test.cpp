@@ -0,0 +1,274 @@
+#include "linear_memory.hpp"
+#include "limits.hpp"
+#include <gtest/gtest.h>
+#include <test/utils/hex.hpp>
+
+using namespace fizzy;
+
+TEST(linear_memory, empty)
+{
+    LinearMemory memory;
+    EXPECT_EQ(memory.size(), 0);
+    EXPECT_EQ(memory.begin(), memory.end());
+}
+
+TEST(linear_memory, zero_filled)
+{
+    LinearMemory memory{PageSize};
+    ASSERT_EQ(memory.size(), PageSize);
+    EXPECT_EQ(memory.end() - memory.begin(), PageSize);
+    EXPECT_EQ(memory.substr(0, PageSize), bytes(PageSize, 0));
+}
+
+TEST(linear_memory, resize)
+{
+    LinearMemory memory{PageSize};
+    memory[0] = 0xaa;
+    memory[PageSize - 1] = 0xbb;
+
+    memory.resize(3 * PageSize);
+    ASSERT_EQ(memory.size(), 3 * PageSize);
+    EXPECT_EQ(memory[0], 0xaa);
+    EXPECT_EQ(memory[PageSize - 1], 0xbb);
+    EXPECT_EQ(memory.substr(PageSize, 2 * PageSize), bytes(2 * PageSize, 0));
+
+    memory.resize(3 * PageSize);
+    EXPECT_EQ(memory.size(), 3 * PageSize);
+    EXPECT_EQ(memory.substr(PageSize - 1, 2), "bb00"_bytes);
+}
+
+TEST(linear_memory, resize_keeps_data_address)
+{
+    LinearMemory memory{PageSize};
+    auto* const data = memory.data();
+    ASSERT_NE(data, nullptr);
+    memory[0] = 0xaa;
+
+    memory.resize(MemoryPagesLimit * PageSize);
+    EXPECT_EQ(memory.data(), data);
+    EXPECT_EQ(memory[0], 0xaa);
+    EXPECT_EQ(memory[MemoryPagesLimit * PageSize - 1], 0);
+}
+
+TEST(linear_memory, max_size)
+{
+    LinearMemory memory{PageSize, 2 * PageSize};
+    EXPECT_EQ(memory.max_size(), 2 * PageSize);
+
+    EXPECT_THROW(memory.resize(3 * PageSize), std::bad_alloc);
+    EXPECT_EQ(memory.size(), PageSize);
+
+    memory.resize(2 * PageSize);
+    EXPECT_EQ(memory.size(), 2 * PageSize);
+    EXPECT_EQ(memory[2 * PageSize - 1], 0);
+
+    EXPECT_THROW(LinearMemory(2 * PageSize, PageSize), std::bad_alloc);
+
+    LinearMemory memory_no_pages{0, 0};
+    EXPECT_EQ(memory_no_pages.size(), 0);
+    EXPECT_EQ(memory_no_pages.max_size(), 0);
+}
+
+TEST(linear_memory, default_max_size)
+{
+    LinearMemory memory;
+    EXPECT_EQ(memory.max_size(), MemoryPagesLimit * PageSize);
+}
+
+TEST(linear_memory, from_image)
+{
+    const auto image = MemoryImage::create(2 * PageSize);
+    if (image == nullptr)
+        GTEST_SKIP() << "memory images not supported";
+
+    ASSERT_EQ(image->size(), 2 * PageSize);
+    ASSERT_TRUE(image->write(1, "aabb"_bytes));
+    ASSERT_TRUE(image->write(2 * PageSize - 1, "cc"_bytes));
+
+    LinearMemory memory1{*image, 3 * PageSize};
+    LinearMemory memory2{*image, 2 * PageSize};
+    ASSERT_EQ(memory1.size(), 2 * PageSize);
+    ASSERT_EQ(memory2.size(), 2 * PageSize);
+    EXPECT_EQ(memory1.substr(0, 4), "00aabb00"_bytes);
+    EXPECT_EQ(memory1[2 * PageSize - 1], 0xcc);
+    EXPECT_EQ(memory2.substr(0, 4), "00aabb00"_bytes);
+
+    // The memories are copies of the image.
+    memory1[1] = 0x11;
+    EXPECT_EQ(memory1.substr(0, 4), "0011bb00"_bytes);
+    EXPECT_EQ(memory2.substr(0, 4), "00aabb00"_bytes);
+
+    memory1.resize(3 * PageSize);
+    EXPECT_EQ(memory1[2 * PageSize - 1], 0xcc);
+    EXPECT_EQ(memory1.substr(2 * PageSize, PageSize), bytes(PageSize, 0));
+    EXPECT_THROW(memory2.resize(3 * PageSize), std::bad_alloc);
+
+    EXPECT_THROW(LinearMemory(*image, PageSize), std::bad_alloc);
+}
+
+TEST(linear_memory, reset)
+{
+    LinearMemory memory{PageSize};
+    memory[0] = 0xaa;
+    memory.resize(3 * PageSize);
+    memory[2 * PageSize] = 0xbb;
+
+    memory.reset();
+    ASSERT_EQ(memory.size(), PageSize);
+    EXPECT_EQ(memory.substr(0, PageSize), bytes(PageSize, 0));
+
+    // The pages decommitted by the reset are zero-filled when committed again.
+    memory.resize(3 * PageSize);
+    EXPECT_EQ(memory.substr(PageSize, 2 * PageSize), bytes(2 * PageSize, 0));
+}
+
+TEST(linear_memory, reset_from_image)
+{
+    const auto image = MemoryImage::create(PageSize);
+    if (image == nullptr)
+        GTEST_SKIP() << "memory images not supported";
+    ASSERT_TRUE(image->write(1, "aabb"_bytes));
+
+    LinearMemory memory{*image, 2 * PageSize};
+    memory[1] = 0x11;
+    memory[PageSize - 1] = 0x22;
+    memory.resize(2 * PageSize);
+    memory[PageSize] = 0x33;
+
+    memory.reset();
+    ASSERT_EQ(memory.size(), PageSize);
+    EXPECT_EQ(memory.substr(0, 4), "00aabb00"_bytes);
+    EXPECT_EQ(memory[PageSize - 1], 0);
+
+    memory.resize(2 * PageSize);
+    EXPECT_EQ(memory[PageSize], 0);
+}
+
+TEST(linear_memory, checkpoint_rollback)
+{
+    LinearMemory memory{4 * PageSize};
+    memory[0] = 0xaa;
+    memory[2 * PageSize] = 0xbb;
+    EXPECT_FALSE(memory.has_checkpoint());
+
+    memory.checkpoint();
+    EXPECT_TRUE(memory.has_checkpoint());
+    EXPECT_EQ(memory.num_dirty_pages(), 0);
+    EXPECT_EQ(memory[0], 0xaa);
+
+    memory[1] = 0x11;
+    memory[2] = 0x22;
+    memory[3 * PageSize - 1] = 0x33;
+    EXPECT_EQ(memory.substr(0, 3), "aa1122"_bytes);
+    EXPECT_EQ(memory[3 * PageSize - 1], 0x33);
+    EXPECT_GE(memory.num_dirty_pages(), 2);
+
+    memory.rollback();
+    EXPECT_EQ(memory.num_dirty_pages(), 0);
+    EXPECT_EQ(memory.substr(0, 3), "aa0000"_bytes);
+    EXPECT_EQ(memory[2 * PageSize], 0xbb);
+    EXPECT_EQ(memory[3 * PageSize - 1], 0);
+
+    // The checkpoint stays set.
+    memory[2 * PageSize] = 0xcc;
+    memory.rollback();
+    EXPECT_EQ(memory[2 * PageSize], 0xbb);
+
+    memory.discard_checkpoint();
+    EXPECT_FALSE(memory.has_checkpoint());
+    memory[0] = 0x11;
+    EXPECT_EQ(memory[0], 0x11);
+}
+
+TEST(linear_memory, checkpoint_rollback_resize)
+{
+    LinearMemory memory{PageSize, 3 * PageSize};
+    memory.checkpoint();
+
+    memory.resize(3 * PageSize);
+    memory[PageSize - 1] = 0x11;
+    memory[2 * PageSize] = 0x22;
+
+    memory.rollback();
+    ASSERT_EQ(memory.size(), PageSize);
+    EXPECT_EQ(memory[PageSize - 1], 0);
+
+    memory.resize(3 * PageSize);
+    EXPECT_EQ(memory.substr(PageSize, 2 * PageSize), bytes(2 * PageSize, 0));
+}
+
+TEST(linear_memory, checkpoint_update)
+{
+    LinearMemory memory{PageSize};
+    memory.checkpoint();
+    memory[0] = 0x11;
+
+    memory.checkpoint();
+    memory[0] = 0x22;
+    memory.rollback();
+    EXPECT_EQ(memory[0], 0x11);
+
+    LinearMemory empty;
+    empty.checkpoint();
+    empty.resize(PageSize);
+    empty[0] = 0x11;
+    empty.rollback();
+    EXPECT_EQ(empty.size(), 0);
+}
+
+TEST(linear_memory, checkpoint_many_memories)
+{
+    std::vector<std::unique_ptr<LinearMemory>> memories;
+    for (int i = 0; i < 64; ++i)
+    {
+        memories.emplace_back(std::make_unique<LinearMemory>(PageSize, PageSize));
+        memories.back()->checkpoint();
+    }
+
+    // Discard some checkpoints, so the writes to these memories do not fault.
+    for (size_t i = 0; i < memories.size(); i += 3)
+        memories[i]->discard_checkpoint();
+
+    for (size_t i = 0; i < memories.size(); ++i)
+        (*memories[i])[i] = 0x11;
+
+    for (size_t i = 0; i < memories.size(); ++i)
+    {
+        auto& memory = *memories[i];
+        EXPECT_EQ(memory.has_checkpoint(), i % 3 != 0);
+        EXPECT_EQ(memory.num_dirty_pages(), (i % 3 != 0) ? 1 : 0);
+        if (memory.has_checkpoint())
+        {
+            memory.rollback();
+            EXPECT_EQ(memory[i], 0);
+        }
+        else
+            EXPECT_EQ(memory[i], 0x11);
+    }
+}
+
+TEST(linear_memory, checkpoint_from_image)
+{
+    const auto image = MemoryImage::create(PageSize);
+    if (image == nullptr)
+        GTEST_SKIP() << "memory images not supported";
+    ASSERT_TRUE(image->write(1, "aabb"_bytes));
+
+    LinearMemory memory{*image, PageSize};
+    memory.checkpoint();
+    memory[1] = 0x11;
+    memory.rollback();
+    EXPECT_EQ(memory.substr(0, 4), "00aabb00"_bytes);
+}
+
+TEST(linear_memory, reset_discards_checkpoint)
+{
+    LinearMemory memory{PageSize};
+    memory.checkpoint();
+    memory[0] = 0x11;
+    memory.reset();
+    EXPECT_FALSE(memory.has_checkpoint());
+    EXPECT_EQ(memory[0], 0);
+    memory[0] = 0x22;
+    EXPECT_EQ(memory[0], 0x22);
+}
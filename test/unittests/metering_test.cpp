@@ -0,0 +1,138 @@
+#include "execute.hpp"
+#include "native.hpp"
+#include "parser.hpp"
+#include <gtest/gtest.h>
+#include <test/utils/asserts.hpp>
+#include <test/utils/hex.hpp>
+#include <iterator>
+
+using namespace fizzy;
+
+namespace
+{
+/* wat2wasm
+(func (param i32) (result i32)
+  (loop
+    local.get 0
+    i32.const 1
+    i32.sub
+    local.tee 0
+    br_if 0
+  )
+  local.get 0
+)
+(func (param i32) (result i32)
+  local.get 0
+  (if (result i32) (then i32.const 1) (else i32.const 2))
+)
+(func (loop br 0))
+*/
+const auto wasm = from_hex(
+    "0061736d0100000001090260017f017f6000000304030000010a270310000340200041016b22000d000b20000b0c"
+    "002000047f41010541020b0b070003400c000b0b");
+
+InstructionCostTable test_costs()
+{
+    InstructionCostTable costs;
+    costs.fill(1);
+    costs[static_cast<uint8_t>(Instr::i32_const)] = 10;
+    costs[static_cast<uint8_t>(Instr::else_)] = 100;
+    return costs;
+}
+}  // namespace
+
+TEST(metering, parse)
+{
+    const auto module = parse(wasm, test_costs());
+    ASSERT_NE(module.instruction_costs, nullptr);
+    EXPECT_EQ(*module.instruction_costs, test_costs());
+
+    // The end of the loop is not a branch target, the code after it continues the basic block.
+    EXPECT_EQ(module.codesec[0].instructions,
+        (std::vector{Instr::meter, Instr::loop, Instr::meter, Instr::local_get, Instr::i32_const,
+            Instr::i32_sub, Instr::local_tee, Instr::br_if, Instr::meter, Instr::end,
+            Instr::local_get, Instr::end}));
+    EXPECT_EQ(module.codesec[1].instructions,
+        (std::vector{Instr::meter, Instr::local_get, Instr::if_, Instr::meter, Instr::i32_const,
+            Instr::else_, Instr::meter, Instr::i32_const, Instr::end, Instr::meter, Instr::end}));
+    EXPECT_EQ(module.codesec[2].instructions,
+        (std::vector{Instr::meter, Instr::loop, Instr::meter, Instr::br, Instr::end, Instr::end}));
+
+    const auto not_metered = parse(wasm);
+    EXPECT_EQ(not_metered.instruction_costs, nullptr);
+    EXPECT_EQ(not_metered.codesec[2].instructions,
+        (std::vector{Instr::loop, Instr::br, Instr::end, Instr::end}));
+}
+
+TEST(metering, execute)
+{
+    const auto instance = instantiate(parse(wasm, test_costs()));
+
+    // The blocks: loop (1), the loop body (14) for each iteration, the end (3).
+    instance->gas_left = 1000;
+    EXPECT_RESULT(execute(*instance, 0, {3}), 0);
+    EXPECT_EQ(instance->gas_left, 1000 - 46);
+
+    // The blocks: local.get and if (2), the if branch (110) or the else branch (11), the end (1).
+    instance->gas_left = 1000;
+    EXPECT_RESULT(execute(*instance, 1, {1}), 1);
+    EXPECT_EQ(instance->gas_left, 1000 - 113);
+    instance->gas_left = 1000;
+    EXPECT_RESULT(execute(*instance, 1, {0}), 2);
+    EXPECT_EQ(instance->gas_left, 1000 - 14);
+
+    // The not metered execution is the same.
+    const auto not_metered = instantiate(parse(wasm));
+    EXPECT_RESULT(execute(*not_metered, 0, {3}), 0);
+    EXPECT_RESULT(execute(*not_metered, 1, {0}), 2);
+}
+
+TEST(metering, out_of_gas)
+{
+    const auto instance = instantiate(parse(wasm, test_costs()));
+
+    instance->gas_left = 46;
+    EXPECT_RESULT(execute(*instance, 0, {3}), 0);
+    EXPECT_EQ(instance->gas_left, 0);
+
+    // The trap happens at the entry of the last block.
+    instance->gas_left = 45;
+    EXPECT_TRUE(execute(*instance, 0, {3}).trapped);
+    EXPECT_EQ(instance->gas_left, -1);
+
+    EXPECT_TRUE(execute(*instance, 0, {3}).trapped);
+    EXPECT_EQ(instance->gas_left, -2);
+
+    // The infinite loop is stopped.
+    instance->gas_left = 1000;
+    EXPECT_TRUE(execute(*instance, 2, {}).trapped);
+    EXPECT_EQ(instance->gas_left, -1);
+}
+
+TEST(metering, register_engine)
+{
+    // The metered code is executed by the Stack engine.
+    const auto instance = instantiate(parse(wasm, test_costs()));
+    instance->engine = ExecutionEngine::Register;
+    instance->gas_left = 45;
+    EXPECT_TRUE(execute(*instance, 0, {3}).trapped);
+    EXPECT_EQ(instance->gas_left, -1);
+    EXPECT_EQ(instance->engine, ExecutionEngine::Stack);
+}
+
+TEST(metering, native_engine)
+{
+    // The native code does not charge the gas, the metered code is executed by the Stack engine.
+    constexpr NativeFunction native_function = [](NativeContext&, std::ptrdiff_t,
+                                                   const uint64_t*) -> uint64_t { return 0; };
+    const NativeFunction functions[] = {native_function, native_function, native_function};
+    const NativeModule native_module{wasm, functions, std::size(functions)};
+
+    const auto instance = instantiate(parse(wasm, test_costs()));
+    instance->native_module = &native_module;
+    instance->engine = ExecutionEngine::Native;
+    instance->gas_left = 45;
+    EXPECT_TRUE(execute(*instance, 0, {3}).trapped);
+    EXPECT_EQ(instance->gas_left, -1);
+    EXPECT_EQ(instance->engine, ExecutionEngine::Stack);
+}
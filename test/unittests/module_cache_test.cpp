@@ -0,0 +1,275 @@
+#include "execute.hpp"
+#include "module_cache.hpp"
+#include "parser.hpp"
+#include <gtest/gtest.h>
+#include <test/utils/asserts.hpp>
+#include <test/utils/hex.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <thread>
+#include <unistd.h>
+
+using namespace fizzy;
+
+namespace
+{
+/* wat2wasm
+(func $f (import "env" "f") (param i32) (result i32))
+(table 2 funcref)
+(memory 1 2)
+(global $g (mut i32) (i32.const 42))
+(func (export "load") (result i32)
+  i32.const 0
+  i32.load
+  global.get $g
+  i32.add
+)
+(func (export "call_import") (param i32) (result i32)
+  local.get 0
+  call $f
+)
+(func (export "indirect") (param i32) (result i32)
+  local.get 0
+  i32.const 1
+  call_indirect (param i32) (result i32)
+)
+(func $start
+  global.get $g
+  i32.const 1
+  i32.add
+  global.set $g
+)
+(start $start)
+(elem (i32.const 0) 1 2)
+(data (i32.const 0) "\07\00\00\00")
+*/
+const auto wasm = from_hex(
+    "0061736d01000000010d0360017f017f6000017f60000002090103656e7601660000030504010000020404017000"
+    "020504010101020606017f01412a0b072103046c6f616400010b63616c6c5f696d706f7274000208696e64697265"
+    "637400030801040908010041000b0201020a27040a00410028020023006a0b0600200010000b0900200041011100"
+    "000b0900230041016a24000b0b0a010041000b0407000000");
+
+std::string hash_hex(const ContentHash& hash)
+{
+    return hex(hash.data(), hash.size());
+}
+
+void check_execution(const Module& module)
+{
+    constexpr auto host_f = [](Instance&, std::vector<uint64_t> args) -> execution_result {
+        return {false, {args[0] * 2}};
+    };
+    auto instance = instantiate(module, {{host_f, module.typesec[0]}});
+
+    EXPECT_RESULT(execute(*instance, 1, {}), 50);
+    EXPECT_RESULT(execute(*instance, 2, {3}), 6);
+    EXPECT_RESULT(execute(*instance, 3, {5}), 10);
+}
+}  // namespace
+
+TEST(module_cache, content_hash)
+{
+    EXPECT_EQ(hash_hex(content_hash({})),
+        "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    EXPECT_EQ(hash_hex(content_hash("616263"_bytes)),
+        "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    // Input of 56 bytes, with the padding taking an extra block.
+    EXPECT_EQ(hash_hex(content_hash(bytes(56, 'a'))),
+        "b35439a4ac6f0948b6d6f9e3c6af0f5f590ce20f1bde7090ef7970686ec6738a");
+    EXPECT_EQ(hash_hex(content_hash(bytes(1000, 'a'))),
+        "41edece42d63e8d9bf515a9ba6932e1c20cbc9f5a5d134645adb5db1b9737ea3");
+}
+
+TEST(module_cache, serialize_roundtrip)
+{
+    const auto module = parse(wasm);
+    const auto hash = content_hash(wasm);
+    const auto serialized = serialize(module, hash);
+
+    const auto loaded = deserialize(serialized, hash);
+    EXPECT_EQ(serialize(loaded, hash), serialized);
+    ASSERT_EQ(loaded.codesec.size(), module.codesec.size());
+    for (size_t i = 0; i < module.codesec.size(); ++i)
+    {
+        EXPECT_EQ(loaded.codesec[i].local_count, module.codesec[i].local_count);
+        EXPECT_EQ(loaded.codesec[i].max_stack_height, module.codesec[i].max_stack_height);
+        EXPECT_EQ(loaded.codesec[i].instructions, module.codesec[i].instructions);
+        EXPECT_EQ(loaded.codesec[i].immediates, module.codesec[i].immediates);
+    }
+    ASSERT_TRUE(loaded.startfunc.has_value());
+    EXPECT_EQ(*loaded.startfunc, 4);
+    ASSERT_EQ(loaded.memorysec.size(), 1);
+    EXPECT_EQ(loaded.memorysec[0].limits.min, 1);
+    EXPECT_EQ(loaded.memorysec[0].limits.max, 2);
+    ASSERT_EQ(loaded.datasec.size(), 1);
+    EXPECT_EQ(loaded.datasec[0].init, "07000000"_bytes);
+
+    check_execution(loaded);
+}
+
+TEST(module_cache, serialize_lazily_decoded)
+{
+    const auto hash = content_hash(wasm);
+    const auto module = parse(wasm, CodeDecoding::Lazy);
+    EXPECT_EQ(serialize(module, hash), serialize(parse(wasm), hash));
+}
+
+TEST(module_cache, deserialize_mismatch)
+{
+    const auto hash = content_hash(wasm);
+    const auto serialized = serialize(parse(wasm), hash);
+
+    auto other_hash = hash;
+    other_hash[31] ^= 1;
+    EXPECT_THROW_MESSAGE(deserialize(serialized, other_hash), parser_error,
+        "serialized module content hash mismatch");
+
+    auto other_byte_order = serialized;
+    std::reverse(&other_byte_order[8], &other_byte_order[12]);
+    EXPECT_THROW_MESSAGE(deserialize(other_byte_order, hash), parser_error,
+        "serialized module byte order mismatch");
+
+    auto other_version = serialized;
+    const uint32_t version = SerializedModuleVersion + 1;
+    std::memcpy(&other_version[12], &version, sizeof(version));
+    EXPECT_THROW_MESSAGE(deserialize(other_version, hash), parser_error,
+        "unsupported serialized module version");
+
+    EXPECT_THROW_MESSAGE(deserialize(wasm, hash), parser_error, "invalid serialized module prefix");
+}
+
+TEST(module_cache, deserialize_malformed)
+{
+    const auto hash = content_hash(wasm);
+    const auto serialized = serialize(parse(wasm), hash);
+
+    // The header: the magic, the byte order mark, the version, the content hash
+    // and the checksum.
+    constexpr size_t header_size = 8 + 4 + 4 + 32 + 32;
+    for (size_t size = 0; size < header_size; ++size)
+    {
+        EXPECT_THROW_MESSAGE(deserialize(bytes_view{serialized}.substr(0, size), hash),
+            parser_error, "unexpected end of serialized module");
+    }
+    for (size_t size = header_size; size < serialized.size(); ++size)
+    {
+        EXPECT_THROW_MESSAGE(deserialize(bytes_view{serialized}.substr(0, size), hash),
+            parser_error, "serialized module checksum mismatch");
+    }
+
+    EXPECT_THROW_MESSAGE(deserialize(serialized + "00"_bytes, hash), parser_error,
+        "serialized module checksum mismatch");
+
+    for (size_t i = header_size; i < serialized.size(); ++i)
+    {
+        auto corrupted = serialized;
+        corrupted[i] ^= 0x80;
+        EXPECT_THROW_MESSAGE(
+            deserialize(corrupted, hash), parser_error, "serialized module checksum mismatch");
+    }
+}
+
+TEST(module_cache, deserialize_invalid_module)
+{
+    const auto hash = content_hash(wasm);
+    const auto module = parse(wasm);
+
+    const auto expect_malformed = [&hash](const Module& invalid_module, const char* what) {
+        EXPECT_THROW_MESSAGE(deserialize(serialize(invalid_module, hash), hash), parser_error,
+            (std::string{"malformed serialized module: "} + what).c_str());
+    };
+
+    auto invalid = module;
+    invalid.codesec[0].max_stack_height = -1;
+    expect_malformed(invalid, "invalid max stack height");
+
+    invalid = module;
+    invalid.funcsec[0] = static_cast<TypeIdx>(module.typesec.size());
+    expect_malformed(invalid, "invalid type index");
+
+    invalid = module;
+    invalid.importsec[0].desc.function_type_index = 100;
+    expect_malformed(invalid, "invalid type index");
+
+    invalid = module;
+    invalid.imported_function_types.clear();
+    expect_malformed(invalid, "number of imported functions differs");
+
+    invalid = module;
+    invalid.exportsec[0].index = 5;
+    expect_malformed(invalid, "invalid export index");
+
+    invalid = module;
+    invalid.startfunc = 5;
+    expect_malformed(invalid, "invalid function index");
+
+    invalid = module;
+    invalid.elementsec[0].init[0] = 5;
+    expect_malformed(invalid, "invalid function index");
+
+    invalid = module;
+    invalid.datasec[0].offset = {ConstantExpression::Kind::GlobalGet, {1}};
+    expect_malformed(invalid, "invalid global index");
+}
+
+TEST(module_cache, parse_cached)
+{
+    char dir_template[] = "/tmp/fizzy-module-cache-XXXXXX";
+    const char* const dir = mkdtemp(dir_template);
+    ASSERT_NE(dir, nullptr);
+    const auto path = std::string{dir} + '/' + hash_hex(content_hash(wasm));
+
+    // The first use parses the binary and stores the serialized module.
+    check_execution(parse_cached(wasm, dir));
+    std::ifstream file{path, std::ios::binary};
+    ASSERT_TRUE(file.is_open());
+    const std::string content{std::istreambuf_iterator<char>{file}, {}};
+    file.close();
+    EXPECT_EQ(bytes(content.begin(), content.end()), serialize(parse(wasm), content_hash(wasm)));
+
+    // The second use loads it.
+    check_execution(parse_cached(wasm, dir));
+
+    // The invalid entry is replaced.
+    std::ofstream{path, std::ios::binary | std::ios::trunc} << "invalid";
+    check_execution(parse_cached(wasm, dir));
+    file.open(path, std::ios::binary);
+    const std::string replaced_content{std::istreambuf_iterator<char>{file}, {}};
+    EXPECT_EQ(replaced_content, content);
+
+    // Invalid binaries are not stored.
+    EXPECT_THROW(parse_cached("0061736d"_bytes, dir), parser_error);
+
+    std::remove(path.c_str());
+    EXPECT_EQ(rmdir(dir), 0);
+}
+
+TEST(module_cache, parse_cached_concurrently)
+{
+    char dir_template[] = "/tmp/fizzy-module-cache-XXXXXX";
+    const char* const dir = mkdtemp(dir_template);
+    ASSERT_NE(dir, nullptr);
+    const auto path = std::string{dir} + '/' + hash_hex(content_hash(wasm));
+
+    // The threads storing the same entry at the same time write separate temporary files.
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 8; ++i)
+        threads.emplace_back([dir] { check_execution(parse_cached(wasm, dir)); });
+    for (auto& thread : threads)
+        thread.join();
+
+    std::ifstream file{path, std::ios::binary};
+    const std::string content{std::istreambuf_iterator<char>{file}, {}};
+    EXPECT_EQ(bytes(content.begin(), content.end()), serialize(parse(wasm), content_hash(wasm)));
+
+    std::remove(path.c_str());
+    EXPECT_EQ(rmdir(dir), 0);
+}
+
+TEST(module_cache, parse_cached_unwritable_directory)
+{
+    check_execution(parse_cached(wasm, "/nonexistent/fizzy-module-cache"));
+}
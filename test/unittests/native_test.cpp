@@ -0,0 +1,197 @@
+#include "execute.hpp"
+#include "native.hpp"
+#include "parser.hpp"
+#include <gtest/gtest.h>
+#include <native_test_module.hpp>
+#include <test/utils/asserts.hpp>
+#include <test/utils/instantiate.hpp>
+#include <pthread.h>
+#include <stdexcept>
+
+using namespace fizzy;
+using namespace fizzy::test;
+
+namespace
+{
+// The native_test_module is compiled by fizzy-aot from native_test.wasm, the module
+// of jit_test.cpp (see its wat source there).
+std::unique_ptr<Instance> instantiate_native_test_module(ExecutionEngine engine, uint64_t& global)
+{
+    auto module = parse(native_test_module.wasm);
+
+    // The imported function executes $i32_rem_s on the same instance.
+    constexpr auto host = [](Instance& instance, std::vector<uint64_t> args) -> execution_result {
+        if (args[0] == 97)
+            instance.interrupt_requested = true;
+        if (args[0] == 98)
+            return {true, {}};
+        if (args[0] == 99)
+            throw std::runtime_error{"host"};
+        return execute(instance, 2, {args[0], 5});
+    };
+    const auto host_type = module.typesec[0];
+    auto instance = instantiate_with_engine(engine,
+        std::make_shared<const Module>(std::move(module)), {{host, host_type}},
+        {ExternalGlobal{&global, true}});
+    instance->native_module = &native_test_module;
+    return instance;
+}
+}  // namespace
+
+TEST(native, module)
+{
+    const auto module = parse(native_test_module.wasm);
+    EXPECT_EQ(native_test_module.num_functions, module.codesec.size());
+}
+
+TEST(native, execute_same_as_stack_engine)
+{
+    uint64_t global = 0;
+    const auto stack_instance = instantiate_native_test_module(ExecutionEngine::Stack, global);
+    const auto native_instance = instantiate_native_test_module(ExecutionEngine::Native, global);
+
+    constexpr uint64_t values32[]{0, 1, 2, 5, 31, 32, 33, 0x12345678, 0x7fffffff, 0x80000000,
+        0xfffffffb, 0xffffffff};
+    constexpr uint64_t values64[]{0, 1, 2, 5, 63, 64, 65, 0x123456789abcdef0,
+        0x7fffffffffffffff, 0x8000000000000000, 0xfffffffffffffffb, 0xffffffffffffffff};
+
+    const auto expect_same = [&](FuncIdx func_idx, std::vector<uint64_t> args) {
+        const auto expected = execute(*stack_instance, func_idx, args);
+        const auto result = execute(*native_instance, func_idx, args);
+        EXPECT_EQ(result.trapped, expected.trapped) << func_idx;
+        EXPECT_EQ(result.stack, expected.stack) << func_idx;
+    };
+
+    for (FuncIdx func_idx = 1; func_idx <= 11; ++func_idx)
+    {
+        for (const auto a : values32)
+            for (const auto b : values32)
+                expect_same(func_idx, {a, b});
+    }
+    for (FuncIdx func_idx = 12; func_idx <= 20; ++func_idx)
+    {
+        for (const auto a : values64)
+            for (const auto b : values64)
+                expect_same(func_idx, {a, b});
+    }
+    for (FuncIdx func_idx = 21; func_idx <= 23; ++func_idx)
+    {
+        for (const auto a : values32)
+            expect_same(func_idx, {a});
+    }
+    for (FuncIdx func_idx = 24; func_idx <= 27; ++func_idx)
+    {
+        for (const auto a : values64)
+            expect_same(func_idx, {a});
+    }
+    for (const auto a : values32)
+        expect_same(28, {a});
+    for (const auto a : values64)
+        expect_same(29, {a});
+    for (const auto a : values64)
+    {
+        for (const auto b : values64)
+            for (const auto c : {0, 1, 2})
+                expect_same(40, {a, b, uint64_t(c)});
+    }
+
+    EXPECT_EQ(native_instance->engine, ExecutionEngine::Native);
+}
+
+TEST(native, execute)
+{
+    uint64_t global = 10;
+    const auto instance = instantiate_native_test_module(ExecutionEngine::Native, global);
+
+    EXPECT_RESULT(execute(*instance, 30, {0}), 0xffffffffb3b2b1b0);
+    EXPECT_RESULT(execute(*instance, 30, {65531}), 0);
+    EXPECT_TRUE(execute(*instance, 30, {65532}).trapped);
+    EXPECT_TRUE(execute(*instance, 30, {0xffffffff}).trapped);
+    EXPECT_RESULT(execute(*instance, 31, {0}), 0xffffb2b1);
+    EXPECT_RESULT(execute(*instance, 32, {0, 0x1234}), 0xfffeed1234);
+    EXPECT_TRUE(execute(*instance, 32, {65530, 0}).trapped);
+
+    // The memory grows up to the maximum size, then the memory accesses check the new size.
+    EXPECT_RESULT(execute(*instance, 33, {1}), 0x20001);
+    EXPECT_RESULT(execute(*instance, 33, {2}), 0x1ffff);
+    EXPECT_RESULT(execute(*instance, 30, {65532}), 0);
+
+    EXPECT_RESULT(execute(*instance, 34, {1}), 16);
+    EXPECT_EQ(global, 11);
+
+    EXPECT_RESULT(execute(*instance, 35, {0}), 100);
+    EXPECT_RESULT(execute(*instance, 35, {1}), 200);
+    EXPECT_RESULT(execute(*instance, 35, {2}), 7);
+    EXPECT_RESULT(execute(*instance, 35, {0xffffffff}), 7);
+
+    EXPECT_RESULT(execute(*instance, 36, {13}), 4);
+    EXPECT_TRUE(execute(*instance, 36, {98}).trapped);
+    EXPECT_THROW(execute(*instance, 36, {99}), std::runtime_error);
+
+    EXPECT_TRUE(execute(*instance, 37, {0}).trapped);
+
+    EXPECT_RESULT(execute(*instance, 38, {7, 0}), 0);
+    EXPECT_TRUE(execute(*instance, 38, {0, 0}).trapped);
+    EXPECT_TRUE(execute(*instance, 38, {7, 1}).trapped);
+    EXPECT_TRUE(execute(*instance, 38, {7, 2}).trapped);
+    EXPECT_TRUE(execute(*instance, 38, {7, 3}).trapped);
+
+    EXPECT_THROW_MESSAGE(
+        execute(*instance, 39, {0, 0}), unsupported_feature, "Floating point instruction.");
+
+    // The execution stack is restored after the traps and exceptions.
+    EXPECT_RESULT(execute(*instance, 36, {13}), 4);
+    EXPECT_EQ(instance->engine, ExecutionEngine::Native);
+}
+
+TEST(native, without_native_module)
+{
+    uint64_t global = 0;
+    const auto instance = instantiate_native_test_module(ExecutionEngine::Native, global);
+    instance->native_module = nullptr;
+    EXPECT_RESULT(execute(*instance, 36, {13}), 4);
+    EXPECT_EQ(instance->engine, ExecutionEngine::Stack);
+}
+
+TEST(native, interrupt)
+{
+    uint64_t global = 0;
+    const auto instance = instantiate_native_test_module(ExecutionEngine::Native, global);
+
+    // The imported function requests the interruption, the execution nested in it traps.
+    EXPECT_TRUE(execute(*instance, 36, {97}).trapped);
+    EXPECT_TRUE(instance->interrupt_requested);
+
+    // The following execution clears the request.
+    EXPECT_RESULT(execute(*instance, 36, {13}), 4);
+    EXPECT_FALSE(instance->interrupt_requested);
+}
+
+TEST(native, native_stack_limit)
+{
+    uint64_t global = 0;
+    const auto instance = instantiate_native_test_module(ExecutionEngine::Native, global);
+    // The execution stack allows a call depth the thread's native stack cannot hold.
+    instance->execution_stack_limit = 256 * 1024 * 1024;
+
+    // The infinite recursion traps at the bottom of the small stack of the thread.
+    struct Execution
+    {
+        Instance& instance;
+        bool trapped = false;
+    } execution{*instance};
+    const auto run = [](void* arg) -> void* {
+        auto& e = *static_cast<Execution*>(arg);
+        e.trapped = execute(e.instance, 37, {0}).trapped;
+        return nullptr;
+    };
+    pthread_attr_t attr;
+    ASSERT_EQ(pthread_attr_init(&attr), 0);
+    ASSERT_EQ(pthread_attr_setstacksize(&attr, 1024 * 1024), 0);
+    pthread_t thread;
+    ASSERT_EQ(pthread_create(&thread, &attr, run, &execution), 0);
+    ASSERT_EQ(pthread_join(thread, nullptr), 0);
+    pthread_attr_destroy(&attr);
+    EXPECT_TRUE(execution.trapped);
+    EXPECT_EQ(instance->engine, ExecutionEngine::Native);
+}
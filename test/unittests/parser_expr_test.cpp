@@ -9,9 +9,13 @@ using namespace fizzy::test;
 
 namespace
 {
+/// Parses the expr as the body of the only function of type [] -> [] in a module without memory.
 inline auto parse_expr(const bytes& input)
 {
-    return fizzy::parse_expr(input.data(), input.data() + input.size(), false);
+    Module module;
+    module.typesec.emplace_back(FuncType{});
+    module.funcsec.emplace_back(TypeIdx{0});
+    return fizzy::parse_expr(input.data(), input.data() + input.size(), 0, module);
 }
 }  // namespace
 
@@ -54,26 +58,17 @@ TEST(parser, instr_block)
     const auto [code1, pos1] = parse_expr(empty);
     EXPECT_EQ(code1.instructions,
         (std::vector{Instr::nop, Instr::nop, Instr::block, Instr::end, Instr::end}));
-    EXPECT_EQ(code1.immediates,
-        "00"
-        "04000000"
-        "09000000"_bytes);
+    EXPECT_EQ(code1.immediates.size(), 0);
 
     const auto block_i64 = "027e0b0b"_bytes;
     const auto [code2, pos2] = parse_expr(block_i64);
     EXPECT_EQ(code2.instructions, (std::vector{Instr::block, Instr::end, Instr::end}));
-    EXPECT_EQ(code2.immediates,
-        "01"
-        "02000000"
-        "09000000"_bytes);
+    EXPECT_EQ(code2.immediates.size(), 0);
 
     const auto block_f64 = "027c0b0b"_bytes;
     const auto [code3, pos3] = parse_expr(block_f64);
     EXPECT_EQ(code3.instructions, (std::vector{Instr::block, Instr::end, Instr::end}));
-    EXPECT_EQ(code3.immediates,
-        "01"
-        "02000000"
-        "09000000"_bytes);
+    EXPECT_EQ(code3.immediates.size(), 0);
 }
 
 TEST(parser, instr_block_input_buffer_overflow)
@@ -102,17 +97,78 @@ TEST(parser, block_br)
         (std::vector{Instr::nop, Instr::block, Instr::i32_const, Instr::local_set, Instr::br,
             Instr::i32_const, Instr::local_set, Instr::end, Instr::local_get, Instr::end}));
     EXPECT_EQ(code.immediates,
-        "00"
-        "08000000"
-        "1d000000"
         "0a000000"
         "01000000"
+        "08000000"
+        "20000000"
+        "00000000"
         "00000000"
         "0b000000"
         "01000000"
         "01000000"_bytes);
 }
 
+TEST(parser, loop_br_if)
+{
+    // i32.const 0
+    // loop (result i32)
+    //   i32.const 1
+    //   i32.const 0
+    //   br_if 0
+    // end
+    // drop
+    // end
+
+    const auto code_bin =
+        i32_const(0) + "037f"_bytes + i32_const(1) + i32_const(0) + "0d000b1a0b"_bytes;
+    const auto [code, pos] = parse_expr(code_bin);
+    EXPECT_EQ(code.instructions,
+        (std::vector{Instr::i32_const, Instr::loop, Instr::i32_const, Instr::i32_const,
+            Instr::br_if, Instr::end, Instr::drop, Instr::end}));
+    // The branch to the loop goes to the loop's first instruction, takes no values
+    // and restores the stack height from before the loop.
+    EXPECT_EQ(code.immediates,
+        "00000000"
+        "01000000"
+        "00000000"
+        "02000000"
+        "04000000"
+        "01000000"
+        "00000000"_bytes);
+}
+
+TEST(parser, if_else_br)
+{
+    // i32.const 0
+    // if (result i32)
+    //   i32.const 1
+    //   br 0
+    // else
+    //   i32.const 2
+    // end
+    // drop
+    // end
+
+    const auto code_bin = i32_const(0) + "047f"_bytes + i32_const(1) + "0c0005"_bytes +
+                          i32_const(2) + "0b1a0b"_bytes;
+    const auto [code, pos] = parse_expr(code_bin);
+    EXPECT_EQ(code.instructions,
+        (std::vector{Instr::i32_const, Instr::if_, Instr::i32_const, Instr::br, Instr::else_,
+            Instr::i32_const, Instr::end, Instr::drop, Instr::end}));
+    EXPECT_EQ(code.immediates,
+        "00000000"
+        "05000000"  // if: the else branch target
+        "28000000"
+        "01000000"
+        "07000000"  // br: the target after the end
+        "2c000000"
+        "00000000"
+        "01000000"
+        "07000000"  // else: the target after the end
+        "2c000000"
+        "02000000"_bytes);
+}
+
 TEST(parser, instr_br_table)
 {
     /*
@@ -149,15 +205,15 @@ TEST(parser, instr_br_table)
             Instr::end, Instr::i32_const, Instr::return_, Instr::end, Instr::i32_const,
             Instr::return_, Instr::end, Instr::i32_const, Instr::end}));
 
-    // 5 blocks + 1 local_get before br_table
-    const auto br_table_imm_offset = 5 * (1 + 2 * 4) + 4;
+    // 1 local_get before br_table
+    const auto br_table_imm_offset = 4;
     const auto expected_br_imm =
         "04000000"
-        "03000000"
-        "02000000"
-        "01000000"
-        "00000000"
-        "04000000"_bytes;
+        "13000000680000000000000000000000"
+        "10000000640000000000000000000000"
+        "0d000000600000000000000000000000"
+        "0a0000005c0000000000000000000000"
+        "160000006c0000000000000000000000"_bytes;
     EXPECT_EQ(code.immediates.substr(br_table_imm_offset, expected_br_imm.size()), expected_br_imm);
 }
 
@@ -179,11 +235,11 @@ TEST(parser, instr_br_table_empty_vector)
         (std::vector{Instr::block, Instr::local_get, Instr::br_table, Instr::i32_const,
             Instr::return_, Instr::end, Instr::i32_const, Instr::end}));
 
-    // blocks + local_get before br_table
-    const auto br_table_imm_offset = 1 + 2 * 4 + 4;
+    // 1 local_get before br_table
+    const auto br_table_imm_offset = 4;
     const auto expected_br_imm =
         "00000000"
-        "00000000"_bytes;
+        "060000001c0000000000000000000000"_bytes;
     EXPECT_EQ(code.immediates.substr(br_table_imm_offset, expected_br_imm.size()), expected_br_imm);
 }
 
@@ -202,11 +258,11 @@ TEST(parser, unexpected_else)
 
 TEST(parser, call_indirect_table_index)
 {
-    const auto code1_bin = i32_const(0) + "1122000b"_bytes;
+    const auto code1_bin = i32_const(0) + "1100000b"_bytes;
     const auto [code, pos] = parse_expr(code1_bin);
     EXPECT_EQ(code.instructions, (std::vector{Instr::i32_const, Instr::call_indirect, Instr::end}));
 
-    const auto code2_bin = i32_const(0) + "1122010b"_bytes;
+    const auto code2_bin = i32_const(0) + "1100010b"_bytes;
     EXPECT_THROW_MESSAGE(
         parse_expr(code2_bin), parser_error, "invalid tableidx encountered with call_indirect");
 }
@@ -266,3 +322,38 @@ TEST(parser, memory_grow_out_of_bounds)
         EXPECT_THROW_MESSAGE(parse_expr(code), parser_error, "Unexpected EOF");
     }
 }
+
+TEST(parser, max_stack_height)
+{
+    const auto [code1, pos1] = parse_expr("0b"_bytes);
+    EXPECT_EQ(code1.max_stack_height, 0);
+
+    const auto add = i32_const(0) + i32_const(1) + "6a1a0b"_bytes;
+    const auto [code2, pos2] = parse_expr(add);
+    EXPECT_EQ(code2.max_stack_height, 2);
+
+    const auto nested_blocks = i32_const(0) + "027f"_bytes + i32_const(1) + "027f"_bytes +
+                               i32_const(2) + "0b6a0b6a1a0b"_bytes;
+    const auto [code3, pos3] = parse_expr(nested_blocks);
+    EXPECT_EQ(code3.max_stack_height, 3);
+
+    // The code after a branch is unreachable.
+    const auto unreachable_code =
+        "02400c00"_bytes + i32_const(1) + i32_const(2) + "1a1a0b0b"_bytes;
+    const auto [code4, pos4] = parse_expr(unreachable_code);
+    EXPECT_EQ(code4.max_stack_height, 0);
+}
+
+TEST(parser, max_stack_height_invalid_block_results)
+{
+    // The invalid block leaves an item on the stack (not rejected by validation yet).
+    const auto block = "0240"_bytes + i32_const(1) + "0b"_bytes + i32_const(2) + "1a0b"_bytes;
+    const auto [code1, pos1] = parse_expr(block);
+    EXPECT_EQ(code1.max_stack_height, 2);
+
+    // The invalid if branch leaves items on the stack before the else branch is exited by br.
+    const auto if_else = i32_const(1) + "0440"_bytes + i32_const(1) + i32_const(2) + "05"_bytes +
+                         i32_const(3) + "0c000b"_bytes + i32_const(4) + "1a0b"_bytes;
+    const auto [code2, pos2] = parse_expr(if_else);
+    EXPECT_EQ(code2.max_stack_height, 3);
+}
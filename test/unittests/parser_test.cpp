@@ -4,6 +4,10 @@
 #include <test/utils/hex.hpp>
 #include <test/utils/leb128_encode.hpp>
 #include <test/utils/wasm_binary.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <system_error>
+#include <unistd.h>
 
 using namespace fizzy;
 using namespace fizzy::test;
@@ -1254,6 +1258,118 @@ TEST(parser, code_section_without_function_section)
         "malformed binary: number of function and code entries must match");
 }
 
+TEST(parser, code_section_parallel_decoding)
+{
+    // 100 x (func (result i32) (i32.const <index>))
+    constexpr size_t num_funcs = 100;
+    bytes funcsec = test::leb128u_encode(num_funcs);
+    bytes codesec = test::leb128u_encode(num_funcs);
+    for (size_t i = 0; i < num_funcs; ++i)
+    {
+        funcsec += "00"_bytes;
+        codesec += add_size_prefix("00"_bytes + test::i32_const(uint32_t(i)) + "0b"_bytes);
+    }
+    const auto bin = bytes{wasm_prefix} + make_section(1, make_vec({make_functype({}, {i32})})) +
+                     make_section(3, funcsec) + make_section(10, codesec);
+
+    const auto module = parse(bin);
+    for (const auto num_threads : {2u, 3u, 8u, 1000u})
+    {
+        const auto parallel_module = parse(bin, CodeDecoding::Eager, num_threads);
+        ASSERT_EQ(parallel_module.codesec.size(), num_funcs);
+        for (size_t i = 0; i < num_funcs; ++i)
+        {
+            EXPECT_EQ(parallel_module.codesec[i].instructions, module.codesec[i].instructions);
+            EXPECT_EQ(parallel_module.codesec[i].immediates, module.codesec[i].immediates);
+            EXPECT_EQ(
+                parallel_module.codesec[i].max_stack_height, module.codesec[i].max_stack_height);
+        }
+    }
+}
+
+TEST(parser, code_section_parallel_decoding_first_error)
+{
+    // 100 x (func (result i32) (i32.const 0)) with the invalid bodies at indices 50 and 70.
+    constexpr size_t num_funcs = 100;
+    bytes funcsec = test::leb128u_encode(num_funcs);
+    bytes codesec = test::leb128u_encode(num_funcs);
+    for (size_t i = 0; i < num_funcs; ++i)
+    {
+        funcsec += "00"_bytes;
+        if (i == 50)
+            codesec += add_size_prefix("000c050b"_bytes);  // br 5
+        else if (i == 70)
+            codesec += add_size_prefix("006a0b"_bytes);  // i32.add
+        else
+            codesec += add_size_prefix("00"_bytes + test::i32_const(0) + "0b"_bytes);
+    }
+    const auto bin = bytes{wasm_prefix} + make_section(1, make_vec({make_functype({}, {i32})})) +
+                     make_section(3, funcsec) + make_section(10, codesec);
+
+    for (const auto num_threads : {1u, 2u, 4u, 16u})
+    {
+        EXPECT_THROW_MESSAGE(parse(bin, CodeDecoding::Eager, num_threads), validation_error,
+            "invalid label index");
+    }
+}
+
+TEST(parser, code_section_lazy_decoding)
+{
+    /* wat2wasm
+    (func (result i32) (call 1))
+    (func (result i32) (i32.const 42))
+    */
+    const auto bin =
+        from_hex("0061736d010000000105016000017f03030200000a0b02040010010b0400412a0b");
+
+    const auto module = parse(bin, CodeDecoding::Lazy);
+    EXPECT_TRUE(module.codesec.empty());
+    ASSERT_NE(module.lazy_codesec, nullptr);
+    ASSERT_EQ(module.lazy_codesec->functions.size(), 2);
+
+    const auto eager_module = parse(bin);
+    for (size_t i = 0; i < 2; ++i)
+    {
+        const auto& code = get_code(module, i);
+        const auto& eager_code = eager_module.codesec[i];
+        EXPECT_EQ(code.local_count, eager_code.local_count);
+        EXPECT_EQ(code.max_stack_height, eager_code.max_stack_height);
+        EXPECT_EQ(code.instructions, eager_code.instructions);
+        EXPECT_EQ(code.immediates, eager_code.immediates);
+
+        // Decoded only once.
+        EXPECT_EQ(&get_code(module, i), &code);
+    }
+}
+
+TEST(parser, code_section_lazy_decoding_invalid_body)
+{
+    /* wat2wasm --no-check
+    (func (result i32) (i32.const 1))
+    (func (result i32) (i32.add))
+    */
+    const auto bin =
+        from_hex("0061736d010000000105016000017f03030200000a0a02040041010b03006a0b");
+
+    EXPECT_THROW_MESSAGE(parse(bin), validation_error, "stack underflow");
+
+    const auto module = parse(bin, CodeDecoding::Lazy);
+    EXPECT_EQ(get_code(module, 0).instructions.size(), 2);
+    EXPECT_THROW_MESSAGE(get_code(module, 1), validation_error, "stack underflow");
+    EXPECT_THROW_MESSAGE(get_code(module, 1), validation_error, "stack underflow");
+}
+
+TEST(parser, code_section_lazy_decoding_checks_locals)
+{
+    const auto large_num = "8080808008"_bytes;  // 0x80000000
+    const auto locals = make_vec({large_num + "7e"_bytes, large_num + "7e"_bytes});
+    const auto wasm = bytes{wasm_prefix} + make_section(1, make_vec({make_functype({}, {})})) +
+                      make_section(3, "0100"_bytes) +
+                      make_section(10, make_vec({add_size_prefix(locals + "0b"_bytes)}));
+
+    EXPECT_THROW_MESSAGE(parse(wasm, CodeDecoding::Lazy), parser_error, "too many local variables");
+}
+
 TEST(parser, data_section_empty)
 {
     const auto bin = bytes{wasm_prefix} + make_section(11, make_vec({}));
@@ -1280,6 +1396,195 @@ TEST(parser, data_section)
     EXPECT_EQ(module.datasec[2].init, "2424"_bytes);
 }
 
+TEST(parser, referenced_bytes_copied)
+{
+    /* wat2wasm
+    (func (import "mod" "foo") (result i32))
+    (memory 1)
+    (func (export "bar") (result i32) (i32.const 42))
+    (data (i32.const 1) "\aa\ff")
+    */
+    auto bin = from_hex(
+        "0061736d010000000105016000017f020b01036d6f6403666f6f00000302010005030100010707010362617200"
+        "010a06010400412a0b0b08010041010b02aaff");
+
+    for (const auto code_decoding : {CodeDecoding::Eager, CodeDecoding::Lazy})
+    {
+        auto input = bin;
+        const auto module = parse(input, code_decoding);
+        // Only the function bodies to be decoded lazily are kept in the storage.
+        EXPECT_EQ(module.storage != nullptr, code_decoding == CodeDecoding::Lazy);
+        std::fill(input.begin(), input.end(), uint8_t{0});
+
+        ASSERT_EQ(module.importsec.size(), 1);
+        EXPECT_EQ(module.importsec[0].module, "mod");
+        EXPECT_EQ(module.importsec[0].name, "foo");
+        ASSERT_EQ(module.exportsec.size(), 1);
+        EXPECT_EQ(module.exportsec[0].name, "bar");
+        ASSERT_EQ(module.datasec.size(), 1);
+        EXPECT_EQ(module.datasec[0].init, "aaff"_bytes);
+        EXPECT_FALSE(module.datasec[0].mapped_init.has_value());
+        EXPECT_EQ(get_code(module, 0).instructions, (std::vector{Instr::i32_const, Instr::end}));
+    }
+}
+
+TEST(parser, parse_file)
+{
+    /* wat2wasm
+    (func (import "mod" "foo") (result i32))
+    (memory 1)
+    (func (export "bar") (result i32) (i32.const 42))
+    (data (i32.const 1) "\aa\ff")
+    */
+    const auto bin = from_hex(
+        "0061736d010000000105016000017f020b01036d6f6403666f6f00000302010005030100010707010362617200"
+        "010a06010400412a0b0b08010041010b02aaff");
+
+    char path[] = "/tmp/fizzy-parse-file-XXXXXX";
+    const int fd = mkstemp(path);
+    ASSERT_NE(fd, -1);
+    ASSERT_EQ(write(fd, bin.data(), bin.size()), static_cast<ssize_t>(bin.size()));
+    close(fd);
+
+    for (const auto code_decoding : {CodeDecoding::Eager, CodeDecoding::Lazy})
+    {
+        const auto module = parse_file(path, code_decoding);
+        ASSERT_NE(module.storage, nullptr);
+
+        ASSERT_EQ(module.importsec.size(), 1);
+        EXPECT_EQ(module.importsec[0].module, "mod");
+        EXPECT_EQ(module.importsec[0].name, "foo");
+        ASSERT_EQ(module.exportsec.size(), 1);
+        EXPECT_EQ(module.exportsec[0].name, "bar");
+        ASSERT_EQ(module.datasec.size(), 1);
+        // The payload is not copied.
+        EXPECT_TRUE(module.datasec[0].init.empty());
+        ASSERT_TRUE(module.datasec[0].mapped_init.has_value());
+        EXPECT_EQ(module.datasec[0].payload(), "aaff"_bytes);
+        EXPECT_EQ(get_code(module, 0).instructions, (std::vector{Instr::i32_const, Instr::end}));
+    }
+
+    // The module keeps the file mapped.
+    const auto module = parse_file(path);
+    unlink(path);
+    EXPECT_EQ(module.datasec[0].payload(), "aaff"_bytes);
+}
+
+TEST(parser, parse_file_errors)
+{
+    EXPECT_THROW(parse_file("/nonexistent/fizzy-parse-file.wasm"), std::system_error);
+
+    char path[] = "/tmp/fizzy-parse-file-XXXXXX";
+    const int fd = mkstemp(path);
+    ASSERT_NE(fd, -1);
+    close(fd);
+    EXPECT_THROW_MESSAGE(parse_file(path), parser_error, "invalid wasm module prefix");
+    unlink(path);
+}
+
+TEST(parser, streaming)
+{
+    /* wat2wasm
+    (func $foo (import "mod" "foo") (result i32))
+    (memory 1)
+    (global i32 (i32.const 1))
+    (func (export "bar") (result i32) (call $foo) (i32.const 42) (i32.add))
+    (func (param i32) (result i32) (local i64) (local.get 0))
+    (data (i32.const 1) "\aa\ff")
+    */
+    const auto bin = from_hex(
+        "0061736d01000000010a026000017f60017f017f020b01036d6f6403666f6f00000303020001050301000106"
+        "06017f0041010b0707010362617200010a100207001000412a6a0b0601017e20000b0b08010041010b02aaff");
+
+    const auto expected = parse(bin);
+    for (const auto chunk_size : {size_t{1}, size_t{2}, size_t{3}, size_t{7}, size_t{1000}})
+    {
+        StreamingParser parser;
+        for (size_t i = 0; i < bin.size(); i += chunk_size)
+            parser.push(bytes_view{bin}.substr(i, chunk_size));
+        const auto module = parser.finish();
+
+        EXPECT_EQ(module.typesec.size(), expected.typesec.size());
+        ASSERT_EQ(module.importsec.size(), 1);
+        EXPECT_EQ(module.importsec[0].module, "mod");
+        EXPECT_EQ(module.importsec[0].name, "foo");
+        EXPECT_EQ(module.memorysec.size(), 1);
+        EXPECT_EQ(module.globalsec.size(), 1);
+        ASSERT_EQ(module.exportsec.size(), 1);
+        EXPECT_EQ(module.exportsec[0].name, "bar");
+        ASSERT_EQ(module.datasec.size(), 1);
+        EXPECT_EQ(module.datasec[0].init, "aaff"_bytes);
+        EXPECT_EQ(module.imported_function_types, expected.imported_function_types);
+        ASSERT_EQ(module.codesec.size(), 2);
+        for (size_t i = 0; i < module.codesec.size(); ++i)
+        {
+            EXPECT_EQ(module.codesec[i].local_count, expected.codesec[i].local_count);
+            EXPECT_EQ(module.codesec[i].max_stack_height, expected.codesec[i].max_stack_height);
+            EXPECT_EQ(module.codesec[i].instructions, expected.codesec[i].instructions);
+            EXPECT_EQ(module.codesec[i].immediates, expected.codesec[i].immediates);
+        }
+    }
+}
+
+TEST(parser, streaming_decodes_function_bodies_on_arrival)
+{
+    /* wat2wasm --no-check
+    (func (result i32) (i32.const 1))
+    (func (result i32) (i32.add))
+    */
+    const auto bin =
+        from_hex("0061736d010000000105016000017f03030200000a0a02040041010b03006a0b");
+
+    // The invalid body is reported by push() receiving it.
+    StreamingParser parser;
+    parser.push(bytes_view{bin}.substr(0, bin.size() - 2));
+    EXPECT_THROW_MESSAGE(
+        parser.push(bytes_view{bin}.substr(bin.size() - 2)), validation_error, "stack underflow");
+}
+
+TEST(parser, streaming_errors)
+{
+    EXPECT_THROW_MESSAGE(StreamingParser{}.finish(), parser_error, "invalid wasm module prefix");
+    EXPECT_THROW_MESSAGE(
+        StreamingParser{}.push("0061736d02"_bytes), parser_error, "invalid wasm module prefix");
+
+    StreamingParser prefix_only;
+    prefix_only.push("0061736d01"_bytes);
+    EXPECT_THROW_MESSAGE(prefix_only.finish(), parser_error, "invalid wasm module prefix");
+
+    StreamingParser incomplete_section;
+    incomplete_section.push(bytes{wasm_prefix} + "010a02"_bytes);
+    EXPECT_THROW_MESSAGE(incomplete_section.finish(), parser_error, "Unexpected EOF");
+
+    StreamingParser incomplete_section_size;
+    incomplete_section_size.push(bytes{wasm_prefix} + "0180"_bytes);
+    EXPECT_THROW_MESSAGE(incomplete_section_size.finish(), parser_error, "Unexpected EOF");
+
+    StreamingParser unknown_section;
+    EXPECT_THROW_MESSAGE(unknown_section.push(bytes{wasm_prefix} + "0c00"_bytes), parser_error,
+        "unknown section encountered 12");
+
+    StreamingParser out_of_order;
+    out_of_order.push(bytes{wasm_prefix} + make_section(3, make_vec({})));
+    EXPECT_THROW_MESSAGE(out_of_order.push(make_section(1, make_vec({}))), parser_error,
+        "Unexpected out-of-order section type");
+
+    // The function section without the code section.
+    StreamingParser no_code;
+    no_code.push(bytes{wasm_prefix} + make_section(1, make_vec({make_functype({}, {})})) +
+                 make_section(3, "0100"_bytes));
+    EXPECT_THROW_MESSAGE(no_code.finish(), parser_error,
+        "malformed binary: number of function and code entries must match");
+
+    StreamingParser code_section_too_large;
+    code_section_too_large.push(bytes{wasm_prefix} +
+                                make_section(1, make_vec({make_functype({}, {})})) +
+                                make_section(3, "0100"_bytes));
+    EXPECT_THROW_MESSAGE(
+        code_section_too_large.push(make_section(10, make_vec({"02000b"_bytes}) + "00"_bytes)),
+        parser_error, "incorrect section 10 size, difference: -1");
+}
+
 TEST(parser, data_section_memidx_nonzero)
 {
     const auto section_contents = make_vec({"0141010b0100"_bytes});
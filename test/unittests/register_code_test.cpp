@@ -0,0 +1,283 @@
+#include "execute.hpp"
+#include "parser.hpp"
+#include "register_code.hpp"
+#include <gtest/gtest.h>
+#include <test/utils/asserts.hpp>
+#include <test/utils/hex.hpp>
+#include <test/utils/instantiate.hpp>
+
+using namespace fizzy;
+using namespace fizzy::test;
+
+namespace
+{
+/* wat2wasm
+(func $twice (import "env" "twice") (param i32) (result i32))
+(memory 1)
+(table 2 funcref)
+(elem (i32.const 0) $add $add10)
+(global (mut i32) (i32.const 0))
+(func $add (param i32 i32) (result i32)
+  local.get 0
+  local.get 1
+  i32.add
+)
+(func $add10 (param i32) (result i32) (local i32)
+  local.get 0
+  i32.const 10
+  i32.add
+  local.set 1
+  local.get 1
+)
+(func $sub_old (param i32 i32) (result i32)
+  local.get 0
+  local.get 1
+  local.set 0
+  local.get 0
+  i32.sub
+)
+(func $fac (param i64) (result i64)
+  local.get 0
+  i64.eqz
+  if (result i64)
+    i64.const 1
+  else
+    local.get 0
+    local.get 0
+    i64.const 1
+    i64.sub
+    call $fac
+    i64.mul
+  end
+)
+(func $br_table (param i32) (result i32)
+  (block (result i32)
+    (block
+      (block
+        local.get 0
+        br_table 0 1
+      )
+      i32.const 100
+      br 1
+    )
+    i32.const 200
+  )
+)
+(func $br_table_value (param i32) (result i32)
+  (block (result i32)
+    i32.const 7
+    local.get 0
+    br_table 0 1
+  )
+  i32.const 1
+  i32.add
+)
+(func $sum (param i32) (result i32) (local i32)
+  (block
+    (loop
+      local.get 0
+      i32.eqz
+      br_if 1
+      local.get 1
+      local.get 0
+      i32.add
+      local.set 1
+      local.get 0
+      i32.const -1
+      i32.add
+      local.set 0
+      br 0
+    )
+  )
+  local.get 1
+)
+(func $br_if_value (param i32) (result i32)
+  (block (result i32)
+    i32.const 5
+    local.get 0
+    br_if 0
+    drop
+    i32.const 9
+  )
+)
+(func $div (param i32 i32) (result i32)
+  local.get 0
+  local.get 1
+  i32.div_u
+)
+(func $unreachable
+  unreachable
+)
+(func $recursive
+  call $recursive
+)
+(func $memory (param i32) (result i32)
+  local.get 0
+  local.get 0
+  i32.store
+  local.get 0
+  i32.load
+)
+(func $select (param i32) (result i32)
+  i32.const 1
+  i32.const 2
+  local.get 0
+  select
+)
+(func $call_indirect (param i32 i32 i32) (result i32)
+  local.get 0
+  local.get 1
+  local.get 2
+  call_indirect (param i32 i32) (result i32)
+)
+(func $global (param i32) (result i32)
+  global.get 0
+  local.get 0
+  i32.add
+  global.set 0
+  global.get 0
+)
+(func $tee (param i32) (result i32) (local i32)
+  local.get 0
+  local.tee 1
+  local.get 1
+  i32.add
+)
+(func $call_imported (param i32) (result i32)
+  local.get 0
+  call $twice
+  i32.const 1
+  i32.add
+)
+*/
+const auto wasm = from_hex(
+    "0061736d01000000011b0560017f017f60027f7f017f60017e017e60000060037f7f7f017f020d0103656e760574"
+    "776963650000031211010001020000000001030300000400000004040170000205030100010606017f0141000b09"
+    "08010041000b0201020aed01110700200020016a0b0d01017f2000410a6a210120010b0b0020002001210020006b"
+    "0b1500200050047e4201052000200042017d10047e0b0b1900027f0240024020000e0100010b41e4000c010b41c8"
+    "010b0b1000027f410720000e0100010b41016a0b2101017f024003402000450d01200120006a21012000417f6a21"
+    "000c000b0b20010b0e00027f410520000d001a41090b0b0700200020016e0b0300000b0400100b0b0e0020002000"
+    "36020020002802000b09004101410220001b0b0b002000200120021101000b0b00230020006a240023000b0b0101"
+    "7f2000220120016a0b09002000100041016a0b");
+
+constexpr uint32_t op(RegisterOp register_op) noexcept
+{
+    return static_cast<uint32_t>(register_op);
+}
+
+std::unique_ptr<Instance> instantiate_register_test_module(
+    const Module& module, ExecutionEngine engine)
+{
+    // The imported function executes the $add function on the same instance.
+    constexpr auto twice = [](Instance& instance, std::vector<uint64_t> args) {
+        return execute(instance, 1, {args[0], args[0]});
+    };
+    return instantiate_with_engine(
+        engine, std::make_shared<const Module>(module), {{twice, module.typesec[0]}});
+}
+}  // namespace
+
+TEST(register_code, translate)
+{
+    const auto module = parse(wasm);
+
+    RegisterCode code;
+    ASSERT_TRUE(translate_to_register_code(module, 0, code));
+    EXPECT_EQ(code.num_args, 2);
+    EXPECT_EQ(code.num_locals, 2);
+    EXPECT_EQ(code.frame_size, 4);
+    EXPECT_TRUE(code.constants.empty());
+    EXPECT_EQ(code.instructions, (std::vector{op(RegisterOp::i32_add), 2u, 0u, 1u,
+                                     op(RegisterOp::ret), 2u}));
+
+    // The constant has the slot after the locals, the result is stored in the local directly.
+    ASSERT_TRUE(translate_to_register_code(module, 1, code));
+    EXPECT_EQ(code.num_args, 1);
+    EXPECT_EQ(code.num_locals, 2);
+    EXPECT_EQ(code.frame_size, 5);
+    EXPECT_EQ(code.constants, std::vector<uint64_t>{10});
+    EXPECT_EQ(code.instructions, (std::vector{op(RegisterOp::i32_add), 1u, 0u, 2u,
+                                     op(RegisterOp::ret), 1u}));
+
+    // The value of the local on the operand stack is copied before the local is modified.
+    ASSERT_TRUE(translate_to_register_code(module, 2, code));
+    EXPECT_EQ(code.instructions,
+        (std::vector{op(RegisterOp::copy), 2u, 0u, op(RegisterOp::copy), 0u, 1u,
+            op(RegisterOp::i32_sub), 2u, 2u, 0u, op(RegisterOp::ret), 2u}));
+}
+
+TEST(register_code, translate_module)
+{
+    const auto module = parse(wasm);
+    const auto register_module = translate_to_register_module(module);
+    ASSERT_NE(register_module, nullptr);
+    EXPECT_EQ(register_module->functions.size(), module.funcsec.size());
+}
+
+TEST(register_code, execute)
+{
+    const auto module = parse(wasm);
+    for (const auto engine : {ExecutionEngine::Stack, ExecutionEngine::Register})
+    {
+        const auto instance = instantiate_register_test_module(module, engine);
+        EXPECT_RESULT(execute(*instance, 1, {2, 3}), 5);
+        EXPECT_RESULT(execute(*instance, 1, {0xffffffff, 3}), 2);
+        EXPECT_RESULT(execute(*instance, 2, {5}), 15);
+        EXPECT_RESULT(execute(*instance, 3, {10, 3}), 7);
+        EXPECT_RESULT(execute(*instance, 4, {0}), 1);
+        EXPECT_RESULT(execute(*instance, 4, {20}), 2432902008176640000);
+        EXPECT_RESULT(execute(*instance, 5, {0}), 100);
+        EXPECT_RESULT(execute(*instance, 5, {1}), 200);
+        EXPECT_RESULT(execute(*instance, 5, {0xffffffff}), 200);
+        EXPECT_RESULT(execute(*instance, 6, {0}), 8);
+        EXPECT_RESULT(execute(*instance, 6, {1}), 7);
+        EXPECT_RESULT(execute(*instance, 7, {0}), 0);
+        EXPECT_RESULT(execute(*instance, 7, {100}), 5050);
+        EXPECT_RESULT(execute(*instance, 8, {1}), 5);
+        EXPECT_RESULT(execute(*instance, 8, {0}), 9);
+        EXPECT_RESULT(execute(*instance, 9, {7, 2}), 3);
+        EXPECT_TRUE(execute(*instance, 9, {7, 0}).trapped);
+        EXPECT_TRUE(execute(*instance, 10, {}).trapped);
+        EXPECT_TRUE(execute(*instance, 11, {}).trapped);
+        EXPECT_RESULT(execute(*instance, 12, {0x1234}), 0x1234);
+        EXPECT_TRUE(execute(*instance, 12, {65533}).trapped);
+        EXPECT_RESULT(execute(*instance, 13, {1}), 1);
+        EXPECT_RESULT(execute(*instance, 13, {0}), 2);
+        EXPECT_RESULT(execute(*instance, 14, {3, 4, 0}), 7);
+        EXPECT_TRUE(execute(*instance, 14, {3, 4, 1}).trapped);
+        EXPECT_TRUE(execute(*instance, 14, {3, 4, 2}).trapped);
+        EXPECT_RESULT(execute(*instance, 15, {3}), 3);
+        EXPECT_RESULT(execute(*instance, 15, {4}), 7);
+        EXPECT_RESULT(execute(*instance, 16, {21}), 42);
+        EXPECT_RESULT(execute(*instance, 17, {21}), 43);
+        EXPECT_EQ(instance->engine, engine);
+    }
+}
+
+TEST(register_code, execute_fallback_to_stack_engine)
+{
+    /* wat2wasm --no-check
+    (func (result i32)
+      (block (result i32)
+        i32.const 1
+        i32.const 0
+        br_if 0
+        i32.const 2
+      )
+      drop
+    )
+    */
+    // The block ends with more values than its arity, what the parser accepts. The stack engine
+    // leaves both values on the operand stack, the register engine cannot give the block
+    // a fixed number of results.
+    const auto wasm_invalid =
+        from_hex("0061736d010000000105016000017f030201000a10010e00027f410141000d0041020b1a0b");
+    const auto module = parse(wasm_invalid);
+    RegisterCode code;
+    EXPECT_FALSE(translate_to_register_code(module, 0, code));
+
+    auto instance = instantiate(module);
+    instance->engine = ExecutionEngine::Register;
+    EXPECT_RESULT(execute(*instance, 0, {}), 1);
+    EXPECT_EQ(instance->engine, ExecutionEngine::Stack);
+}
@@ -130,3 +130,47 @@ TEST(stack, clear_on_empty)
     Stack<char> stack;
     stack.clear();
 }
+
+TEST(operand_stack, push_pop_peek)
+{
+    uint64_t storage[4]{};
+    OperandStack stack{storage};
+
+    EXPECT_TRUE(stack.empty());
+    EXPECT_EQ(stack.bottom(), storage);
+
+    stack.push(1);
+    stack.push(2);
+    stack.push(3);
+    EXPECT_EQ(stack.size(), 3);
+    EXPECT_EQ(stack.end(), storage + 3);
+    EXPECT_EQ(stack.peek(), 3);
+    EXPECT_EQ(stack.peek(2), 1);
+
+    EXPECT_EQ(stack.pop(), 3);
+    stack.drop();
+    EXPECT_EQ(stack.size(), 1);
+    EXPECT_EQ(stack.peek(), 1);
+
+    stack.clear();
+    EXPECT_TRUE(stack.empty());
+}
+
+TEST(operand_stack, external_memory)
+{
+    uint64_t storage[4]{10, 11, 12, 13};
+    OperandStack stack{storage + 1, storage + 3};
+
+    EXPECT_EQ(stack.size(), 2);
+    EXPECT_EQ(stack.peek(), 12);
+    EXPECT_EQ(stack.peek(1), 11);
+
+    stack.push(20);  // Writes directly into the external memory.
+    EXPECT_EQ(storage[3], 20);
+
+    stack.resize(1);
+    EXPECT_EQ(stack.peek(), 11);
+    stack.push(30);
+    EXPECT_EQ(storage[2], 30);
+    EXPECT_EQ(stack.size(), 2);
+}
@@ -0,0 +1,111 @@
+#include "execute.hpp"
+#include "parser.hpp"
+#include "superinstructions.hpp"
+#include <gtest/gtest.h>
+#include <test/utils/asserts.hpp>
+#include <test/utils/hex.hpp>
+
+using namespace fizzy;
+
+namespace
+{
+/* wat2wasm
+(memory 1)
+(data (i32.const 8) "\78\56\34\12")
+(func (param i32 i32) (result i32)
+  local.get 0
+  local.get 1
+  i32.add
+)
+(func (param i32) (result i32) (local i32)
+  local.get 0
+  i32.const 10
+  i32.add
+  local.set 1
+  local.get 1
+)
+(func (param i32) (result i32)
+  local.get 0
+  i32.load offset=4
+)
+(func (param i32) (result i32) (local i32)
+  (block
+    (loop
+      local.get 0
+      i32.eqz
+      br_if 1
+      local.get 1
+      local.get 0
+      i32.add
+      local.set 1
+      local.get 0
+      i32.const -1
+      i32.add
+      local.set 0
+      br 0
+    )
+  )
+  local.get 1
+)
+*/
+const auto wasm = from_hex(
+    "0061736d01000000010c0260027f7f017f60017f017f0305040001010105030100010a41040700200020016a0b0d"
+    "01017f2000410a6a210120010b070020002802040b2101017f024003402000450d01200120006a21012000417f6a"
+    "21000c000b0b20010b0b0a010041080b0478563412");
+
+void expect_results(const Module& module)
+{
+    const auto instance = instantiate(std::make_shared<const Module>(module));
+    EXPECT_RESULT(execute(*instance, 0, {2, 3}), 5);
+    EXPECT_RESULT(execute(*instance, 0, {0xffffffff, 3}), 2);
+    EXPECT_RESULT(execute(*instance, 1, {5}), 15);
+    EXPECT_RESULT(execute(*instance, 1, {0xfffffffe}), 8);
+    EXPECT_RESULT(execute(*instance, 2, {4}), 0x12345678);
+    EXPECT_RESULT(execute(*instance, 2, {65528}), 0);
+    EXPECT_TRUE(execute(*instance, 2, {65529}).trapped);
+    EXPECT_TRUE(execute(*instance, 2, {0xffffffff}).trapped);
+    EXPECT_RESULT(execute(*instance, 3, {0}), 0);
+    EXPECT_RESULT(execute(*instance, 3, {100}), 5050);
+}
+}  // namespace
+
+TEST(superinstructions, fuse)
+{
+    auto module = parse(wasm);
+    fuse_superinstructions(module);
+
+    EXPECT_EQ(module.codesec[0].instructions,
+        (std::vector{Instr::local_get_local_get_i32_add, Instr::local_get, Instr::i32_add,
+            Instr::end}));
+    EXPECT_EQ(module.codesec[1].instructions,
+        (std::vector{Instr::local_get_i32_const_i32_add_local_set, Instr::i32_const,
+            Instr::i32_add, Instr::local_set, Instr::local_get, Instr::end}));
+    EXPECT_EQ(module.codesec[2].instructions,
+        (std::vector{Instr::local_get_i32_load, Instr::i32_load, Instr::end}));
+    EXPECT_EQ(module.codesec[3].instructions,
+        (std::vector{Instr::block, Instr::loop, Instr::local_get, Instr::i32_eqz_br_if,
+            Instr::br_if, Instr::local_get_local_get_i32_add, Instr::local_get, Instr::i32_add,
+            Instr::local_set, Instr::local_get_i32_const_i32_add_local_set, Instr::i32_const,
+            Instr::i32_add, Instr::local_set, Instr::br, Instr::end, Instr::end, Instr::local_get,
+            Instr::end}));
+
+    // The immediates are not changed.
+    EXPECT_EQ(module.codesec[3].immediates, parse(wasm).codesec[3].immediates);
+}
+
+TEST(superinstructions, execute)
+{
+    expect_results(parse(wasm));
+
+    auto module = parse(wasm);
+    fuse_superinstructions(module);
+    expect_results(module);
+}
+
+TEST(superinstructions, execute_lazy)
+{
+    auto module = parse(wasm, CodeDecoding::Lazy);
+    fuse_superinstructions(module);
+    EXPECT_EQ(get_code(module, 0).instructions[0], Instr::local_get_local_get_i32_add);
+    expect_results(module);
+}
@@ -2,6 +2,7 @@
 #include <gtest/gtest.h>
 #include <test/utils/asserts.hpp>
 #include <test/utils/hex.hpp>
+#include <random>
 
 using namespace fizzy;
 
@@ -11,6 +12,18 @@ inline bool utf8_validate(bytes_view input)
 {
     return fizzy::utf8_validate(input.begin(), input.end());
 }
+
+std::vector<decltype(&fizzy::utf8_validate)> validators()
+{
+    std::vector<decltype(&fizzy::utf8_validate)> validators{
+        fizzy::utf8_validate, utf8_validate_scalar};
+#if defined(__x86_64__)
+    validators.emplace_back(utf8_validate_sse2);
+    if (__builtin_cpu_supports("avx2"))
+        validators.emplace_back(utf8_validate_avx2);
+#endif
+    return validators;
+}
 }  // namespace
 
 TEST(utf8, invalid_first_bytes)
@@ -128,3 +141,101 @@ TEST(utf8, validate)
     for (const auto& testcase : testcases)
         EXPECT_EQ(utf8_validate(testcase.first), testcase.second);
 }
+
+TEST(utf8, validate_across_blocks)
+{
+    // The sequences placed at every offset of a longer ASCII string, so that they cross
+    // the boundaries of the blocks of the vectorized implementations.
+    const std::vector<std::pair<bytes, bool>> testcases = {
+        {"c2bf"_bytes, true},
+        {"e0a080"_bytes, true},
+        {"ed9fbf"_bytes, true},
+        {"f0908080"_bytes, true},
+        {"f48fbfbf"_bytes, true},
+        {"616263c2bfe0a080ecbabaed9fbfee8181efaa81f09081a0f1a0a081f4819f85"_bytes, true},
+        {"80"_bytes, false},
+        {"c1bf"_bytes, false},
+        {"c2"_bytes, false},
+        {"e080bf"_bytes, false},
+        {"e0a0"_bytes, false},
+        {"eda080"_bytes, false},
+        {"f08f8080"_bytes, false},
+        {"f0908080bf"_bytes, false},
+        {"f4908080"_bytes, false},
+        {"f5808080"_bytes, false},
+        {"ff"_bytes, false},
+    };
+    for (const auto validate : validators())
+    {
+        for (const auto& [sequence, valid] : testcases)
+        {
+            for (size_t offset = 0; offset <= 70; ++offset)
+            {
+                const auto input = bytes(offset, 'a') + sequence + bytes(70 - offset, 'a');
+                EXPECT_EQ(validate(input.data(), input.data() + input.size()), valid);
+
+                // The sequence at the end of the input.
+                const auto input_end = bytes(offset, 'a') + sequence;
+                EXPECT_EQ(validate(input_end.data(), input_end.data() + input_end.size()), valid);
+            }
+        }
+    }
+}
+
+TEST(utf8, validate_random)
+{
+    // The random strings of the bytes of all the ranges of Table 3-7 are validated the same
+    // by all the implementations.
+    constexpr uint8_t alphabet[]{0x00, 0x7f, 0x80, 0x8f, 0x90, 0x9f, 0xa0, 0xbf, 0xc0, 0xc1,
+        0xc2, 0xdf, 0xe0, 0xe1, 0xec, 0xed, 0xee, 0xef, 0xf0, 0xf1, 0xf3, 0xf4, 0xf5, 0xff};
+    std::mt19937 gen{0};
+    std::uniform_int_distribution<size_t> size_dist{0, 100};
+    std::uniform_int_distribution<size_t> byte_dist{0, std::size(alphabet) - 1};
+
+    const auto validators_list = validators();
+    for (size_t i = 0; i < 20000; ++i)
+    {
+        bytes input(size_dist(gen), 0);
+        for (auto& byte : input)
+            byte = alphabet[byte_dist(gen)];
+
+        const auto expected = utf8_validate_scalar(input.data(), input.data() + input.size());
+        for (const auto validate : validators_list)
+            EXPECT_EQ(validate(input.data(), input.data() + input.size()), expected);
+    }
+
+    // The valid strings of random code points, with a random byte replaced in half of them.
+    std::uniform_int_distribution<uint32_t> code_point_dist{0, 0x10ffff};
+    for (size_t i = 0; i < 20000; ++i)
+    {
+        bytes input;
+        while (input.size() < size_dist(gen))
+        {
+            // Prefer the shorter encodings.
+            const auto c = code_point_dist(gen) >> (gen() % 20);
+            if (c >= 0xd800 && c <= 0xdfff)
+                continue;  // Surrogates are not valid code points.
+            if (c <= 0x7f)
+                input.push_back(static_cast<uint8_t>(c));
+            else if (c <= 0x7ff)
+                input += {static_cast<uint8_t>(0xc0 | (c >> 6)),
+                    static_cast<uint8_t>(0x80 | (c & 0x3f))};
+            else if (c <= 0xffff)
+                input += {static_cast<uint8_t>(0xe0 | (c >> 12)),
+                    static_cast<uint8_t>(0x80 | ((c >> 6) & 0x3f)),
+                    static_cast<uint8_t>(0x80 | (c & 0x3f))};
+            else
+                input += {static_cast<uint8_t>(0xf0 | (c >> 18)),
+                    static_cast<uint8_t>(0x80 | ((c >> 12) & 0x3f)),
+                    static_cast<uint8_t>(0x80 | ((c >> 6) & 0x3f)),
+                    static_cast<uint8_t>(0x80 | (c & 0x3f))};
+        }
+        ASSERT_TRUE(utf8_validate_scalar(input.data(), input.data() + input.size()));
+        if (i % 2 == 1 && !input.empty())
+            input[gen() % input.size()] = alphabet[byte_dist(gen)];
+
+        const auto expected = utf8_validate_scalar(input.data(), input.data() + input.size());
+        for (const auto validate : validators_list)
+            EXPECT_EQ(validate(input.data(), input.data() + input.size()), expected);
+    }
+}
@@ -45,8 +45,8 @@ TEST(validation_stack, block_with_result)
     )
     */
     const auto wasm = from_hex("0061736d01000000010401600000030201000a0a010800027f417f0b1a0b");
-    parse(wasm);
-    // TODO: Add max stack height check.
+    const auto module = parse(wasm);
+    EXPECT_EQ(module.codesec[0].max_stack_height, 1);
 }
 
 TEST(validation_stack, block_with_result_stack_underflow)
@@ -89,8 +89,8 @@ TEST(validation_stack, loop_with_result)
     )
     */
     const auto wasm = from_hex("0061736d01000000010401600000030201000a0a010800037f417f0b1a0b");
-    parse(wasm);
-    // TODO: Add max stack height check.
+    const auto module = parse(wasm);
+    EXPECT_EQ(module.codesec[0].max_stack_height, 1);
 }
 
 TEST(validation_stack, loop_with_result_stack_underflow)
@@ -107,7 +107,7 @@ TEST(validation_stack, loop_with_result_stack_underflow)
     EXPECT_THROW_MESSAGE(parse(wasm), validation_error, "stack underflow");
 }
 
-TEST(validation_stack, DISABLED_call_stack_underflow)
+TEST(validation_stack, call_stack_underflow)
 {
     /* wat2wasm --no-check
     (func $f (param i32) (result i32)
@@ -123,6 +123,39 @@ TEST(validation_stack, DISABLED_call_stack_underflow)
     EXPECT_THROW_MESSAGE(parse(wasm), validation_error, "stack underflow");
 }
 
+TEST(validation_stack, call_indirect_stack_underflow)
+{
+    /* wat2wasm --no-check
+    (type $t (func (param i32) (result i32)))
+    (table 1 funcref)
+    (func (type $t)
+      get_local 0
+    )
+    (func (result i32)
+      ;; Call argument missing.
+      (call_indirect (type $t) (i32.const 0))
+    )
+    */
+    const auto wasm = from_hex(
+        "0061736d01000000010a0260017f017f6000017f03030200010404017000010a0e02040020000b0700410011"
+        "00000b");
+    EXPECT_THROW_MESSAGE(parse(wasm), validation_error, "stack underflow");
+}
+
+TEST(validation_stack, br_stack_underflow)
+{
+    /* wat2wasm --no-check
+    (func (result i32)
+      (block (result i32)
+        ;; The block result missing.
+        br 0
+      )
+    )
+    */
+    const auto wasm = from_hex("0061736d010000000105016000017f030201000a09010700027f0c000b0b");
+    EXPECT_THROW_MESSAGE(parse(wasm), validation_error, "stack underflow");
+}
+
 TEST(validation_stack, unreachable)
 {
     /* wat2wasm
@@ -132,8 +165,8 @@ TEST(validation_stack, unreachable)
     )
     */
     const auto wasm = from_hex("0061736d010000000105016000017f030201000a0601040000450b");
-    parse(wasm);
-    // TODO: Add max stack height check.
+    const auto module = parse(wasm);
+    EXPECT_EQ(module.codesec[0].max_stack_height, 0);
 }
 
 TEST(validation_stack, unreachable_2)
@@ -148,8 +181,8 @@ TEST(validation_stack, unreachable_2)
     )
     */
     const auto wasm = from_hex("0061736d01000000010401600000030201000a09010700006a6a6a1a0b");
-    parse(wasm);
-    // TODO: Add max stack height check.
+    const auto module = parse(wasm);
+    EXPECT_EQ(module.codesec[0].max_stack_height, 0);
 }
 
 TEST(validation_stack, br)
@@ -164,8 +197,8 @@ TEST(validation_stack, br)
     )
     */
     const auto wasm = from_hex("0061736d01000000010401600000030201000a0b01090002400c00451a0b0b");
-    parse(wasm);
-    // TODO: Add max stack height check.
+    const auto module = parse(wasm);
+    EXPECT_EQ(module.codesec[0].max_stack_height, 0);
 }
 
 TEST(validation_stack, br_table)
@@ -185,8 +218,8 @@ TEST(validation_stack, br_table)
     */
     const auto wasm = from_hex(
         "0061736d0100000001050160017f00030201000a14011200024041e90720000e0100016c6c6c1a0b0b");
-    parse(wasm);
-    // TODO: Add max stack height check.
+    const auto module = parse(wasm);
+    EXPECT_EQ(module.codesec[0].max_stack_height, 2);
 }
 
 TEST(validation_stack, return_)
@@ -199,8 +232,8 @@ TEST(validation_stack, return_)
     )
     */
     const auto wasm = from_hex("0061736d01000000010401600000030201000a070105000f451a0b");
-    parse(wasm);
-    // TODO: Add max stack height check.
+    const auto module = parse(wasm);
+    EXPECT_EQ(module.codesec[0].max_stack_height, 0);
 }
 
 TEST(validation_stack, if_stack_underflow)
@@ -317,8 +350,8 @@ TEST(validation_stack, if_invalid_end_stack_height)
     */
     const auto wasm = from_hex(
         "0061736d01000000010401600000030201000a1701150042014102047e4201420205420342041a0b1a1a0b");
-    parse(wasm);
-    // TODO: Add max stack height check.
+    const auto module = parse(wasm);
+    EXPECT_EQ(module.codesec[0].max_stack_height, 4);
 }
 
 TEST(validation_stack, if_with_unreachable)
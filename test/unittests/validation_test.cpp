@@ -48,6 +48,17 @@ TEST(validation, memory_size_no_memory)
         parse(wasm), validation_error, "memory instructions require imported or defined memory");
 }
 
+TEST(validation, call_invalid_func_index)
+{
+    /* wat2wasm --no-check
+    (func
+      call 1
+    )
+    */
+    const auto wasm = from_hex("0061736d01000000010401600000030201000a0601040010010b");
+    EXPECT_THROW_MESSAGE(parse(wasm), validation_error, "invalid funcidx encountered with call");
+}
+
 TEST(validation, br_invalid_label_index)
 {
     /* wat2wasm --no-check
@@ -9,7 +9,9 @@ TEST(wasm_engine, parse_error)
 {
     const auto wasm = "0102"_bytes;
 
-    for (auto engine_create_fn : {create_fizzy_engine, create_wabt_engine, create_wasm3_engine})
+    for (auto engine_create_fn :
+        {create_fizzy_engine, create_fizzy_fused_engine, create_fizzy_register_engine,
+            create_fizzy_jit_engine, create_wabt_engine, create_wasm3_engine})
     {
         auto engine = engine_create_fn();
         ASSERT_FALSE(engine->parse(wasm));
@@ -31,7 +33,9 @@ TEST(wasm_engine, instantiate_error)
     // TODO: parse/instantiate is not properly separated in wabt and wasm3
     // (and wasm3 doesn't care about imports, until execution)
 
-    for (auto engine_create_fn : {create_fizzy_engine})
+    for (auto engine_create_fn :
+        {create_fizzy_engine, create_fizzy_fused_engine, create_fizzy_register_engine,
+            create_fizzy_jit_engine})
     {
         auto engine = engine_create_fn();
         ASSERT_TRUE(engine->parse(wasm));
@@ -56,7 +60,9 @@ TEST(wasm_engine, trapped)
     const auto wasm =
         from_hex("0061736d0100000001040160000003020100070801047465737400000a05010300000b");
 
-    for (auto engine_create_fn : {create_fizzy_engine, create_wabt_engine, create_wasm3_engine})
+    for (auto engine_create_fn :
+        {create_fizzy_engine, create_fizzy_fused_engine, create_fizzy_register_engine,
+            create_fizzy_jit_engine, create_wabt_engine, create_wasm3_engine})
     {
         auto engine = engine_create_fn();
         ASSERT_TRUE(engine->parse(wasm));
@@ -84,7 +90,9 @@ TEST(wasm_engine, multi_i32_args_ret_i32)
         "0061736d0100000001080160037f7f7f017f03020100070801047465737400000a0c010a00200020026b20016c"
         "0b");
 
-    for (auto engine_create_fn : {create_fizzy_engine, create_wabt_engine, create_wasm3_engine})
+    for (auto engine_create_fn :
+        {create_fizzy_engine, create_fizzy_fused_engine, create_fizzy_register_engine,
+            create_fizzy_jit_engine, create_wabt_engine, create_wasm3_engine})
     {
         auto engine = engine_create_fn();
         ASSERT_TRUE(engine->parse(wasm));
@@ -117,7 +125,9 @@ TEST(wasm_engine, multi_mixed_args_ret_i32)
         "0061736d0100000001080160037f7e7f017f03020100070801047465737400000a0e010c00200020026bad2001"
         "7ea70b");
 
-    for (auto engine_create_fn : {create_fizzy_engine, create_wabt_engine, create_wasm3_engine})
+    for (auto engine_create_fn :
+        {create_fizzy_engine, create_fizzy_fused_engine, create_fizzy_register_engine,
+            create_fizzy_jit_engine, create_wabt_engine, create_wasm3_engine})
     {
         auto engine = engine_create_fn();
         ASSERT_TRUE(engine->parse(wasm));
@@ -141,7 +151,9 @@ TEST(wasm_engine, no_memory)
     const auto wasm =
         from_hex("0061736d0100000001040160000003020100070801047465737400000a040102000b");
 
-    for (auto engine_create_fn : {create_fizzy_engine, create_wabt_engine, create_wasm3_engine})
+    for (auto engine_create_fn :
+        {create_fizzy_engine, create_fizzy_fused_engine, create_fizzy_register_engine,
+            create_fizzy_jit_engine, create_wabt_engine, create_wasm3_engine})
     {
         auto engine = engine_create_fn();
         ASSERT_TRUE(engine->parse(wasm));
@@ -168,7 +180,9 @@ TEST(wasm_engine, memory)
         "0061736d0100000001060160027f7f00030201000503010001071102066d656d6f72790200047465737400000a"
         "0e010c00200120002802003602000b");
 
-    for (auto engine_create_fn : {create_fizzy_engine, create_wabt_engine, create_wasm3_engine})
+    for (auto engine_create_fn :
+        {create_fizzy_engine, create_fizzy_fused_engine, create_fizzy_register_engine,
+            create_fizzy_jit_engine, create_wabt_engine, create_wasm3_engine})
     {
         auto engine = engine_create_fn();
         ASSERT_TRUE(engine->parse(wasm));
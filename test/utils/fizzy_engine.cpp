@@ -1,17 +1,25 @@
 #include "execute.hpp"
 #include "parser.hpp"
+#include "superinstructions.hpp"
 
 #include <test/utils/wasm_engine.hpp>
-#include <cassert>
 #include <cstring>
 
 namespace fizzy::test
 {
 class FizzyEngine : public WasmEngine
 {
+    std::shared_ptr<const Module> m_module;
     std::unique_ptr<Instance> m_instance;
+    bool m_superinstructions = false;
+    ExecutionEngine m_engine = ExecutionEngine::Stack;
 
 public:
+    explicit FizzyEngine(
+        bool superinstructions = false, ExecutionEngine engine = ExecutionEngine::Stack) noexcept
+      : m_superinstructions{superinstructions}, m_engine{engine}
+    {}
+
     bool parse(bytes_view input) final;
     std::optional<FuncRef> find_function(std::string_view name) const final;
     bool instantiate() final;
@@ -25,15 +33,30 @@ std::unique_ptr<WasmEngine> create_fizzy_engine()
     return std::make_unique<FizzyEngine>();
 }
 
+std::unique_ptr<WasmEngine> create_fizzy_fused_engine()
+{
+    return std::make_unique<FizzyEngine>(true);
+}
+
+std::unique_ptr<WasmEngine> create_fizzy_register_engine()
+{
+    return std::make_unique<FizzyEngine>(false, ExecutionEngine::Register);
+}
+
+std::unique_ptr<WasmEngine> create_fizzy_jit_engine()
+{
+    return std::make_unique<FizzyEngine>(false, ExecutionEngine::Jit);
+}
+
 bool FizzyEngine::parse(bytes_view input)
 {
     try
     {
         auto module = fizzy::parse(input);
-        m_instance =
-            std::make_unique<Instance>(std::move(module), bytes_ptr{nullptr, [](bytes*) {}}, 0,
-                table_ptr{nullptr, [](table_elements*) {}}, std::vector<uint64_t>{},
-                std::vector<ExternalFunction>{}, std::vector<ExternalGlobal>{});
+        if (m_superinstructions)
+            fuse_superinstructions(module);
+        m_module = std::make_shared<const Module>(std::move(module));
+        m_instance.reset();
     }
     catch (const fizzy::parser_error&)
     {
@@ -46,7 +69,8 @@ bool FizzyEngine::instantiate()
 {
     try
     {
-        m_instance = fizzy::instantiate(std::move(m_instance->module));
+        m_instance = fizzy::instantiate(m_module);
+        m_instance->engine = m_engine;
     }
     catch (const fizzy::instantiate_error&)
     {
@@ -74,15 +98,14 @@ bytes_view FizzyEngine::get_memory() const
 
 std::optional<WasmEngine::FuncRef> FizzyEngine::find_function(std::string_view name) const
 {
-    return fizzy::find_exported_function(m_instance->module, name);
+    return fizzy::find_exported_function(*m_module, name);
 }
 
 WasmEngine::Result FizzyEngine::execute(
     WasmEngine::FuncRef func_ref, const std::vector<uint64_t>& args)
 {
-    const auto [trapped, result_stack] =
-        fizzy::execute(*m_instance, static_cast<uint32_t>(func_ref), args);
-    assert(result_stack.size() <= 1);
-    return {trapped, !result_stack.empty() ? result_stack.back() : std::optional<uint64_t>{}};
+    const auto result = fizzy::execute(*m_instance, static_cast<uint32_t>(func_ref),
+        span<const uint64_t>{args.data(), args.size()});
+    return {result.trapped, result.has_value ? result.value : std::optional<uint64_t>{}};
 }
 }  // namespace fizzy::test
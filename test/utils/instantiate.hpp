@@ -0,0 +1,20 @@
+#pragma once
+
+#include "execute.hpp"
+#include <memory>
+#include <vector>
+
+namespace fizzy::test
+{
+/// Instantiates the module with the imported functions and globals, to be executed by the given
+/// engine.
+inline std::unique_ptr<Instance> instantiate_with_engine(ExecutionEngine engine,
+    std::shared_ptr<const Module> module, std::vector<ExternalFunction> imported_functions = {},
+    std::vector<ExternalGlobal> imported_globals = {})
+{
+    auto instance = instantiate(
+        std::move(module), std::move(imported_functions), {}, {}, std::move(imported_globals));
+    instance->engine = engine;
+    return instance;
+}
+}  // namespace fizzy::test
@@ -54,6 +54,18 @@ public:
 };
 
 std::unique_ptr<WasmEngine> create_fizzy_engine();
+
+/// Creates the fizzy engine executing the code with superinstructions,
+/// see fuse_superinstructions().
+std::unique_ptr<WasmEngine> create_fizzy_fused_engine();
+
+/// Creates the fizzy engine executing the register-based code, see ExecutionEngine::Register.
+std::unique_ptr<WasmEngine> create_fizzy_register_engine();
+
+/// Creates the fizzy engine executing the code compiled to machine code,
+/// see ExecutionEngine::Jit.
+std::unique_ptr<WasmEngine> create_fizzy_jit_engine();
+
 std::unique_ptr<WasmEngine> create_wabt_engine();
 std::unique_ptr<WasmEngine> create_wasm3_engine();
 }  // namespace fizzy::test
@@ -0,0 +1,661 @@
+// fizzy-aot: compiles the functions of a wasm module to C++ for the Native execution engine.
+//
+// Usage: fizzy-aot WASM_FILE NAME OUTPUT_DIR
+//
+// Writes OUTPUT_DIR/NAME.hpp declaring `extern const fizzy::NativeModule NAME;` and
+// OUTPUT_DIR/NAME.cpp defining it. The functions are translated from the register-based code
+// of the module (see RegisterCode): the slots of a frame become C++ variables and the branches
+// become gotos.
+
+#include "bytes.hpp"
+#include "parser.hpp"
+#include "register_code.hpp"
+#include "types.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+class Generator
+{
+    const fizzy::Module& m_module;
+    const fizzy::RegisterModule& m_register_module;
+    const size_t m_num_imported_functions;
+    const size_t m_num_imported_globals;
+
+    // The state of the function being generated.
+    const fizzy::RegisterCode* m_code = nullptr;
+    std::set<uint32_t> m_used_slots;
+    std::set<uint32_t> m_targets;
+    uint32_t m_instr_offset = 0;
+
+public:
+    Generator(const fizzy::Module& module, const fizzy::RegisterModule& register_module)
+      : m_module{module},
+        m_register_module{register_module},
+        m_num_imported_functions{module.imported_function_types.size()},
+        m_num_imported_globals{static_cast<size_t>(
+            std::count_if(module.importsec.begin(), module.importsec.end(),
+                [](const fizzy::Import& import) {
+                    return import.kind == fizzy::ExternalKind::Global;
+                }))}
+    {}
+
+    void generate_header(std::ostream& out, std::string_view name, std::string_view source)
+    {
+        out << "// Generated by fizzy-aot from " << source << ".\n"
+            << "#pragma once\n\n"
+            << "#include \"native.hpp\"\n\n"
+            << "/// The functions of " << source
+            << " compiled to native code, see fizzy::NativeModule.\n"
+            << "extern const fizzy::NativeModule " << name << ";\n";
+    }
+
+    void generate_source(std::ostream& out, std::string_view name, std::string_view source,
+        fizzy::bytes_view wasm)
+    {
+        out << "// Generated by fizzy-aot from " << source << ".\n"
+            << "#include \"" << name << ".hpp\"\n"
+            << "#include <algorithm>\n"
+            << "#include <iterator>\n\n"
+            << "namespace\n{\n";
+
+        out << "constexpr uint8_t wasm[] = {";
+        for (size_t i = 0; i < wasm.size(); ++i)
+        {
+            out << (i % 16 == 0 ? "\n    " : " ") << "0x" << std::hex << std::setw(2)
+                << std::setfill('0') << unsigned{wasm[i]} << std::dec << ",";
+        }
+        out << "\n};\n\n";
+
+        const auto& functions = m_register_module.functions;
+        for (size_t i = 0; i < functions.size(); ++i)
+            out << signature(i) << ";\n";
+
+        for (size_t i = 0; i < functions.size(); ++i)
+        {
+            out << "\n";
+            generate_function(out, i);
+        }
+
+        for (size_t i = 0; i < functions.size(); ++i)
+        {
+            const auto num_args = functions[i].num_args;
+            out << "\nuint64_t w" << i
+                << "(fizzy::NativeContext& context, std::ptrdiff_t stack_space, const uint64_t* "
+                << (num_args != 0 ? "args" : "/*args*/") << ")\n{\n"
+                << "    return f" << i << "(context, stack_space";
+            for (uint32_t j = 0; j < num_args; ++j)
+                out << ", args[" << j << "]";
+            out << ");\n}\n";
+        }
+
+        if (!functions.empty())
+        {
+            out << "\nconstexpr fizzy::NativeFunction functions[] = {";
+            for (size_t i = 0; i < functions.size(); ++i)
+                out << (i % 8 == 0 ? "\n    " : " ") << "w" << i << ",";
+            out << "\n};\n";
+        }
+        out << "}  // namespace\n\n";
+
+        out << "const fizzy::NativeModule " << name << "{{wasm, sizeof(wasm)}, "
+            << (functions.empty() ? "nullptr, 0" : "functions, std::size(functions)") << "};\n";
+    }
+
+private:
+    const fizzy::FuncType& function_type(fizzy::FuncIdx func_idx) const
+    {
+        if (func_idx < m_num_imported_functions)
+            return m_module.typesec[m_module.imported_function_types[func_idx]];
+        return m_module.typesec[m_module.funcsec[func_idx - m_num_imported_functions]];
+    }
+
+    std::string signature(size_t code_idx) const
+    {
+        std::ostringstream out;
+        out << "uint64_t f" << code_idx
+            << "(fizzy::NativeContext& context, std::ptrdiff_t stack_space";
+        for (uint32_t i = 0; i < m_register_module.functions[code_idx].num_args; ++i)
+            out << ", [[maybe_unused]] uint64_t r" << i;
+        out << ")";
+        return out.str();
+    }
+
+    /// Returns the expression of the slot's value: the variable or the constant.
+    std::string slot(uint32_t idx)
+    {
+        const auto num_locals = m_code->num_locals;
+        if (idx >= num_locals && idx - num_locals < m_code->constants.size())
+            return "uint64_t{" + std::to_string(m_code->constants[idx - num_locals]) + "u}";
+        m_used_slots.insert(idx);
+        return "r" + std::to_string(idx);
+    }
+
+    std::string i32(uint32_t idx) { return "static_cast<uint32_t>(" + slot(idx) + ")"; }
+    std::string s32(uint32_t idx) { return "static_cast<int32_t>(" + slot(idx) + ")"; }
+    std::string s64(uint32_t idx) { return "static_cast<int64_t>(" + slot(idx) + ")"; }
+
+    static std::string label(uint32_t target) { return "L" + std::to_string(target); }
+
+    void generate_function(std::ostream& out, size_t code_idx)
+    {
+        m_code = &m_register_module.functions[code_idx];
+        m_used_slots.clear();
+        m_targets.clear();
+
+        std::ostringstream body;
+        const auto& instructions = m_code->instructions;
+        std::vector<size_t> offsets;
+        for (size_t pc = 0; pc < instructions.size();)
+        {
+            offsets.push_back(pc);
+            m_instr_offset = static_cast<uint32_t>(pc);
+            body << "    ";
+            pc += generate_instruction(body, &instructions[pc]);
+        }
+
+        out << signature(code_idx) << "\n{\n"
+            << "    fizzy::native::enter(context, stack_space, " << m_code->frame_size << ");\n";
+        for (const auto idx : m_used_slots)
+        {
+            if (idx >= m_code->num_args)
+                out << "    [[maybe_unused]] uint64_t r" << idx << " = 0;\n";
+        }
+
+        // The labels are emitted only for the branch targets, in front of their instructions.
+        std::istringstream lines{body.str()};
+        std::string line;
+        for (const auto offset : offsets)
+        {
+            if (m_targets.count(static_cast<uint32_t>(offset)) != 0)
+                out << label(static_cast<uint32_t>(offset)) << ":\n";
+            std::getline(lines, line);
+            out << line << "\n";
+        }
+        // Not reachable in the translated code, but all the branch targets must be valid.
+        if (m_targets.count(static_cast<uint32_t>(instructions.size())) != 0)
+            out << label(static_cast<uint32_t>(instructions.size())) << ":\n";
+        out << "    context.trap();\n}\n";
+    }
+
+    void branch(std::ostream& out, uint32_t target)
+    {
+        m_targets.insert(target);
+        // The interruption is checked when the branch goes back to a loop.
+        if (target <= m_instr_offset)
+            out << "{ fizzy::native::check_interrupt(context); goto " << label(target) << "; }";
+        else
+            out << "goto " << label(target) << ";";
+    }
+
+    void unary(std::ostream& out, const uint32_t* pc, const std::string& expr)
+    {
+        out << slot(pc[1]) << " = " << expr << ";";
+    }
+
+    void binary(std::ostream& out, const uint32_t* pc, std::string_view op)
+    {
+        out << slot(pc[1]) << " = " << slot(pc[2]) << " " << op << " " << slot(pc[3]) << ";";
+    }
+
+    void binary32(std::ostream& out, const uint32_t* pc, std::string_view op)
+    {
+        out << slot(pc[1]) << " = static_cast<uint32_t>(" << slot(pc[2]) << " " << op << " "
+            << slot(pc[3]) << ");";
+    }
+
+    void compare_s(std::ostream& out, const uint32_t* pc, bool is_64, std::string_view op)
+    {
+        out << slot(pc[1]) << " = " << (is_64 ? s64(pc[2]) : s32(pc[2])) << " " << op << " "
+            << (is_64 ? s64(pc[3]) : s32(pc[3])) << ";";
+    }
+
+    void helper(std::ostream& out, const uint32_t* pc, std::string_view function)
+    {
+        out << slot(pc[1]) << " = fizzy::native::" << function << "(context, " << slot(pc[2])
+            << ", " << slot(pc[3]) << ");";
+    }
+
+    void load(std::ostream& out, const uint32_t* pc, std::string_view types)
+    {
+        out << slot(pc[1]) << " = fizzy::native::load<" << types << ">(context, " << slot(pc[2])
+            << ", " << pc[3] << ");";
+    }
+
+    void store(std::ostream& out, const uint32_t* pc, std::string_view type)
+    {
+        out << "fizzy::native::store<" << type << ">(context, " << slot(pc[1]) << ", "
+            << slot(pc[2]) << ", " << pc[3] << ");";
+    }
+
+    /// Returns the array of the call arguments, declared in the statement's block.
+    std::string call_args(std::ostream& out, uint32_t args, size_t num_args)
+    {
+        if (num_args == 0)
+            return "nullptr";
+        out << "const uint64_t args[] = {";
+        for (uint32_t i = 0; i < num_args; ++i)
+            out << (i != 0 ? ", " : "") << slot(args + i);
+        out << "}; ";
+        return "args";
+    }
+
+    void call(std::ostream& out, fizzy::FuncIdx func_idx, uint32_t args)
+    {
+        const auto& type = function_type(func_idx);
+        const auto result = type.outputs.empty() ? std::string{} : slot(args) + " = ";
+
+        if (func_idx < m_num_imported_functions)
+        {
+            out << "{ ";
+            const auto args_array = call_args(out, args, type.inputs.size());
+            out << result << "context.call_imported(" << func_idx << ", stack_space - " << args
+                << ", " << args_array << "); }";
+            return;
+        }
+
+        // The frame of the called function starts at its first argument, after the call frame
+        // record, like in the register engine.
+        out << result << "f" << func_idx - m_num_imported_functions
+            << "(context, stack_space - (fizzy::NativeFrameRecordSize + " << args << ")";
+        for (uint32_t i = 0; i < type.inputs.size(); ++i)
+            out << ", " << slot(args + i);
+        out << ");";
+    }
+
+    void call_indirect(std::ostream& out, fizzy::TypeIdx type_idx, uint32_t elem, uint32_t args)
+    {
+        const auto& type = m_module.typesec[type_idx];
+        out << "{ ";
+        const auto args_array = call_args(out, args, type.inputs.size());
+        if (!type.outputs.empty())
+            out << slot(args) << " = ";
+        out << "context.call_indirect(" << type_idx << ", " << slot(elem) << ", stack_space - "
+            << args << ", " << args_array << "); }";
+    }
+
+    void global(std::ostream& out, uint32_t global_idx)
+    {
+        if (global_idx < m_num_imported_globals)
+            out << "*context.imported_globals[" << global_idx << "].value";
+        else
+            out << "context.globals[" << global_idx - m_num_imported_globals << "]";
+    }
+
+    /// Generates the statement of the instruction, returns the number of its words.
+    size_t generate_instruction(std::ostream& out, const uint32_t* pc)
+    {
+        using fizzy::RegisterOp;
+
+        switch (static_cast<RegisterOp>(pc[0]))
+        {
+        case RegisterOp::unreachable:
+            out << "context.trap();\n";
+            return 1;
+        case RegisterOp::unsupported:
+            out << "context.unsupported();\n";
+            return 1;
+        case RegisterOp::br:
+            branch(out, pc[1]);
+            out << "\n";
+            return 2;
+        case RegisterOp::br_if:
+        case RegisterOp::br_eqz:
+            out << "if (" << slot(pc[1])
+                << (static_cast<RegisterOp>(pc[0]) == RegisterOp::br_if ? " != 0) " : " == 0) ");
+            branch(out, pc[2]);
+            out << "\n";
+            return 3;
+        case RegisterOp::br_table:
+        {
+            const auto size = pc[2];
+            out << "switch (std::min(" << slot(pc[1]) << ", uint64_t{" << size << "})) { ";
+            for (uint32_t i = 0; i < size; ++i)
+            {
+                out << "case " << i << ": ";
+                branch(out, pc[3 + i]);
+                out << " ";
+            }
+            out << "default: ";
+            branch(out, pc[3 + size]);
+            out << " }\n";
+            return 4 + size_t{size};
+        }
+        case RegisterOp::call:
+            call(out, pc[1], pc[2]);
+            out << "\n";
+            return 3;
+        case RegisterOp::call_indirect:
+            call_indirect(out, pc[1], pc[2], pc[3]);
+            out << "\n";
+            return 4;
+        case RegisterOp::ret:
+            out << "return " << slot(pc[1]) << ";\n";
+            return 2;
+        case RegisterOp::ret_void:
+            out << "return 0;\n";
+            return 1;
+        case RegisterOp::copy:
+            out << slot(pc[1]) << " = " << slot(pc[2]) << ";\n";
+            return 3;
+        case RegisterOp::select:
+            out << slot(pc[1]) << " = " << slot(pc[4]) << " != 0 ? " << slot(pc[2]) << " : "
+                << slot(pc[3]) << ";\n";
+            return 5;
+        case RegisterOp::global_get:
+            out << slot(pc[1]) << " = ";
+            global(out, pc[2]);
+            out << ";\n";
+            return 3;
+        case RegisterOp::global_set:
+            global(out, pc[1]);
+            out << " = " << slot(pc[2]) << ";\n";
+            return 3;
+
+        case RegisterOp::i32_load:
+            load(out, pc, "uint32_t");
+            break;
+        case RegisterOp::i64_load:
+            load(out, pc, "uint64_t");
+            break;
+        case RegisterOp::i32_load8_s:
+            load(out, pc, "uint32_t, int8_t");
+            break;
+        case RegisterOp::i32_load8_u:
+            load(out, pc, "uint32_t, uint8_t");
+            break;
+        case RegisterOp::i32_load16_s:
+            load(out, pc, "uint32_t, int16_t");
+            break;
+        case RegisterOp::i32_load16_u:
+            load(out, pc, "uint32_t, uint16_t");
+            break;
+        case RegisterOp::i64_load8_s:
+            load(out, pc, "uint64_t, int8_t");
+            break;
+        case RegisterOp::i64_load16_s:
+            load(out, pc, "uint64_t, int16_t");
+            break;
+        case RegisterOp::i64_load32_s:
+            load(out, pc, "uint64_t, int32_t");
+            break;
+        case RegisterOp::store8:
+            store(out, pc, "uint8_t");
+            break;
+        case RegisterOp::store16:
+            store(out, pc, "uint16_t");
+            break;
+        case RegisterOp::store32:
+            store(out, pc, "uint32_t");
+            break;
+        case RegisterOp::store64:
+            store(out, pc, "uint64_t");
+            break;
+
+        case RegisterOp::memory_size:
+            out << slot(pc[1]) << " = context.memory_size / fizzy::PageSize;\n";
+            return 2;
+        case RegisterOp::memory_grow:
+            out << slot(pc[1]) << " = context.memory_grow(" << i32(pc[2]) << ");\n";
+            return 3;
+
+        case RegisterOp::i32_eqz:
+        case RegisterOp::i64_eqz:
+            unary(out, pc, slot(pc[2]) + " == 0");
+            out << "\n";
+            return 3;
+        case RegisterOp::i32_clz:
+            unary(out, pc, "fizzy::native::clz32(" + slot(pc[2]) + ")");
+            out << "\n";
+            return 3;
+        case RegisterOp::i32_ctz:
+            unary(out, pc, "fizzy::native::ctz32(" + slot(pc[2]) + ")");
+            out << "\n";
+            return 3;
+        case RegisterOp::i32_popcnt:
+            unary(out, pc, "fizzy::native::popcnt32(" + slot(pc[2]) + ")");
+            out << "\n";
+            return 3;
+        case RegisterOp::i64_clz:
+            unary(out, pc, "fizzy::native::clz64(" + slot(pc[2]) + ")");
+            out << "\n";
+            return 3;
+        case RegisterOp::i64_ctz:
+            unary(out, pc, "fizzy::native::ctz64(" + slot(pc[2]) + ")");
+            out << "\n";
+            return 3;
+        case RegisterOp::i64_popcnt:
+            unary(out, pc, "fizzy::native::popcnt64(" + slot(pc[2]) + ")");
+            out << "\n";
+            return 3;
+        case RegisterOp::i32_wrap_i64:
+            unary(out, pc, i32(pc[2]));
+            out << "\n";
+            return 3;
+        case RegisterOp::i64_extend_i32_s:
+            unary(out, pc, "static_cast<uint64_t>(static_cast<int64_t>(" + s32(pc[2]) + "))");
+            out << "\n";
+            return 3;
+
+        // The i32 values are zero-extended, so the unsigned comparisons and the bitwise operations
+        // are the same as of i64.
+        case RegisterOp::i32_eq:
+        case RegisterOp::i64_eq:
+            binary(out, pc, "==");
+            break;
+        case RegisterOp::i32_ne:
+        case RegisterOp::i64_ne:
+            binary(out, pc, "!=");
+            break;
+        case RegisterOp::i32_lt_u:
+        case RegisterOp::i64_lt_u:
+            binary(out, pc, "<");
+            break;
+        case RegisterOp::i32_gt_u:
+        case RegisterOp::i64_gt_u:
+            binary(out, pc, ">");
+            break;
+        case RegisterOp::i32_le_u:
+        case RegisterOp::i64_le_u:
+            binary(out, pc, "<=");
+            break;
+        case RegisterOp::i32_ge_u:
+        case RegisterOp::i64_ge_u:
+            binary(out, pc, ">=");
+            break;
+        case RegisterOp::i32_and:
+        case RegisterOp::i64_and:
+            binary(out, pc, "&");
+            break;
+        case RegisterOp::i32_or:
+        case RegisterOp::i64_or:
+            binary(out, pc, "|");
+            break;
+        case RegisterOp::i32_xor:
+        case RegisterOp::i64_xor:
+            binary(out, pc, "^");
+            break;
+        case RegisterOp::i32_lt_s:
+            compare_s(out, pc, false, "<");
+            break;
+        case RegisterOp::i32_gt_s:
+            compare_s(out, pc, false, ">");
+            break;
+        case RegisterOp::i32_le_s:
+            compare_s(out, pc, false, "<=");
+            break;
+        case RegisterOp::i32_ge_s:
+            compare_s(out, pc, false, ">=");
+            break;
+        case RegisterOp::i64_lt_s:
+            compare_s(out, pc, true, "<");
+            break;
+        case RegisterOp::i64_gt_s:
+            compare_s(out, pc, true, ">");
+            break;
+        case RegisterOp::i64_le_s:
+            compare_s(out, pc, true, "<=");
+            break;
+        case RegisterOp::i64_ge_s:
+            compare_s(out, pc, true, ">=");
+            break;
+        case RegisterOp::i32_add:
+            binary32(out, pc, "+");
+            break;
+        case RegisterOp::i32_sub:
+            binary32(out, pc, "-");
+            break;
+        case RegisterOp::i32_mul:
+            binary32(out, pc, "*");
+            break;
+        case RegisterOp::i64_add:
+            binary(out, pc, "+");
+            break;
+        case RegisterOp::i64_sub:
+            binary(out, pc, "-");
+            break;
+        case RegisterOp::i64_mul:
+            binary(out, pc, "*");
+            break;
+        case RegisterOp::i32_div_s:
+            helper(out, pc, "div_s<int32_t>");
+            break;
+        case RegisterOp::i32_div_u:
+            helper(out, pc, "div_u<uint32_t>");
+            break;
+        case RegisterOp::i32_rem_s:
+            helper(out, pc, "rem_s<int32_t>");
+            break;
+        case RegisterOp::i32_rem_u:
+            helper(out, pc, "rem_u<uint32_t>");
+            break;
+        case RegisterOp::i64_div_s:
+            helper(out, pc, "div_s<int64_t>");
+            break;
+        case RegisterOp::i64_div_u:
+            helper(out, pc, "div_u<uint64_t>");
+            break;
+        case RegisterOp::i64_rem_s:
+            helper(out, pc, "rem_s<int64_t>");
+            break;
+        case RegisterOp::i64_rem_u:
+            helper(out, pc, "rem_u<uint64_t>");
+            break;
+        case RegisterOp::i32_shl:
+            out << slot(pc[1]) << " = static_cast<uint32_t>(" << slot(pc[2]) << " << ("
+                << slot(pc[3]) << " & 31));";
+            break;
+        case RegisterOp::i32_shr_s:
+            out << slot(pc[1]) << " = static_cast<uint32_t>(" << s32(pc[2]) << " >> ("
+                << slot(pc[3]) << " & 31));";
+            break;
+        case RegisterOp::i32_shr_u:
+            out << slot(pc[1]) << " = " << slot(pc[2]) << " >> (" << slot(pc[3]) << " & 31);";
+            break;
+        case RegisterOp::i64_shl:
+            out << slot(pc[1]) << " = " << slot(pc[2]) << " << (" << slot(pc[3]) << " & 63);";
+            break;
+        case RegisterOp::i64_shr_s:
+            out << slot(pc[1]) << " = static_cast<uint64_t>(" << s64(pc[2]) << " >> ("
+                << slot(pc[3]) << " & 63));";
+            break;
+        case RegisterOp::i64_shr_u:
+            out << slot(pc[1]) << " = " << slot(pc[2]) << " >> (" << slot(pc[3]) << " & 63);";
+            break;
+        case RegisterOp::i32_rotl:
+            out << slot(pc[1]) << " = fizzy::native::rotl<uint32_t>(" << slot(pc[2]) << ", "
+                << slot(pc[3]) << ");";
+            break;
+        case RegisterOp::i32_rotr:
+            out << slot(pc[1]) << " = fizzy::native::rotr<uint32_t>(" << slot(pc[2]) << ", "
+                << slot(pc[3]) << ");";
+            break;
+        case RegisterOp::i64_rotl:
+            out << slot(pc[1]) << " = fizzy::native::rotl<uint64_t>(" << slot(pc[2]) << ", "
+                << slot(pc[3]) << ");";
+            break;
+        case RegisterOp::i64_rotr:
+            out << slot(pc[1]) << " = fizzy::native::rotr<uint64_t>(" << slot(pc[2]) << ", "
+                << slot(pc[3]) << ");";
+            break;
+        }
+        // The memory accesses and the binary operations have 3 operands.
+        out << "\n";
+        return 4;
+    }
+};
+
+bool is_identifier(std::string_view name)
+{
+    const auto is_alpha = [](char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); };
+    const auto is_digit = [](char c) { return c >= '0' && c <= '9'; };
+    return !name.empty() && (is_alpha(name[0]) || name[0] == '_') &&
+           std::all_of(name.begin(), name.end(),
+               [&](char c) { return is_alpha(c) || is_digit(c) || c == '_'; });
+}
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        if (argc != 4)
+        {
+            std::cerr << "Usage: " << argv[0] << " WASM_FILE NAME OUTPUT_DIR\n";
+            return -1;
+        }
+
+        const std::string wasm_path = argv[1];
+        const std::string name = argv[2];
+        const std::string output_dir = argv[3];
+        if (!is_identifier(name))
+        {
+            std::cerr << "Invalid NAME, must be a C++ identifier: " << name << "\n";
+            return -1;
+        }
+
+        std::ifstream wasm_file{wasm_path, std::ios::binary};
+        if (!wasm_file)
+        {
+            std::cerr << "Cannot read " << wasm_path << "\n";
+            return 1;
+        }
+        const fizzy::bytes wasm(
+            std::istreambuf_iterator<char>{wasm_file}, std::istreambuf_iterator<char>{});
+
+        const auto module = fizzy::parse(wasm);
+        const auto register_module = fizzy::translate_to_register_module(module);
+        if (register_module == nullptr)
+        {
+            std::cerr << "The module code cannot be translated: " << wasm_path << "\n";
+            return 1;
+        }
+
+        const auto source = wasm_path.substr(wasm_path.find_last_of("/\\") + 1);
+        Generator generator{module, *register_module};
+
+        std::ofstream header{output_dir + "/" + name + ".hpp"};
+        generator.generate_header(header, name, source);
+        std::ofstream cpp{output_dir + "/" + name + ".cpp"};
+        generator.generate_source(cpp, name, source, wasm);
+        if (!header || !cpp)
+        {
+            std::cerr << "Cannot write to " << output_dir << "\n";
+            return 1;
+        }
+        return 0;
+    }
+    catch (const std::exception& ex)
+    {
+        std::cerr << "Exception: " << ex.what() << "\n";
+        return -2;
+    }
+}